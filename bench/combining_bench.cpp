@@ -0,0 +1,66 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <string>
+
+#include "StripedHashMap.hpp"
+#include "FlatCombiningHashMap.hpp"
+
+#define OPS_PER_THREAD 200000
+#define HOT_KEYS 16
+#define WRITE_PERCENT 90
+
+/*
+* @brief Runs a write-heavy hot-key workload on a map from several threads
+* @param map Map to hammer (StripedHashMap or FlatCombiningHashMap)
+* @param threads Number of threads
+* @return Throughput in million operations per second
+*/
+template <class Map>
+double run(Map& map, int threads) {
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&map, t]() {
+            std::mt19937 rng(t);
+            long value = 0;
+            for (int i = 0; i < OPS_PER_THREAD; i++) {
+                int key = static_cast<int>(rng() % HOT_KEYS);
+                if (static_cast<int>(rng() % 100) < WRITE_PERCENT) {
+                    map.insert_or_assign(key, i);
+                } else {
+                    map.get(key, value);
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return (double)threads * OPS_PER_THREAD / seconds / 1e6;
+}
+
+/*
+* @brief Contention benchmark: flat combining vs striped and global locking
+* on a write-heavy workload over a few hot keys
+*/
+int main() {
+    int max_threads = static_cast<int>(std::max(2u, std::thread::hardware_concurrency()));
+    std::cout << "write-heavy hot keys: " << HOT_KEYS << " keys, "
+        << WRITE_PERCENT << "% writes, Mops/s\n";
+    std::cout << std::setw(8) << "threads"
+        << std::setw(14) << "global lock"
+        << std::setw(14) << "striped(16)"
+        << std::setw(16) << "flat combining" << "\n";
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        StripedHashMap<int, long> global(1);
+        StripedHashMap<int, long> striped(16);
+        FlatCombiningHashMap<int, long> combining;
+        std::cout << std::setw(8) << threads << std::fixed << std::setprecision(2)
+            << std::setw(14) << run(global, threads)
+            << std::setw(14) << run(striped, threads)
+            << std::setw(16) << run(combining, threads) << "\n";
+    }
+}
@@ -0,0 +1,182 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "KvServer.hpp"
+#include "PartitionedDictionary.hpp"
+
+#define ROUNDS_PER_CLIENT 2000
+#define BATCH_KEYS 64
+#define KEY_SPACE 100000
+#define CLIENTS_PER_BACKEND 2
+#define MIGRATION_KEYS 50000
+
+/*
+* @struct BackendProcess
+* @brief A forked process running a KvServer on a Unix socket
+*/
+struct BackendProcess {
+    pid_t pid;
+    PartitionedDictionary::Endpoint endpoint;
+};
+
+/*
+* @brief Forks a backend process and waits until it accepts connections
+* @param index Distinguishes the socket path
+* @return The running backend
+*/
+BackendProcess spawn_backend(int index) {
+    BackendProcess backend;
+    backend.endpoint.unix_path = "/tmp/kv_partition_" + std::to_string(getpid()) + "_" + std::to_string(index) + ".sock";
+    backend.pid = fork();
+    if (backend.pid < 0) throw std::runtime_error("fork failed");
+    if (backend.pid == 0) {
+        try {
+            KvServer::Options options;
+            options.unix_path = backend.endpoint.unix_path;
+            KvServer server(options);
+            server.run();
+        } catch (const std::exception& e) {
+            std::cerr << "backend: " << e.what() << "\n";
+        }
+        _exit(0);
+    }
+    for (int attempt = 0; attempt < 500; attempt++) {
+        try {
+            KvClient::connect_unix(backend.endpoint.unix_path);
+            return backend;
+        } catch (const std::runtime_error&) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+    throw std::runtime_error("backend did not start");
+}
+
+/*
+* @brief Kills backend processes and removes their sockets
+* @param backends Backends to stop
+*/
+void stop_backends(const std::vector<BackendProcess>& backends) {
+    for (const auto& backend : backends) {
+        kill(backend.pid, SIGKILL);
+        waitpid(backend.pid, nullptr, 0);
+        unlink(backend.endpoint.unix_path.c_str());
+    }
+}
+
+/*
+* @brief Runs client threads doing batched MSET / MGET rounds over all backends
+* @param endpoints Backends
+* @param clients Number of client threads
+* @return Throughput in thousand keys per second
+*/
+double run(const std::vector<PartitionedDictionary::Endpoint>& endpoints, int clients) {
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (int c = 0; c < clients; c++) {
+        threads.emplace_back([&endpoints, c]() {
+            PartitionedDictionary dictionary(endpoints);
+            std::mt19937 rng(c);
+            std::uniform_int_distribution<int> pick(0, KEY_SPACE - 1);
+            std::vector<std::pair<std::string, std::string>> pairs(BATCH_KEYS);
+            std::vector<std::string> keys(BATCH_KEYS);
+            std::vector<std::string> values;
+            std::vector<bool> found;
+            for (int round = 0; round < ROUNDS_PER_CLIENT; round++) {
+                for (int i = 0; i < BATCH_KEYS; i++) {
+                    keys[i] = "key:" + std::to_string(pick(rng));
+                    pairs[i] = {keys[i], keys[i]};
+                }
+                if (round % 4 == 0) {
+                    dictionary.mset(pairs);
+                } else {
+                    dictionary.mget(keys, values, found);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return (double)clients * ROUNDS_PER_CLIENT * BATCH_KEYS / seconds / 1e3;
+}
+
+/*
+* @brief Partitioning harness: throughput of batched requests against 1, 2,
+* 4, ... backend processes (clients scale with backends), then key movement
+* when a backend is added and removed
+*/
+int main() {
+    signal(SIGPIPE, SIG_IGN);
+    int max_backends = static_cast<int>(std::max(4u, std::thread::hardware_concurrency()));
+    std::cout << "batches of " << BATCH_KEYS << " keys (1 MSET : 3 MGET), "
+        << CLIENTS_PER_BACKEND << " clients per backend, thousand keys/s\n";
+    std::cout << std::setw(10) << "backends" << std::setw(12) << "keys/s" << std::setw(10) << "speedup" << "\n";
+    double baseline = 0;
+    for (int count = 1; count <= max_backends; count *= 2) {
+        std::vector<BackendProcess> backends;
+        std::vector<PartitionedDictionary::Endpoint> endpoints;
+        for (int i = 0; i < count; i++) {
+            backends.push_back(spawn_backend(i));
+            endpoints.push_back(backends.back().endpoint);
+        }
+        double throughput = run(endpoints, count * CLIENTS_PER_BACKEND);
+        if (count == 1) baseline = throughput;
+        std::cout << std::setw(10) << count << std::fixed << std::setprecision(1)
+            << std::setw(12) << throughput
+            << std::setw(9) << throughput / baseline << "x\n";
+        stop_backends(backends);
+    }
+
+    // migration: add a fifth backend, then remove the first one
+    std::vector<BackendProcess> backends;
+    std::vector<PartitionedDictionary::Endpoint> endpoints;
+    for (int i = 0; i < 5; i++) backends.push_back(spawn_backend(i));
+    for (int i = 0; i < 4; i++) endpoints.push_back(backends[i].endpoint);
+    PartitionedDictionary dictionary(endpoints);
+    std::vector<std::pair<std::string, std::string>> pairs;
+    for (int i = 0; i < MIGRATION_KEYS; i++) {
+        pairs.emplace_back("key:" + std::to_string(i), std::to_string(i));
+        if (pairs.size() == 1000) {
+            dictionary.mset(pairs);
+            pairs.clear();
+        }
+    }
+    auto verify = [&dictionary]() {
+        std::vector<std::string> keys;
+        std::vector<std::string> values;
+        std::vector<bool> found;
+        int missing = 0;
+        for (int i = 0; i < MIGRATION_KEYS; i++) {
+            keys.push_back("key:" + std::to_string(i));
+            if (keys.size() == 1000 || i + 1 == MIGRATION_KEYS) {
+                dictionary.mget(keys, values, found);
+                missing += static_cast<int>(std::count(found.begin(), found.end(), false));
+                keys.clear();
+            }
+        }
+        return missing;
+    };
+    dictionary.add_backend(backends[4].endpoint);
+    int missing_during = verify();
+    dictionary.wait_for_migration();
+    std::cout << "add backend 5:    moved " << dictionary.migrated_keys() << " of " << MIGRATION_KEYS
+        << " keys (ideal " << MIGRATION_KEYS / 5 << "), missing during/after: "
+        << missing_during << "/" << verify() << "\n";
+    dictionary.remove_backend(backends[0].endpoint);
+    missing_during = verify();
+    dictionary.wait_for_migration();
+    std::cout << "remove backend 1: moved " << dictionary.migrated_keys() << " of " << MIGRATION_KEYS
+        << " keys (ideal " << MIGRATION_KEYS / 5 << "), missing during/after: "
+        << missing_during << "/" << verify() << ", total " << dictionary.size() << "\n";
+    stop_backends(backends);
+}
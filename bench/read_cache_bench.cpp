@@ -0,0 +1,102 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <string>
+#include <cmath>
+#include <algorithm>
+
+#include "CachedDictionary.hpp"
+
+#define KEYS 100000
+#define LOOKUPS_PER_THREAD 1000000
+#define ZIPF_EXPONENT 0.99
+#define WRITE_EVERY 1000
+
+/*
+* @brief Draws keys from a Zipf distribution over KEYS keys
+* @param rng Random generator
+* @param cdf Cumulative probabilities of the keys, hottest first
+* @return Index of the drawn key
+*/
+int zipf_key(std::mt19937& rng, const std::vector<double>& cdf) {
+    double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+    return static_cast<int>(std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin());
+}
+
+/*
+* @brief Runs Zipfian lookups (with an occasional write) from several threads
+* @param dictionary Dictionary to read from
+* @param keys Key strings, hottest first
+* @param cdf Cumulative probabilities of the keys
+* @param threads Number of threads
+* @return Throughput in million lookups per second
+*/
+double run(CachedDictionary& dictionary, const std::vector<std::string>& keys,
+           const std::vector<double>& cdf, int threads) {
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            std::mt19937 rng(t);
+            std::string value;
+            for (int i = 0; i < LOOKUPS_PER_THREAD; i++) {
+                const std::string& key = keys[zipf_key(rng, cdf)];
+                if (i % WRITE_EVERY == 0) {
+                    dictionary.insert_or_assign(key, std::to_string(i));
+                } else {
+                    dictionary.get(key, value);
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return (double)threads * LOOKUPS_PER_THREAD / seconds / 1e6;
+}
+
+/*
+* @brief Read cache benchmark: Zipfian lookups on a shared dictionary with
+* and without the per-thread cache
+*/
+int main() {
+    std::vector<std::string> keys;
+    std::vector<double> cdf;
+    double total = 0;
+    for (int i = 0; i < KEYS; i++) {
+        keys.push_back("key" + std::to_string(i));
+        total += 1.0 / std::pow(i + 1, ZIPF_EXPONENT);
+        cdf.push_back(total);
+    }
+    for (double& c : cdf) c /= total;
+    int max_threads = static_cast<int>(std::max(2u, std::thread::hardware_concurrency()));
+    std::cout << "zipf(" << ZIPF_EXPONENT << ") over " << KEYS << " keys, 1 write per "
+        << WRITE_EVERY << " lookups, Mops/s\n";
+    std::cout << std::setw(8) << "threads"
+        << std::setw(12) << "no cache"
+        << std::setw(12) << "cached"
+        << std::setw(12) << "hit rate" << "\n";
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        CachedDictionary plain(0);
+        CachedDictionary cached;
+        for (const auto& key : keys) {
+            plain.insert(key, key);
+            cached.insert(key, key);
+        }
+        double without = run(plain, keys, cdf, threads);
+        double with = run(cached, keys, cdf, threads);
+        // cache stats are per thread, so measure the hit rate with a pass on this one
+        std::mt19937 rng(0);
+        std::string value;
+        for (int i = 0; i < LOOKUPS_PER_THREAD / 10; i++) {
+            cached.get(keys[zipf_key(rng, cdf)], value);
+        }
+        auto stats = cached.local_stats();
+        std::cout << std::setw(8) << threads << std::fixed << std::setprecision(2)
+            << std::setw(12) << without
+            << std::setw(12) << with
+            << std::setw(11) << 100.0 * stats.hits / (stats.hits + stats.misses) << "%\n";
+    }
+}
@@ -0,0 +1,124 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <memory>
+
+#include "EpochReclamation.hpp"
+#include "HazardPointers.hpp"
+
+#define READS_PER_THREAD 2000000
+#define WRITE_INTERVAL_US 50
+
+/*
+* @struct Payload
+* @brief The object readers dereference and the writer keeps replacing
+*/
+struct Payload {
+    long value;
+};
+
+/*
+* @brief Runs readers dereferencing a shared pointer while a writer replaces
+* it every WRITE_INTERVAL_US and hands the old object to a reclaimer
+* @param threads Number of reader threads
+* @param make_reader Called on each reader thread, returns a callable that
+* reads through the pointer once and returns the value seen
+* @param replace Swaps in a new object and retires (or keeps) the old one
+* @return Read-side cost in nanoseconds per read
+*/
+template <class MakeReader, class Replace>
+double run(int threads, MakeReader make_reader, Replace replace) {
+    std::atomic<bool> done{false};
+    std::thread writer([&]() {
+        long next = 0;
+        while (!done.load(std::memory_order_relaxed)) {
+            replace(++next);
+            std::this_thread::sleep_for(std::chrono::microseconds(WRITE_INTERVAL_US));
+        }
+    });
+    std::vector<std::thread> readers;
+    std::vector<double> nanos(threads);
+    std::vector<long> sums(threads);
+    for (int t = 0; t < threads; t++) {
+        readers.emplace_back([&, t]() {
+            auto read = make_reader();
+            long sum = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < READS_PER_THREAD; i++) {
+                sum += read();
+            }
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            nanos[t] = std::chrono::duration<double, std::nano>(elapsed).count() / READS_PER_THREAD;
+            sums[t] = sum;
+        });
+    }
+    for (auto& reader : readers) reader.join();
+    done.store(true);
+    writer.join();
+    return *std::max_element(nanos.begin(), nanos.end());
+}
+
+/*
+* @brief Read-side overhead benchmark: unprotected reads (objects are never
+* freed) vs epoch pinning vs hazard pointers, with a writer retiring objects
+*/
+int main() {
+    int max_threads = static_cast<int>(std::max(2u, std::thread::hardware_concurrency()));
+    std::cout << "read-side cost, ns per read (writer replaces every "
+        << WRITE_INTERVAL_US << "us)\n";
+    std::cout << std::setw(8) << "threads"
+        << std::setw(14) << "unprotected"
+        << std::setw(10) << "epoch"
+        << std::setw(18) << "hazard pointer" << "\n";
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        std::atomic<Payload*> current{new Payload{0}};
+
+        // baseline: no protection, so old objects are only freed at the end
+        std::vector<Payload*> leaked;
+        double plain = run(threads,
+            [&]() {
+                return [&]() { return current.load(std::memory_order_acquire)->value; };
+            },
+            [&](long v) { leaked.push_back(current.exchange(new Payload{v})); });
+        for (Payload* p : leaked) delete p;
+
+        double epoch;
+        {
+            EpochDomain domain;
+            epoch = run(threads,
+                [&]() {
+                    return [&]() {
+                        auto guard = domain.pin();
+                        return current.load(std::memory_order_acquire)->value;
+                    };
+                },
+                [&](long v) { domain.retire(current.exchange(new Payload{v})); });
+        }
+
+        double hazard;
+        {
+            HazardDomain domain;
+            hazard = run(threads,
+                [&]() {
+                    // one hazard slot per reader thread, reused for every read
+                    auto holder = std::make_shared<HazardDomain::Holder>(domain.make_holder());
+                    return [&current, holder]() {
+                        long value = holder->protect(current)->value;
+                        holder->reset();
+                        return value;
+                    };
+                },
+                [&](long v) { domain.retire(current.exchange(new Payload{v})); });
+        }
+        delete current.load();
+
+        std::cout << std::setw(8) << threads << std::fixed << std::setprecision(2)
+            << std::setw(14) << plain
+            << std::setw(10) << epoch
+            << std::setw(18) << hazard << "\n";
+    }
+}
@@ -0,0 +1,122 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include "Dictionary.hpp"
+#include "Snapshot.hpp"
+#include "LazyDictionary.hpp"
+
+#define KEYS 1000000
+#define VALUE_BYTES 100
+#define DELTAS 3
+#define CHANGES_PER_DELTA 2000
+
+/*
+* @brief Times a call
+* @param fn Call to time
+* @return Elapsed milliseconds
+*/
+template <class Fn>
+double time_ms(Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/*
+* @brief Prints one line of results
+* @param what Name of the step
+* @param stats What it wrote
+* @param ms How long it took
+*/
+void report(const std::string& what, const SnapshotStats& stats, double ms) {
+    std::cout << std::left << std::setw(16) << what << std::right
+        << std::setw(10) << stats.segments
+        << std::setw(10) << stats.pairs
+        << std::setw(12) << std::fixed << std::setprecision(2) << stats.raw_bytes / 1e6
+        << std::setw(12) << stats.bytes / 1e6
+        << std::setw(10) << std::setprecision(1) << ms << "\n";
+}
+
+/*
+* @brief Snapshot harness: a full save of a large Dictionary, then deltas
+* after a few thousand updates each, loading the chain with 1, 2, 4, ...
+* threads and compacting it, then opening it lazily: time to the first
+* lookup and to a fully warm map
+*/
+int main() {
+    std::string base = "/tmp/snapshot_bench_" + std::to_string(getpid());
+    Dictionary dictionary;
+    std::mt19937 rng(1);
+    std::string filler;
+    for (int i = 0; i < VALUE_BYTES; i++) {
+        filler.push_back(static_cast<char>('a' + rng() % 16));
+    }
+    for (int i = 0; i < KEYS; i++) {
+        dictionary.insert("key:" + std::to_string(i), std::to_string(i) + filler.substr(i % 16));
+    }
+    IncrementalSnapshot<std::string, std::string> snapshot(dictionary);
+    std::vector<std::string> chain;
+
+    std::cout << KEYS << " keys, " << CHANGES_PER_DELTA << " updates per delta\n";
+    std::cout << std::left << std::setw(16) << "step" << std::right << std::setw(10) << "segments"
+        << std::setw(10) << "pairs" << std::setw(12) << "raw MB" << std::setw(12) << "stored MB"
+        << std::setw(10) << "ms" << "\n";
+    SnapshotStats stats;
+    chain.push_back(base + ".0");
+    double ms = time_ms([&]() { stats = snapshot.save(chain.back()); });
+    report("full", stats, ms);
+
+    std::uniform_int_distribution<int> pick(0, KEYS - 1);
+    for (int delta = 1; delta <= DELTAS; delta++) {
+        for (int i = 0; i < CHANGES_PER_DELTA; i++) {
+            std::string key = "key:" + std::to_string(pick(rng));
+            if (i % 10 == 0) {
+                dictionary.erase(key);
+            } else {
+                dictionary.insert_or_assign(key, std::to_string(delta) + filler);
+            }
+        }
+        chain.push_back(base + "." + std::to_string(delta));
+        ms = time_ms([&]() { stats = snapshot.save_incremental(chain.back()); });
+        report("delta " + std::to_string(delta), stats, ms);
+    }
+
+    Dictionary loaded;
+    size_t max_threads = std::max(4u, std::thread::hardware_concurrency());
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        ms = time_ms([&]() { IncrementalSnapshot<std::string, std::string>::load(chain, loaded, threads); });
+        std::cout << "load chain of " << chain.size() << " with " << threads << " threads: "
+            << std::setprecision(1) << ms << " ms, " << (loaded == dictionary ? "matches" : "MISMATCH") << "\n";
+    }
+    ms = time_ms([&]() { stats = IncrementalSnapshot<std::string, std::string>::compact(chain, base + ".compact"); });
+    report("compact", stats, ms);
+
+    bool lazy_matches = false;
+    {
+        std::string value;
+        std::unique_ptr<LazyDictionary> lazy;
+        ms = time_ms([&]() {
+            lazy.reset(new LazyDictionary(chain));
+            lazy->get("key:" + std::to_string(pick(rng)), value);
+        });
+        std::cout << "lazy open + first get: " << std::setprecision(1) << ms << " ms, "
+            << lazy->loaded_segments() << " segments loaded\n";
+        ms = time_ms([&]() { lazy->wait_until_warm(); });
+        lazy_matches = lazy->take() == dictionary;
+        std::cout << "lazy warm: " << ms << " ms more, " << (lazy_matches ? "matches" : "MISMATCH") << "\n";
+    }
+
+    for (const auto& path : chain) unlink(path.c_str());
+    unlink((base + ".compact").c_str());
+    if (loaded != dictionary || !lazy_matches) throw std::runtime_error("loaded snapshot doesn't match");
+}
@@ -0,0 +1,82 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <string>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include "SpillingHashMap.hpp"
+
+#define KEYS 500000
+#define VALUE_BYTES 200
+#define LOOKUPS 2000000
+#define ZIPF_EXPONENT 0.99
+
+/*
+* @brief Draws keys from a Zipf distribution over KEYS keys
+* @param rng Random generator
+* @param cdf Cumulative probabilities of the keys, hottest first
+* @return Index of the drawn key
+*/
+int zipf_key(std::mt19937& rng, const std::vector<double>& cdf) {
+    double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+    return static_cast<int>(std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin());
+}
+
+/*
+* @brief Spill harness: fills a SpillingHashMap under budgets of 100%, 25%,
+* 10% and 2% of its values, then runs Zipfian at() lookups and reports how
+* many had to be read back from the spill file
+*/
+int main() {
+    std::vector<std::string> keys;
+    for (int i = 0; i < KEYS; i++) keys.push_back("key:" + std::to_string(i));
+    std::vector<double> cdf(KEYS);
+    double total = 0;
+    for (int i = 0; i < KEYS; i++) {
+        total += 1.0 / std::pow(i + 1, ZIPF_EXPONENT);
+        cdf[i] = total;
+    }
+    for (double& p : cdf) p /= total;
+    // keys are inserted in shuffled order, so the hot ones aren't the first or last written
+    std::vector<int> order(KEYS);
+    for (int i = 0; i < KEYS; i++) order[i] = i;
+    std::shuffle(order.begin(), order.end(), std::mt19937(7));
+
+    std::string path = "/tmp/spill_bench_" + std::to_string(getpid());
+    size_t full = KEYS * (sizeof(std::string) + VALUE_BYTES);
+    std::cout << KEYS << " keys, " << VALUE_BYTES << "-byte values, " << LOOKUPS << " Zipfian lookups\n";
+    std::cout << std::left << std::setw(8) << "budget" << std::right << std::setw(12) << "resident MB"
+        << std::setw(12) << "file MB" << std::setw(10) << "fill ms" << std::setw(12) << "Mlookups/s"
+        << std::setw(10) << "reloads" << "\n";
+    for (int percent : {100, 25, 10, 2}) {
+        SpillingHashMap<std::string, std::string> map(full / 100 * percent, path);
+        auto start = std::chrono::steady_clock::now();
+        for (int i : order) {
+            map.insert(keys[i], std::string(VALUE_BYTES, static_cast<char>('a' + i % 26)));
+        }
+        double fill_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        SpillStats before = map.spill_stats();
+        std::mt19937 rng(1);
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < LOOKUPS; i++) {
+            int key = zipf_key(rng, cdf);
+            const std::string& value = map.at(keys[key]);
+            if (value[0] != 'a' + key % 26) throw std::runtime_error("wrong value for " + keys[key]);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        SpillStats after = map.spill_stats();
+        std::cout << std::left << std::setw(8) << (std::to_string(percent) + "%") << std::right << std::fixed
+            << std::setw(12) << std::setprecision(1) << after.resident_bytes / 1e6
+            << std::setw(12) << after.file_bytes / 1e6
+            << std::setw(10) << fill_ms
+            << std::setw(12) << std::setprecision(2) << LOOKUPS / seconds / 1e6
+            << std::setw(9) << std::setprecision(1) << 100.0 * (after.reloads - before.reloads) / LOOKUPS << "%\n";
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef CHECK_HPP
+#define CHECK_HPP
+
+#include <iostream>
+#include <cstdlib>
+
+/*
+* @brief Aborts the check program with the failed condition and its location
+* when condition is false (unlike assert, also when NDEBUG is defined)
+*/
+#define CHECK(condition)                                                        \
+    do {                                                                        \
+        if (!(condition)) {                                                     \
+            std::cerr << __FILE__ << ":" << __LINE__                            \
+                << ": check failed: " #condition "\n";                          \
+            std::abort();                                                       \
+        }                                                                       \
+    } while (0)
+
+#endif //CHECK_HPP
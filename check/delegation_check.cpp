@@ -0,0 +1,104 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <future>
+#include <optional>
+#include <string>
+#include <algorithm>
+
+#include "Check.hpp"
+#include "MpscQueue.hpp"
+#include "DelegationHashMap.hpp"
+
+#define PRODUCERS 4
+#define ITEMS_PER_PRODUCER 50000
+#define QUEUE_CAPACITY 64
+#define CLIENTS 4
+#define KEYS_PER_CLIENT 5000
+#define SHARDS 4
+
+/*
+* @brief Producers push (producer, sequence) pairs into a small queue while
+* one consumer pops them: every item must arrive exactly once, and in order
+* per producer
+*/
+void check_mpsc_queue() {
+    MpscQueue<std::pair<int, int>> queue(QUEUE_CAPACITY);
+    std::vector<std::thread> producers;
+    for (int p = 0; p < PRODUCERS; p++) {
+        producers.emplace_back([&queue, p]() {
+            for (int i = 0; i < ITEMS_PER_PRODUCER; i++) {
+                while (!queue.try_push(std::make_pair(p, i))) std::this_thread::yield();
+            }
+        });
+    }
+    std::vector<int> next(PRODUCERS, 0);
+    long received = 0;
+    std::pair<int, int> item;
+    while (received < static_cast<long>(PRODUCERS) * ITEMS_PER_PRODUCER) {
+        if (!queue.try_pop(item)) {
+            std::this_thread::yield();
+            continue;
+        }
+        CHECK(item.first >= 0 && item.first < PRODUCERS);
+        CHECK(item.second == next[item.first]);
+        next[item.first]++;
+        received++;
+    }
+    for (auto& producer : producers) producer.join();
+    CHECK(!queue.try_pop(item));
+    CHECK(queue.size_approx() == 0);
+    for (int p = 0; p < PRODUCERS; p++) CHECK(next[p] == ITEMS_PER_PRODUCER);
+}
+
+/*
+* @brief Clients insert their own keys, erase half of them and look them all
+* up, concurrently and partly batched: every future must hold the result a
+* sequential map would give, and the map must end up with the kept half
+*/
+void check_delegation_map() {
+    DelegationHashMap<std::string, int> map(SHARDS);
+    std::vector<std::thread> clients;
+    for (int c = 0; c < CLIENTS; c++) {
+        clients.emplace_back([&map, c]() {
+            auto key = [c](int i) { return std::to_string(c) + ":" + std::to_string(i); };
+            {
+                DelegationHashMap<std::string, int>::Batch batch(map);
+                std::vector<std::future<bool>> inserted;
+                for (int i = 0; i < KEYS_PER_CLIENT; i++) {
+                    inserted.push_back(batch.insert(key(i), i));
+                }
+                batch.flush();
+                for (auto& result : inserted) CHECK(result.get());
+            }
+            for (int i = 0; i < KEYS_PER_CLIENT; i += 2) {
+                CHECK(!map.insert(key(i), -1).get());
+                CHECK(map.erase(key(i)).get());
+                CHECK(!map.erase(key(i)).get());
+            }
+            for (int i = 0; i < KEYS_PER_CLIENT; i++) {
+                std::optional<int> value = map.get(key(i)).get();
+                if (i % 2 == 0) {
+                    CHECK(!value);
+                } else {
+                    CHECK(value && *value == i);
+                }
+            }
+            CHECK(!map.insert_or_assign(key(1), 100).get());
+            CHECK(map.get(key(1)).get() == std::optional<int>(100));
+        });
+    }
+    for (auto& client : clients) client.join();
+    CHECK(map.size() == CLIENTS * (KEYS_PER_CLIENT / 2));
+}
+
+/*
+* @brief Concurrent correctness checks of MpscQueue and DelegationHashMap
+*/
+int main() {
+    check_mpsc_queue();
+    std::cout << "MpscQueue: ok\n";
+    check_delegation_map();
+    std::cout << "DelegationHashMap: ok\n";
+    return 0;
+}
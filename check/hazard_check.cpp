@@ -0,0 +1,163 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+#include "Check.hpp"
+#include "HazardPointers.hpp"
+
+#define THREADS 4
+#define ITEMS_PER_THREAD 20000
+#define READERS 2
+#define REPLACEMENTS 20000
+
+/*
+* @struct Payload
+* @brief An object readers dereference while a writer replaces and retires it
+* @var value Non-negative while alive, set to -1 just before it is freed
+*/
+struct Payload {
+    std::atomic<long> value;
+    explicit Payload(long value) : value(value) {}
+};
+
+std::atomic<long> payloads_freed{0};
+
+/*
+* @brief Deleter handed to the domain, poisons the payload so a reader that
+* still sees it fails its check (and ThreadSanitizer reports the free)
+* @param object Payload to free
+*/
+void free_payload(void* object) {
+    Payload* payload = static_cast<Payload*>(object);
+    payload->value.store(-1, std::memory_order_relaxed);
+    delete payload;
+    payloads_freed.fetch_add(1);
+}
+
+/*
+* @class Stack
+* @brief A Treiber stack whose pops protect the top node with a hazard
+* pointer, so a node is never freed (nor its address reused) under a
+* concurrent pop
+*/
+class Stack {
+public:
+    explicit Stack(HazardDomain& domain) : domain(domain) {}
+
+    ~Stack() {
+        Node* node = top.load();
+        while (node != nullptr) {
+            Node* next = node->next;
+            delete node;
+            node = next;
+        }
+    }
+
+    void push(long value) {
+        Node* node = new Node{value, top.load(std::memory_order_relaxed)};
+        while (!top.compare_exchange_weak(node->next, node, std::memory_order_release)) {}
+    }
+
+    bool pop(long& value) {
+        HazardDomain::Holder holder = domain.make_holder();
+        while (true) {
+            Node* node = holder.protect(top);
+            if (node == nullptr) return false;
+            if (top.compare_exchange_strong(node, node->next, std::memory_order_acquire)) {
+                value = node->value;
+                holder.reset();
+                domain.retire(node);
+                return true;
+            }
+        }
+    }
+
+private:
+    struct Node {
+        long value;
+        Node* next;
+    };
+
+    HazardDomain& domain;
+    std::atomic<Node*> top{nullptr};
+};
+
+/*
+* @brief Readers protect and dereference a shared pointer while a writer
+* keeps replacing it: no reader may see a freed payload, and every retired
+* payload must be freed by the time the domain is gone
+*/
+void check_protect() {
+    payloads_freed.store(0);
+    {
+        HazardDomain domain;
+        std::atomic<Payload*> current{new Payload(0)};
+        std::atomic<bool> done{false};
+        std::vector<std::thread> readers;
+        for (int r = 0; r < READERS; r++) {
+            readers.emplace_back([&]() {
+                HazardDomain::Holder holder = domain.make_holder();
+                long last = 0;
+                while (!done.load()) {
+                    long value = holder.protect(current)->value.load(std::memory_order_relaxed);
+                    CHECK(value >= last);
+                    last = value;
+                }
+            });
+        }
+        for (long i = 1; i <= REPLACEMENTS; i++) {
+            Payload* old = current.exchange(new Payload(i), std::memory_order_acq_rel);
+            domain.retire(old, free_payload);
+        }
+        done.store(true);
+        for (auto& reader : readers) reader.join();
+        domain.collect();
+        CHECK(domain.pending() == 0);
+        CHECK(payloads_freed.load() == REPLACEMENTS);
+        delete current.load();
+    }
+}
+
+/*
+* @brief Threads push distinct values and pop concurrently, then exit with
+* retired nodes still pending: every value must be popped exactly once, and
+* the nodes the exited threads left behind must be freed by a later collect
+*/
+void check_stack() {
+    HazardDomain domain;
+    Stack stack(domain);
+    std::vector<std::atomic<int>> popped(THREADS * ITEMS_PER_THREAD);
+    for (auto& count : popped) count.store(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([&, t]() {
+            long value;
+            for (long i = 0; i < ITEMS_PER_THREAD; i++) {
+                stack.push(t * ITEMS_PER_THREAD + i);
+                if (i % 2 == 1) {
+                    CHECK(stack.pop(value));
+                    popped[value].fetch_add(1);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    long value;
+    while (stack.pop(value)) popped[value].fetch_add(1);
+    for (auto& count : popped) CHECK(count.load() == 1);
+    // the exited threads' garbage went to the domain, collect() frees it
+    domain.collect();
+    CHECK(domain.pending() == 0);
+}
+
+/*
+* @brief Concurrent correctness checks of HazardDomain
+*/
+int main() {
+    check_protect();
+    std::cout << "HazardDomain protect: ok\n";
+    check_stack();
+    std::cout << "HazardDomain stack: ok\n";
+    return 0;
+}
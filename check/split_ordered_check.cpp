@@ -0,0 +1,142 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <string>
+
+#include "Check.hpp"
+#include "EpochReclamation.hpp"
+#include "SplitOrderedHashMap.hpp"
+
+#define WRITERS 4
+#define READERS 2
+#define KEYS_PER_WRITER 20000
+#define STABLE_KEYS 1000
+#define REPLACEMENTS 20000
+
+/*
+* @struct Payload
+* @brief An object readers dereference while a writer replaces and retires it
+* @var value Non-negative while alive, set to -1 just before it is freed
+*/
+struct Payload {
+    std::atomic<long> value;
+    explicit Payload(long value) : value(value) {}
+};
+
+std::atomic<long> payloads_freed{0};
+
+/*
+* @brief Deleter handed to the domain, poisons the payload so a reader that
+* still sees it fails its check (and ThreadSanitizer reports the free)
+* @param object Payload to free
+*/
+void free_payload(void* object) {
+    Payload* payload = static_cast<Payload*>(object);
+    payload->value.store(-1, std::memory_order_relaxed);
+    delete payload;
+    payloads_freed.fetch_add(1);
+}
+
+/*
+* @brief Readers pin the domain and dereference a shared pointer while a
+* writer keeps replacing it: no reader may see a freed payload, and every
+* retired payload must be freed by the time the domain is gone
+*/
+void check_epoch_domain() {
+    payloads_freed.store(0);
+    {
+        EpochDomain domain;
+        std::atomic<Payload*> current{new Payload(0)};
+        std::atomic<bool> done{false};
+        std::vector<std::thread> readers;
+        for (int r = 0; r < READERS; r++) {
+            readers.emplace_back([&]() {
+                long last = 0;
+                while (!done.load()) {
+                    auto guard = domain.pin();
+                    long value = current.load(std::memory_order_acquire)->value.load(std::memory_order_relaxed);
+                    CHECK(value >= last);
+                    last = value;
+                }
+            });
+        }
+        for (long i = 1; i <= REPLACEMENTS; i++) {
+            Payload* old = current.exchange(new Payload(i), std::memory_order_acq_rel);
+            domain.retire(old, free_payload);
+        }
+        done.store(true);
+        for (auto& reader : readers) reader.join();
+        domain.synchronize();
+        CHECK(domain.pending() == 0);
+        CHECK(payloads_freed.load() == REPLACEMENTS);
+        delete current.load();
+    }
+}
+
+/*
+* @brief Writers insert their own keys, overwrite them, then erase half,
+* while readers keep finding a set of keys no one touches: every call must
+* return what a sequential map would, and the map must end up with the
+* stable keys plus the kept half
+*/
+void check_split_ordered_map() {
+    SplitOrderedHashMap<std::string, long> map;
+    for (long i = 0; i < STABLE_KEYS; i++) {
+        CHECK(map.insert("stable:" + std::to_string(i), i));
+    }
+    std::atomic<bool> done{false};
+    std::vector<std::thread> readers;
+    for (int r = 0; r < READERS; r++) {
+        readers.emplace_back([&]() {
+            while (!done.load()) {
+                for (long i = 0; i < STABLE_KEYS; i++) {
+                    long value = -1;
+                    CHECK(map.get("stable:" + std::to_string(i), value));
+                    CHECK(value == i);
+                }
+            }
+        });
+    }
+    std::vector<std::thread> writers;
+    for (int w = 0; w < WRITERS; w++) {
+        writers.emplace_back([&map, w]() {
+            auto key = [w](long i) { return std::to_string(w) + ":" + std::to_string(i); };
+            for (long i = 0; i < KEYS_PER_WRITER; i++) {
+                CHECK(map.insert(key(i), i));
+                CHECK(!map.insert(key(i), -1));
+            }
+            for (long i = 0; i < KEYS_PER_WRITER; i++) {
+                CHECK(!map.insert_or_assign(key(i), i * 10));
+            }
+            for (long i = 0; i < KEYS_PER_WRITER; i += 2) {
+                CHECK(map.erase(key(i)));
+                CHECK(!map.erase(key(i)));
+            }
+            for (long i = 0; i < KEYS_PER_WRITER; i++) {
+                long value = -1;
+                bool found = map.get(key(i), value);
+                CHECK(found == (i % 2 == 1));
+                CHECK(!found || value == i * 10);
+            }
+        });
+    }
+    for (auto& writer : writers) writer.join();
+    done.store(true);
+    for (auto& reader : readers) reader.join();
+    CHECK(map.size() == STABLE_KEYS + WRITERS * (KEYS_PER_WRITER / 2));
+    int seen = 0;
+    for (auto it = map.cbegin(); it != map.cend(); ++it) seen++;
+    CHECK(seen == map.size());
+}
+
+/*
+* @brief Concurrent correctness checks of EpochDomain and SplitOrderedHashMap
+*/
+int main() {
+    check_epoch_domain();
+    std::cout << "EpochDomain: ok\n";
+    check_split_ordered_map();
+    std::cout << "SplitOrderedHashMap: ok\n";
+    return 0;
+}
@@ -1,9 +1,12 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <iterator>
 
 #include "HashMap.hpp"
 #include "Dictionary.hpp"
+#include "HeavyHitters.hpp"
+#include "ChangeStream.hpp"
 
 /*
 * @brief Simple demonstration of HashMap and Dictionary 
@@ -72,4 +75,43 @@ int main() {
     catch (const InvalidKey& e) {
         std::cout << "[expected] dict.erase('missing') threw: " << e.what() << "\n";
     }
+
+    // bulk update - moves pairs in, overwriting existing keys
+    std::vector<std::pair<std::string, std::string>> overrides = {
+        {"apple", "red fruit"}, {"carrot", "vegetable"}};
+    dict.update(std::make_move_iterator(overrides.begin()),
+                std::make_move_iterator(overrides.end()));
+    Dictionary more;
+    more["banana"] = "fruit";
+    dict.update(more);
+    std::cout << "after update size= " << dict.size()
+        << " dict['apple'] = " << dict.at("apple") << "\n";
+
+    // lookup sampling - which keys are hot, which lookups miss
+    HeavyHitters<std::string> sampler(8, 4);
+    dict.set_lookup_observer(&sampler);
+    for (int i = 0; i < 400; i++) {
+        dict.contains_key(i % 4 == 0 ? "carrot" : "apple");
+        dict.contains_key("cherry");
+    }
+    dict.set_lookup_observer(nullptr);
+    for (const auto& entry : sampler.hot(2)) {
+        std::cout << "hot key " << entry.key << " ~" << entry.count << " lookups\n";
+    }
+    for (const auto& entry : sampler.missed(1)) {
+        std::cout << "missed key " << entry.key << " ~" << entry.count << " lookups\n";
+    }
+
+    // change-data-capture - every mutation lands in a stream another thread can drain
+    ChangeStream<std::string, std::string> changes(16, OverflowPolicy::Overwrite);
+    dict.set_mutation_observer(&changes);
+    dict.insert_or_assign("apple", "green fruit");
+    dict.insert("date", "fruit");
+    dict.erase("carrot");
+    dict.set_mutation_observer(nullptr);
+    const char* kinds[] = {"insert", "update", "erase", "clear"};
+    changes.consume([&kinds](const ChangeStream<std::string, std::string>::Event& event) {
+        std::cout << "change #" << event.sequence << " " << kinds[static_cast<int>(event.kind)]
+            << " " << event.key << (event.value.empty() ? "" : " = " + event.value) << "\n";
+    });
 }
\ No newline at end of file
@@ -0,0 +1,149 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstdlib>
+
+#include "KvClient.hpp"
+
+/*
+* @struct LoadOptions
+* @brief What to connect to and what load to generate
+*/
+struct LoadOptions {
+    std::string unix_path;
+    int tcp_port = -1;
+    int clients = 4;
+    int requests = 100000;      // per client
+    int pipeline = 16;          // requests in flight per round trip
+    int keys = 10000;
+    double set_ratio = 0.1;
+    int value_size = 32;
+};
+
+/*
+* @brief Prints the command line usage
+* @param program Name the program was started with
+*/
+void usage(const char* program) {
+    std::cerr << "usage: " << program << " [--unix PATH | --port N] [--clients N] [--requests N]\n"
+        << "       [--pipeline N] [--keys N] [--set-ratio R] [--value-size N]\n";
+}
+
+/*
+* @brief Opens a connection as configured
+* @param options Load options
+* @return The connected client
+*/
+KvClient connect(const LoadOptions& options) {
+    if (options.tcp_port >= 0) return KvClient::connect_tcp("127.0.0.1", options.tcp_port);
+    return KvClient::connect_unix(options.unix_path);
+}
+
+/*
+* @brief One client's load: rounds of pipelined GETs and SETs over random keys
+* @param options Load options
+* @param seed Random seed of this client
+* @param latencies Filled with the round trip time of every pipeline, in microseconds
+*/
+void run_client(const LoadOptions& options, int seed, std::vector<double>& latencies) {
+    KvClient client = connect(options);
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> pick(0, options.keys - 1);
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    std::string value(static_cast<size_t>(options.value_size), 'v');
+    for (int done = 0; done < options.requests;) {
+        int batch = std::min(options.pipeline, options.requests - done);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < batch; i++) {
+            std::string key = "key:" + std::to_string(pick(rng));
+            if (coin(rng) < options.set_ratio) {
+                client.send({"SET", key, value});
+            } else {
+                client.send({"GET", key});
+            }
+        }
+        client.flush();
+        for (int i = 0; i < batch; i++) {
+            RespValue reply = client.receive();
+            if (reply.type == RespValue::Type::Error) throw std::runtime_error(reply.text);
+        }
+        latencies.push_back(std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start).count());
+        done += batch;
+    }
+}
+
+/*
+* @brief Load generator for kv_server: several clients send pipelined GET/SET
+* traffic, then throughput and round trip latency percentiles are reported
+*/
+int main(int argc, char** argv) {
+    LoadOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 2;
+        }
+        const char* next = argv[++i];
+        if (arg == "--unix") options.unix_path = next;
+        else if (arg == "--port") options.tcp_port = std::atoi(next);
+        else if (arg == "--clients") options.clients = std::atoi(next);
+        else if (arg == "--requests") options.requests = std::atoi(next);
+        else if (arg == "--pipeline") options.pipeline = std::atoi(next);
+        else if (arg == "--keys") options.keys = std::atoi(next);
+        else if (arg == "--set-ratio") options.set_ratio = std::atof(next);
+        else if (arg == "--value-size") options.value_size = std::atoi(next);
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (options.unix_path.empty() && options.tcp_port < 0) options.unix_path = "/tmp/kv.sock";
+    if (options.clients < 1 || options.pipeline < 1 || options.keys < 1 || options.requests < 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    std::vector<std::vector<double>> latencies(options.clients);
+    std::vector<std::string> errors(options.clients);
+    std::vector<std::thread> clients;
+    auto start = std::chrono::steady_clock::now();
+    for (int c = 0; c < options.clients; c++) {
+        clients.emplace_back([&, c]() {
+            try {
+                run_client(options, c, latencies[c]);
+            } catch (const std::exception& e) {
+                errors[c] = e.what();
+            }
+        });
+    }
+    for (auto& client : clients) client.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (const auto& error : errors) {
+        if (!error.empty()) {
+            std::cerr << "kv_load: " << error << "\n";
+            return 1;
+        }
+    }
+    std::vector<double> all;
+    for (const auto& client : latencies) all.insert(all.end(), client.begin(), client.end());
+    std::sort(all.begin(), all.end());
+    auto percentile = [&all](double p) {
+        return all.empty() ? 0.0 : all[static_cast<size_t>(p * (all.size() - 1))];
+    };
+    double total = static_cast<double>(options.clients) * options.requests;
+    std::cout << options.clients << " clients, pipeline " << options.pipeline << ", "
+        << options.set_ratio * 100 << "% SET, " << options.keys << " keys\n";
+    std::cout << std::fixed << std::setprecision(0)
+        << total / seconds << " requests/s\n"
+        << std::setprecision(1)
+        << "round trip us: p50 " << percentile(0.50)
+        << "  p99 " << percentile(0.99)
+        << "  max " << percentile(1.0) << "\n";
+    return 0;
+}
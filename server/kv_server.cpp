@@ -0,0 +1,103 @@
+#include <iostream>
+#include <string>
+#include <memory>
+#include <cstdlib>
+#include <csignal>
+
+#include "KvServer.hpp"
+#include "Replication.hpp"
+
+static KvServer* running = nullptr;
+
+/*
+* @brief SIGINT / SIGTERM handler, makes the event loop return
+*/
+extern "C" void handle_signal(int) {
+    if (running != nullptr) running->stop();
+}
+
+/*
+* @brief Prints the command line usage
+* @param program Name the program was started with
+*/
+void usage(const char* program) {
+    std::cerr << "usage: " << program << " [--unix PATH] [--port N] [--snapshot FILE] [--log FILE]\n"
+        << "       [--follow-unix PATH | --follow-port N | --follow-log FILE]\n"
+        << "  serves a Dictionary over RESP (GET SET DEL MGET MSET PING DBSIZE SCAN\n"
+        << "  BGSAVE LASTSAVE ROLE)\n"
+        << "  --snapshot: loaded at startup if present, BGSAVE writes it from a forked child\n"
+        << "  --log:      leader, every write is logged to FILE and shipped to followers\n"
+        << "  --follow-*: read-only follower of a leader's socket, port or log file\n"
+        << "  default: --unix /tmp/kv.sock\n";
+}
+
+/*
+* @brief Key-value server: listens on a Unix socket and/or loopback TCP
+* until interrupted, standalone, as a replication leader or as a follower
+*/
+int main(int argc, char** argv) {
+    KvServer::Options options;
+    std::string log_path;
+    FollowerServer::Source leader;
+    bool follow = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 2;
+        }
+        const char* next = argv[++i];
+        if (arg == "--unix") {
+            options.unix_path = next;
+        } else if (arg == "--port") {
+            options.tcp_port = std::atoi(next);
+        } else if (arg == "--snapshot") {
+            options.snapshot_path = next;
+        } else if (arg == "--log") {
+            log_path = next;
+        } else if (arg == "--follow-unix") {
+            leader.unix_path = next;
+            follow = true;
+        } else if (arg == "--follow-port") {
+            leader.tcp_port = std::atoi(next);
+            follow = true;
+        } else if (arg == "--follow-log") {
+            leader.log_path = next;
+            follow = true;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (options.unix_path.empty() && options.tcp_port < 0) {
+        options.unix_path = "/tmp/kv.sock";
+    }
+    if (follow && !log_path.empty()) {
+        usage(argv[0]);
+        return 2;
+    }
+    try {
+        std::unique_ptr<KvServer> server;
+        if (follow) {
+            server = std::make_unique<FollowerServer>(options, leader);
+        } else if (!log_path.empty()) {
+            server = std::make_unique<LeaderServer>(options, log_path);
+        } else {
+            server = std::make_unique<KvServer>(options);
+        }
+        running = server.get();
+        std::signal(SIGINT, handle_signal);
+        std::signal(SIGTERM, handle_signal);
+        std::signal(SIGPIPE, SIG_IGN);
+        if (!options.unix_path.empty()) std::cout << "listening on " << options.unix_path << "\n";
+        if (server->tcp_port() >= 0) std::cout << "listening on 127.0.0.1:" << server->tcp_port() << "\n";
+        std::cout.flush();
+        server->run();
+        running = nullptr;
+        std::cout << "stopped with " << server->dictionary().size() << " keys\n";
+    } catch (const std::exception& e) {
+        std::cerr << "kv_server: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,315 @@
+#ifndef BACKGROUNDSAVER_HPP
+#define BACKGROUNDSAVER_HPP
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#include "HashMap.hpp"
+#include "Snapshot.hpp"
+
+/*
+* @struct BackgroundSaveStatus
+* @brief State of the last background save. A save is Running from
+* snapshot_async() until its child process exits
+*/
+struct BackgroundSaveStatus {
+    enum class State : std::uint8_t { Idle, Running, Succeeded, Failed };
+
+    State state = State::Idle;
+    std::string path;                                       // file being / last written
+    std::string error;                                      // why the save failed
+    SnapshotStats stats;                                    // what a successful save wrote
+    std::uint64_t id = 0;                                   // id of the snapshot
+    pid_t pid = -1;                                         // child process
+    std::chrono::system_clock::time_point started;
+    std::chrono::system_clock::time_point finished;
+    std::chrono::system_clock::time_point last_success;     // epoch if none yet
+};
+
+/*
+* @class BackgroundSaver
+* @brief Point-in-time snapshots of a HashMap or Dictionary without pausing
+* its writers, as Redis BGSAVE does: snapshot_async() forks, the child
+* writes its copy-on-write image of the map as a full snapshot (see
+* IncrementalSnapshot::load()) and exits, while the parent keeps mutating.
+* Memory is only duplicated for the pages the parent writes during the save.
+* A reaper thread collects the child's result through a pipe, updates the
+* status, wakes wait() and calls the completion callback
+* @var on_done Called on the reaper thread after each save ends
+* @var lock Protects current
+* @var finished_save Signaled when a save ends
+* @var current Status of the running or last save
+* @var reaper Thread waiting for the running (or last) child
+* @note Only the forking thread exists in the child, so no other thread may
+* mutate the map during snapshot_async(). The child allocates memory, which
+* glibc makes fork-safe. It closes every descriptor it inherits but the
+* standard ones and its result pipe, so the parent's sockets (e.g. a
+* server's clients) don't stay open for as long as the save runs
+*/
+class BackgroundSaver {
+public:
+
+    using Callback = std::function<void(const BackgroundSaveStatus&)>;
+
+    /*
+    * @brief Creates an idle saver
+    * @param on_done Called with the final status after each save, on the
+    * reaper thread. It must not call snapshot_async() or wait()
+    */
+    explicit BackgroundSaver(Callback on_done = Callback());
+
+    /*
+    * @brief Waits for a running save to end (destructor)
+    */
+    ~BackgroundSaver();
+
+    BackgroundSaver(const BackgroundSaver&) = delete;
+    BackgroundSaver& operator=(const BackgroundSaver&) = delete;
+
+    /*
+    * @brief Starts saving a snapshot of the map as it is now
+    * @param map Map to save
+    * @param path Path of the snapshot
+    * @param segment_count Number of snapshot segments, a power of 2
+    * @param threads Threads compressing in the child, 1 leaves the other
+    * cores to the parent
+    * @return true if the save started, false if another one is running
+    * @throws std::invalid_argument if segment_count is not a power of 2
+    * @throws std::runtime_error if the child can't be created
+    */
+    template <class KeyT, class ValueT>
+    bool snapshot_async(const HashMap<KeyT, ValueT>& map, const std::string& path,
+                        size_t segment_count = SNAPSHOT_SEGMENTS, size_t threads = 1);
+
+    /*
+    * @brief Returns the status of the running or last save
+    * @return A copy of the status
+    */
+    BackgroundSaveStatus status() const;
+
+    /*
+    * @brief Running getter
+    * @return true if a save is running
+    */
+    bool running() const;
+
+    /*
+    * @brief Waits until no save is running
+    * @return Status of the last save
+    */
+    BackgroundSaveStatus wait();
+
+private:
+    Callback on_done;
+    mutable std::mutex lock;
+    std::condition_variable finished_save;
+    BackgroundSaveStatus current;
+    std::thread reaper;
+
+    /*
+    * @brief Reaper thread body: reads the child's result, waits for it to
+    * exit and publishes the final status
+    * @param pid The child
+    * @param result_fd Read end of the child's result pipe
+    */
+    void reap(pid_t pid, int result_fd);
+
+    /*
+    * @brief Child process body: writes the snapshot, reports on the pipe and exits
+    * @param map Map to save
+    * @param path Path of the snapshot
+    * @param header Header of the snapshot
+    * @param threads Threads compressing
+    * @param result_fd Write end of the result pipe
+    */
+    template <class KeyT, class ValueT>
+    [[noreturn]] static void save_in_child(const HashMap<KeyT, ValueT>& map, const std::string& path,
+                                           const SnapshotHeader& header, size_t threads, int result_fd);
+
+    /*
+    * @brief Closes the descriptors the child inherited, except 0-2 and one
+    * @param keep Descriptor to keep open
+    */
+    static void close_inherited(int keep);
+};
+
+// ==================== Implementation ====================
+
+inline BackgroundSaver::BackgroundSaver(Callback on_done) : on_done(std::move(on_done)) {}
+
+
+inline BackgroundSaver::~BackgroundSaver() {
+    if (reaper.joinable()) reaper.join();
+}
+
+
+template <class KeyT, class ValueT>
+bool BackgroundSaver::snapshot_async(const HashMap<KeyT, ValueT>& map, const std::string& path,
+                                     size_t segment_count, size_t threads) {
+    if (segment_count == 0 || (segment_count & (segment_count - 1)) != 0
+        || segment_count >= SNAPSHOT_END_MARKER) {
+        throw std::invalid_argument("segment count must be a power of 2");
+    }
+    if (running()) return false;
+    // the previous reaper has published its status, only its exit is left
+    if (reaper.joinable()) reaper.join();
+
+    SnapshotHeader header;
+    header.kind = SnapshotKind::Full;
+    header.segment_count = static_cast<std::uint32_t>(segment_count);
+    header.id = snapshot_detail::new_snapshot_id();
+    int fds[2];
+    // close-on-exec from the start: a process another thread forks and execs
+    // meanwhile must not hold the write end, or the reaper would never see EOF
+    if (pipe2(fds, O_CLOEXEC) < 0) snapshot_detail::fail("pipe2");
+    pid_t pid = fork();
+    if (pid < 0) {
+        int error = errno;
+        close(fds[0]);
+        close(fds[1]);
+        errno = error;
+        snapshot_detail::fail("fork");
+    }
+    if (pid == 0) {
+        close_inherited(fds[1]);
+        save_in_child(map, path, header, snapshot_detail::resolve_threads(threads), fds[1]);
+    }
+    close(fds[1]);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        current.state = BackgroundSaveStatus::State::Running;
+        current.path = path;
+        current.error.clear();
+        current.stats = SnapshotStats();
+        current.id = header.id;
+        current.pid = pid;
+        current.started = std::chrono::system_clock::now();
+    }
+    reaper = std::thread(&BackgroundSaver::reap, this, pid, fds[0]);
+    return true;
+}
+
+
+inline BackgroundSaveStatus BackgroundSaver::status() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return current;
+}
+
+
+inline bool BackgroundSaver::running() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return current.state == BackgroundSaveStatus::State::Running;
+}
+
+
+inline BackgroundSaveStatus BackgroundSaver::wait() {
+    std::unique_lock<std::mutex> guard(lock);
+    finished_save.wait(guard, [this]() { return current.state != BackgroundSaveStatus::State::Running; });
+    return current;
+}
+
+
+inline void BackgroundSaver::reap(pid_t pid, int result_fd) {
+    std::string result;
+    char chunk[256];
+    for (;;) {
+        ssize_t got = read(result_fd, chunk, sizeof(chunk));
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) break;
+        result.append(chunk, static_cast<size_t>(got));
+    }
+    close(result_fd);
+    int exit_status = 0;
+    while (waitpid(pid, &exit_status, 0) < 0 && errno == EINTR) {
+    }
+
+    BackgroundSaveStatus final_status;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        current.finished = std::chrono::system_clock::now();
+        // the child reports 1 + four u64 stats on success, 0 + message on failure
+        const char* cursor = result.data() + 1;
+        const char* end = result.data() + result.size();
+        std::uint64_t segments = 0;
+        std::uint64_t pairs = 0;
+        if (WIFEXITED(exit_status) && WEXITSTATUS(exit_status) == 0 && !result.empty() && result[0] == 1
+            && Serializer<std::uint64_t>::read(cursor, end, segments)
+            && Serializer<std::uint64_t>::read(cursor, end, pairs)
+            && Serializer<std::uint64_t>::read(cursor, end, current.stats.bytes)
+            && Serializer<std::uint64_t>::read(cursor, end, current.stats.raw_bytes)) {
+            current.stats.segments = static_cast<size_t>(segments);
+            current.stats.pairs = static_cast<size_t>(pairs);
+            current.state = BackgroundSaveStatus::State::Succeeded;
+            current.last_success = current.finished;
+        } else {
+            current.state = BackgroundSaveStatus::State::Failed;
+            if (!result.empty() && result[0] == 0) {
+                current.error = result.substr(1);
+            } else if (WIFSIGNALED(exit_status)) {
+                current.error = "save process killed by signal " + std::to_string(WTERMSIG(exit_status));
+            } else {
+                current.error = "save process exited without a result";
+            }
+        }
+        final_status = current;
+    }
+    finished_save.notify_all();
+    if (on_done) on_done(final_status);
+}
+
+
+template <class KeyT, class ValueT>
+void BackgroundSaver::save_in_child(const HashMap<KeyT, ValueT>& map, const std::string& path,
+                                    const SnapshotHeader& header, size_t threads, int result_fd) {
+    std::string result;
+    try {
+        SnapshotStats stats = snapshot_detail::write_map(map, path, header, nullptr, threads);
+        result.push_back(1);
+        Serializer<std::uint64_t>::write(result, stats.segments);
+        Serializer<std::uint64_t>::write(result, stats.pairs);
+        Serializer<std::uint64_t>::write(result, stats.bytes);
+        Serializer<std::uint64_t>::write(result, stats.raw_bytes);
+    } catch (const std::exception& e) {
+        result.assign(1, 0);
+        result.append(e.what());
+    }
+    size_t sent = 0;
+    while (sent < result.size()) {
+        ssize_t written = write(result_fd, result.data() + sent, result.size() - sent);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) break;
+        sent += static_cast<size_t>(written);
+    }
+    // skip the parent's atexit handlers and stdio buffers
+    _exit(result[0] == 1 ? 0 : 1);
+}
+
+
+inline void BackgroundSaver::close_inherited(int keep) {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 34))
+    unsigned first = 3;
+    unsigned kept = static_cast<unsigned>(keep);
+    if ((kept <= first || close_range(first, kept - 1, 0) == 0) && close_range(kept + 1, ~0U, 0) == 0) {
+        return;
+    }
+    // ENOSYS before Linux 5.9, fall back to closing one at a time
+#endif
+    long max = sysconf(_SC_OPEN_MAX);
+    for (long fd = 3; fd < max; fd++) {
+        if (fd != keep) close(static_cast<int>(fd));
+    }
+}
+
+#endif //BACKGROUNDSAVER_HPP
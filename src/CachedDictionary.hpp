@@ -0,0 +1,360 @@
+#ifndef CACHEDDICTIONARY_HPP
+#define CACHEDDICTIONARY_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <functional>
+#include <cstdint>
+
+#include "Dictionary.hpp"
+
+#define READ_CACHE_SLOTS 4096
+#define READ_CACHE_VERSION_SHARDS 256
+
+/*
+* @class CachedDictionary
+* @brief A Dictionary shared between threads behind a reader-writer lock,
+* with an optional per-thread direct-mapped cache of recent lookups in front
+* of it. Every write bumps the version of the key's shard; a cached lookup
+* is served without touching the lock as long as its shard's version hasn't
+* moved since it was cached, so repeat reads of hot keys scale with threads
+* @var dictionary The shared Dictionary, guarded by lock
+* @var versions Write counters, one per shard of the key space
+* @var cache_slots Slots in each thread's cache (a power of 2), 0 if disabled
+* @var id Identifies this dictionary in the threads' cache lists
+* @var alive Expires when the dictionary is destroyed, so threads drop its caches
+* @note With READ_CACHE_VERSION_SHARDS 1 the versions are a single global
+* counter; more shards keep writes to cold keys from invalidating hot ones.
+* A slot that was hit survives one conflicting miss, so a stream of cold
+* keys doesn't flush the hot ones out of the direct-mapped cache
+*/
+class CachedDictionary {
+public:
+
+    /*
+    * @struct CacheStats
+    * @brief Lookups the calling thread served from its cache, and the rest
+    */
+    struct CacheStats {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+    };
+
+    /*
+    * @brief Constructs an empty CachedDictionary
+    * @param cache_slots Entries in each thread's read cache (rounded up to a
+    * power of 2), 0 disables the cache
+    */
+    explicit CachedDictionary(size_t cache_slots = READ_CACHE_SLOTS);
+
+    CachedDictionary(const CachedDictionary&) = delete;
+    CachedDictionary& operator=(const CachedDictionary&) = delete;
+
+    /*
+    * @brief Inserts a (key, value) pair
+    * @param key Key to insert
+    * @param value Value to insert
+    * @return true if insertion was successful, false if the key already exists
+    */
+    bool insert(const std::string& key, const std::string& value);
+
+    /*
+    * @brief Inserts a pair or assigns the value of an existing key
+    * @param key Key to insert or update
+    * @param value Value to insert or assign
+    * @return true if a new pair was inserted, false if a value was assigned
+    */
+    bool insert_or_assign(const std::string& key, const std::string& value);
+
+    /*
+    * @brief Erases a pair with a given key
+    * @param key Key in the pair that should be erased
+    * @return true if erasure was successful
+    * @throws InvalidKey if key does not exist in the dictionary
+    */
+    bool erase(const std::string& key);
+
+    /*
+    * @brief Bulk updates from iterator range of (key, value) pairs under one
+    * lock acquisition, see Dictionary::update()
+    * @param begin Start of update range
+    * @param end End of update range
+    */
+    template <class Iterator>
+    void update(Iterator begin, Iterator end);
+
+    /*
+    * @brief Returns whether a given key is stored, served from the calling
+    * thread's cache when possible
+    * @param key Key to look for
+    * @return true if key exists, false otherwise
+    */
+    bool contains_key(const std::string& key) const;
+
+    /*
+    * @brief Copies out the value of a given key, served from the calling
+    * thread's cache when possible
+    * @param key Key to look up
+    * @param value Set to the key's value when found
+    * @return true if the key exists, false otherwise
+    */
+    bool get(const std::string& key, std::string& value) const;
+
+    /*
+    * @brief Copies out the value of a given key
+    * @param key Key to look up
+    * @return Copy of the value mapped to the key
+    * @throws std::runtime_error if key does not exist
+    */
+    std::string at(const std::string& key) const;
+
+    /*
+    * @brief Returns the number of pairs
+    * @return Number of keys stored
+    */
+    int size() const;
+
+    /*
+    * @brief Returns the calling thread's cache counters for this dictionary
+    * @return Hits and misses since the thread first read from it
+    */
+    CacheStats local_stats() const;
+
+private:
+
+    /*
+    * @struct Version
+    * @brief A shard's write counter on its own cache line
+    */
+    struct alignas(64) Version {
+        std::atomic<std::uint64_t> value{0};
+    };
+
+    /*
+    * @struct Slot
+    * @brief One cached lookup, found (with its value) or missing
+    */
+    struct Slot {
+        std::uint64_t version = 0;
+        std::size_t hash = 0;
+        bool valid = false;
+        bool found = false;
+        bool referenced = false;                // hit since filled, spared by one miss
+        std::string key;
+        std::string value;
+    };
+
+    /*
+    * @struct ReadCache
+    * @brief A thread's direct-mapped cache for one dictionary
+    */
+    struct ReadCache {
+        std::vector<Slot> slots;
+        CacheStats stats;
+    };
+
+    /*
+    * @struct ThreadCaches
+    * @brief The caches a thread holds for every dictionary it read from
+    */
+    struct ThreadCaches {
+        struct Entry {
+            std::uint64_t id;
+            std::weak_ptr<void> alive;
+            std::unique_ptr<ReadCache> cache;
+        };
+        std::vector<Entry> entries;
+    };
+
+    Dictionary dictionary;
+    mutable std::shared_mutex lock;
+    mutable Version versions[READ_CACHE_VERSION_SHARDS];
+    size_t cache_slots;
+    int slot_bits;
+    std::uint64_t id;
+    std::shared_ptr<void> alive;
+
+    /*
+    * @brief Returns the version counter of the shard a hash falls into
+    * @param hash std::hash of the key
+    * @return The shard's version
+    */
+    std::atomic<std::uint64_t>& version_of(std::size_t hash) const;
+
+    /*
+    * @brief Returns the calling thread's cache for this dictionary, creating it on first use
+    * @return The thread's cache
+    */
+    ReadCache& local_cache() const;
+
+    /*
+    * @brief Looks a key up through the calling thread's cache
+    * @param key Key to look up
+    * @param value Set to the key's value when found, may be nullptr
+    * @return true if the key exists, false otherwise
+    */
+    bool lookup(const std::string& key, std::string* value) const;
+};
+
+// ==================== Implementation ====================
+
+inline CachedDictionary::CachedDictionary(size_t cache_slots) :
+    cache_slots(0), slot_bits(0), alive(std::make_shared<int>(0)) {
+    static std::atomic<std::uint64_t> next_id{1};
+    id = next_id.fetch_add(1);
+    if (cache_slots > 0) {
+        this->cache_slots = 1;
+        while (this->cache_slots < cache_slots) {
+            this->cache_slots *= 2;
+            slot_bits++;
+        }
+    }
+}
+
+
+inline bool CachedDictionary::insert(const std::string& key, const std::string& value) {
+    std::size_t hash = std::hash<std::string>()(key);
+    std::unique_lock<std::shared_mutex> guard(lock);
+    if (!dictionary.insert_hashed(key, hash, value)) return false;
+    version_of(hash).fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+
+inline bool CachedDictionary::insert_or_assign(const std::string& key, const std::string& value) {
+    std::size_t hash = std::hash<std::string>()(key);
+    std::unique_lock<std::shared_mutex> guard(lock);
+    bool inserted = dictionary.insert_or_assign_hashed(key, hash, value);
+    version_of(hash).fetch_add(1, std::memory_order_release);
+    return inserted;
+}
+
+
+inline bool CachedDictionary::erase(const std::string& key) {
+    std::size_t hash = std::hash<std::string>()(key);
+    std::unique_lock<std::shared_mutex> guard(lock);
+    bool erased = dictionary.erase(HashedKey<std::string>(key, hash));
+    version_of(hash).fetch_add(1, std::memory_order_release);
+    return erased;
+}
+
+
+template <class Iterator>
+void CachedDictionary::update(Iterator begin, Iterator end) {
+    std::unique_lock<std::shared_mutex> guard(lock);
+    dictionary.update(begin, end);
+    // a bulk write may touch any shard
+    for (auto& version : versions) {
+        version.value.fetch_add(1, std::memory_order_release);
+    }
+}
+
+
+inline bool CachedDictionary::contains_key(const std::string& key) const {
+    return lookup(key, nullptr);
+}
+
+
+inline bool CachedDictionary::get(const std::string& key, std::string& value) const {
+    return lookup(key, &value);
+}
+
+
+inline std::string CachedDictionary::at(const std::string& key) const {
+    std::string value;
+    if (!lookup(key, &value)) throw std::runtime_error("no such key exists!");
+    return value;
+}
+
+
+inline int CachedDictionary::size() const {
+    std::shared_lock<std::shared_mutex> guard(lock);
+    return dictionary.size();
+}
+
+
+inline CachedDictionary::CacheStats CachedDictionary::local_stats() const {
+    if (cache_slots == 0) return CacheStats();
+    return local_cache().stats;
+}
+
+
+inline std::atomic<std::uint64_t>& CachedDictionary::version_of(std::size_t hash) const {
+    std::uint64_t mixed = mix_hash(hash);
+    return versions[(mixed >> 32) % READ_CACHE_VERSION_SHARDS].value;
+}
+
+
+inline CachedDictionary::ReadCache& CachedDictionary::local_cache() const {
+    thread_local ThreadCaches held;
+    for (auto& entry : held.entries) {
+        if (entry.id == id) return *entry.cache;
+    }
+    // drop caches of dictionaries that no longer exist
+    auto& entries = held.entries;
+    for (size_t i = 0; i < entries.size();) {
+        if (entries[i].alive.expired()) {
+            entries[i] = std::move(entries.back());
+            entries.pop_back();
+        } else {
+            i++;
+        }
+    }
+    auto cache = std::make_unique<ReadCache>();
+    cache->slots.resize(cache_slots);
+    entries.push_back(ThreadCaches::Entry{id, alive, std::move(cache)});
+    return *entries.back().cache;
+}
+
+
+inline bool CachedDictionary::lookup(const std::string& key, std::string* value) const {
+    std::size_t hash = std::hash<std::string>()(key);
+    if (cache_slots == 0) {
+        std::shared_lock<std::shared_mutex> guard(lock);
+        const std::string* found = dictionary.find_hashed(key, hash);
+        if (found != nullptr && value != nullptr) *value = *found;
+        return found != nullptr;
+    }
+    std::atomic<std::uint64_t>& version = version_of(hash);
+    ReadCache& cache = local_cache();
+    std::uint64_t mixed = mix_hash(hash);
+    Slot& slot = cache.slots[slot_bits == 0 ? 0 : static_cast<size_t>(mixed >> (64 - slot_bits))];
+    // hit: no write to the key's shard since the slot was filled
+    if (slot.valid && slot.hash == hash && slot.version == version.load(std::memory_order_acquire) &&
+        slot.key == key) {
+        cache.stats.hits++;
+        slot.referenced = true;
+        if (slot.found && value != nullptr) *value = slot.value;
+        return slot.found;
+    }
+    cache.stats.misses++;
+    std::shared_lock<std::shared_mutex> guard(lock);
+    const std::string* found = dictionary.find_hashed(key, hash);
+    if (found != nullptr && value != nullptr) *value = *found;
+    // second chance: a cold key doesn't evict a still-valid entry that was hit
+    if (slot.valid && slot.referenced &&
+        slot.version == version_of(slot.hash).load(std::memory_order_acquire)) {
+        slot.referenced = false;
+        return found != nullptr;
+    }
+    // writers bump versions under the exclusive lock, so this pairs with the value read
+    slot.valid = false;
+    slot.version = version.load(std::memory_order_acquire);
+    slot.hash = hash;
+    slot.key = key;
+    slot.found = (found != nullptr);
+    slot.referenced = false;
+    if (found != nullptr) {
+        slot.value = *found;
+    } else {
+        slot.value.clear();
+    }
+    slot.valid = true;
+    return found != nullptr;
+}
+
+#endif //CACHEDDICTIONARY_HPP
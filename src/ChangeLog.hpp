@@ -0,0 +1,491 @@
+#ifndef CHANGELOG_HPP
+#define CHANGELOG_HPP
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "Dictionary.hpp"
+#include "Crc32.hpp"
+
+#define CHANGE_LOG_HEADER_BYTES 8
+#define CHANGE_LOG_MIN_BODY 21
+#define CHANGE_LOG_MAX_BODY (1u << 30)
+#define CHANGE_LOG_INDEX_EVERY 256
+#define CHANGE_LOG_READ_CHUNK 65536
+#define CHANGE_LOG_COMPACT_BYTES 4096
+
+/*
+* @enum ChangeOp
+* @brief Kind of a logged Dictionary mutation
+*/
+enum class ChangeOp : std::uint8_t { Set = 1, Erase = 2 };
+
+/*
+* @struct ChangeRecord
+* @brief One logged mutation. Sequence numbers start at 1 and have no gaps;
+* the timestamp is the leader's wall clock in milliseconds
+*/
+struct ChangeRecord {
+    std::uint64_t sequence = 0;
+    std::uint64_t timestamp_ms = 0;
+    ChangeOp op = ChangeOp::Set;
+    std::string key;
+    std::string value;              // empty for Erase
+};
+
+/*
+* @class ChangeLogDecoder
+* @brief Incremental decoder of change log frames, fed with bytes read from
+* a log file or received from a leader. A frame is
+* [u32 body length][u32 CRC-32 of body][body], the body being
+* [u64 sequence][u64 timestamp][u8 op][u32 key length][key][value],
+* all integers little-endian
+* @var buffer Bytes fed and not decoded yet (from pos on)
+* @var pos Start of the first undecoded frame in buffer
+* @var consumed Total bytes of the frames decoded so far
+*/
+class ChangeLogDecoder {
+public:
+
+    /*
+    * @brief Appends bytes
+    * @param data Bytes to append
+    * @param length Number of bytes
+    */
+    void feed(const char* data, size_t length);
+
+    /*
+    * @brief Decodes the next complete frame
+    * @param record Set to the decoded record
+    * @return true if a record was decoded, false if more bytes are needed
+    * @throws std::runtime_error if the frame is corrupt
+    */
+    bool next(ChangeRecord& record);
+
+    /*
+    * @brief Returns the number of bytes in the frames decoded so far
+    * @return Decoded byte count, the offset of the next frame in the stream
+    */
+    std::uint64_t decoded_bytes() const;
+
+private:
+    std::string buffer;
+    size_t pos = 0;
+    std::uint64_t consumed = 0;
+};
+
+/*
+* @class ChangeLog
+* @brief Append-only binary log of Dictionary mutations in a file. Appends
+* are buffered and written by flush(), so a batch of mutations costs one
+* write. Opening an existing log recovers its last sequence number and cuts
+* off a torn or corrupt tail left by a crash
+* @var fd The log file, opened for appending
+* @var pending Frames appended and not written yet
+* @var file_size Bytes written to the file
+* @var next_sequence Sequence number of the next append
+* @var flushed_sequence Last sequence number written to the file
+* @var index Offset of every CHANGE_LOG_INDEX_EVERY-th record, for reads
+* from the middle of the log
+*/
+class ChangeLog {
+public:
+
+    /*
+    * @brief Opens (or creates) a log file
+    * @param path Path of the log
+    * @throws std::runtime_error if the file can't be opened
+    */
+    explicit ChangeLog(const std::string& path);
+
+    /*
+    * @brief Writes pending records and closes the file (destructor)
+    */
+    ~ChangeLog();
+
+    ChangeLog(const ChangeLog&) = delete;
+    ChangeLog& operator=(const ChangeLog&) = delete;
+
+    /*
+    * @brief Appends a mutation to the pending batch
+    * @param op Kind of mutation
+    * @param key Key mutated
+    * @param value Value set, ignored for Erase
+    * @return Sequence number of the record
+    * @throws std::invalid_argument if the record is too large (see fits()),
+    * nothing is appended then
+    */
+    std::uint64_t append(ChangeOp op, const std::string& key, const std::string& value = std::string());
+
+    /*
+    * @brief Writes the pending batch to the file
+    * @throws std::runtime_error if the write fails
+    */
+    void flush();
+
+    /*
+    * @brief Writes the pending batch and waits until it is on stable storage
+    * @throws std::runtime_error if the write or the sync fails
+    */
+    void sync();
+
+    /*
+    * @brief Returns the sequence number of the last appended record
+    * @return Last sequence number, 0 if the log is empty
+    */
+    std::uint64_t last_sequence() const;
+
+    /*
+    * @brief Calls a function for every written record after a given sequence number
+    * @param after Sequence number to start after (0 for the whole log)
+    * @param fn Called with each const ChangeRecord&, returns false to stop
+    * @throws std::runtime_error if the file can't be read or is corrupt
+    */
+    template <class Fn>
+    void scan(std::uint64_t after, Fn&& fn) const;
+
+    /*
+    * @brief Encodes the written records after a given sequence number, for shipping
+    * @param after Sequence number to start after
+    * @param max_bytes Stop once out holds this many bytes (at least one record is read)
+    * @param out Encoded frames are appended to it
+    * @return Number of records appended
+    */
+    size_t read_from(std::uint64_t after, size_t max_bytes, std::string& out) const;
+
+    /*
+    * @brief Encodes a record as one frame
+    * @param record Record to encode
+    * @param out The frame is appended to it
+    * @throws std::invalid_argument if the record is too large, out is left as is
+    */
+    static void encode(const ChangeRecord& record, std::string& out);
+
+    /*
+    * @brief Returns whether a mutation fits in one record, whose body is
+    * limited to CHANGE_LOG_MAX_BODY bytes
+    * @param key Key mutated
+    * @param value Value set (empty for Erase)
+    * @return true if it can be appended
+    */
+    static bool fits(const std::string& key, const std::string& value);
+
+    /*
+    * @brief Replays a record on a Dictionary
+    * @param dictionary Dictionary to mutate
+    * @param record Mutation to apply
+    */
+    static void apply(Dictionary& dictionary, const ChangeRecord& record);
+
+private:
+
+    /*
+    * @struct IndexEntry
+    * @brief File offset of a record
+    */
+    struct IndexEntry {
+        std::uint64_t sequence;
+        std::uint64_t offset;
+    };
+
+    int fd;
+    std::string pending;
+    std::uint64_t file_size;
+    std::uint64_t next_sequence;
+    std::uint64_t flushed_sequence;
+    std::vector<IndexEntry> index;
+
+    /*
+    * @brief Adds a record to the index if it starts a new index interval
+    * @param sequence Sequence number of the record
+    * @param offset File offset of the record
+    */
+    void index_record(std::uint64_t sequence, std::uint64_t offset);
+
+    /*
+    * @brief Throws a std::runtime_error naming the failed call and errno
+    * @param what Name of the failed call
+    */
+    [[noreturn]] static void fail(const std::string& what);
+};
+
+// ==================== Implementation ====================
+
+namespace change_log_detail {
+
+inline void put_u32(std::string& out, std::uint32_t value) {
+    for (int i = 0; i < 4; i++) out += static_cast<char>((value >> (8 * i)) & 0xFF);
+}
+
+
+inline void put_u64(std::string& out, std::uint64_t value) {
+    for (int i = 0; i < 8; i++) out += static_cast<char>((value >> (8 * i)) & 0xFF);
+}
+
+
+inline std::uint32_t get_u32(const char* data) {
+    std::uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) value = (value << 8) | static_cast<unsigned char>(data[i]);
+    return value;
+}
+
+
+inline std::uint64_t get_u64(const char* data) {
+    std::uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) value = (value << 8) | static_cast<unsigned char>(data[i]);
+    return value;
+}
+
+} // namespace change_log_detail
+
+
+inline void ChangeLogDecoder::feed(const char* data, size_t length) {
+    // drop decoded bytes once they dominate the buffer
+    if (pos > CHANGE_LOG_COMPACT_BYTES && pos * 2 > buffer.size()) {
+        buffer.erase(0, pos);
+        pos = 0;
+    }
+    buffer.append(data, length);
+}
+
+
+inline bool ChangeLogDecoder::next(ChangeRecord& record) {
+    using namespace change_log_detail;
+    if (buffer.size() - pos < CHANGE_LOG_HEADER_BYTES) return false;
+    const char* header = buffer.data() + pos;
+    std::uint32_t length = get_u32(header);
+    if (length < CHANGE_LOG_MIN_BODY || length > CHANGE_LOG_MAX_BODY) {
+        throw std::runtime_error("change log: invalid record length");
+    }
+    if (buffer.size() - pos - CHANGE_LOG_HEADER_BYTES < length) return false;
+    const char* body = header + CHANGE_LOG_HEADER_BYTES;
+    if (Crc32::of(body, length) != get_u32(header + 4)) {
+        throw std::runtime_error("change log: checksum mismatch");
+    }
+    std::uint32_t key_length = get_u32(body + 17);
+    if (key_length > length - CHANGE_LOG_MIN_BODY) {
+        throw std::runtime_error("change log: invalid key length");
+    }
+    std::uint8_t op = static_cast<std::uint8_t>(body[16]);
+    if (op != static_cast<std::uint8_t>(ChangeOp::Set) && op != static_cast<std::uint8_t>(ChangeOp::Erase)) {
+        throw std::runtime_error("change log: unknown operation");
+    }
+    record.sequence = get_u64(body);
+    record.timestamp_ms = get_u64(body + 8);
+    record.op = static_cast<ChangeOp>(op);
+    record.key.assign(body + CHANGE_LOG_MIN_BODY, key_length);
+    record.value.assign(body + CHANGE_LOG_MIN_BODY + key_length, length - CHANGE_LOG_MIN_BODY - key_length);
+    pos += CHANGE_LOG_HEADER_BYTES + length;
+    consumed += CHANGE_LOG_HEADER_BYTES + length;
+    return true;
+}
+
+
+inline std::uint64_t ChangeLogDecoder::decoded_bytes() const {
+    return consumed;
+}
+
+
+inline ChangeLog::ChangeLog(const std::string& path) :
+    file_size(0), next_sequence(1), flushed_sequence(0) {
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) fail("open " + path);
+    // recover the last sequence number, keeping only the intact prefix
+    ChangeLogDecoder decoder;
+    ChangeRecord record;
+    char chunk[CHANGE_LOG_READ_CHUNK];
+    bool intact = true;
+    for (;;) {
+        ssize_t received = read(fd, chunk, sizeof(chunk));
+        if (received < 0) {
+            if (errno == EINTR) continue;
+            int error = errno;
+            close(fd);
+            errno = error;
+            fail("read " + path);
+        }
+        if (received == 0) break;
+        decoder.feed(chunk, static_cast<size_t>(received));
+        try {
+            for (;;) {
+                std::uint64_t offset = decoder.decoded_bytes();
+                if (!decoder.next(record)) break;
+                if (record.sequence != next_sequence) {
+                    throw std::runtime_error("change log: sequence gap");
+                }
+                index_record(record.sequence, offset);
+                next_sequence++;
+            }
+        } catch (const std::runtime_error&) {
+            intact = false;
+            break;
+        }
+    }
+    file_size = decoder.decoded_bytes();
+    flushed_sequence = next_sequence - 1;
+    if (!intact || lseek(fd, 0, SEEK_END) != static_cast<off_t>(file_size)) {
+        if (ftruncate(fd, static_cast<off_t>(file_size)) < 0) {
+            int error = errno;
+            close(fd);
+            errno = error;
+            fail("ftruncate " + path);
+        }
+    }
+}
+
+
+inline ChangeLog::~ChangeLog() {
+    try {
+        flush();
+    } catch (const std::runtime_error&) {
+        // nothing left to report a failed final write to
+    }
+    close(fd);
+}
+
+
+inline std::uint64_t ChangeLog::append(ChangeOp op, const std::string& key, const std::string& value) {
+    ChangeRecord record;
+    record.sequence = next_sequence;
+    record.timestamp_ms = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    record.op = op;
+    record.key = key;
+    if (op == ChangeOp::Set) record.value = value;
+    std::uint64_t offset = file_size + pending.size();
+    encode(record, pending);
+    index_record(record.sequence, offset);
+    next_sequence++;
+    return record.sequence;
+}
+
+
+inline void ChangeLog::flush() {
+    size_t written = 0;
+    while (written < pending.size()) {
+        ssize_t result = write(fd, pending.data() + written, pending.size() - written);
+        if (result < 0) {
+            if (errno == EINTR) continue;
+            // keep the unwritten tail so a later flush can retry it
+            pending.erase(0, written);
+            file_size += written;
+            fail("write change log");
+        }
+        written += static_cast<size_t>(result);
+    }
+    file_size += pending.size();
+    pending.clear();
+    flushed_sequence = next_sequence - 1;
+}
+
+
+inline void ChangeLog::sync() {
+    flush();
+    if (fdatasync(fd) < 0) fail("fdatasync change log");
+}
+
+
+inline std::uint64_t ChangeLog::last_sequence() const {
+    return next_sequence - 1;
+}
+
+
+template <class Fn>
+void ChangeLog::scan(std::uint64_t after, Fn&& fn) const {
+    if (after >= flushed_sequence) return;
+    // start from the last indexed record at or before the first one wanted
+    auto it = std::upper_bound(index.begin(), index.end(), after + 1,
+        [](std::uint64_t sequence, const IndexEntry& entry) { return sequence < entry.sequence; });
+    std::uint64_t offset = (it == index.begin()) ? 0 : std::prev(it)->offset;
+    ChangeLogDecoder decoder;
+    ChangeRecord record;
+    char chunk[CHANGE_LOG_READ_CHUNK];
+    while (offset < file_size) {
+        size_t wanted = static_cast<size_t>(std::min<std::uint64_t>(sizeof(chunk), file_size - offset));
+        ssize_t received = pread(fd, chunk, wanted, static_cast<off_t>(offset));
+        if (received < 0) {
+            if (errno == EINTR) continue;
+            fail("read change log");
+        }
+        if (received == 0) break;
+        offset += static_cast<std::uint64_t>(received);
+        decoder.feed(chunk, static_cast<size_t>(received));
+        while (decoder.next(record)) {
+            if (record.sequence <= after) continue;
+            if (!fn(static_cast<const ChangeRecord&>(record))) return;
+        }
+    }
+}
+
+
+inline size_t ChangeLog::read_from(std::uint64_t after, size_t max_bytes, std::string& out) const {
+    size_t count = 0;
+    size_t start = out.size();
+    scan(after, [&](const ChangeRecord& record) {
+        encode(record, out);
+        count++;
+        return out.size() - start < max_bytes;
+    });
+    return count;
+}
+
+
+inline void ChangeLog::encode(const ChangeRecord& record, std::string& out) {
+    using namespace change_log_detail;
+    // recovery treats a longer body as corruption and would cut the log there
+    if (!fits(record.key, record.value)) {
+        throw std::invalid_argument("change log: record exceeds CHANGE_LOG_MAX_BODY");
+    }
+    std::uint32_t length = static_cast<std::uint32_t>(CHANGE_LOG_MIN_BODY + record.key.size() + record.value.size());
+    size_t header = out.size();
+    put_u32(out, length);
+    put_u32(out, 0);
+    size_t body = out.size();
+    put_u64(out, record.sequence);
+    put_u64(out, record.timestamp_ms);
+    out += static_cast<char>(record.op);
+    put_u32(out, static_cast<std::uint32_t>(record.key.size()));
+    out += record.key;
+    out += record.value;
+    std::uint32_t crc = Crc32::of(out.data() + body, out.size() - body);
+    for (int i = 0; i < 4; i++) out[header + 4 + i] = static_cast<char>((crc >> (8 * i)) & 0xFF);
+}
+
+
+inline bool ChangeLog::fits(const std::string& key, const std::string& value) {
+    return key.size() <= CHANGE_LOG_MAX_BODY - CHANGE_LOG_MIN_BODY
+        && value.size() <= CHANGE_LOG_MAX_BODY - CHANGE_LOG_MIN_BODY - key.size();
+}
+
+
+inline void ChangeLog::apply(Dictionary& dictionary, const ChangeRecord& record) {
+    std::size_t hash = std::hash<std::string>()(record.key);
+    if (record.op == ChangeOp::Set) {
+        dictionary.insert_or_assign_hashed(record.key, hash, record.value);
+    } else {
+        dictionary.erase_hashed(record.key, hash);
+    }
+}
+
+
+inline void ChangeLog::index_record(std::uint64_t sequence, std::uint64_t offset) {
+    if ((sequence - 1) % CHANGE_LOG_INDEX_EVERY == 0) {
+        index.push_back(IndexEntry{sequence, offset});
+    }
+}
+
+
+inline void ChangeLog::fail(const std::string& what) {
+    throw std::runtime_error(what + " failed: " + std::strerror(errno));
+}
+
+#endif //CHANGELOG_HPP
@@ -0,0 +1,330 @@
+#ifndef CHANGESTREAM_HPP
+#define CHANGESTREAM_HPP
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <limits>
+#include <stdexcept>
+#include <cstdint>
+#include <cstddef>
+
+#include "HashMap.hpp"
+
+#define CHANGE_STREAM_CAPACITY 4096
+
+/*
+* @enum ChangeKind
+* @brief Kind of a captured mutation
+*/
+enum class ChangeKind : std::uint8_t { Insert, Update, Erase, Clear };
+
+/*
+* @enum OverflowPolicy
+* @brief What a writer does when the stream is full: wait for the consumer,
+* discard the new event, or discard the oldest unconsumed one
+*/
+enum class OverflowPolicy : std::uint8_t { Block, Drop, Overwrite };
+
+/*
+* @brief Template parameters:
+* - KeyT   : type of keys (default-constructible)
+* - ValueT : type of values (default-constructible)
+*/
+template <class KeyT, class ValueT>
+
+/*
+* @class ChangeStream
+* @brief Change-data-capture for HashMap and Dictionary: attached with
+* set_mutation_observer(), it copies every insert, update, erase and clear
+* into a bounded ring (cells stamped with positions, as in MpscQueue) that
+* another thread consumes without locking. Writers don't lock either: they
+* claim a position with a CAS on tail. Every event carries a sequence
+* number, position + 1 plus the dropped events before it, so a consumer that
+* sees a gap knows it missed events (Drop and Overwrite policies) and has to
+* resynchronize
+* @var cells Ring of cells, capacity is a power of 2
+* @var mask capacity - 1
+* @var overflow What writers do when the ring is full
+* @var tail Next position writers claim
+* @var head Next position the consumer reads, also advanced by writers
+* evicting the oldest event under the Overwrite policy
+* @var pending_drops Events dropped since the last claimed position, handed
+* to the next writer that claims one
+* @var dropped_events Events discarded by the Drop policy
+* @var overwritten_events Events discarded by the Overwrite policy
+* @var dropped_seen Dropped events counted into the sequence numbers the
+* consumer has handed out (consumer only)
+* @note Several maps (e.g. the stripes of a sharded map) may share one
+* stream; events of one map are in its mutation order. Under the Block
+* policy a writer waits as long as the consumer doesn't pop
+*/
+class ChangeStream : public MutationObserver<KeyT, ValueT> {
+public:
+
+    /*
+    * @struct Event
+    * @brief One captured mutation, key and value are empty when they don't
+    * apply (value of Erase, both of Clear)
+    */
+    struct Event {
+        std::uint64_t sequence = 0;
+        ChangeKind kind = ChangeKind::Insert;
+        KeyT key{};
+        ValueT value{};
+    };
+
+    /*
+    * @brief Constructs an empty stream
+    * @param capacity Maximum number of unconsumed events (rounded up to a power of 2)
+    * @param overflow What writers do when the stream is full
+    * @throws std::invalid_argument if capacity is 0
+    */
+    explicit ChangeStream(size_t capacity = CHANGE_STREAM_CAPACITY,
+                          OverflowPolicy overflow = OverflowPolicy::Block);
+
+    ChangeStream(const ChangeStream&) = delete;
+    ChangeStream& operator=(const ChangeStream&) = delete;
+
+    /*
+    * @brief Takes out the oldest event, consumer thread only
+    * @param event Set to the event
+    * @return true if an event was taken, false if the stream is empty
+    */
+    bool try_pop(Event& event);
+
+    /*
+    * @brief Takes out the available events, consumer thread only
+    * @param fn Called with each Event&, oldest first
+    * @param max Maximum number of events to take
+    * @return Number of events taken
+    */
+    template <class Fn>
+    size_t consume(Fn&& fn, size_t max = std::numeric_limits<size_t>::max());
+
+    /*
+    * @brief Returns the sequence number of the last captured mutation
+    * @return Last sequence number, 0 before the first mutation, exact when
+    * no writer is active
+    */
+    std::uint64_t last_sequence() const;
+
+    /*
+    * @brief Returns the number of events the Drop policy discarded
+    * @return Dropped events
+    */
+    std::uint64_t dropped() const;
+
+    /*
+    * @brief Returns the number of events the Overwrite policy discarded
+    * @return Overwritten events
+    */
+    std::uint64_t overwritten() const;
+
+    /*
+    * @brief Returns an estimate of the number of unconsumed events
+    * @return Number of events, exact when no writer or consumer is active
+    */
+    size_t size_approx() const;
+
+    void on_write(const KeyT& key, const ValueT& value, bool inserted) override;
+    void on_erase(const KeyT& key) override;
+    void on_clear() override;
+
+private:
+
+    /*
+    * @struct Cell
+    * @brief An event slot. stamp == position: free for the writer of that
+    * position, stamp == position + 1: holds its event, and missed is the
+    * number of events dropped just before it
+    */
+    struct Cell {
+        std::atomic<size_t> stamp;
+        std::uint64_t missed;
+        Event event;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    OverflowPolicy overflow;
+    alignas(64) std::atomic<size_t> tail;
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<std::uint64_t> pending_drops;
+    std::atomic<std::uint64_t> dropped_events;
+    std::atomic<std::uint64_t> overwritten_events;
+    alignas(64) std::uint64_t dropped_seen;
+
+    /*
+    * @brief Appends an event according to the overflow policy
+    * @param kind Kind of mutation
+    * @param key Key mutated, nullptr for Clear
+    * @param value Value written, nullptr for Erase and Clear
+    */
+    void publish(ChangeKind kind, const KeyT* key, const ValueT* value);
+
+    /*
+    * @brief Discards the oldest event to free the cell a writer needs
+    * @param position Position the writer wants to claim
+    * @return true if this writer discarded it, false if the consumer took
+    * it first or it isn't published yet (retry)
+    */
+    bool evict(size_t position);
+};
+
+// ==================== Implementation ====================
+
+template <class KeyT, class ValueT>
+ChangeStream<KeyT, ValueT>::ChangeStream(size_t capacity, OverflowPolicy overflow) :
+    overflow(overflow), tail(0), head(0), pending_drops(0), dropped_events(0), overwritten_events(0),
+    dropped_seen(0) {
+    if (capacity == 0) {
+        throw std::invalid_argument("stream capacity must be positive");
+    }
+    size_t rounded = 1;
+    while (rounded < capacity) {
+        rounded *= 2;
+    }
+    cells.reset(new Cell[rounded]);
+    for (size_t i = 0; i < rounded; i++) {
+        cells[i].stamp.store(i, std::memory_order_relaxed);
+    }
+    mask = rounded - 1;
+}
+
+
+template <class KeyT, class ValueT>
+bool ChangeStream<KeyT, ValueT>::try_pop(Event& event) {
+    size_t pos = head.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell& cell = cells[pos & mask];
+        size_t stamp = cell.stamp.load(std::memory_order_acquire);
+        std::intptr_t diff = static_cast<std::intptr_t>(stamp) - static_cast<std::intptr_t>(pos + 1);
+        if (diff < 0) return false;
+        if (diff > 0) {
+            // a writer evicted this event, start over from the new head
+            pos = head.load(std::memory_order_relaxed);
+            continue;
+        }
+        // writers evicting under Overwrite race for the same event
+        if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+            event = std::move(cell.event);
+            // Drop and Overwrite never mix, so evicted events never carry drops
+            dropped_seen += cell.missed;
+            event.sequence = pos + 1 + dropped_seen;
+            cell.stamp.store(pos + mask + 1, std::memory_order_release);
+            return true;
+        }
+    }
+}
+
+
+template <class KeyT, class ValueT>
+template <class Fn>
+size_t ChangeStream<KeyT, ValueT>::consume(Fn&& fn, size_t max) {
+    Event event;
+    size_t count = 0;
+    while (count < max && try_pop(event)) {
+        fn(event);
+        count++;
+    }
+    return count;
+}
+
+
+template <class KeyT, class ValueT>
+std::uint64_t ChangeStream<KeyT, ValueT>::last_sequence() const {
+    return tail.load(std::memory_order_relaxed) + dropped_events.load(std::memory_order_relaxed);
+}
+
+
+template <class KeyT, class ValueT>
+std::uint64_t ChangeStream<KeyT, ValueT>::dropped() const {
+    return dropped_events.load(std::memory_order_relaxed);
+}
+
+
+template <class KeyT, class ValueT>
+std::uint64_t ChangeStream<KeyT, ValueT>::overwritten() const {
+    return overwritten_events.load(std::memory_order_relaxed);
+}
+
+
+template <class KeyT, class ValueT>
+size_t ChangeStream<KeyT, ValueT>::size_approx() const {
+    size_t back = tail.load(std::memory_order_relaxed);
+    size_t front = head.load(std::memory_order_relaxed);
+    return back > front ? back - front : 0;
+}
+
+
+template <class KeyT, class ValueT>
+void ChangeStream<KeyT, ValueT>::on_write(const KeyT& key, const ValueT& value, bool inserted) {
+    publish(inserted ? ChangeKind::Insert : ChangeKind::Update, &key, &value);
+}
+
+
+template <class KeyT, class ValueT>
+void ChangeStream<KeyT, ValueT>::on_erase(const KeyT& key) {
+    publish(ChangeKind::Erase, &key, nullptr);
+}
+
+
+template <class KeyT, class ValueT>
+void ChangeStream<KeyT, ValueT>::on_clear() {
+    publish(ChangeKind::Clear, nullptr, nullptr);
+}
+
+
+template <class KeyT, class ValueT>
+void ChangeStream<KeyT, ValueT>::publish(ChangeKind kind, const KeyT* key, const ValueT* value) {
+    size_t pos = tail.load(std::memory_order_relaxed);
+    for (;;) {
+        size_t stamp = cells[pos & mask].stamp.load(std::memory_order_acquire);
+        std::intptr_t diff = static_cast<std::intptr_t>(stamp) - static_cast<std::intptr_t>(pos);
+        if (diff == 0) {
+            if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            continue;
+        }
+        if (diff > 0) {
+            pos = tail.load(std::memory_order_relaxed);
+            continue;
+        }
+        // a cell stamped below pos still holds the event of the previous lap
+        if (overflow == OverflowPolicy::Drop) {
+            // the next claimed event counts this one into its sequence
+            // number, leaving a gap
+            pending_drops.fetch_add(1, std::memory_order_relaxed);
+            dropped_events.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (overflow == OverflowPolicy::Overwrite && evict(pos)) {
+            overwritten_events.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            std::this_thread::yield();
+        }
+        pos = tail.load(std::memory_order_relaxed);
+    }
+    Cell& cell = cells[pos & mask];
+    cell.missed = pending_drops.exchange(0, std::memory_order_relaxed);
+    cell.event.kind = kind;
+    cell.event.key = key != nullptr ? *key : KeyT();
+    cell.event.value = value != nullptr ? *value : ValueT();
+    cell.stamp.store(pos + 1, std::memory_order_release);
+}
+
+
+template <class KeyT, class ValueT>
+bool ChangeStream<KeyT, ValueT>::evict(size_t position) {
+    size_t oldest = position - (mask + 1);
+    Cell& cell = cells[oldest & mask];
+    if (cell.stamp.load(std::memory_order_acquire) != oldest + 1) return false;
+    // claim the oldest event the way the consumer would, then free its cell
+    if (!head.compare_exchange_strong(oldest, oldest + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+        return false;
+    }
+    cell.stamp.store(position, std::memory_order_release);
+    return true;
+}
+
+#endif //CHANGESTREAM_HPP
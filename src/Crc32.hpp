@@ -0,0 +1,65 @@
+#ifndef CRC32_HPP
+#define CRC32_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+#define CRC32_POLYNOMIAL 0xEDB88320u
+
+/*
+* @class Crc32
+* @brief CRC-32 (IEEE 802.3, the zlib / PNG checksum), table driven
+*/
+class Crc32 {
+public:
+
+    /*
+    * @brief Checksums a byte range, optionally continuing an earlier checksum
+    * @param data Bytes to checksum
+    * @param length Number of bytes
+    * @param crc Checksum of the preceding bytes, 0 to start
+    * @return The checksum of everything so far
+    */
+    static std::uint32_t of(const void* data, size_t length, std::uint32_t crc = 0);
+
+private:
+
+    /*
+    * @brief Returns the byte-at-a-time lookup table, built on first use
+    * @return 256 partial remainders
+    */
+    static const std::uint32_t* table();
+};
+
+// ==================== Implementation ====================
+
+inline std::uint32_t Crc32::of(const void* data, size_t length, std::uint32_t crc) {
+    const std::uint32_t* lookup = table();
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc = lookup[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+
+inline const std::uint32_t* Crc32::table() {
+    struct Table {
+        std::uint32_t entries[256];
+
+        Table() {
+            for (std::uint32_t i = 0; i < 256; i++) {
+                std::uint32_t remainder = i;
+                for (int bit = 0; bit < 8; bit++) {
+                    remainder = (remainder & 1) ? (remainder >> 1) ^ CRC32_POLYNOMIAL : remainder >> 1;
+                }
+                entries[i] = remainder;
+            }
+        }
+    };
+    static const Table built;
+    return built.entries;
+}
+
+#endif //CRC32_HPP
@@ -0,0 +1,460 @@
+#ifndef DELEGATIONHASHMAP_HPP
+#define DELEGATIONHASHMAP_HPP
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <future>
+#include <optional>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "HashMap.hpp"
+#include "MpscQueue.hpp"
+
+#define DELEGATION_QUEUE_CAPACITY 4096
+#define DELEGATION_SPIN_ROUNDS 1024
+#define DELEGATION_IDLE_SLEEP_US 50
+
+/*
+* @brief Template parameters:
+* - KeyT   : type of keys
+* - ValueT : type of values
+*/
+template <class KeyT, class ValueT>
+
+/*
+* @class DelegationHashMap
+* @brief A shard-per-core map: every shard is a private HashMap owned by one
+* thread, and other threads never touch it - they send operations to the owner
+* through a lock-free MPSC queue and get results back through futures.
+* Operations on the same shard can be batched into a single message
+* @var shards Owner state of every shard
+* @var stopping Set when the owners should drain their queues and exit
+*/
+class DelegationHashMap {
+public:
+
+    /*
+    * @brief Starts one owner thread per shard
+    * @param shard_count Number of shards (0 - one per hardware thread)
+    * @param pin_owners Whether to pin owner i to CPU i (best effort, Linux only)
+    */
+    explicit DelegationHashMap(int shard_count = 0, bool pin_owners = false);
+
+    /*
+    * @brief Completes every queued operation and stops the owner threads (destructor)
+    */
+    ~DelegationHashMap();
+
+    DelegationHashMap(const DelegationHashMap&) = delete;
+    DelegationHashMap& operator=(const DelegationHashMap&) = delete;
+
+    /*
+    * @brief Sends an insert to the key's owner
+    * @return Future set to true if inserted, false if the key already existed
+    */
+    std::future<bool> insert(KeyT key, ValueT value);
+
+    /*
+    * @brief Sends an insert-or-assign to the key's owner
+    * @return Future set to true if a new pair was inserted, false if a value was assigned
+    */
+    std::future<bool> insert_or_assign(KeyT key, ValueT value);
+
+    /*
+    * @brief Sends an erase to the key's owner
+    * @return Future set to true if the key was erased, false if it didn't exist
+    */
+    std::future<bool> erase(KeyT key);
+
+    /*
+    * @brief Sends a lookup to the key's owner
+    * @return Future set to a copy of the value, or std::nullopt if the key doesn't exist
+    */
+    std::future<std::optional<ValueT>> get(KeyT key);
+
+    /*
+    * @brief Returns the number of pairs, asking every owner
+    * @return Number of keys stored (blocks until every owner answered)
+    */
+    int size();
+
+    /*
+    * @brief Shard count getter
+    * @return Number of shards (and owner threads)
+    */
+    int shard_count() const;
+
+    // groups operations into one message per shard (defined below)
+    class Batch;
+
+private:
+
+    enum class Op { Insert, InsertOrAssign, Erase, Get, Size };
+
+    /*
+    * @struct Request
+    * @brief One operation, with the promise its result is delivered through
+    */
+    struct Request {
+        Op op;
+        KeyT key;
+        ValueT value;
+        std::size_t hash;
+        std::promise<bool> flag;
+        std::promise<std::optional<ValueT>> found;
+        std::promise<int> count;
+    };
+
+    using Message = std::vector<Request>;
+
+    /*
+    * @struct Shard
+    * @brief A private HashMap, the queue feeding it and its owner thread
+    */
+    struct Shard {
+        HashMap<KeyT, ValueT> map;
+        MpscQueue<Message*> queue{DELEGATION_QUEUE_CAPACITY};
+        std::thread owner;
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<bool> stopping{false};
+
+    /*
+    * @brief Picks the shard owning a hash
+    * @param hash std::hash<KeyT> of the key
+    * @return Index of the owning shard
+    */
+    size_t shard_of(std::size_t hash) const;
+
+    /*
+    * @brief Appends a request to a per-shard message, creating it if needed
+    * @param pending Per-shard messages being assembled
+    * @param op Operation
+    * @param key Key argument
+    * @param value Value argument
+    * @return The appended request
+    */
+    Request& add(std::vector<Message*>& pending, Op op, KeyT&& key, ValueT&& value);
+
+    /*
+    * @brief Hands a message to a shard's owner, waiting while its queue is full
+    * @param shard Index of the shard
+    * @param message Message to send (owned by the receiver afterwards)
+    */
+    void send(size_t shard, Message* message);
+
+    /*
+    * @brief Owner thread body: applies messages until stopped and drained
+    * @param shard Shard owned by this thread
+    */
+    void run(Shard& shard);
+
+    /*
+    * @brief Applies one request to the owner's HashMap and fulfils its promise
+    * @param map The owner's HashMap
+    * @param request Request to apply
+    */
+    static void apply(HashMap<KeyT, ValueT>& map, Request& request);
+};
+
+/*
+* @brief Template parameters:
+* - KeyT   : type of keys
+* - ValueT : type of values
+*/
+template <class KeyT, class ValueT>
+
+/*
+* @class Batch
+* @brief Collects operations and sends them as one message per shard on
+* flush(), amortizing queue traffic for bulk callers. Not thread-safe - use
+* one Batch per thread
+*/
+class DelegationHashMap<KeyT, ValueT>::Batch {
+public:
+
+    /*
+    * @brief Starts an empty batch for a map
+    * @param map Map the operations are sent to
+    */
+    explicit Batch(DelegationHashMap& map);
+
+    /*
+    * @brief Sends whatever is still pending (destructor)
+    */
+    ~Batch();
+
+    Batch(const Batch&) = delete;
+    Batch& operator=(const Batch&) = delete;
+
+    /*
+    * @brief Queues an insert (see DelegationHashMap::insert)
+    */
+    std::future<bool> insert(KeyT key, ValueT value);
+
+    /*
+    * @brief Queues an insert-or-assign (see DelegationHashMap::insert_or_assign)
+    */
+    std::future<bool> insert_or_assign(KeyT key, ValueT value);
+
+    /*
+    * @brief Queues an erase (see DelegationHashMap::erase)
+    */
+    std::future<bool> erase(KeyT key);
+
+    /*
+    * @brief Queues a lookup (see DelegationHashMap::get)
+    */
+    std::future<std::optional<ValueT>> get(KeyT key);
+
+    /*
+    * @brief Sends every queued operation, one message per shard
+    */
+    void flush();
+
+private:
+    DelegationHashMap& map;
+    std::vector<Message*> pending;
+};
+
+// ==================== Implementation ====================
+
+template <class KeyT, class ValueT>
+DelegationHashMap<KeyT, ValueT>::DelegationHashMap(int shard_count, bool pin_owners) {
+    int count = (shard_count > 0) ? shard_count
+        : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    for (int i = 0; i < count; i++) {
+        shards.push_back(std::make_unique<Shard>());
+    }
+    for (int i = 0; i < count; i++) {
+        Shard& shard = *shards[i];
+        shard.owner = std::thread([this, &shard, i, pin_owners]() {
+#ifdef __linux__
+            if (pin_owners) {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(i % std::max(1u, std::thread::hardware_concurrency()), &set);
+                sched_setaffinity(0, sizeof(set), &set);
+            }
+#else
+            (void)i;
+            (void)pin_owners;
+#endif
+            run(shard);
+        });
+    }
+}
+
+
+template <class KeyT, class ValueT>
+DelegationHashMap<KeyT, ValueT>::~DelegationHashMap() {
+    stopping.store(true, std::memory_order_release);
+    for (auto& shard : shards) {
+        shard->owner.join();
+    }
+}
+
+
+template <class KeyT, class ValueT>
+std::future<bool> DelegationHashMap<KeyT, ValueT>::insert(KeyT key, ValueT value) {
+    Batch batch(*this);
+    return batch.insert(std::move(key), std::move(value));
+}
+
+
+template <class KeyT, class ValueT>
+std::future<bool> DelegationHashMap<KeyT, ValueT>::insert_or_assign(KeyT key, ValueT value) {
+    Batch batch(*this);
+    return batch.insert_or_assign(std::move(key), std::move(value));
+}
+
+
+template <class KeyT, class ValueT>
+std::future<bool> DelegationHashMap<KeyT, ValueT>::erase(KeyT key) {
+    Batch batch(*this);
+    return batch.erase(std::move(key));
+}
+
+
+template <class KeyT, class ValueT>
+std::future<std::optional<ValueT>> DelegationHashMap<KeyT, ValueT>::get(KeyT key) {
+    Batch batch(*this);
+    return batch.get(std::move(key));
+}
+
+
+template <class KeyT, class ValueT>
+int DelegationHashMap<KeyT, ValueT>::size() {
+    std::vector<std::future<int>> counts;
+    for (size_t i = 0; i < shards.size(); i++) {
+        auto message = new Message(1);
+        (*message)[0].op = Op::Size;
+        counts.push_back((*message)[0].count.get_future());
+        send(i, message);
+    }
+    int total = 0;
+    for (auto& count : counts) {
+        total += count.get();
+    }
+    return total;
+}
+
+
+template <class KeyT, class ValueT>
+int DelegationHashMap<KeyT, ValueT>::shard_count() const {
+    return static_cast<int>(shards.size());
+}
+
+
+template <class KeyT, class ValueT>
+DelegationHashMap<KeyT, ValueT>::Batch::Batch(DelegationHashMap& map) :
+    map(map), pending(map.shards.size(), nullptr) {}
+
+
+template <class KeyT, class ValueT>
+DelegationHashMap<KeyT, ValueT>::Batch::~Batch() {
+    flush();
+}
+
+
+template <class KeyT, class ValueT>
+std::future<bool> DelegationHashMap<KeyT, ValueT>::Batch::insert(KeyT key, ValueT value) {
+    return map.add(pending, Op::Insert, std::move(key), std::move(value)).flag.get_future();
+}
+
+
+template <class KeyT, class ValueT>
+std::future<bool> DelegationHashMap<KeyT, ValueT>::Batch::insert_or_assign(KeyT key, ValueT value) {
+    return map.add(pending, Op::InsertOrAssign, std::move(key), std::move(value)).flag.get_future();
+}
+
+
+template <class KeyT, class ValueT>
+std::future<bool> DelegationHashMap<KeyT, ValueT>::Batch::erase(KeyT key) {
+    return map.add(pending, Op::Erase, std::move(key), ValueT()).flag.get_future();
+}
+
+
+template <class KeyT, class ValueT>
+std::future<std::optional<ValueT>> DelegationHashMap<KeyT, ValueT>::Batch::get(KeyT key) {
+    return map.add(pending, Op::Get, std::move(key), ValueT()).found.get_future();
+}
+
+
+template <class KeyT, class ValueT>
+void DelegationHashMap<KeyT, ValueT>::Batch::flush() {
+    for (size_t i = 0; i < pending.size(); i++) {
+        if (pending[i] != nullptr) {
+            map.send(i, pending[i]);
+            pending[i] = nullptr;
+        }
+    }
+}
+
+
+template <class KeyT, class ValueT>
+size_t DelegationHashMap<KeyT, ValueT>::shard_of(std::size_t hash) const {
+    // high bits of the scrambled hash, independent of the buckets' low bits
+    std::uint64_t mixed = mix_hash(hash);
+    return static_cast<size_t>((mixed >> 32) % shards.size());
+}
+
+
+template <class KeyT, class ValueT>
+typename DelegationHashMap<KeyT, ValueT>::Request&
+DelegationHashMap<KeyT, ValueT>::add(std::vector<Message*>& pending, Op op,
+                                     KeyT&& key, ValueT&& value) {
+    std::size_t hash = std::hash<KeyT>()(key);
+    size_t shard = shard_of(hash);
+    if (pending[shard] == nullptr) {
+        pending[shard] = new Message();
+    }
+    auto& message = *pending[shard];
+    message.push_back(Request{op, std::move(key), std::move(value), hash, {}, {}, {}});
+    return message.back();
+}
+
+
+template <class KeyT, class ValueT>
+void DelegationHashMap<KeyT, ValueT>::send(size_t shard, Message* message) {
+    while (!shards[shard]->queue.try_push(message)) {
+        std::this_thread::yield();
+    }
+}
+
+
+template <class KeyT, class ValueT>
+void DelegationHashMap<KeyT, ValueT>::run(Shard& shard) {
+    Message* message = nullptr;
+    int idle = 0;
+    for (;;) {
+        if (shard.queue.try_pop(message)) {
+            for (auto& request : *message) {
+                apply(shard.map, request);
+            }
+            delete message;
+            idle = 0;
+            continue;
+        }
+        // stop only once the queue is drained after the stop request
+        if (stopping.load(std::memory_order_acquire) && shard.queue.size_approx() == 0) {
+            return;
+        }
+        // back off from spinning to yielding to short sleeps while idle
+        if (++idle < DELEGATION_SPIN_ROUNDS) {
+            continue;
+        } else if (idle < 2 * DELEGATION_SPIN_ROUNDS) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(DELEGATION_IDLE_SLEEP_US));
+        }
+    }
+}
+
+
+template <class KeyT, class ValueT>
+void DelegationHashMap<KeyT, ValueT>::apply(HashMap<KeyT, ValueT>& map, Request& request) {
+    try {
+        switch (request.op) {
+            case Op::Insert:
+                request.flag.set_value(map.insert_hashed(request.key, request.hash, request.value));
+                break;
+            case Op::InsertOrAssign:
+                request.flag.set_value(map.insert_or_assign_hashed(
+                    std::move(request.key), request.hash, std::move(request.value)));
+                break;
+            case Op::Erase:
+                request.flag.set_value(map.erase_hashed(request.key, request.hash));
+                break;
+            case Op::Get: {
+                const ValueT* found = map.find_hashed(request.key, request.hash);
+                request.found.set_value(found ? std::optional<ValueT>(*found) : std::nullopt);
+                break;
+            }
+            case Op::Size:
+                request.count.set_value(map.size());
+                break;
+        }
+    } catch (...) {
+        // deliver the failure through whichever future the caller holds
+        if (request.op == Op::Get) {
+            request.found.set_exception(std::current_exception());
+        } else if (request.op == Op::Size) {
+            request.count.set_exception(std::current_exception());
+        } else {
+            request.flag.set_exception(std::current_exception());
+        }
+    }
+}
+
+#endif //DELEGATIONHASHMAP_HPP
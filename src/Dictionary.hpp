@@ -4,6 +4,8 @@
 #include <string>
 #include <stdexcept>
 #include <utility>
+#include <iterator>
+#include <type_traits>
 
 #include "HashMap.hpp"
 
@@ -55,6 +57,16 @@ public:
     */
     Dictionary(const Dictionary& dictionary);
 
+    /*
+    * @brief Constructs a Dictionary that takes over another Dictionary's pairs
+    * (move constructor), the other Dictionary is left empty
+    * @param dictionary Dictionary to take the pairs of
+    */
+    Dictionary(Dictionary&& dictionary);
+
+    Dictionary& operator=(const Dictionary&) = default;
+    Dictionary& operator=(Dictionary&&) = default;
+
 //    methods
 
     /*
@@ -65,14 +77,34 @@ public:
     */
     bool erase(const std::string& key) override;
 
+    /*
+    * @brief erase() for a key with a precomputed hash
+    * @throws InvalidKey if key does not exist in Dictionary
+    */
+    bool erase(const HashedKey<std::string>& key) override;
+
     template <class Iterator>
     /*
     * @brief Bulk updates from iterator range of (key, value) pairs,
-    * if pair does not exist - inserts it
+    * if pair does not exist - inserts it. Forward ranges are reserved for
+    * up front, and pairs are moved in when the range yields rvalues
+    * (e.g. std::move_iterator)
     * @param begin Start of update range
     * @param end End of update range
     */
     void update(Iterator begin, Iterator end);
+
+    /*
+    * @brief Bulk updates from another Dictionary, merging bucket by bucket
+    * @param dictionary Dictionary to copy pairs from
+    */
+    void update(const Dictionary& dictionary);
+
+    /*
+    * @brief Bulk updates from another Dictionary, moving its pairs
+    * @param dictionary Dictionary to move pairs from (left empty)
+    */
+    void update(Dictionary&& dictionary);
 };
 
 // ==================== Implementation ====================
@@ -83,6 +115,9 @@ inline Dictionary::Dictionary(std::vector<std::string> keys,
 inline Dictionary::Dictionary(const Dictionary& dictionary) :
     HashMap<std::string, std::string>(dictionary){}
 
+inline Dictionary::Dictionary(Dictionary&& dictionary) :
+    HashMap<std::string, std::string>(std::move(dictionary)){}
+
 inline bool Dictionary::erase(const std::string& key) {
     // validate key exists in Dictionary
     if (!contains_key(key)) {
@@ -92,10 +127,33 @@ inline bool Dictionary::erase(const std::string& key) {
     return HashMap<std::string, std::string>::erase(key);
 }
 
+inline bool Dictionary::erase(const HashedKey<std::string>& key) {
+    // validate key exists in Dictionary
+    if (!contains_key(key)) {
+        throw InvalidKey();
+    }
+    return HashMap<std::string, std::string>::erase(key);
+}
+
+inline void Dictionary::update(const Dictionary& dictionary) {
+    merge(dictionary);
+}
+
+inline void Dictionary::update(Dictionary&& dictionary) {
+    merge(std::move(dictionary));
+}
+
 template <class Iterator>
 void Dictionary::update(Iterator begin, Iterator end) {
-    for (auto i = begin; i != end; i++) {
-        (*this)[i->first] = i->second;
+    // size up front when the range can be measured without consuming it
+    using category = typename std::iterator_traits<Iterator>::iterator_category;
+    if constexpr (std::is_base_of_v<std::forward_iterator_tag, category>) {
+        reserve(size() + static_cast<int>(std::distance(begin, end)));
+    }
+    for (auto i = begin; i != end; ++i) {
+        auto&& pair = *i;
+        insert_or_assign(std::forward<decltype(pair)>(pair).first,
+                         std::forward<decltype(pair)>(pair).second);
     }
 }
 
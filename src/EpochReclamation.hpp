@@ -0,0 +1,336 @@
+#ifndef EPOCHRECLAMATION_HPP
+#define EPOCHRECLAMATION_HPP
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <cstdint>
+#include <stdexcept>
+
+#include "ThreadRecords.hpp"
+
+#define EPOCH_COLLECT_THRESHOLD 64
+
+/*
+* @class EpochDomain
+* @brief Epoch-based memory reclamation for lock-free data structures.
+* Readers pin() the domain while they hold pointers into the structure;
+* writers retire() unlinked objects, which are freed once every thread that
+* could still see them has unpinned (two epoch advances later)
+* @var state Global epoch, thread records and orphaned garbage, shared with
+* exiting threads so they can hand back their records safely
+* @var collect_threshold Retires between two automatic collect() calls
+* @note Each thread gets a record per domain on first use (ThreadRecordRegistry)
+* and gives it back (with its pending garbage) when it exits. Garbage is kept in one
+* batch per epoch, so reclaiming checks one epoch per batch, not per object.
+* One domain can serve any number of structures; see HazardPointers.hpp for
+* the alternative that bounds garbage when readers may stall
+*/
+class EpochDomain {
+private:
+    struct Record;
+
+public:
+
+    /*
+    * @class Guard
+    * @brief Keeps the calling thread pinned while alive (RAII), pins nest
+    */
+    class Guard {
+    public:
+        Guard(Guard&& other) noexcept;
+        ~Guard();
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+        Guard& operator=(Guard&&) = delete;
+    private:
+        friend class EpochDomain;
+        Record* record;
+        explicit Guard(Record* record);
+    };
+
+    /*
+    * @brief Constructs a domain
+    * @param collect_threshold Retires between two automatic collect() calls
+    * @throws std::invalid_argument if collect_threshold is 0
+    */
+    explicit EpochDomain(unsigned collect_threshold = EPOCH_COLLECT_THRESHOLD);
+
+    /*
+    * @brief Frees every retired object, no thread may still be pinned (destructor)
+    */
+    ~EpochDomain();
+
+    EpochDomain(const EpochDomain&) = delete;
+    EpochDomain& operator=(const EpochDomain&) = delete;
+
+    /*
+    * @brief Pins the calling thread to the current epoch
+    * @return Guard that unpins when destroyed
+    */
+    Guard pin();
+
+    /*
+    * @brief Schedules an unlinked object to be deleted once no pinned thread
+    * can reach it
+    * @param object Object to delete
+    */
+    template <class T>
+    void retire(T* object);
+
+    /*
+    * @brief Schedules an unlinked object to be freed with a custom deleter
+    * @param object Object to free
+    * @param deleter Function freeing the object
+    */
+    void retire(void* object, void (*deleter)(void*));
+
+    /*
+    * @brief Tries to advance the epoch and frees what the calling thread
+    * retired at least two epochs ago
+    */
+    void collect();
+
+    /*
+    * @brief Waits until everything the calling thread retired is freed,
+    * must not be called while pinned
+    */
+    void synchronize();
+
+    /*
+    * @brief Returns the number of retired objects not freed yet
+    * @return Pending object count (approximate while other threads retire)
+    */
+    size_t pending() const;
+
+private:
+
+    /*
+    * @struct Retired
+    * @brief An object waiting to be freed and how to free it
+    */
+    struct Retired {
+        void* object;
+        void (*deleter)(void*);
+    };
+
+    /*
+    * @struct Batch
+    * @brief The objects one thread retired during one epoch
+    */
+    struct Batch {
+        std::uint64_t epoch;
+        std::vector<Retired> items;
+    };
+
+    /*
+    * @struct Record
+    * @brief A thread's view of the domain: its pinned epoch and its own garbage
+    */
+    struct Record {
+        std::atomic<std::uint64_t> epoch{0};    // pinned epoch, 0 when not pinned
+        std::atomic<bool> in_use{false};        // owned by a live thread
+        int depth = 0;                          // nesting of pin() calls
+        unsigned retires = 0;                   // retires since the last collect
+        std::deque<Batch> limbo;                // oldest batch first
+        Record* next = nullptr;
+    };
+
+    /*
+    * @struct State
+    * @brief Everything the domain shares with its threads (the records
+    * included), freed with the last owner
+    */
+    struct State : ThreadRecordRegistry<Record, State> {
+        std::atomic<std::uint64_t> epoch{1};
+        std::mutex orphans_lock;
+        std::deque<Batch> orphans;
+        std::atomic<size_t> pending{0};
+
+        /*
+        * @brief Takes the garbage of an exiting thread's record
+        * @param record The record
+        */
+        void release(Record& record);
+    };
+
+    std::shared_ptr<State> state;
+    unsigned collect_threshold;
+
+    /*
+    * @brief Returns the calling thread's record, acquiring one on first use
+    * @return The thread's record in this domain
+    */
+    Record* local_record();
+
+    /*
+    * @brief Frees the batches that were retired at least two epochs ago
+    * @param limbo Batches to free from, oldest first
+    * @param epoch Current global epoch
+    * @return Number of objects freed
+    */
+    static size_t free_old(std::deque<Batch>& limbo, std::uint64_t epoch);
+
+    /*
+    * @brief Frees every object of a list of batches
+    * @param limbo Batches to free
+    */
+    static void free_all(std::deque<Batch>& limbo);
+};
+
+// ==================== Implementation ====================
+
+inline EpochDomain::Guard::Guard(Record* record) : record(record) {}
+
+
+inline EpochDomain::Guard::Guard(Guard&& other) noexcept : record(other.record) {
+    other.record = nullptr;
+}
+
+
+inline EpochDomain::Guard::~Guard() {
+    if (record != nullptr && --record->depth == 0) {
+        record->epoch.store(0, std::memory_order_release);
+    }
+}
+
+
+inline void EpochDomain::State::release(Record& record) {
+    if (record.limbo.empty()) return;
+    std::lock_guard<std::mutex> guard(orphans_lock);
+    for (auto& batch : record.limbo) {
+        orphans.push_back(std::move(batch));
+    }
+    record.limbo.clear();
+}
+
+
+inline EpochDomain::EpochDomain(unsigned collect_threshold) :
+    state(std::make_shared<State>()), collect_threshold(collect_threshold) {
+    if (collect_threshold == 0) {
+        throw std::invalid_argument("collect_threshold must be positive");
+    }
+}
+
+
+inline EpochDomain::~EpochDomain() {
+    std::lock_guard<std::mutex> guard(state->orphans_lock);
+    for (Record* record = state->head(); record != nullptr; record = record->next) {
+        free_all(record->limbo);
+    }
+    free_all(state->orphans);
+}
+
+
+inline EpochDomain::Guard EpochDomain::pin() {
+    Record* record = local_record();
+    if (record->depth++ == 0) {
+        // publish the pinned epoch before reading any shared pointer
+        std::uint64_t epoch = state->epoch.load(std::memory_order_acquire);
+#ifdef RECLAMATION_UNDER_TSAN
+        record->epoch.exchange(epoch, std::memory_order_seq_cst);
+#else
+        record->epoch.store(epoch, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+#endif
+    }
+    return Guard(record);
+}
+
+
+template <class T>
+void EpochDomain::retire(T* object) {
+    retire(object, [](void* p) { delete static_cast<T*>(p); });
+}
+
+
+inline void EpochDomain::retire(void* object, void (*deleter)(void*)) {
+    Record* record = local_record();
+    std::uint64_t epoch = state->epoch.load(std::memory_order_acquire);
+    if (record->limbo.empty() || record->limbo.back().epoch != epoch) {
+        record->limbo.push_back(Batch{epoch, {}});
+    }
+    record->limbo.back().items.push_back(Retired{object, deleter});
+    state->pending.fetch_add(1, std::memory_order_relaxed);
+    if (++record->retires >= collect_threshold) {
+        record->retires = 0;
+        collect();
+    }
+}
+
+
+inline void EpochDomain::collect() {
+#ifdef RECLAMATION_UNDER_TSAN
+    std::uint64_t epoch = state->epoch.fetch_add(0, std::memory_order_seq_cst);
+#else
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::uint64_t epoch = state->epoch.load(std::memory_order_acquire);
+#endif
+    // the epoch can only advance once every pinned thread has seen it
+    bool caught_up = true;
+    for (Record* r = state->head(); r != nullptr; r = r->next) {
+        std::uint64_t pinned = r->epoch.load(std::memory_order_acquire);
+        if (pinned != 0 && pinned != epoch) {
+            caught_up = false;
+            break;
+        }
+    }
+    if (caught_up && state->epoch.compare_exchange_strong(epoch, epoch + 1)) {
+        epoch++;
+    }
+    size_t freed = free_old(local_record()->limbo, epoch);
+    std::unique_lock<std::mutex> guard(state->orphans_lock, std::try_to_lock);
+    if (guard.owns_lock() && !state->orphans.empty()) {
+        freed += free_old(state->orphans, epoch);
+    }
+    state->pending.fetch_sub(freed, std::memory_order_relaxed);
+}
+
+
+inline void EpochDomain::synchronize() {
+    Record* record = local_record();
+    collect();
+    while (!record->limbo.empty()) {
+        std::this_thread::yield();
+        collect();
+    }
+}
+
+
+inline size_t EpochDomain::pending() const {
+    return state->pending.load(std::memory_order_relaxed);
+}
+
+
+inline EpochDomain::Record* EpochDomain::local_record() {
+    return State::local(state);
+}
+
+
+inline size_t EpochDomain::free_old(std::deque<Batch>& limbo, std::uint64_t epoch) {
+    // a batch retired in epoch e is unreachable to everyone once epoch e + 2 starts
+    size_t freed = 0;
+    while (!limbo.empty() && limbo.front().epoch + 2 <= epoch) {
+        for (auto& retired : limbo.front().items) {
+            retired.deleter(retired.object);
+        }
+        freed += limbo.front().items.size();
+        limbo.pop_front();
+    }
+    return freed;
+}
+
+
+inline void EpochDomain::free_all(std::deque<Batch>& limbo) {
+    for (auto& batch : limbo) {
+        for (auto& retired : batch.items) {
+            retired.deleter(retired.object);
+        }
+    }
+    limbo.clear();
+}
+
+#endif //EPOCHRECLAMATION_HPP
@@ -0,0 +1,277 @@
+#ifndef FLATCOMBININGHASHMAP_HPP
+#define FLATCOMBININGHASHMAP_HPP
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <stdexcept>
+#include <exception>
+
+#include "HashMap.hpp"
+
+#define FC_SLOTS 128
+
+/*
+* @brief Template parameters:
+* - KeyT   : type of keys
+* - ValueT : type of values
+*/
+template <class KeyT, class ValueT>
+
+/*
+* @class FlatCombiningHashMap
+* @brief A thread-safe HashMap using flat combining: each thread publishes its
+* operation in a slot, and whichever thread takes the combiner lock applies
+* every pending operation to the underlying HashMap in one pass, so one lock
+* acquisition (and one cache-hot HashMap) serves a whole batch of threads
+* @var slots Publication slots, one per in-flight operation
+* @var combiner Lock held by the thread currently applying operations
+* @var map The underlying HashMap, only touched by the combiner
+* @var slots_used One past the highest slot ever claimed, bounds the combiner's scan
+*/
+class FlatCombiningHashMap {
+public:
+
+    /*
+    * @brief Constructs an empty FlatCombiningHashMap (default constructor)
+    */
+    FlatCombiningHashMap() = default;
+
+    FlatCombiningHashMap(const FlatCombiningHashMap&) = delete;
+    FlatCombiningHashMap& operator=(const FlatCombiningHashMap&) = delete;
+
+    /*
+    * @brief Inserts a (key, value) pair
+    * @param key Key to insert
+    * @param value Value to insert
+    * @return true if insertion was successful, false if the key already exists
+    */
+    bool insert(const KeyT& key, const ValueT& value);
+
+    /*
+    * @brief Inserts a pair or assigns the value of an existing key
+    * @param key Key to insert or update
+    * @param value Value to insert or assign
+    * @return true if a new pair was inserted, false if a value was assigned
+    */
+    bool insert_or_assign(const KeyT& key, const ValueT& value);
+
+    /*
+    * @brief Returns whether a given key is stored in the map
+    * @param key Key to look for
+    * @return true if key exists, false otherwise
+    */
+    bool contains_key(const KeyT& key);
+
+    /*
+    * @brief Copies out the value of a given key
+    * @param key Key to look up
+    * @param value Set to the key's value when found
+    * @return true if the key exists, false otherwise
+    */
+    bool get(const KeyT& key, ValueT& value);
+
+    /*
+    * @brief Copies out the value of a given key
+    * @param key Key to look up
+    * @return Copy of the value mapped to the key
+    * @throws std::runtime_error if key does not exist
+    */
+    ValueT at(const KeyT& key);
+
+    /*
+    * @brief Erases a pair with a given key
+    * @param key Key in the pair that should be erased
+    * @return true if erasure was successful, false otherwise
+    */
+    bool erase(const KeyT& key);
+
+    /*
+    * @brief Returns the number of pairs
+    * @return Number of keys stored
+    */
+    int size();
+
+private:
+
+    enum class Op { Insert, InsertOrAssign, Contains, Get, Erase };
+
+    enum SlotState { Free, Claimed, Pending, Done };
+
+    /*
+    * @struct Slot
+    * @brief A published operation with its arguments and result, on its own
+    * cache line so publishing threads don't interfere with each other
+    */
+    struct alignas(64) Slot {
+        std::atomic<int> state{Free};
+        Op op = Op::Contains;
+        const KeyT* key = nullptr;
+        const ValueT* value = nullptr;
+        ValueT* out = nullptr;
+        bool result = false;
+        std::exception_ptr error;
+    };
+
+    Slot slots[FC_SLOTS];
+    std::atomic<size_t> slots_used{0};
+    std::mutex combiner;
+    HashMap<KeyT, ValueT> map;
+
+    /*
+    * @brief Publishes an operation and waits until some combiner applied it
+    * @param op Operation to perform
+    * @param key Key argument
+    * @param value Value argument (insert operations), may be nullptr
+    * @param out Where Get copies the value to, may be nullptr
+    * @return Result of the operation
+    */
+    bool execute(Op op, const KeyT& key, const ValueT* value, ValueT* out);
+
+    /*
+    * @brief Applies every pending operation (called with the combiner lock held)
+    */
+    void combine();
+
+    /*
+    * @brief Applies one operation to the underlying HashMap
+    * @param slot Slot holding the operation
+    */
+    void apply(Slot& slot);
+};
+
+// ==================== Implementation ====================
+
+template <class KeyT, class ValueT>
+bool FlatCombiningHashMap<KeyT, ValueT>::insert(const KeyT& key, const ValueT& value) {
+    return execute(Op::Insert, key, &value, nullptr);
+}
+
+
+template <class KeyT, class ValueT>
+bool FlatCombiningHashMap<KeyT, ValueT>::insert_or_assign(const KeyT& key, const ValueT& value) {
+    return execute(Op::InsertOrAssign, key, &value, nullptr);
+}
+
+
+template <class KeyT, class ValueT>
+bool FlatCombiningHashMap<KeyT, ValueT>::contains_key(const KeyT& key) {
+    return execute(Op::Contains, key, nullptr, nullptr);
+}
+
+
+template <class KeyT, class ValueT>
+bool FlatCombiningHashMap<KeyT, ValueT>::get(const KeyT& key, ValueT& value) {
+    return execute(Op::Get, key, nullptr, &value);
+}
+
+
+template <class KeyT, class ValueT>
+ValueT FlatCombiningHashMap<KeyT, ValueT>::at(const KeyT& key) {
+    ValueT value;
+    if (!get(key, value)) throw std::runtime_error("no such key exists!");
+    return value;
+}
+
+
+template <class KeyT, class ValueT>
+bool FlatCombiningHashMap<KeyT, ValueT>::erase(const KeyT& key) {
+    return execute(Op::Erase, key, nullptr, nullptr);
+}
+
+
+template <class KeyT, class ValueT>
+int FlatCombiningHashMap<KeyT, ValueT>::size() {
+    std::lock_guard<std::mutex> guard(combiner);
+    return map.size();
+}
+
+
+template <class KeyT, class ValueT>
+bool FlatCombiningHashMap<KeyT, ValueT>::execute(Op op, const KeyT& key,
+                                                 const ValueT* value, ValueT* out) {
+    // claim a free slot, starting from the one this thread used last time
+    thread_local size_t hint = 0;
+    Slot* slot = nullptr;
+    for (size_t i = hint; slot == nullptr; i = (i + 1) % FC_SLOTS) {
+        int expected = Free;
+        if (slots[i].state.load(std::memory_order_relaxed) == Free &&
+            slots[i].state.compare_exchange_strong(expected, Claimed,
+                                                   std::memory_order_acquire)) {
+            slot = &slots[i];
+            hint = i;
+        } else if ((i + 1) % FC_SLOTS == hint) {
+            std::this_thread::yield();
+        }
+    }
+    size_t used = slots_used.load(std::memory_order_relaxed);
+    while (used <= hint && !slots_used.compare_exchange_weak(used, hint + 1)) {
+    }
+    slot->op = op;
+    slot->key = &key;
+    slot->value = value;
+    slot->out = out;
+    slot->state.store(Pending, std::memory_order_release);
+    // either become the combiner or wait for the current one to serve us
+    while (slot->state.load(std::memory_order_acquire) != Done) {
+        if (combiner.try_lock()) {
+            combine();
+            combiner.unlock();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    bool result = slot->result;
+    std::exception_ptr error = slot->error;
+    slot->error = nullptr;
+    slot->state.store(Free, std::memory_order_release);
+    if (error) std::rethrow_exception(error);
+    return result;
+}
+
+
+template <class KeyT, class ValueT>
+void FlatCombiningHashMap<KeyT, ValueT>::combine() {
+    size_t used = slots_used.load(std::memory_order_acquire);
+    for (size_t i = 0; i < used; i++) {
+        Slot& slot = slots[i];
+        if (slot.state.load(std::memory_order_acquire) == Pending) {
+            // a failing operation is reported to its own thread, not the combiner
+            try {
+                apply(slot);
+            } catch (...) {
+                slot.error = std::current_exception();
+            }
+            slot.state.store(Done, std::memory_order_release);
+        }
+    }
+}
+
+
+template <class KeyT, class ValueT>
+void FlatCombiningHashMap<KeyT, ValueT>::apply(Slot& slot) {
+    const KeyT& key = *slot.key;
+    switch (slot.op) {
+        case Op::Insert:
+            slot.result = map.insert(key, *slot.value);
+            break;
+        case Op::InsertOrAssign:
+            slot.result = map.insert_or_assign(key, *slot.value);
+            break;
+        case Op::Contains:
+            slot.result = map.contains_key(key);
+            break;
+        case Op::Get: {
+            const ValueT* found = map.find_hashed(key, std::hash<KeyT>()(key));
+            slot.result = (found != nullptr);
+            if (found != nullptr) *slot.out = *found;
+            break;
+        }
+        case Op::Erase:
+            slot.result = map.erase(key);
+            break;
+    }
+}
+
+#endif //FLATCOMBININGHASHMAP_HPP
@@ -0,0 +1,306 @@
+#ifndef HASHAGGREGATE_HPP
+#define HASHAGGREGATE_HPP
+
+#include <vector>
+#include <functional>
+#include <thread>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+#include "HashMap.hpp"
+
+#define AGGREGATE_PARTITION_BITS 6
+#define AGGREGATE_PARALLEL_THRESHOLD 65536
+
+// ==================== Aggregate states ====================
+// An aggregate state is default-constructible (the empty aggregate) and has
+// update(value) to fold in one row and merge(state) to combine two partials
+
+/*
+* @class SumState
+* @brief Running sum of the values
+* @var value Sum so far
+*/
+template <class T>
+struct SumState {
+    T value = T();
+    void update(const T& v) { value += v; }
+    void merge(const SumState& other) { value += other.value; }
+};
+
+/*
+* @class CountState
+* @brief Number of rows
+* @var value Count so far
+*/
+struct CountState {
+    long long value = 0;
+    template <class T>
+    void update(const T&) { value++; }
+    void merge(const CountState& other) { value += other.value; }
+};
+
+/*
+* @class MinState
+* @brief Smallest value seen
+* @var value Minimum so far (meaningful only when seen is true)
+* @var seen Whether any row was folded in
+*/
+template <class T>
+struct MinState {
+    T value = T();
+    bool seen = false;
+    void update(const T& v) {
+        if (!seen || v < value) value = v;
+        seen = true;
+    }
+    void merge(const MinState& other) {
+        if (other.seen) update(other.value);
+    }
+};
+
+/*
+* @class MaxState
+* @brief Largest value seen
+* @var value Maximum so far (meaningful only when seen is true)
+* @var seen Whether any row was folded in
+*/
+template <class T>
+struct MaxState {
+    T value = T();
+    bool seen = false;
+    void update(const T& v) {
+        if (!seen || value < v) value = v;
+        seen = true;
+    }
+    void merge(const MaxState& other) {
+        if (other.seen) update(other.value);
+    }
+};
+
+/*
+* @brief Template parameters:
+* - KeyT     : type of the group-by key
+* - AggState : aggregate state kept per key (e.g. SumState<double>)
+*/
+template <class KeyT, class AggState>
+
+/*
+* @class HashAggregate
+* @brief A group-by operator: folds key/value columns into one AggState per
+* key, with a single HashMap probe per row
+* @var partitions Final per-key states, radix-partitioned by high hash bits
+* @var thread_count Number of threads used for large inputs
+* @note Large inputs are split across threads, each filling its own
+* partitioned partial tables; partition p of every thread is then merged
+* into partitions[p] by one thread, so the merge needs no locking
+*/
+class HashAggregate {
+public:
+
+    /*
+    * @brief Constructs an empty aggregation
+    * @param threads Number of threads for large inputs (0 - one per hardware thread)
+    */
+    explicit HashAggregate(int threads = 0);
+
+    /*
+    * @brief Folds a span of rows into the per-key states
+    * @param keys Pointer to the first key
+    * @param values Pointer to the first value (values[i] belongs to keys[i])
+    * @param count Number of rows
+    */
+    template <class ValueT>
+    void update(const KeyT* keys, const ValueT* values, size_t count);
+
+    /*
+    * @brief update() from key and value vectors
+    * @throws std::runtime_error if the vector sizes don't match
+    */
+    template <class ValueT>
+    void update(const std::vector<KeyT>& keys, const std::vector<ValueT>& values);
+
+    /*
+    * @brief Looks up the state of a key
+    * @param key Key to look for
+    * @return Pointer to the key's state, nullptr if no row had that key
+    */
+    const AggState* find(const KeyT& key) const;
+
+    /*
+    * @brief Returns the number of distinct keys
+    * @return Number of groups
+    */
+    size_t size() const;
+
+    /*
+    * @brief Calls fn(key, state) for every group
+    * @param fn Callable taking (const KeyT&, const AggState&)
+    */
+    template <class Fn>
+    void for_each(Fn fn) const;
+
+    /*
+    * @brief Collects all groups into a single HashMap
+    * @return HashMap from key to its state
+    */
+    HashMap<KeyT, AggState> result() const;
+
+    /*
+    * @brief Removes all groups
+    */
+    void clear();
+
+private:
+    std::vector<HashMap<KeyT, AggState>> partitions;
+    int thread_count;
+
+    /*
+    * @brief Maps a key's hash to its radix partition
+    * @param hash std::hash<KeyT> of the key
+    * @return Index of the partition
+    */
+    static size_t partition_of(std::size_t hash);
+
+    /*
+    * @brief Folds rows into a set of partitioned tables on the calling thread
+    * @param tables Partitioned tables to update
+    * @param keys Pointer to the first key
+    * @param values Pointer to the first value
+    * @param count Number of rows
+    */
+    template <class ValueT>
+    static void fold(std::vector<HashMap<KeyT, AggState>>& tables,
+                     const KeyT* keys, const ValueT* values, size_t count);
+};
+
+// ==================== Implementation ====================
+
+template <class KeyT, class AggState>
+HashAggregate<KeyT, AggState>::HashAggregate(int threads) :
+    partitions(size_t(1) << AGGREGATE_PARTITION_BITS) {
+    thread_count = (threads > 0) ? threads
+        : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+}
+
+
+template <class KeyT, class AggState>
+template <class ValueT>
+void HashAggregate<KeyT, AggState>::update(const KeyT* keys, const ValueT* values,
+                                           size_t count) {
+    if (count < AGGREGATE_PARALLEL_THRESHOLD || thread_count == 1) {
+        fold(partitions, keys, values, count);
+        return;
+    }
+    // phase 1: every thread folds its slice into private partitioned tables
+    size_t threads = static_cast<size_t>(thread_count);
+    std::vector<std::vector<HashMap<KeyT, AggState>>> partials(threads);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        size_t begin = count * t / threads;
+        size_t end = count * (t + 1) / threads;
+        workers.emplace_back([&, t, begin, end]() {
+            partials[t].resize(partitions.size());
+            fold(partials[t], keys + begin, values + begin, end - begin);
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    workers.clear();
+    // phase 2: partition p of every partial is merged by a single thread
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            std::hash<KeyT> hash_key;
+            for (size_t p = t; p < partitions.size(); p += threads) {
+                for (const auto& partial : partials) {
+                    for (const auto& [key, state] : partial[p]) {
+                        partitions[p].get_or_insert_hashed(key, hash_key(key)).merge(state);
+                    }
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+}
+
+
+template <class KeyT, class AggState>
+template <class ValueT>
+void HashAggregate<KeyT, AggState>::update(const std::vector<KeyT>& keys,
+                                           const std::vector<ValueT>& values) {
+    if (keys.size() != values.size()) {
+        throw std::runtime_error("vector sizes don't match!");
+    }
+    update(keys.data(), values.data(), keys.size());
+}
+
+
+template <class KeyT, class AggState>
+const AggState* HashAggregate<KeyT, AggState>::find(const KeyT& key) const {
+    std::size_t hash = std::hash<KeyT>()(key);
+    return partitions[partition_of(hash)].find_hashed(key, hash);
+}
+
+
+template <class KeyT, class AggState>
+size_t HashAggregate<KeyT, AggState>::size() const {
+    size_t groups = 0;
+    for (const auto& table : partitions) {
+        groups += table.size();
+    }
+    return groups;
+}
+
+
+template <class KeyT, class AggState>
+template <class Fn>
+void HashAggregate<KeyT, AggState>::for_each(Fn fn) const {
+    for (const auto& table : partitions) {
+        for (const auto& [key, state] : table) {
+            fn(key, state);
+        }
+    }
+}
+
+
+template <class KeyT, class AggState>
+HashMap<KeyT, AggState> HashAggregate<KeyT, AggState>::result() const {
+    HashMap<KeyT, AggState> groups;
+    groups.reserve(static_cast<int>(size()));
+    for_each([&groups](const KeyT& key, const AggState& state) {
+        groups.insert(key, state);
+    });
+    return groups;
+}
+
+
+template <class KeyT, class AggState>
+void HashAggregate<KeyT, AggState>::clear() {
+    for (auto& table : partitions) {
+        table.clear();
+    }
+}
+
+
+template <class KeyT, class AggState>
+size_t HashAggregate<KeyT, AggState>::partition_of(std::size_t hash) {
+    // high bits of the scrambled hash, so identity hashes (integers) spread too
+    std::uint64_t mixed = mix_hash(hash);
+    return static_cast<size_t>(mixed >> (64 - AGGREGATE_PARTITION_BITS));
+}
+
+
+template <class KeyT, class AggState>
+template <class ValueT>
+void HashAggregate<KeyT, AggState>::fold(std::vector<HashMap<KeyT, AggState>>& tables,
+                                         const KeyT* keys, const ValueT* values,
+                                         size_t count) {
+    std::hash<KeyT> hash_key;
+    for (size_t i = 0; i < count; i++) {
+        std::size_t hash = hash_key(keys[i]);
+        // single probe: find the state or default-insert it, then fold in place
+        tables[partition_of(hash)].get_or_insert_hashed(keys[i], hash).update(values[i]);
+    }
+}
+
+#endif //HASHAGGREGATE_HPP
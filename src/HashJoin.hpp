@@ -0,0 +1,243 @@
+#ifndef HASHJOIN_HPP
+#define HASHJOIN_HPP
+
+#include <vector>
+#include <utility>
+#include <functional>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+
+#include "HashMap.hpp"
+
+#define HASH_JOIN_BATCH 64
+#define HASH_JOIN_CACHE_BYTES (1 << 20)
+#define HASH_JOIN_MAX_PARTITION_BITS 10
+
+/*
+* @brief Template parameters:
+* - KeyT     : type of the join key
+* - BuildRow : type of the rows on the build side
+* - ProbeRow : type of the rows on the probe side
+*/
+template <class KeyT, class BuildRow, class ProbeRow>
+
+/*
+* @class HashJoin
+* @brief An equi-join operator: builds a HashMap-backed multimap over the
+* build-side rows, then probes it with probe-side rows in batches
+* (hash the batch, prefetch bucket headers then their pairs, compare, emit
+* matching row indices)
+* @var tables One HashMap per radix partition, mapping a key to the first
+* build row holding it
+* @var next_row For every build row, the next build row with the same key
+* (NO_ROW ends the chain)
+* @var partition_bits Number of high hash bits selecting the partition
+* @var rows_built Number of build rows
+* @note Build inputs larger than HASH_JOIN_CACHE_BYTES are radix-partitioned
+* by high hash bits first, so each partition's table is built cache-resident
+*/
+class HashJoin {
+public:
+
+    // row index that marks the end of a chain of build rows
+    static constexpr size_t NO_ROW = std::numeric_limits<size_t>::max();
+
+    /*
+    * @brief Constructs an empty join (default constructor)
+    */
+    HashJoin();
+
+    /*
+    * @brief Builds the multimap from a span of build-side rows,
+    * replacing anything built before
+    * @param rows Pointer to the first build row
+    * @param count Number of build rows
+    * @param key_of Callable returning the join key of a BuildRow
+    */
+    template <class KeyOf>
+    void build(const BuildRow* rows, size_t count, KeyOf key_of);
+
+    /*
+    * @brief build() from a vector of build-side rows
+    */
+    template <class KeyOf>
+    void build(const std::vector<BuildRow>& rows, KeyOf key_of);
+
+    /*
+    * @brief Probes the built multimap with a span of probe-side rows
+    * @param rows Pointer to the first probe row
+    * @param count Number of probe rows
+    * @param key_of Callable returning the join key of a ProbeRow
+    * @param matches Vector to append (build row index, probe row index) pairs to,
+    * build rows of one probe row are emitted in ascending order
+    */
+    template <class KeyOf>
+    void probe(const ProbeRow* rows, size_t count, KeyOf key_of,
+               std::vector<std::pair<size_t, size_t>>& matches) const;
+
+    /*
+    * @brief probe() from a vector of probe-side rows
+    * @return Vector of (build row index, probe row index) pairs
+    */
+    template <class KeyOf>
+    std::vector<std::pair<size_t, size_t>> probe(const std::vector<ProbeRow>& rows,
+                                                 KeyOf key_of) const;
+
+    /*
+    * @brief Build size getter
+    * @return Number of build rows in the multimap
+    */
+    size_t build_size() const;
+
+    /*
+    * @brief Partition count getter
+    * @return Number of radix partitions the build side was split into
+    */
+    size_t partitions() const;
+
+private:
+    std::vector<HashMap<KeyT, size_t>> tables;
+    std::vector<size_t> next_row;
+    int partition_bits;
+    size_t rows_built;
+
+    /*
+    * @brief Maps a key's hash to its radix partition
+    * @param hash std::hash<KeyT> of the key
+    * @return Index of the partition
+    */
+    size_t partition_of(std::size_t hash) const;
+};
+
+// ==================== Implementation ====================
+
+template <class KeyT, class BuildRow, class ProbeRow>
+HashJoin<KeyT, BuildRow, ProbeRow>::HashJoin() :
+    tables(1), partition_bits(0), rows_built(0) {}
+
+
+template <class KeyT, class BuildRow, class ProbeRow>
+template <class KeyOf>
+void HashJoin<KeyT, BuildRow, ProbeRow>::build(const BuildRow* rows, size_t count,
+                                               KeyOf key_of) {
+    // pick enough partitions for each one's table to fit in cache
+    size_t bytes = count * (sizeof(std::pair<KeyT, size_t>) + 2 * sizeof(size_t));
+    partition_bits = 0;
+    while ((bytes >> partition_bits) > HASH_JOIN_CACHE_BYTES &&
+           partition_bits < HASH_JOIN_MAX_PARTITION_BITS) {
+        partition_bits++;
+    }
+    size_t partition_count = size_t(1) << partition_bits;
+    tables.assign(partition_count, HashMap<KeyT, size_t>());
+    next_row.assign(count, NO_ROW);
+    rows_built = count;
+
+    // hash every key once and count rows per partition
+    std::hash<KeyT> hash_key;
+    std::vector<std::size_t> hashes(count);
+    std::vector<size_t> offsets(partition_count + 1, 0);
+    for (size_t i = 0; i < count; i++) {
+        hashes[i] = hash_key(key_of(rows[i]));
+        offsets[partition_of(hashes[i]) + 1]++;
+    }
+    for (size_t p = 0; p < partition_count; p++) {
+        offsets[p + 1] += offsets[p];
+    }
+    // scatter row indices into partition order (stable within a partition)
+    std::vector<size_t> order(count);
+    std::vector<size_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < count; i++) {
+        order[cursor[partition_of(hashes[i])]++] = i;
+    }
+    // build each partition's table in one pass over its rows, walking them
+    // backwards so every chain lists its build rows in ascending order
+    for (size_t p = 0; p < partition_count; p++) {
+        auto& table = tables[p];
+        table.reserve(static_cast<int>(offsets[p + 1] - offsets[p]));
+        for (size_t j = offsets[p + 1]; j > offsets[p]; j--) {
+            size_t row = order[j - 1];
+            const KeyT& key = key_of(rows[row]);
+            size_t* head = table.find_hashed(key, hashes[row]);
+            if (head != nullptr) {
+                next_row[row] = *head;
+                *head = row;
+            } else {
+                table.insert_hashed(key, hashes[row], row);
+            }
+        }
+    }
+}
+
+
+template <class KeyT, class BuildRow, class ProbeRow>
+template <class KeyOf>
+void HashJoin<KeyT, BuildRow, ProbeRow>::build(const std::vector<BuildRow>& rows,
+                                               KeyOf key_of) {
+    build(rows.data(), rows.size(), key_of);
+}
+
+
+template <class KeyT, class BuildRow, class ProbeRow>
+template <class KeyOf>
+void HashJoin<KeyT, BuildRow, ProbeRow>::probe(const ProbeRow* rows, size_t count,
+                                               KeyOf key_of,
+                                               std::vector<std::pair<size_t, size_t>>& matches) const {
+    std::hash<KeyT> hash_key;
+    std::size_t hashes[HASH_JOIN_BATCH];
+    for (size_t start = 0; start < count; start += HASH_JOIN_BATCH) {
+        size_t batch = std::min<size_t>(HASH_JOIN_BATCH, count - start);
+        // hash the batch and prefetch the bucket headers it will touch
+        for (size_t i = 0; i < batch; i++) {
+            hashes[i] = hash_key(key_of(rows[start + i]));
+            tables[partition_of(hashes[i])].prefetch_hashed(hashes[i]);
+        }
+        // the headers are in by now, prefetch the pairs they point to
+        for (size_t i = 0; i < batch; i++) {
+            tables[partition_of(hashes[i])].prefetch_pairs_hashed(hashes[i]);
+        }
+        // compare and emit every build row chained under a matching key
+        for (size_t i = 0; i < batch; i++) {
+            const size_t* head = tables[partition_of(hashes[i])]
+                .find_hashed(key_of(rows[start + i]), hashes[i]);
+            if (head == nullptr) continue;
+            for (size_t row = *head; row != NO_ROW; row = next_row[row]) {
+                matches.emplace_back(row, start + i);
+            }
+        }
+    }
+}
+
+
+template <class KeyT, class BuildRow, class ProbeRow>
+template <class KeyOf>
+std::vector<std::pair<size_t, size_t>>
+HashJoin<KeyT, BuildRow, ProbeRow>::probe(const std::vector<ProbeRow>& rows,
+                                          KeyOf key_of) const {
+    std::vector<std::pair<size_t, size_t>> matches;
+    probe(rows.data(), rows.size(), key_of, matches);
+    return matches;
+}
+
+
+template <class KeyT, class BuildRow, class ProbeRow>
+size_t HashJoin<KeyT, BuildRow, ProbeRow>::build_size() const {
+    return rows_built;
+}
+
+
+template <class KeyT, class BuildRow, class ProbeRow>
+size_t HashJoin<KeyT, BuildRow, ProbeRow>::partitions() const {
+    return tables.size();
+}
+
+
+template <class KeyT, class BuildRow, class ProbeRow>
+size_t HashJoin<KeyT, BuildRow, ProbeRow>::partition_of(std::size_t hash) const {
+    if (partition_bits == 0) return 0;
+    // high bits of the scrambled hash, so identity hashes (integers) spread too
+    std::uint64_t mixed = mix_hash(hash);
+    return static_cast<size_t>(mixed >> (64 - partition_bits));
+}
+
+#endif //HASHJOIN_HPP
@@ -6,12 +6,149 @@
 #include <functional>
 #include <utility>
 #include <iterator>
+#include <cstdint>
+#include <thread>
+#include <system_error>
+#include <algorithm>
+#include <optional>
 
 #define INIT_CAPACITY 16
 #define INIT_SIZE 0
 #define MAX_LOAD_FACTOR 0.75
 #define MIN_LOAD_FACTOR 0.25
 #define MIN_CAPACITY 1
+#define HASH_MIX_MULTIPLIER 0x9E3779B97F4A7C15ULL
+#define PARALLEL_SORT_THRESHOLD 65536
+#define BULK_BUILD_THRESHOLD 65536
+#define BULK_BUILD_PARTITION_BUCKETS 4096
+
+/*
+* @brief Scrambles a hash value with a fixed odd multiplier (Fibonacci
+* hashing) so that its high bits depend on all of its bits. Shards, stripes
+* and partitions are picked from the high bits, which leaves the low bits
+* to the buckets, and identity hashes (integers) still spread
+* @param hash Hash value of a key
+* @return Mixed hash value
+*/
+inline std::uint64_t mix_hash(std::size_t hash) {
+    return static_cast<std::uint64_t>(hash) * HASH_MIX_MULTIPLIER;
+}
+
+/*
+* @class HashedKey
+* @brief A key bundled with its std::hash value, computed once and reused by
+* every HashMap entry point that accepts it
+* @var key The key
+* @var hash std::hash<KeyT> of the key
+*/
+template <class KeyT>
+struct HashedKey {
+    KeyT key;
+    std::size_t hash;
+
+    /*
+    * @brief Wraps a key and hashes it
+    * @param key Key to wrap
+    */
+    explicit HashedKey(KeyT key) : key(std::move(key)), hash(std::hash<KeyT>()(this->key)) {}
+
+    /*
+    * @brief Wraps a key with a hash computed elsewhere
+    * @param key Key to wrap
+    * @param hash std::hash<KeyT> of the key
+    */
+    HashedKey(KeyT key, std::size_t hash) : key(std::move(key)), hash(hash) {}
+};
+
+/*
+* @class LookupObserver
+* @brief Hook a HashMap notifies of its lookups (see set_lookup_observer()).
+* Only one lookup in sample_every (at random) is passed on to record(), the
+* rest cost a thread-local xorshift step
+* @var sample_mask sample_every - 1 (sample_every is a power of 2)
+*/
+template <class KeyT>
+class LookupObserver {
+public:
+
+    /*
+    * @brief Constructs an observer sampling one lookup in sample_every
+    * @param sample_every Sampling period (rounded up to a power of 2)
+    */
+    explicit LookupObserver(unsigned sample_every) : sample_mask(0) {
+        while (sample_mask + 1 < sample_every) {
+            sample_mask = sample_mask * 2 + 1;
+        }
+    }
+
+    virtual ~LookupObserver() = default;
+
+    /*
+    * @brief Called by the HashMap for every lookup
+    * @param key Key that was looked up
+    * @param found Whether the key was stored
+    */
+    void observe(const KeyT& key, bool found) {
+        // xorshift rather than a counter, so periodic access patterns don't alias
+        thread_local std::uint64_t state = 0x2545F4914F6CDD1DULL;
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        if ((state & sample_mask) != 0) return;
+        record(key, found);
+    }
+
+    /*
+    * @brief Sampling period getter
+    * @return Number of lookups per recorded one
+    */
+    unsigned sample_every() const {
+        return sample_mask + 1;
+    }
+
+protected:
+
+    /*
+    * @brief Records a sampled lookup, may be called from several threads at once
+    * @param key Key that was looked up
+    * @param found Whether the key was stored
+    */
+    virtual void record(const KeyT& key, bool found) = 0;
+
+private:
+    std::uint32_t sample_mask;
+};
+
+/*
+* @class MutationObserver
+* @brief Hook a HashMap notifies of every change to its contents (see
+* set_mutation_observer()), called synchronously by the writing thread
+* right after the change (right before it for erasures)
+*/
+template <class KeyT, class ValueT>
+class MutationObserver {
+public:
+    virtual ~MutationObserver() = default;
+
+    /*
+    * @brief Called when a pair is inserted or its value is assigned
+    * @param key Key written
+    * @param value Value now mapped to the key
+    * @param inserted true for a new pair, false for an assignment
+    */
+    virtual void on_write(const KeyT& key, const ValueT& value, bool inserted) = 0;
+
+    /*
+    * @brief Called when a pair is erased
+    * @param key Key about to be erased
+    */
+    virtual void on_erase(const KeyT& key) = 0;
+
+    /*
+    * @brief Called when every pair is removed at once (clear(), assignment)
+    */
+    virtual void on_clear() = 0;
+};
 
 /*
 * @brief Template parameters:
@@ -26,6 +163,12 @@ template <class KeyT, class ValueT>
 * @var buckets Pointer to a dynamically allocated array of buckets
 * @var table_size Number of (key, value) pairs in the hash map
 * @var table_capacity Number of buckets (always a power of 2)
+* @var occupied Bitmap with a set bit for every non-empty bucket, so clear(),
+* copying and iteration skip empty buckets 64 at a time
+* @var deterministic Whether iteration order depends only on the contents
+* (see set_deterministic())
+* @var observer Notified of lookups when set, nullptr otherwise (not copied)
+* @var mutation_observer Notified of changes when set, nullptr otherwise (not copied)
 */
 class HashMap {
 public:
@@ -49,6 +192,13 @@ public:
     */
     HashMap(const HashMap<KeyT, ValueT>& hashmap);
 
+    /*
+    * @brief Constructs a HashMap that takes over another HashMap's buckets
+    * (move constructor), the other HashMap is left empty
+    * @param hashmap HashMap to take the pairs of
+    */
+    HashMap(HashMap<KeyT, ValueT>&& hashmap);
+
     /*
     * @brief Clears contents and deleted allocated buckets array (destructor)
     */
@@ -82,6 +232,134 @@ public:
     */
     bool insert(const KeyT& key, const ValueT& value);
 
+    /*
+    * @brief insert() for a key with a precomputed hash
+    */
+    bool insert(const HashedKey<KeyT>& key, const ValueT& value);
+
+    /*
+    * @brief Inserts a (key, value) pair using a hash computed by the caller
+    * @param key Key to insert
+    * @param hash std::hash<KeyT> of the key
+    * @param value Value to insert
+    * @return true if insertion was successful, false if the key already exists
+    */
+    bool insert_hashed(const KeyT& key, std::size_t hash, const ValueT& value);
+
+    /*
+    * @brief Looks up a key using a hash computed by the caller
+    * @param key Key to look for
+    * @param hash std::hash<KeyT> of the key
+    * @return Pointer to the value mapped to the key, nullptr if the key does not exist
+    */
+    ValueT* find_hashed(const KeyT& key, std::size_t hash);
+
+    /*
+    * @brief Const find_hashed()
+    */
+    const ValueT* find_hashed(const KeyT& key, std::size_t hash) const;
+
+    /*
+    * @brief Hints the CPU to start loading the bucket a hash maps to (the
+    * bucket's vector header, not its pairs), so a later find_hashed() on a
+    * batch of keys overlaps the cache misses
+    * @param hash std::hash<KeyT> of a key about to be looked up
+    */
+    void prefetch_hashed(std::size_t hash) const;
+
+    /*
+    * @brief Second prefetch stage: hints the CPU to start loading the pairs
+    * of the bucket a hash maps to. It reads the bucket's header, so call it
+    * on a batch after prefetch_hashed() on the same batch has brought the
+    * headers in
+    * @param hash std::hash<KeyT> of a key about to be looked up
+    */
+    void prefetch_pairs_hashed(std::size_t hash) const;
+
+    /*
+    * @brief Erases a pair using a hash computed by the caller
+    * @param key Key in the pair that should be erased
+    * @param hash std::hash<KeyT> of the key
+    * @return true if erasure was successful, false otherwise
+    * @note Never throws for a missing key, also on a Dictionary, whose
+    * erase() overloads throw InvalidKey: it is the primitive that stores
+    * built on a Dictionary use when a missing key is not an error
+    */
+    bool erase_hashed(const KeyT& key, std::size_t hash);
+
+    /*
+    * @brief Inserts a pair or assigns to an existing one with a single probe
+    * @param key Key to insert or update (copied or moved)
+    * @param hash std::hash<KeyT> of the key
+    * @param value Value to insert or assign (copied or moved)
+    * @return true if a new pair was inserted, false if a value was assigned
+    */
+    template <class K, class V>
+    bool insert_or_assign_hashed(K&& key, std::size_t hash, V&& value);
+
+    /*
+    * @brief operator[] using a hash computed by the caller - returns the value
+    * of a key, inserting a default ValueT first if the key is missing
+    * @param key Key to find (or insert)
+    * @param hash std::hash<KeyT> of the key
+    * @return Reference to the value mapped to the key
+    */
+    ValueT& get_or_insert_hashed(const KeyT& key, std::size_t hash);
+
+    /*
+    * @brief Read-modify-write with a single probe: the key's value (if any)
+    * is handed to fn, and whatever fn leaves behind is stored back - an
+    * empty optional erases the pair, or inserts nothing if the key was missing
+    * @param key Key to update
+    * @param hash std::hash<KeyT> of the key
+    * @param fn Called as fn(std::optional<ValueT>&), engaged with the current
+    * value when the key exists. If fn throws, what it left behind is kept
+    * @return true if the key is stored after the call, false otherwise
+    */
+    template <class Fn>
+    bool compute_hashed(const KeyT& key, std::size_t hash, Fn&& fn);
+
+    /*
+    * @brief Inserts a (key, value) pair, or assigns the value if the key
+    * already exists, probing the key's bucket only once
+    * @param key Key to insert or update
+    * @param value Value to insert or assign (copied or moved)
+    * @return true if a new pair was inserted, false if an existing value was assigned
+    */
+    template <class V>
+    bool insert_or_assign(const KeyT& key, V&& value);
+
+    /*
+    * @brief insert_or_assign() that moves the key into the HashMap when inserting
+    */
+    template <class V>
+    bool insert_or_assign(KeyT&& key, V&& value);
+
+    /*
+    * @brief insert_or_assign() for a key with a precomputed hash
+    */
+    template <class V>
+    bool insert_or_assign(const HashedKey<KeyT>& key, V&& value);
+
+    /*
+    * @brief Grows the HashMap so that a given number of pairs fits
+    * without exceeding MAX_LOAD_FACTOR (never shrinks)
+    * @param count Number of pairs the HashMap should hold without resizing
+    */
+    void reserve(int count);
+
+    /*
+    * @brief Inserts many pairs at once, overwriting existing keys (a later
+    * duplicate in the input wins). Large inputs are first radix-partitioned
+    * by bucket range, moving the pairs into their partition, then each
+    * partition fills its own cache-sized range of buckets in one pass
+    * @param pairs (key, value) pairs to insert (moved into the HashMap)
+    * @note Capacity is reserved for size() + pairs.size() up front, so an
+    * input with duplicate or already present keys can leave the HashMap
+    * more sparsely loaded than inserting the pairs one by one would
+    */
+    void bulk_insert(std::vector<std::pair<KeyT, ValueT>> pairs);
+
     /*
     * @brief Returns whether a given key is stored in the HashMap
     * @param key Key to look for
@@ -89,6 +367,11 @@ public:
     */
     bool contains_key(const KeyT& key) const;
 
+    /*
+    * @brief contains_key() for a key with a precomputed hash
+    */
+    bool contains_key(const HashedKey<KeyT>& key) const;
+
     /*
     * @brief Accesses the value of a given key
     * @param key Key look up the value of
@@ -103,6 +386,16 @@ public:
     */
     const ValueT& at(const KeyT& key) const;
 
+    /*
+    * @brief at() for a key with a precomputed hash
+    */
+    ValueT& at(const HashedKey<KeyT>& key);
+
+    /*
+    * @brief Const at() for a key with a precomputed hash
+    */
+    const ValueT& at(const HashedKey<KeyT>& key) const;
+
     /*
     * @brief Erases a pair with a given key from the HashMap
     * @param key Key in the pair that should be erased
@@ -110,6 +403,11 @@ public:
     */
     bool virtual erase(const KeyT& key);
 
+    /*
+    * @brief erase() for a key with a precomputed hash
+    */
+    bool virtual erase(const HashedKey<KeyT>& key);
+
     /*
     * @brief Load factor getter
     * @return double representing the HashMap's current load factor
@@ -125,6 +423,11 @@ public:
     */
     int bucket_size(const KeyT& key) const;
 
+    /*
+    * @brief bucket_size() for a key with a precomputed hash
+    */
+    int bucket_size(const HashedKey<KeyT>& key) const;
+
     /*
     * @brief Bucket index getter
     * @param key Key that should be stored in the bucket to find the index of
@@ -134,11 +437,114 @@ public:
     */
     int bucket_index(const KeyT& key) const;
 
+    /*
+    * @brief bucket_index() for a key with a precomputed hash
+    */
+    int bucket_index(const HashedKey<KeyT>& key) const;
+
     /*
     * @brief Removes all the pairs from the hashmap, keeping the current capacity
     */
     void clear();
 
+    /*
+    * @brief Removes all the pairs and resets the capacity to INIT_CAPACITY,
+    * destroying the old buckets on a background thread owned by the HashMap.
+    * Meant for dropping huge HashMaps without paying for their destruction
+    * on the calling thread
+    * @note At most one such thread runs per HashMap: a second call first
+    * waits for the previous one, and the destructor joins it. KeyT and
+    * ValueT destructors run concurrently with the caller until then. If the
+    * thread can't be started the old buckets are destroyed on the caller
+    */
+    void clear_in_background();
+
+    /*
+    * @brief Turns deterministic iteration order on or off (off by default).
+    * When on, the bucket index is taken from the high bits of the key's
+    * hash multiplied by a fixed constant, and pairs inside a bucket are kept
+    * sorted by that mixed hash, so iteration visits pairs in mixed-hash order
+    * no matter the capacity, insertion order or erase history
+    * @param enable true to turn the mode on, false to turn it off
+    * @note Order is reproducible across runs as long as std::hash<KeyT> is
+    * (true for integral keys and std::string in libstdc++ and libc++).
+    * Distinct keys with identical hashes keep their insertion order
+    */
+    void set_deterministic(bool enable);
+
+    /*
+    * @brief Deterministic mode getter
+    * @return true if deterministic iteration order is on
+    */
+    bool is_deterministic() const;
+
+    /*
+    * @brief Visits one step of a resumable scan (a bucket's worth of pairs).
+    * Start with cursor 0 and pass back the returned cursor until it is 0.
+    * The cursor is a position in hash order rather than in the bucket
+    * array, so every pair present for the whole scan is visited even if the
+    * HashMap grows or shrinks between steps (some may be visited twice)
+    * @param cursor 0 to start, then the cursor returned by the previous step
+    * @param fn Called with (const KeyT&, const ValueT&) for each visited pair
+    * @return Cursor of the next step, 0 when the scan is complete
+    * @note Toggling set_deterministic() in the middle of a scan voids the guarantee
+    */
+    template <class Fn>
+    std::size_t scan(std::size_t cursor, Fn&& fn) const;
+
+    /*
+    * @brief Visits the pairs of one stripe: the pairs whose hash has the
+    * given low bits. Outside deterministic mode only the buckets that can
+    * hold them are touched (1 in stripes of the table), so snapshots can
+    * rewrite a stripe without walking the whole HashMap. In deterministic
+    * mode the whole table is walked, see for_each_with_stripe()
+    * @param stripe Stripe to visit, less than stripes
+    * @param stripes Number of stripes, a power of 2
+    * @param fn Called with (const KeyT&, const ValueT&) for each pair of the stripe
+    */
+    template <class Fn>
+    void for_each_in_stripe(std::size_t stripe, std::size_t stripes, Fn&& fn) const;
+
+    /*
+    * @brief Visits every pair with its stripe in a single pass, for callers
+    * that need many stripes in deterministic mode, where for_each_in_stripe()
+    * walks the whole table for each one
+    * @param stripes Number of stripes, a power of 2
+    * @param fn Called with (std::size_t stripe, const KeyT&, const ValueT&) for each pair
+    */
+    template <class Fn>
+    void for_each_with_stripe(std::size_t stripes, Fn&& fn) const;
+
+    /*
+    * @brief Attaches an observer notified of every lookup (contains_key(),
+    * at(), find_hashed()), e.g. a HeavyHitters sampler. Copies of the
+    * HashMap start without one
+    * @param observer Observer to notify, nullptr to detach. Must outlive the HashMap
+    * or be detached first
+    */
+    void set_lookup_observer(LookupObserver<KeyT>* observer);
+
+    /*
+    * @brief Attaches an observer notified of every insert, assignment,
+    * erase and clear, e.g. a ChangeStream. Copies of the HashMap start
+    * without one
+    * @param observer Observer to notify, nullptr to detach. Must outlive the HashMap
+    * or be detached first
+    * @note Values changed in place through a reference (at(), operator[],
+    * find_hashed()) are not reported, only the default insertion of operator[]
+    */
+    void set_mutation_observer(MutationObserver<KeyT, ValueT>* observer);
+
+    /*
+    * @brief Returns a key-sorted snapshot of the HashMap without copying
+    * the pairs. Large HashMaps are sorted with a parallel merge sort
+    * @param less Strict weak ordering of keys (operator< by default)
+    * @return Vector of pointers to the pairs, sorted by key. The pointers
+    * stay valid until the HashMap is modified
+    */
+    template <class Compare = std::less<KeyT>>
+    std::vector<const std::pair<KeyT, ValueT>*> sorted_view(Compare less = Compare()) const;
+
 //    operators
 
     /*
@@ -148,11 +554,31 @@ public:
     */
     HashMap& operator= (const HashMap<KeyT, ValueT>& hashmap);
 
+    /*
+    * @brief Takes over the pairs of a given HashMap without copying them, the
+    * given HashMap is left empty. Observers stay with their HashMap
+    * @param hashmap HashMap to take the pairs of
+    * @return Reference to this HashMap
+    */
+    HashMap& operator= (HashMap<KeyT, ValueT>&& hashmap);
+
+    /*
+    * @brief Exchanges the pairs of two HashMaps without copying them. Observers
+    * stay with their HashMap and see the new contents as a clear and rewrite
+    * @param hashmap HashMap to exchange pairs with
+    */
+    void swap(HashMap<KeyT, ValueT>& hashmap);
+
     /*
     * @brief const operator[] - delegates to at()
     */
     const ValueT& operator[](const KeyT& key) const;
 
+    /*
+    * @brief const operator[] for a key with a precomputed hash - delegates to at()
+    */
+    const ValueT& operator[](const HashedKey<KeyT>& key) const;
+
     /*
     * @brief Inserts a default ValueT if key does not exist in hashmap 
     * and returns its value
@@ -161,6 +587,11 @@ public:
     */
     ValueT& operator[](const KeyT& key);
 
+    /*
+    * @brief operator[] for a key with a precomputed hash
+    */
+    ValueT& operator[](const HashedKey<KeyT>& key);
+
     /*
     * @brief Checks if a given HashMap is equal to this HashMap (contain the same (key, value) pairs)
     * @param hashmap Hashmap to check equality with 
@@ -203,14 +634,10 @@ public:
         * @return ConstIterator that holds the current pair (before advancing)
         */
         ConstIterator &operator++ () {
-            if (_bucket_index >= _hashmap.table_capacity) return *this;
+            if (_bucket_index >= static_cast<size_t>(_hashmap.table_capacity)) return *this;
             ++_pair_index;
-            while (_bucket_index < _hashmap.table_capacity) {
-                if (_pair_index < _hashmap.buckets[_bucket_index].size()) return *this;
-                ++_bucket_index;
-                _pair_index = 0;
-                if (_bucket_index < _hashmap.table_capacity && !_hashmap.buckets[_bucket_index].empty()) return *this;
-            }
+            if (_pair_index < _hashmap.buckets[_bucket_index].size()) return *this;
+            _bucket_index = _hashmap.next_occupied(_bucket_index + 1);
             _pair_index = 0;
             return *this;
         }
@@ -254,7 +681,7 @@ public:
         * throws std::out_of_range when trying to dereference end()
         */
         reference operator* () const {
-            if (_bucket_index >= _hashmap.table_capacity) {
+            if (_bucket_index >= static_cast<size_t>(_hashmap.table_capacity)) {
                 throw std::out_of_range("HashMap iterator: dereference of end()");
             }
             if (_pair_index >= _hashmap.buckets[_bucket_index].size()) {
@@ -296,14 +723,7 @@ public:
     * @brief const begin()
     */
     const_iterator cbegin () const {
-        int i = 0;
-        while (i < table_capacity && buckets[i].empty()) {
-            i++;
-        }
-        if (i == table_capacity) {
-            return cend();
-        }
-        return ConstIterator(*this, i, 0);
+        return ConstIterator(*this, next_occupied(0), 0);
     }
 
     /*
@@ -328,10 +748,135 @@ public:
         return cend();
     }
 
+protected:
+
+    /*
+    * @brief Inserts or overwrites every pair of another HashMap. When both
+    * HashMaps end up with the same capacity, pairs are merged bucket by bucket
+    * without rehashing the keys
+    * @param hashmap HashMap to copy pairs from
+    */
+    void merge(const HashMap<KeyT, ValueT>& hashmap);
+
+    /*
+    * @brief merge() that moves the pairs out of the given HashMap and leaves it empty
+    */
+    void merge(HashMap<KeyT, ValueT>&& hashmap);
+
 private:
     std::vector<std::pair<KeyT, ValueT>>* buckets;
     int table_size;
     int table_capacity;
+    std::vector<std::uint64_t> occupied;
+    bool deterministic = false;
+    LookupObserver<KeyT>* observer = nullptr;
+    MutationObserver<KeyT, ValueT>* mutation_observer = nullptr;
+    std::thread reclaimer;
+
+    /*
+    * @brief Exchanges buckets, sizes and mode with another HashMap, observers untouched
+    * @param hashmap HashMap to exchange with
+    */
+    void swap_contents(HashMap<KeyT, ValueT>& hashmap);
+
+    /*
+    * @brief Reports the whole contents to the mutation observer as a clear and rewrite
+    */
+    void notify_replaced();
+
+    /*
+    * @brief Hashes a key
+    * @param key Key to hash
+    * @return Hash value of the key
+    */
+    std::size_t hash_of(const KeyT& key) const;
+
+    /*
+    * @brief Maps a hash value to a bucket index for the current capacity
+    * @param hash Hash value of a key
+    * @return Index of the bucket the key belongs to
+    */
+    std::size_t index_of(std::size_t hash) const;
+
+    /*
+    * @brief Maps a hash value to a bucket index for a given capacity
+    * @param hash Hash value of a key
+    * @param capacity Number of buckets (a power of 2)
+    * @return Index of the bucket the key belongs to
+    */
+    std::size_t index_of(std::size_t hash, int capacity) const;
+
+    /*
+    * @brief Finds the first non-empty bucket at or after a given index
+    * @param from Bucket index to start scanning from
+    * @return Index of the bucket, table_capacity if there is none
+    */
+    size_t next_occupied(size_t from) const;
+
+    /*
+    * @brief Scrambles a hash value with mix_hash() (deterministic mode)
+    * @param hash Hash value of a key
+    * @return Mixed hash value whose high bits select the bucket
+    */
+    static std::uint64_t mix(std::size_t hash);
+
+    /*
+    * @brief Reverses the bit order of a 64-bit value (scan cursors)
+    * @param value Value to reverse
+    * @return value with bit i moved to bit 63 - i
+    */
+    static std::uint64_t reverse_bits(std::uint64_t value);
+
+    /*
+    * @brief Appends a pair to a bucket and marks the bucket as occupied.
+    * In deterministic mode the pair is placed to keep the bucket sorted
+    * @param bucket Index of the bucket
+    * @param hash Hash value of the key (only used in deterministic mode)
+    * @param key Key of the new pair (copied or moved)
+    * @param value Value of the new pair (copied or moved)
+    * @return Reference to the inserted pair
+    */
+    template <class K, class V>
+    std::pair<KeyT, ValueT>& push_to_bucket(std::size_t bucket, std::size_t hash,
+                                            K&& key, V&& value);
+
+    /*
+    * @brief Looks up a key in a single bucket
+    * @param bucket Index of the bucket to search
+    * @param key Key to look for
+    * @return Pointer to the matching pair, nullptr if the key is not in the bucket
+    */
+    std::pair<KeyT, ValueT>* find_in_bucket(std::size_t bucket, const KeyT& key) const;
+
+    /*
+    * @brief find_in_bucket() for a user lookup, reported to the observer if any
+    * @param hash std::hash<KeyT> of the key
+    * @param key Key to look for
+    * @return Pointer to the matching pair, nullptr if the key does not exist
+    */
+    std::pair<KeyT, ValueT>* lookup(std::size_t hash, const KeyT& key) const;
+
+    /*
+    * @brief Erases the i-th pair of a bucket, then shrinks the HashMap if needed
+    * @param bucket_idx Index of the bucket
+    * @param i Position of the pair in the bucket
+    */
+    void erase_at(std::size_t bucket_idx, size_t i);
+
+    /*
+    * @brief Moves all pairs to a new bucket array of a given capacity
+    * @param new_capacity New number of buckets (a power of 2)
+    */
+    void rehash(int new_capacity);
+
+    /*
+    * @brief Shared body of bulk_insert() and the vector constructor
+    * @param count Number of input pairs
+    * @param key_at Callable returning a movable reference to the i-th key
+    * @param value_at Callable returning a movable reference to the i-th value
+    */
+    template <class KeyAt, class ValueAt>
+    void bulk_insert_or_assign(size_t count, KeyAt key_at, ValueAt value_at);
 
 };
 
@@ -342,6 +887,7 @@ HashMap<KeyT, ValueT>::HashMap() {
     table_size = INIT_SIZE;
     table_capacity = INIT_CAPACITY;
     buckets = new std::vector<std::pair<KeyT, ValueT>> [INIT_CAPACITY];
+    occupied.assign((INIT_CAPACITY + 63) / 64, 0);
 }
 
 
@@ -352,16 +898,14 @@ HashMap<KeyT, ValueT>::HashMap(std::vector<KeyT> keys,
     if (keys.size() != values.size()) {
         throw std::runtime_error("vector sizes don't match!");
     } else {
-        // insert all (key, value) pairs
+        // insert all (key, value) pairs, later duplicates overwrite earlier ones
         table_size = INIT_SIZE;
         table_capacity = INIT_CAPACITY;
         buckets = new std::vector<std::pair<KeyT, ValueT>> [INIT_CAPACITY];
-        for (size_t i = 0; i < keys.size(); i++) {
-            bool res = insert(keys[i], values[i]);
-            if (!res) {
-                (*this)[keys[i]] = values[i];
-            }
-        }
+        occupied.assign((INIT_CAPACITY + 63) / 64, 0);
+        bulk_insert_or_assign(keys.size(),
+            [&keys](size_t i) -> KeyT& { return keys[i]; },
+            [&values](size_t i) -> ValueT& { return values[i]; });
     }
 }
 
@@ -371,17 +915,25 @@ HashMap<KeyT, ValueT>::HashMap(const HashMap<KeyT, ValueT>& hashmap) {
     table_capacity = hashmap.capacity();
     table_size = hashmap.size();
     buckets = new std::vector<std::pair<KeyT, ValueT>> [table_capacity];
-    for (int i = 0; i < table_capacity; i++) {
-        for (size_t j = 0; j < hashmap.buckets[i].size(); j++) {
-           buckets[i].push_back(hashmap.buckets[i][j]);
-        }
+    occupied = hashmap.occupied;
+    deterministic = hashmap.deterministic;
+    for (size_t i = next_occupied(0); i < static_cast<size_t>(table_capacity);
+         i = next_occupied(i + 1)) {
+        buckets[i] = hashmap.buckets[i];
     }
 }
 
 
+template <class KeyT, class ValueT>
+HashMap<KeyT, ValueT>::HashMap(HashMap<KeyT, ValueT>&& hashmap) : HashMap() {
+    swap_contents(hashmap);
+}
+
+
 template <class KeyT, class ValueT>
 HashMap<KeyT, ValueT>::~HashMap() {
-    clear();
+    if (reclaimer.joinable()) reclaimer.join();
+    // deleting the bucket array destroys the pairs, no separate clear() pass
     delete [] buckets;
 }
 
@@ -406,107 +958,238 @@ bool HashMap<KeyT, ValueT>::empty() const {
 
 template <class KeyT, class ValueT>
 bool HashMap<KeyT, ValueT>::insert(const KeyT& key, const ValueT& value) {
+    return insert_hashed(key, hash_of(key), value);
+}
+
+
+template <class KeyT, class ValueT>
+bool HashMap<KeyT, ValueT>::insert(const HashedKey<KeyT>& key, const ValueT& value) {
+    return insert_hashed(key.key, key.hash, value);
+}
+
+
+template <class KeyT, class ValueT>
+bool HashMap<KeyT, ValueT>::insert_hashed(const KeyT& key, std::size_t hash,
+                                          const ValueT& value) {
     // validate key does not exist in HashMap
-    if (contains_key(key)) {
+    if (find_in_bucket(index_of(hash), key) != nullptr) {
         return false;
     }
-    else {
-        // insert (key, value) pair
-        std::hash<KeyT> hash_key;
-        std::size_t bucket_index = hash_key(key) & (table_capacity - 1);
-        auto pair = std::pair<KeyT, ValueT> (key, value);
-        buckets[bucket_index].push_back(pair);
-        table_size++;
-        // resize HashMap and rehash pairs 
-        while (get_load_factor() > MAX_LOAD_FACTOR) {
-            auto temp = new std::vector<std::pair<KeyT,
-            ValueT>>[table_capacity * 2];
-            for (int i = 0; i < table_capacity; i++) {
-                for (size_t j = 0; j < buckets[i].size(); j++) {
-                    std::size_t bucket_index = hash_key(buckets[i][j].first)
-                            & ((table_capacity * 2) - 1);
-                    temp[bucket_index].push_back(buckets[i][j]);
-                }
-            }
-            delete [] buckets;
-            buckets = temp;
-            table_capacity *= 2;
+    // resize HashMap before inserting so the bucket index stays valid
+    reserve(table_size + 1);
+    push_to_bucket(index_of(hash), hash, key, value);
+    return true;
+}
+
+
+template <class KeyT, class ValueT>
+template <class V>
+bool HashMap<KeyT, ValueT>::insert_or_assign(const KeyT& key, V&& value) {
+    return insert_or_assign_hashed(key, hash_of(key), std::forward<V>(value));
+}
+
+
+template <class KeyT, class ValueT>
+template <class V>
+bool HashMap<KeyT, ValueT>::insert_or_assign(KeyT&& key, V&& value) {
+    std::size_t hash = hash_of(key);
+    return insert_or_assign_hashed(std::move(key), hash, std::forward<V>(value));
+}
+
+
+template <class KeyT, class ValueT>
+template <class V>
+bool HashMap<KeyT, ValueT>::insert_or_assign(const HashedKey<KeyT>& key, V&& value) {
+    return insert_or_assign_hashed(key.key, key.hash, std::forward<V>(value));
+}
+
+
+template <class KeyT, class ValueT>
+ValueT* HashMap<KeyT, ValueT>::find_hashed(const KeyT& key, std::size_t hash) {
+    auto pair = lookup(hash, key);
+    return (pair == nullptr) ? nullptr : &pair->second;
+}
+
+
+template <class KeyT, class ValueT>
+const ValueT* HashMap<KeyT, ValueT>::find_hashed(const KeyT& key, std::size_t hash) const {
+    auto pair = lookup(hash, key);
+    return (pair == nullptr) ? nullptr : &pair->second;
+}
+
+
+template <class KeyT, class ValueT>
+void HashMap<KeyT, ValueT>::bulk_insert(std::vector<std::pair<KeyT, ValueT>> pairs) {
+    bulk_insert_or_assign(pairs.size(),
+        [&pairs](size_t i) -> KeyT& { return pairs[i].first; },
+        [&pairs](size_t i) -> ValueT& { return pairs[i].second; });
+}
+
+
+template <class KeyT, class ValueT>
+template <class KeyAt, class ValueAt>
+void HashMap<KeyT, ValueT>::bulk_insert_or_assign(size_t count, KeyAt key_at,
+                                                  ValueAt value_at) {
+    reserve(table_size + static_cast<int>(count));
+    size_t partitions = static_cast<size_t>(table_capacity) / BULK_BUILD_PARTITION_BUCKETS;
+    if (count < BULK_BUILD_THRESHOLD || partitions < 2) {
+        for (size_t i = 0; i < count; i++) {
+            std::size_t hash = hash_of(key_at(i));
+            insert_or_assign_hashed(std::move(key_at(i)), hash, std::move(value_at(i)));
+        }
+        return;
+    }
+    // a partition is a contiguous range of BULK_BUILD_PARTITION_BUCKETS buckets
+    int shift = __builtin_ctzll(static_cast<unsigned long long>(BULK_BUILD_PARTITION_BUCKETS));
+    struct Entry {
+        KeyT key;
+        ValueT value;
+        std::size_t hash;
+    };
+    // pass 1: hash every key once and count entries per partition
+    std::vector<std::size_t> hashes(count);
+    std::vector<size_t> sizes(partitions, 0);
+    for (size_t i = 0; i < count; i++) {
+        hashes[i] = hash_of(key_at(i));
+        sizes[index_of(hashes[i]) >> shift]++;
+    }
+    // pass 2: move every pair into its partition in input order, reading the
+    // input sequentially and appending to each partition sequentially
+    std::vector<std::vector<Entry>> parts(partitions);
+    for (size_t p = 0; p < partitions; p++) {
+        parts[p].reserve(sizes[p]);
+    }
+    for (size_t i = 0; i < count; i++) {
+        parts[index_of(hashes[i]) >> shift].push_back(
+            Entry{std::move(key_at(i)), std::move(value_at(i)), hashes[i]});
+    }
+    // pass 3: partitions are in bucket order, so inserting them one after
+    // another streams through the pairs and touches one cache-sized bucket
+    // range at a time
+    for (auto& part : parts) {
+        for (auto& entry : part) {
+            insert_or_assign_hashed(std::move(entry.key), entry.hash, std::move(entry.value));
         }
-        return true;
+        std::vector<Entry>().swap(part);
     }
 }
 
 
 template <class KeyT, class ValueT>
-bool HashMap<KeyT, ValueT>::contains_key(const KeyT& key) const {
-    std::hash<KeyT> hash_key;
-    std::size_t bucket_index = hash_key(key) & (table_capacity - 1);
-    for (size_t j = 0; j < buckets[bucket_index].size(); j++) {
-        if (buckets[bucket_index][j].first == key) {
-            return true;
-        }
+void HashMap<KeyT, ValueT>::prefetch_hashed(std::size_t hash) const {
+    __builtin_prefetch(&buckets[index_of(hash)]);
+}
+
+
+template <class KeyT, class ValueT>
+void HashMap<KeyT, ValueT>::prefetch_pairs_hashed(std::size_t hash) const {
+    __builtin_prefetch(buckets[index_of(hash)].data());
+}
+
+
+template <class KeyT, class ValueT>
+void HashMap<KeyT, ValueT>::reserve(int count) {
+    int new_capacity = table_capacity;
+    while ((double)count / (double)new_capacity > MAX_LOAD_FACTOR) {
+        new_capacity *= 2;
     }
-    return false;
+    if (new_capacity != table_capacity) {
+        rehash(new_capacity);
+    }
+}
+
+
+template <class KeyT, class ValueT>
+bool HashMap<KeyT, ValueT>::contains_key(const KeyT& key) const {
+    return lookup(hash_of(key), key) != nullptr;
+}
+
+
+template <class KeyT, class ValueT>
+bool HashMap<KeyT, ValueT>::contains_key(const HashedKey<KeyT>& key) const {
+    return lookup(key.hash, key.key) != nullptr;
 }
 
 
 template <class KeyT, class ValueT>
 ValueT& HashMap<KeyT, ValueT>::at(const KeyT& key) {
-    std::hash<KeyT> hash_key;
-    int bucket = hash_key(key) & (table_capacity - 1);
-    for (size_t i = 0; i < buckets[bucket].size(); i++) {
-        if (buckets[bucket][i].first == key) return buckets[bucket][i].second;
-    }
-    throw std::runtime_error("no such key exists!");
+    auto pair = lookup(hash_of(key), key);
+    if (pair == nullptr) throw std::runtime_error("no such key exists!");
+    return pair->second;
 }
 
 
 template <class KeyT, class ValueT>
 const ValueT& HashMap<KeyT, ValueT>::at(const KeyT& key) const {
-    std::hash<KeyT> hash_key;
-    int bucket = hash_key(key) & (table_capacity - 1);
-    for (size_t i = 0; i < buckets[bucket].size(); i++) {
-        if (buckets[bucket][i].first == key) return buckets[bucket][i].second;
-    }
-    throw std::runtime_error("no such key exists!");
+    auto pair = lookup(hash_of(key), key);
+    if (pair == nullptr) throw std::runtime_error("no such key exists!");
+    return pair->second;
+}
+
+
+template <class KeyT, class ValueT>
+ValueT& HashMap<KeyT, ValueT>::at(const HashedKey<KeyT>& key) {
+    auto value = find_hashed(key.key, key.hash);
+    if (value == nullptr) throw std::runtime_error("no such key exists!");
+    return *value;
+}
+
+
+template <class KeyT, class ValueT>
+const ValueT& HashMap<KeyT, ValueT>::at(const HashedKey<KeyT>& key) const {
+    auto value = find_hashed(key.key, key.hash);
+    if (value == nullptr) throw std::runtime_error("no such key exists!");
+    return *value;
 }
 
 
 template <class KeyT, class ValueT>
 bool HashMap<KeyT, ValueT>::erase(const KeyT& key) {
+    return erase_hashed(key, hash_of(key));
+}
+
+
+template <class KeyT, class ValueT>
+bool HashMap<KeyT, ValueT>::erase(const HashedKey<KeyT>& key) {
+    return erase_hashed(key.key, key.hash);
+}
+
+
+template <class KeyT, class ValueT>
+bool HashMap<KeyT, ValueT>::erase_hashed(const KeyT& key, std::size_t hash) {
     // validate key exists in HashMap
-    if (!contains_key(key)) {
+    std::size_t bucket_idx = index_of(hash);
+    auto& bucket = buckets[bucket_idx];
+    size_t i = 0;
+    while (i < bucket.size() && !(bucket[i].first == key)) {
+        i++;
+    }
+    if (i == bucket.size()) {
         return false;
     }
-    else {
-        // erase (key, value) pair from HahsMap
-        int bucket_idx = bucket_index(key);
-        auto& bucket = buckets[bucket_idx];
-        for (size_t i = 0; i < bucket.size(); i++) {
-            if (bucket[i].first == key) {
-                bucket.erase(bucket.begin() + i);
-                table_size--;
-                break;
-            }
-        }
-        // resize HashMap and rehash pairs 
-        while ((get_load_factor() < MIN_LOAD_FACTOR) &&
-        (table_capacity > MIN_CAPACITY)) {
-            auto temp = new std::vector<std::pair<KeyT,
-            ValueT>>[table_capacity / 2];
-            std::hash<KeyT> hash_key;
-            for (int i = 0; i < table_capacity; i++) {
-                for (size_t j = 0; j < buckets[i].size(); j++) {
-                    std::size_t bucket_index = hash_key(buckets[i][j].first)
-                            & ((table_capacity / 2) - 1);
-                    temp[bucket_index].push_back(buckets[i][j]);
-                }
-            }
-            delete [] buckets;
-            buckets = temp;
-            table_capacity /= 2;
-        }
-        return true;
+    erase_at(bucket_idx, i);
+    return true;
+}
+
+
+template <class KeyT, class ValueT>
+void HashMap<KeyT, ValueT>::erase_at(std::size_t bucket_idx, size_t i) {
+    auto& bucket = buckets[bucket_idx];
+    if (mutation_observer != nullptr) mutation_observer->on_erase(bucket[i].first);
+    // erase (key, value) pair from HashMap
+    bucket.erase(bucket.begin() + i);
+    table_size--;
+    if (bucket.empty()) {
+        occupied[bucket_idx / 64] &= ~(std::uint64_t(1) << (bucket_idx % 64));
+    }
+    // resize HashMap and rehash pairs
+    int new_capacity = table_capacity;
+    while (((double)table_size / (double)new_capacity < MIN_LOAD_FACTOR) &&
+    (new_capacity > MIN_CAPACITY)) {
+        new_capacity /= 2;
+    }
+    if (new_capacity != table_capacity) {
+        rehash(new_capacity);
     }
 }
 
@@ -532,10 +1215,27 @@ int HashMap<KeyT, ValueT>::bucket_size(const KeyT& key) const {
 
 template <class KeyT, class ValueT>
 int HashMap<KeyT, ValueT>::bucket_index(const KeyT& key) const {
-    if (contains_key(key)) {
-        std::hash<KeyT> hash_key;
-        size_t bucket_index = hash_key(key) & (static_cast<size_t>(table_capacity) - 1);
-        return static_cast<int>(bucket_index);
+    std::size_t bucket = index_of(hash_of(key));
+    if (find_in_bucket(bucket, key) != nullptr) {
+        return static_cast<int>(bucket);
+    }
+    else {
+        throw std::runtime_error("no such key exists!");
+    }
+}
+
+
+template <class KeyT, class ValueT>
+int HashMap<KeyT, ValueT>::bucket_size(const HashedKey<KeyT>& key) const {
+    return static_cast<int>(buckets[bucket_index(key)].size());
+}
+
+
+template <class KeyT, class ValueT>
+int HashMap<KeyT, ValueT>::bucket_index(const HashedKey<KeyT>& key) const {
+    std::size_t bucket = index_of(key.hash);
+    if (find_in_bucket(bucket, key.key) != nullptr) {
+        return static_cast<int>(bucket);
     }
     else {
         throw std::runtime_error("no such key exists!");
@@ -545,45 +1245,499 @@ int HashMap<KeyT, ValueT>::bucket_index(const KeyT& key) const {
 
 template <class KeyT, class ValueT>
 void HashMap<KeyT, ValueT>::clear() {
-    for (int i = 0; i < table_capacity; i++) {
-        buckets[i].clear();
+    // only occupied buckets are visited, the bitmap is scanned a word at a time
+    if (table_size == 0) return;
+    if (mutation_observer != nullptr) mutation_observer->on_clear();
+    for (size_t word = 0; word < occupied.size(); word++) {
+        std::uint64_t bits = occupied[word];
+        while (bits != 0) {
+            buckets[word * 64 + __builtin_ctzll(bits)].clear();
+            bits &= bits - 1;
+        }
+        occupied[word] = 0;
     }
     table_size = 0;
 }
 
 
+template <class KeyT, class ValueT>
+void HashMap<KeyT, ValueT>::clear_in_background() {
+    auto fresh = new std::vector<std::pair<KeyT, ValueT>> [INIT_CAPACITY];
+    if (mutation_observer != nullptr && table_size != 0) mutation_observer->on_clear();
+    auto old_buckets = buckets;
+    buckets = fresh;
+    table_size = INIT_SIZE;
+    table_capacity = INIT_CAPACITY;
+    occupied.assign((INIT_CAPACITY + 63) / 64, 0);
+    // one batch in flight at a time, so threads can't pile up
+    if (reclaimer.joinable()) reclaimer.join();
+    try {
+        reclaimer = std::thread([old_buckets]() { delete [] old_buckets; });
+    } catch (const std::system_error&) {
+        delete [] old_buckets;
+    }
+}
+
+
+template <class KeyT, class ValueT>
+void HashMap<KeyT, ValueT>::set_deterministic(bool enable) {
+    if (enable == deterministic) return;
+    deterministic = enable;
+    // re-place every pair under the new bucket index function
+    rehash(table_capacity);
+}
+
+
+template <class KeyT, class ValueT>
+bool HashMap<KeyT, ValueT>::is_deterministic() const {
+    return deterministic;
+}
+
+
+template <class KeyT, class ValueT>
+template <class Fn>
+std::size_t HashMap<KeyT, ValueT>::scan(std::size_t cursor, Fn&& fn) const {
+    std::uint64_t position = static_cast<std::uint64_t>(cursor);
+    std::uint64_t mask = static_cast<std::uint64_t>(table_capacity) - 1;
+    int bits = __builtin_ctzll(static_cast<unsigned long long>(table_capacity));
+    // the bucket holding the cursor position: high bits in deterministic mode, low bits otherwise
+    std::size_t bucket = deterministic ? (bits == 0 ? 0 : static_cast<std::size_t>(position >> (64 - bits)))
+                                       : static_cast<std::size_t>(position & mask);
+    for (const auto& pair : buckets[bucket]) {
+        fn(static_cast<const KeyT&>(pair.first), static_cast<const ValueT&>(pair.second));
+    }
+    if (deterministic) {
+        // buckets split in place when growing, so counting up in the high bits covers them all
+        if (bits == 0 || bucket + 1 == static_cast<std::size_t>(table_capacity)) return 0;
+        return static_cast<std::size_t>(static_cast<std::uint64_t>(bucket + 1) << (64 - bits));
+    }
+    // count up in the reversed low bits: a bucket and the buckets it splits
+    // into (or merges from) are all visited on the same side of the cursor
+    position |= ~mask;
+    position = reverse_bits(reverse_bits(position) + 1);
+    return static_cast<std::size_t>(position);
+}
+
+
+template <class KeyT, class ValueT>
+template <class Fn>
+void HashMap<KeyT, ValueT>::for_each_in_stripe(std::size_t stripe, std::size_t stripes, Fn&& fn) const {
+    std::size_t capacity = static_cast<std::size_t>(table_capacity);
+    // a bucket holds a single stripe when the table has at least as many buckets as stripes
+    bool filter = deterministic || capacity < stripes;
+    std::size_t step = deterministic ? 1 : std::min(capacity, stripes);
+    for (std::size_t i = deterministic ? 0 : (stripe & (step - 1)); i < capacity; i += step) {
+        for (const auto& pair : buckets[i]) {
+            if (filter && (hash_of(pair.first) & (stripes - 1)) != stripe) continue;
+            fn(static_cast<const KeyT&>(pair.first), static_cast<const ValueT&>(pair.second));
+        }
+    }
+}
+
+
+template <class KeyT, class ValueT>
+template <class Fn>
+void HashMap<KeyT, ValueT>::for_each_with_stripe(std::size_t stripes, Fn&& fn) const {
+    std::size_t capacity = static_cast<std::size_t>(table_capacity);
+    for (std::size_t i = 0; i < capacity; i++) {
+        for (const auto& pair : buckets[i]) {
+            fn(hash_of(pair.first) & (stripes - 1),
+               static_cast<const KeyT&>(pair.first), static_cast<const ValueT&>(pair.second));
+        }
+    }
+}
+
+
+template <class KeyT, class ValueT>
+void HashMap<KeyT, ValueT>::set_lookup_observer(LookupObserver<KeyT>* observer) {
+    this->observer = observer;
+}
+
+
+template <class KeyT, class ValueT>
+void HashMap<KeyT, ValueT>::set_mutation_observer(MutationObserver<KeyT, ValueT>* observer) {
+    mutation_observer = observer;
+}
+
+
+template <class KeyT, class ValueT>
+template <class Compare>
+std::vector<const std::pair<KeyT, ValueT>*> HashMap<KeyT, ValueT>::sorted_view(Compare less) const {
+    std::vector<const std::pair<KeyT, ValueT>*> view;
+    view.reserve(table_size);
+    for (size_t i = next_occupied(0); i < static_cast<size_t>(table_capacity);
+         i = next_occupied(i + 1)) {
+        for (const auto& pair : buckets[i]) {
+            view.push_back(&pair);
+        }
+    }
+    auto by_key = [&less](const std::pair<KeyT, ValueT>* a, const std::pair<KeyT, ValueT>* b) {
+        return less(a->first, b->first);
+    };
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    if (view.size() < PARALLEL_SORT_THRESHOLD || threads == 1) {
+        std::sort(view.begin(), view.end(), by_key);
+        return view;
+    }
+    // sort one run per thread, then merge neighbouring runs pairwise in parallel
+    std::vector<size_t> bounds;
+    for (size_t t = 0; t <= threads; t++) {
+        bounds.push_back(view.size() * t / threads);
+    }
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            std::sort(view.begin() + bounds[t], view.begin() + bounds[t + 1], by_key);
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    while (bounds.size() > 2) {
+        std::vector<size_t> merged_bounds;
+        workers.clear();
+        for (size_t r = 0; r + 2 < bounds.size(); r += 2) {
+            size_t first = bounds[r], middle = bounds[r + 1], last = bounds[r + 2];
+            workers.emplace_back([&, first, middle, last]() {
+                std::inplace_merge(view.begin() + first, view.begin() + middle,
+                                   view.begin() + last, by_key);
+            });
+            merged_bounds.push_back(first);
+        }
+        // an odd run out carries over to the next round unmerged
+        if (bounds.size() % 2 == 0) {
+            merged_bounds.push_back(bounds[bounds.size() - 2]);
+        }
+        merged_bounds.push_back(bounds.back());
+        for (auto& worker : workers) worker.join();
+        bounds.swap(merged_bounds);
+    }
+    return view;
+}
+
+
+template <class KeyT, class ValueT>
+void HashMap<KeyT, ValueT>::merge(const HashMap<KeyT, ValueT>& hashmap) {
+    if (this == &hashmap) return;
+    reserve(table_size + hashmap.size());
+    // same capacity - a pair lands in the same bucket index in both HashMaps
+    // (not used in deterministic mode, where buckets are kept sorted by hash)
+    bool same_layout = (table_capacity == hashmap.capacity()) &&
+        !deterministic && !hashmap.deterministic;
+    for (size_t i = hashmap.next_occupied(0); i < static_cast<size_t>(hashmap.capacity());
+         i = hashmap.next_occupied(i + 1)) {
+        for (const auto& pair : hashmap.buckets[i]) {
+            if (same_layout) {
+                auto existing = find_in_bucket(i, pair.first);
+                if (existing != nullptr) {
+                    existing->second = pair.second;
+                    if (mutation_observer != nullptr) {
+                        mutation_observer->on_write(existing->first, existing->second, false);
+                    }
+                } else {
+                    push_to_bucket(i, 0, pair.first, pair.second);
+                }
+            } else {
+                insert_or_assign(pair.first, pair.second);
+            }
+        }
+    }
+}
+
+
+template <class KeyT, class ValueT>
+void HashMap<KeyT, ValueT>::merge(HashMap<KeyT, ValueT>&& hashmap) {
+    if (this == &hashmap) return;
+    reserve(table_size + hashmap.size());
+    bool same_layout = (table_capacity == hashmap.capacity()) &&
+        !deterministic && !hashmap.deterministic;
+    for (size_t i = hashmap.next_occupied(0); i < static_cast<size_t>(hashmap.capacity());
+         i = hashmap.next_occupied(i + 1)) {
+        for (auto& pair : hashmap.buckets[i]) {
+            if (same_layout) {
+                auto existing = find_in_bucket(i, pair.first);
+                if (existing != nullptr) {
+                    existing->second = std::move(pair.second);
+                    if (mutation_observer != nullptr) {
+                        mutation_observer->on_write(existing->first, existing->second, false);
+                    }
+                } else {
+                    push_to_bucket(i, 0, std::move(pair.first), std::move(pair.second));
+                }
+            } else {
+                insert_or_assign(std::move(pair.first), std::move(pair.second));
+            }
+        }
+    }
+    hashmap.clear();
+}
+
+
+template <class KeyT, class ValueT>
+std::size_t HashMap<KeyT, ValueT>::hash_of(const KeyT& key) const {
+    std::hash<KeyT> hash_key;
+    return hash_key(key);
+}
+
+
+template <class KeyT, class ValueT>
+std::size_t HashMap<KeyT, ValueT>::index_of(std::size_t hash) const {
+    return index_of(hash, table_capacity);
+}
+
+
+template <class KeyT, class ValueT>
+std::size_t HashMap<KeyT, ValueT>::index_of(std::size_t hash, int capacity) const {
+    if (deterministic) {
+        // high bits of the mixed hash, so bucket order follows mixed-hash order
+        if (capacity == 1) return 0;
+        int bits = __builtin_ctzll(static_cast<unsigned long long>(capacity));
+        return static_cast<std::size_t>(mix(hash) >> (64 - bits));
+    }
+    return hash & (static_cast<std::size_t>(capacity) - 1);
+}
+
+
+template <class KeyT, class ValueT>
+size_t HashMap<KeyT, ValueT>::next_occupied(size_t from) const {
+    size_t capacity = static_cast<size_t>(table_capacity);
+    if (from >= capacity) return capacity;
+    size_t word = from / 64;
+    // mask off the buckets before 'from' in the first word
+    std::uint64_t bits = occupied[word] & (~std::uint64_t(0) << (from % 64));
+    while (bits == 0) {
+        if (++word == occupied.size()) return capacity;
+        bits = occupied[word];
+    }
+    return word * 64 + __builtin_ctzll(bits);
+}
+
+
+template <class KeyT, class ValueT>
+template <class K, class V>
+std::pair<KeyT, ValueT>& HashMap<KeyT, ValueT>::push_to_bucket(std::size_t bucket,
+                                                               std::size_t hash,
+                                                               K&& key, V&& value) {
+    auto& pairs = buckets[bucket];
+    occupied[bucket / 64] |= std::uint64_t(1) << (bucket % 64);
+    table_size++;
+    std::pair<KeyT, ValueT>* pair;
+    if (!deterministic) {
+        pair = &pairs.emplace_back(std::forward<K>(key), std::forward<V>(value));
+    } else {
+        // keep the bucket sorted by mixed hash, equal hashes keep insertion order
+        std::uint64_t mixed = mix(hash);
+        size_t pos = pairs.size();
+        while (pos > 0 && mix(hash_of(pairs[pos - 1].first)) > mixed) {
+            pos--;
+        }
+        pair = &*pairs.emplace(pairs.begin() + pos, std::forward<K>(key), std::forward<V>(value));
+    }
+    if (mutation_observer != nullptr) mutation_observer->on_write(pair->first, pair->second, true);
+    return *pair;
+}
+
+
+template <class KeyT, class ValueT>
+std::uint64_t HashMap<KeyT, ValueT>::mix(std::size_t hash) {
+    return mix_hash(hash);
+}
+
+
+template <class KeyT, class ValueT>
+std::uint64_t HashMap<KeyT, ValueT>::reverse_bits(std::uint64_t value) {
+    value = ((value >> 1) & 0x5555555555555555ULL) | ((value & 0x5555555555555555ULL) << 1);
+    value = ((value >> 2) & 0x3333333333333333ULL) | ((value & 0x3333333333333333ULL) << 2);
+    value = ((value >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((value & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    return __builtin_bswap64(value);
+}
+
+
+template <class KeyT, class ValueT>
+std::pair<KeyT, ValueT>* HashMap<KeyT, ValueT>::find_in_bucket(std::size_t bucket,
+                                                               const KeyT& key) const {
+    for (auto& pair : buckets[bucket]) {
+        if (pair.first == key) return &pair;
+    }
+    return nullptr;
+}
+
+
+template <class KeyT, class ValueT>
+std::pair<KeyT, ValueT>* HashMap<KeyT, ValueT>::lookup(std::size_t hash, const KeyT& key) const {
+    auto pair = find_in_bucket(index_of(hash), key);
+    if (observer != nullptr) observer->observe(key, pair != nullptr);
+    return pair;
+}
+
+
+template <class KeyT, class ValueT>
+template <class K, class V>
+bool HashMap<KeyT, ValueT>::insert_or_assign_hashed(K&& key, std::size_t hash, V&& value) {
+    auto existing = find_in_bucket(index_of(hash), key);
+    if (existing != nullptr) {
+        existing->second = std::forward<V>(value);
+        if (mutation_observer != nullptr) mutation_observer->on_write(existing->first, existing->second, false);
+        return false;
+    }
+    // resize HashMap before inserting so the bucket index stays valid
+    reserve(table_size + 1);
+    push_to_bucket(index_of(hash), hash, std::forward<K>(key), std::forward<V>(value));
+    return true;
+}
+
+
+template <class KeyT, class ValueT>
+void HashMap<KeyT, ValueT>::rehash(int new_capacity) {
+    auto temp = new std::vector<std::pair<KeyT, ValueT>>[new_capacity];
+    std::vector<std::uint64_t> temp_occupied((new_capacity + 63) / 64, 0);
+    for (size_t i = next_occupied(0); i < static_cast<size_t>(table_capacity);
+         i = next_occupied(i + 1)) {
+        for (auto& pair : buckets[i]) {
+            std::size_t hash = hash_of(pair.first);
+            std::size_t bucket = index_of(hash, new_capacity);
+            auto& target = temp[bucket];
+            if (deterministic && !target.empty() &&
+                mix(hash_of(target.back().first)) > mix(hash)) {
+                // only when switching modes - pairs already in mixed-hash order append
+                size_t pos = target.size();
+                while (pos > 0 && mix(hash_of(target[pos - 1].first)) > mix(hash)) {
+                    pos--;
+                }
+                target.insert(target.begin() + pos, std::move(pair));
+            } else {
+                target.push_back(std::move(pair));
+            }
+            temp_occupied[bucket / 64] |= std::uint64_t(1) << (bucket % 64);
+        }
+    }
+    delete [] buckets;
+    buckets = temp;
+    table_capacity = new_capacity;
+    occupied.swap(temp_occupied);
+}
+
+
 template <class KeyT, class ValueT>
 HashMap<KeyT, ValueT>& HashMap<KeyT, ValueT>::operator=(const HashMap<KeyT, ValueT>& hashmap) {
     if (this == &hashmap) return *this;
     HashMap tmp(hashmap);
-    std::swap(buckets, tmp.buckets);
-    std::swap(table_size, tmp.table_size);
-    std::swap(table_capacity, tmp.table_capacity);
+    swap_contents(tmp);
+    notify_replaced();
+    return *this;
+}
+
+
+template <class KeyT, class ValueT>
+HashMap<KeyT, ValueT>& HashMap<KeyT, ValueT>::operator=(HashMap<KeyT, ValueT>&& hashmap) {
+    if (this == &hashmap) return *this;
+    swap_contents(hashmap);
+    notify_replaced();
+    hashmap.clear();
     return *this;
 }
 
 
+template <class KeyT, class ValueT>
+void HashMap<KeyT, ValueT>::swap(HashMap<KeyT, ValueT>& hashmap) {
+    if (this == &hashmap) return;
+    swap_contents(hashmap);
+    notify_replaced();
+    hashmap.notify_replaced();
+}
+
+
+template <class KeyT, class ValueT>
+void HashMap<KeyT, ValueT>::swap_contents(HashMap<KeyT, ValueT>& hashmap) {
+    std::swap(buckets, hashmap.buckets);
+    std::swap(table_size, hashmap.table_size);
+    std::swap(table_capacity, hashmap.table_capacity);
+    occupied.swap(hashmap.occupied);
+    std::swap(deterministic, hashmap.deterministic);
+}
+
+
+template <class KeyT, class ValueT>
+void HashMap<KeyT, ValueT>::notify_replaced() {
+    if (mutation_observer != nullptr) {
+        // the new contents replace the old ones wholesale
+        mutation_observer->on_clear();
+        for (const auto& pair : *this) {
+            mutation_observer->on_write(pair.first, pair.second, true);
+        }
+    }
+}
+
+
 template <class KeyT, class ValueT>
 const ValueT& HashMap<KeyT, ValueT>::operator[](const KeyT& key) const {
     return at(key);
 }
 
 
+template <class KeyT, class ValueT>
+const ValueT& HashMap<KeyT, ValueT>::operator[](const HashedKey<KeyT>& key) const {
+    return at(key);
+}
+
+
 template <class KeyT, class ValueT>
 ValueT& HashMap<KeyT, ValueT>::operator[](const KeyT& key) {
-    // if key is not in HashMap - add it
-    if (!contains_key(key)) {
-        insert(key, ValueT());
-    }
-    // find and return value mapped to given key
-    int bucket = bucket_index(key);
-    size_t index = 0;
-    for (size_t i = 0; i < buckets[bucket].size(); i++) {
-        if (buckets[bucket][i].first == key) {
-            index = i;
+    return get_or_insert_hashed(key, hash_of(key));
+}
+
+
+template <class KeyT, class ValueT>
+ValueT& HashMap<KeyT, ValueT>::operator[](const HashedKey<KeyT>& key) {
+    return get_or_insert_hashed(key.key, key.hash);
+}
+
+
+template <class KeyT, class ValueT>
+ValueT& HashMap<KeyT, ValueT>::get_or_insert_hashed(const KeyT& key, std::size_t hash) {
+    auto existing = find_in_bucket(index_of(hash), key);
+    if (existing != nullptr) {
+        return existing->second;
+    }
+    // if key is not in HashMap - add it with a default value
+    reserve(table_size + 1);
+    return push_to_bucket(index_of(hash), hash, key, ValueT()).second;
+}
+
+
+template <class KeyT, class ValueT>
+template <class Fn>
+bool HashMap<KeyT, ValueT>::compute_hashed(const KeyT& key, std::size_t hash, Fn&& fn) {
+    std::size_t bucket_idx = index_of(hash);
+    auto& bucket = buckets[bucket_idx];
+    size_t i = 0;
+    while (i < bucket.size() && !(bucket[i].first == key)) {
+        i++;
+    }
+    bool found = (i < bucket.size());
+    std::optional<ValueT> value;
+    if (found) value.emplace(std::move(bucket[i].second));
+    try {
+        fn(value);
+    } catch (...) {
+        if (found && value) {
+            bucket[i].second = std::move(*value);
+            if (mutation_observer != nullptr) mutation_observer->on_write(bucket[i].first, bucket[i].second, false);
+        }
+        if (found && !value) erase_at(bucket_idx, i);
+        throw;
+    }
+    if (found) {
+        if (value) {
+            bucket[i].second = std::move(*value);
+            if (mutation_observer != nullptr) mutation_observer->on_write(bucket[i].first, bucket[i].second, false);
+        } else {
+            erase_at(bucket_idx, i);
         }
+    } else if (value) {
+        // resize HashMap before inserting so the bucket index stays valid
+        reserve(table_size + 1);
+        push_to_bucket(index_of(hash), hash, key, std::move(*value));
     }
-    return buckets[bucket][index].second;
+    return value.has_value();
 }
 
 
@@ -592,7 +1746,8 @@ bool HashMap<KeyT,ValueT>::operator==(const HashMap<KeyT, ValueT>& hashmap) cons
     // validate HashMaps sizes match
     if (table_size != hashmap.size()) return false;
     
-    for (int i = 0; i < table_capacity; i++) {
+    for (size_t i = next_occupied(0); i < static_cast<size_t>(table_capacity);
+         i = next_occupied(i + 1)) {
         for (const auto& [key, value] : buckets[i]) {
             // validate HashMaps have the same keys
             if (!hashmap.contains_key(key)) return false;
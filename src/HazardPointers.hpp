@@ -0,0 +1,333 @@
+#ifndef HAZARDPOINTERS_HPP
+#define HAZARDPOINTERS_HPP
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+
+#include "ThreadRecords.hpp"
+
+#define HAZARD_SLOTS_PER_THREAD 4
+#define HAZARD_SCAN_FACTOR 2
+#define HAZARD_MIN_SCAN 64
+
+/*
+* @class HazardDomain
+* @brief Hazard-pointer memory reclamation, the alternative to EpochDomain:
+* a reader publishes each pointer it is about to dereference in a hazard
+* slot, and a retired object is freed once no slot holds it. Reads cost a
+* store and a re-check each, but a stalled reader only pins the objects it
+* actually protects, so garbage stays bounded
+* @var state Thread records and orphaned garbage, shared with exiting
+* threads so they can hand back their records safely
+* @note Each thread gets HAZARD_SLOTS_PER_THREAD slots per domain on first use
+* (ThreadRecordRegistry) and gives them back (with its pending garbage) when
+* the thread exits
+*/
+class HazardDomain {
+private:
+    struct Record;
+
+public:
+
+    /*
+    * @class Holder
+    * @brief Owns one hazard slot of the calling thread (RAII), must stay on that thread
+    */
+    class Holder {
+    public:
+        Holder(Holder&& other) noexcept;
+        ~Holder();
+        Holder(const Holder&) = delete;
+        Holder& operator=(const Holder&) = delete;
+        Holder& operator=(Holder&&) = delete;
+
+        /*
+        * @brief Loads a pointer and protects it, retrying until the published
+        * hazard matches the source
+        * @param source Shared pointer to read
+        * @return The protected pointer, valid until reset() or the next protect()
+        */
+        template <class T>
+        T* protect(const std::atomic<T*>& source);
+
+        /*
+        * @brief Publishes a hazard without validating it, the caller must
+        * re-check that the object is still reachable afterwards
+        * @param object Object to protect
+        */
+        void set(const void* object);
+
+        /*
+        * @brief Drops the protection
+        */
+        void reset();
+
+    private:
+        friend class HazardDomain;
+        Record* record;
+        int slot;
+        Holder(Record* record, int slot);
+    };
+
+    /*
+    * @brief Constructs a domain (default constructor)
+    */
+    HazardDomain();
+
+    /*
+    * @brief Frees every retired object, no thread may still hold hazards (destructor)
+    */
+    ~HazardDomain();
+
+    HazardDomain(const HazardDomain&) = delete;
+    HazardDomain& operator=(const HazardDomain&) = delete;
+
+    /*
+    * @brief Takes a free hazard slot of the calling thread
+    * @return Holder owning the slot
+    * @throws std::runtime_error if all HAZARD_SLOTS_PER_THREAD slots are taken
+    */
+    Holder make_holder();
+
+    /*
+    * @brief Schedules an unlinked object to be deleted once no hazard points to it
+    * @param object Object to delete
+    */
+    template <class T>
+    void retire(T* object);
+
+    /*
+    * @brief Schedules an unlinked object to be freed with a custom deleter
+    * @param object Object to free
+    * @param deleter Function freeing the object
+    */
+    void retire(void* object, void (*deleter)(void*));
+
+    /*
+    * @brief Scans every hazard slot and frees the calling thread's retired
+    * objects that no slot protects
+    */
+    void collect();
+
+    /*
+    * @brief Returns the number of retired objects not freed yet
+    * @return Pending object count (approximate while other threads retire)
+    */
+    size_t pending() const;
+
+private:
+
+    /*
+    * @struct Retired
+    * @brief An object waiting to be freed and how to free it
+    */
+    struct Retired {
+        void* object;
+        void (*deleter)(void*);
+    };
+
+    /*
+    * @struct Record
+    * @brief A thread's hazard slots and its own garbage
+    */
+    struct Record {
+        std::atomic<const void*> hazards[HAZARD_SLOTS_PER_THREAD] = {};
+        std::atomic<bool> in_use{false};        // owned by a live thread
+        unsigned taken = 0;                     // bitmask of slots owned by holders
+        std::vector<Retired> retired;
+        Record* next = nullptr;
+    };
+
+    /*
+    * @struct State
+    * @brief Everything the domain shares with its threads (the records
+    * included), freed with the last owner
+    */
+    struct State : ThreadRecordRegistry<Record, State> {
+        std::mutex orphans_lock;
+        std::vector<Retired> orphans;
+        std::atomic<size_t> pending{0};
+
+        /*
+        * @brief Takes the garbage of an exiting thread's record and clears its hazards
+        * @param record The record
+        */
+        void release(Record& record);
+    };
+
+    std::shared_ptr<State> state;
+
+    /*
+    * @brief Returns the calling thread's record, acquiring one on first use
+    * @return The thread's record in this domain
+    */
+    Record* local_record();
+
+    /*
+    * @brief Frees the objects of a list that no hazard protects
+    * @param retired List to free from
+    * @param hazards Sorted snapshot of every published hazard
+    * @return Number of objects freed
+    */
+    static size_t free_unprotected(std::vector<Retired>& retired,
+                                   const std::vector<const void*>& hazards);
+};
+
+// ==================== Implementation ====================
+
+inline HazardDomain::Holder::Holder(Record* record, int slot) : record(record), slot(slot) {}
+
+
+inline HazardDomain::Holder::Holder(Holder&& other) noexcept :
+    record(other.record), slot(other.slot) {
+    other.record = nullptr;
+}
+
+
+inline HazardDomain::Holder::~Holder() {
+    if (record != nullptr) {
+        reset();
+        record->taken &= ~(1u << slot);
+    }
+}
+
+
+template <class T>
+T* HazardDomain::Holder::protect(const std::atomic<T*>& source) {
+    T* object = source.load(std::memory_order_relaxed);
+    for (;;) {
+        // the hazard must be visible before the source is re-read
+        record->hazards[slot].store(object, std::memory_order_seq_cst);
+        T* again = source.load(std::memory_order_seq_cst);
+        if (again == object) return object;
+        object = again;
+    }
+}
+
+
+inline void HazardDomain::Holder::set(const void* object) {
+    record->hazards[slot].store(object, std::memory_order_seq_cst);
+}
+
+
+inline void HazardDomain::Holder::reset() {
+    record->hazards[slot].store(nullptr, std::memory_order_release);
+}
+
+
+inline void HazardDomain::State::release(Record& record) {
+    if (!record.retired.empty()) {
+        std::lock_guard<std::mutex> guard(orphans_lock);
+        orphans.insert(orphans.end(), record.retired.begin(), record.retired.end());
+        record.retired.clear();
+    }
+    for (auto& hazard : record.hazards) {
+        hazard.store(nullptr, std::memory_order_relaxed);
+    }
+    record.taken = 0;
+}
+
+
+inline HazardDomain::HazardDomain() : state(std::make_shared<State>()) {}
+
+
+inline HazardDomain::~HazardDomain() {
+    std::lock_guard<std::mutex> guard(state->orphans_lock);
+    for (Record* record = state->head(); record != nullptr; record = record->next) {
+        for (auto& retired : record->retired) {
+            retired.deleter(retired.object);
+        }
+        record->retired.clear();
+    }
+    for (auto& retired : state->orphans) {
+        retired.deleter(retired.object);
+    }
+    state->orphans.clear();
+}
+
+
+inline HazardDomain::Holder HazardDomain::make_holder() {
+    Record* record = local_record();
+    for (int slot = 0; slot < HAZARD_SLOTS_PER_THREAD; slot++) {
+        if ((record->taken & (1u << slot)) == 0) {
+            record->taken |= 1u << slot;
+            return Holder(record, slot);
+        }
+    }
+    throw std::runtime_error("all hazard slots of this thread are taken");
+}
+
+
+template <class T>
+void HazardDomain::retire(T* object) {
+    retire(object, [](void* p) { delete static_cast<T*>(p); });
+}
+
+
+inline void HazardDomain::retire(void* object, void (*deleter)(void*)) {
+    Record* record = local_record();
+    record->retired.push_back(Retired{object, deleter});
+    state->pending.fetch_add(1, std::memory_order_relaxed);
+    // scanning costs O(threads * slots), so wait for a batch proportional to it
+    size_t hazards = static_cast<size_t>(state->size()) * HAZARD_SLOTS_PER_THREAD;
+    if (record->retired.size() >= std::max<size_t>(HAZARD_MIN_SCAN, HAZARD_SCAN_FACTOR * hazards)) {
+        collect();
+    }
+}
+
+
+inline void HazardDomain::collect() {
+#ifdef RECLAMATION_UNDER_TSAN
+    state->pending.fetch_add(0, std::memory_order_seq_cst);
+#else
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+#endif
+    std::vector<const void*> hazards;
+    for (Record* r = state->head(); r != nullptr; r = r->next) {
+        for (auto& hazard : r->hazards) {
+            const void* object = hazard.load(std::memory_order_seq_cst);
+            if (object != nullptr) hazards.push_back(object);
+        }
+    }
+    std::sort(hazards.begin(), hazards.end());
+    size_t freed = free_unprotected(local_record()->retired, hazards);
+    std::unique_lock<std::mutex> guard(state->orphans_lock, std::try_to_lock);
+    if (guard.owns_lock() && !state->orphans.empty()) {
+        freed += free_unprotected(state->orphans, hazards);
+    }
+    state->pending.fetch_sub(freed, std::memory_order_relaxed);
+}
+
+
+inline size_t HazardDomain::pending() const {
+    return state->pending.load(std::memory_order_relaxed);
+}
+
+
+inline HazardDomain::Record* HazardDomain::local_record() {
+    return State::local(state);
+}
+
+
+inline size_t HazardDomain::free_unprotected(std::vector<Retired>& retired,
+                                             const std::vector<const void*>& hazards) {
+    size_t kept = 0;
+    for (size_t i = 0; i < retired.size(); i++) {
+        if (std::binary_search(hazards.begin(), hazards.end(),
+                               static_cast<const void*>(retired[i].object))) {
+            retired[kept++] = retired[i];
+        } else {
+            retired[i].deleter(retired[i].object);
+        }
+    }
+    size_t freed = retired.size() - kept;
+    retired.resize(kept);
+    return freed;
+}
+
+#endif //HAZARDPOINTERS_HPP
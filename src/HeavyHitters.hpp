@@ -0,0 +1,325 @@
+#ifndef HEAVYHITTERS_HPP
+#define HEAVYHITTERS_HPP
+
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <cstdint>
+
+#include "HashMap.hpp"
+
+#define HEAVY_HITTERS_CAPACITY 128
+#define HEAVY_HITTERS_SAMPLE_EVERY 64
+
+/*
+* @brief Template parameters:
+* - KeyT : type of the counted keys
+*/
+template <class KeyT>
+
+/*
+* @class SpaceSaving
+* @brief The space-saving top-k sketch (Metwally et al.): at most capacity
+* counters, and an unseen key takes over the smallest counter, inheriting
+* its count as the error bound. Any key counted more than total / capacity
+* times is guaranteed to hold a counter
+* @var counters Min-heap of counters by count
+* @var positions Position of each counted key in the heap
+* @var max_counters Maximum number of counters
+* @var total Sum of every offered weight
+*/
+class SpaceSaving {
+public:
+
+    /*
+    * @struct Entry
+    * @brief A key with its estimated count, which overestimates the true
+    * count by at most error
+    */
+    struct Entry {
+        KeyT key;
+        std::uint64_t count;
+        std::uint64_t error;
+    };
+
+    /*
+    * @brief Constructs an empty sketch
+    * @param capacity Maximum number of counters
+    * @throws std::invalid_argument if capacity is 0
+    */
+    explicit SpaceSaving(size_t capacity = HEAVY_HITTERS_CAPACITY);
+
+    /*
+    * @brief Counts an occurrence of a key
+    * @param key Key to count
+    * @param weight Occurrences to add
+    */
+    void offer(const KeyT& key, std::uint64_t weight = 1);
+
+    /*
+    * @brief Returns the keys with the largest estimated counts
+    * @param n Maximum number of keys to return
+    * @return Up to n entries, largest count first
+    */
+    std::vector<Entry> top(size_t n) const;
+
+    /*
+    * @brief Returns the sum of every offered weight
+    * @return Total count
+    */
+    std::uint64_t total_count() const;
+
+    /*
+    * @brief Removes every counter
+    */
+    void clear();
+
+private:
+    std::vector<Entry> counters;
+    HashMap<KeyT, size_t> positions;
+    size_t max_counters;
+    std::uint64_t total;
+
+    /*
+    * @brief Moves a counter towards the root while it is smaller than its parent
+    * @param i Heap position of the counter
+    */
+    void sift_up(size_t i);
+
+    /*
+    * @brief Moves a counter towards the leaves while it is larger than a child
+    * @param i Heap position of the counter
+    */
+    void sift_down(size_t i);
+
+    /*
+    * @brief Swaps two counters and updates their positions
+    */
+    void swap_counters(size_t i, size_t j);
+};
+
+/*
+* @brief Template parameters:
+* - KeyT : type of the observed keys
+*/
+template <class KeyT>
+
+/*
+* @class HeavyHitters
+* @brief Opt-in lookup sampler for HashMap and Dictionary: every sampled
+* lookup is counted in one of two space-saving sketches, the most accessed
+* keys and the most missed keys, queryable while the map is in use
+* @var hits Sketch of sampled lookups that found their key
+* @var misses Sketch of sampled lookups that didn't
+* @var lock Guards both sketches (only taken for sampled lookups)
+* @note Attach with map.set_lookup_observer(&sampler). Reported counts are
+* scaled back up by the sampling period, so they estimate real lookups
+*/
+class HeavyHitters : public LookupObserver<KeyT> {
+public:
+    using Entry = typename SpaceSaving<KeyT>::Entry;
+
+    /*
+    * @brief Constructs an empty sampler
+    * @param capacity Counters per sketch, bounds the memory used
+    * @param sample_every Sampling period, one lookup in sample_every is
+    * counted (rounded up to a power of 2)
+    */
+    explicit HeavyHitters(size_t capacity = HEAVY_HITTERS_CAPACITY,
+                          unsigned sample_every = HEAVY_HITTERS_SAMPLE_EVERY);
+
+    /*
+    * @brief Returns the most frequently accessed keys
+    * @param n Maximum number of keys to return
+    * @return Up to n entries, most accessed first, counts in estimated lookups
+    */
+    std::vector<Entry> hot(size_t n) const;
+
+    /*
+    * @brief Returns the most frequently missed keys
+    * @param n Maximum number of keys to return
+    * @return Up to n entries, most missed first, counts in estimated lookups
+    */
+    std::vector<Entry> missed(size_t n) const;
+
+    /*
+    * @brief Returns the estimated number of lookups observed so far
+    * @return Sampled lookups times the sampling period
+    */
+    std::uint64_t lookups() const;
+
+    /*
+    * @brief Forgets everything observed so far
+    */
+    void reset();
+
+protected:
+
+    /*
+    * @brief Counts a sampled lookup in the matching sketch
+    * @param key Key that was looked up
+    * @param found Whether the key was stored
+    */
+    void record(const KeyT& key, bool found) override;
+
+private:
+    SpaceSaving<KeyT> hits;
+    SpaceSaving<KeyT> misses;
+    mutable std::mutex lock;
+
+    /*
+    * @brief Scales sketch entries from samples to estimated lookups
+    * @param entries Entries to scale
+    * @return The scaled entries
+    */
+    std::vector<Entry> scaled(std::vector<Entry> entries) const;
+};
+
+// ==================== Implementation ====================
+
+template <class KeyT>
+SpaceSaving<KeyT>::SpaceSaving(size_t capacity) : max_counters(capacity), total(0) {
+    if (capacity == 0) {
+        throw std::invalid_argument("sketch capacity must be positive");
+    }
+    counters.reserve(capacity);
+    positions.reserve(static_cast<int>(capacity));
+}
+
+
+template <class KeyT>
+void SpaceSaving<KeyT>::offer(const KeyT& key, std::uint64_t weight) {
+    total += weight;
+    std::size_t hash = std::hash<KeyT>()(key);
+    size_t* position = positions.find_hashed(key, hash);
+    if (position != nullptr) {
+        counters[*position].count += weight;
+        sift_down(*position);
+        return;
+    }
+    if (counters.size() < max_counters) {
+        counters.push_back(Entry{key, weight, 0});
+        positions.insert_hashed(key, hash, counters.size() - 1);
+        sift_up(counters.size() - 1);
+        return;
+    }
+    // evict the smallest counter, the newcomer may have been counted there
+    Entry& smallest = counters[0];
+    positions.erase(smallest.key);
+    std::uint64_t floor = smallest.count;
+    smallest = Entry{key, floor + weight, floor};
+    positions.insert_hashed(key, hash, 0);
+    sift_down(0);
+}
+
+
+template <class KeyT>
+std::vector<typename SpaceSaving<KeyT>::Entry> SpaceSaving<KeyT>::top(size_t n) const {
+    std::vector<Entry> result(counters);
+    std::sort(result.begin(), result.end(), [](const Entry& a, const Entry& b) {
+        return a.count > b.count;
+    });
+    if (result.size() > n) result.resize(n);
+    return result;
+}
+
+
+template <class KeyT>
+std::uint64_t SpaceSaving<KeyT>::total_count() const {
+    return total;
+}
+
+
+template <class KeyT>
+void SpaceSaving<KeyT>::clear() {
+    counters.clear();
+    positions.clear();
+    total = 0;
+}
+
+
+template <class KeyT>
+void SpaceSaving<KeyT>::sift_up(size_t i) {
+    while (i > 0 && counters[(i - 1) / 2].count > counters[i].count) {
+        swap_counters(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+
+template <class KeyT>
+void SpaceSaving<KeyT>::sift_down(size_t i) {
+    for (;;) {
+        size_t smallest = i;
+        for (size_t child = 2 * i + 1; child <= 2 * i + 2 && child < counters.size(); child++) {
+            if (counters[child].count < counters[smallest].count) smallest = child;
+        }
+        if (smallest == i) return;
+        swap_counters(i, smallest);
+        i = smallest;
+    }
+}
+
+
+template <class KeyT>
+void SpaceSaving<KeyT>::swap_counters(size_t i, size_t j) {
+    std::swap(counters[i], counters[j]);
+    positions.at(counters[i].key) = i;
+    positions.at(counters[j].key) = j;
+}
+
+
+template <class KeyT>
+HeavyHitters<KeyT>::HeavyHitters(size_t capacity, unsigned sample_every) :
+    LookupObserver<KeyT>(sample_every), hits(capacity), misses(capacity) {}
+
+
+template <class KeyT>
+std::vector<typename HeavyHitters<KeyT>::Entry> HeavyHitters<KeyT>::hot(size_t n) const {
+    std::lock_guard<std::mutex> guard(lock);
+    return scaled(hits.top(n));
+}
+
+
+template <class KeyT>
+std::vector<typename HeavyHitters<KeyT>::Entry> HeavyHitters<KeyT>::missed(size_t n) const {
+    std::lock_guard<std::mutex> guard(lock);
+    return scaled(misses.top(n));
+}
+
+
+template <class KeyT>
+std::uint64_t HeavyHitters<KeyT>::lookups() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return (hits.total_count() + misses.total_count()) * this->sample_every();
+}
+
+
+template <class KeyT>
+void HeavyHitters<KeyT>::reset() {
+    std::lock_guard<std::mutex> guard(lock);
+    hits.clear();
+    misses.clear();
+}
+
+
+template <class KeyT>
+void HeavyHitters<KeyT>::record(const KeyT& key, bool found) {
+    std::lock_guard<std::mutex> guard(lock);
+    (found ? hits : misses).offer(key);
+}
+
+
+template <class KeyT>
+std::vector<typename HeavyHitters<KeyT>::Entry>
+HeavyHitters<KeyT>::scaled(std::vector<Entry> entries) const {
+    for (auto& entry : entries) {
+        entry.count *= this->sample_every();
+        entry.error *= this->sample_every();
+    }
+    return entries;
+}
+
+#endif //HEAVYHITTERS_HPP
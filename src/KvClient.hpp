@@ -0,0 +1,355 @@
+#ifndef KVCLIENT_HPP
+#define KVCLIENT_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "Resp.hpp"
+
+#define KV_CLIENT_READ_CHUNK 65536
+
+/*
+* @class KvClient
+* @brief Blocking RESP client for a KvServer. Requests can be pipelined:
+* send() only buffers, flush() writes every buffered request at once and
+* receive() takes the replies out in order
+* @var fd Connected socket
+* @var output Requests buffered since the last flush()
+* @var input Parser holding replies read and not yet received
+*/
+class KvClient {
+public:
+
+    /*
+    * @brief Connects to a server's Unix socket
+    * @param path Socket path
+    * @return The connected client
+    * @throws std::runtime_error if the connection fails
+    */
+    static KvClient connect_unix(const std::string& path);
+
+    /*
+    * @brief Connects to a server's TCP port
+    * @param host IPv4 address of the server
+    * @param port Port of the server
+    * @return The connected client
+    * @throws std::runtime_error if the connection fails
+    */
+    static KvClient connect_tcp(const std::string& host, int port);
+
+    KvClient(KvClient&& other) noexcept;
+    KvClient& operator=(KvClient&& other) noexcept;
+    KvClient(const KvClient&) = delete;
+    KvClient& operator=(const KvClient&) = delete;
+
+    /*
+    * @brief Closes the connection (destructor)
+    */
+    ~KvClient();
+
+    /*
+    * @brief Buffers a request without sending it
+    * @param args Command name followed by its arguments
+    */
+    void send(const std::vector<std::string>& args);
+
+    /*
+    * @brief Writes every buffered request
+    * @throws std::runtime_error if the connection fails
+    */
+    void flush();
+
+    /*
+    * @brief Waits for the next reply
+    * @return The reply
+    * @throws std::runtime_error if the connection closes or fails
+    */
+    RespValue receive();
+
+    /*
+    * @brief Sends one request and waits for its reply
+    * @param args Command name followed by its arguments
+    * @return The reply
+    * @throws std::runtime_error if the connection fails
+    */
+    RespValue call(const std::vector<std::string>& args);
+
+    /*
+    * @brief Looks a key up
+    * @param key Key to look up
+    * @param value Set to the key's value when found
+    * @return true if the key exists, false otherwise
+    * @throws std::runtime_error on connection or server errors
+    */
+    bool get(const std::string& key, std::string& value);
+
+    /*
+    * @brief Stores a pair, replacing any previous value
+    * @param key Key to store
+    * @param value Value to store
+    * @throws std::runtime_error on connection or server errors
+    */
+    void set(const std::string& key, const std::string& value);
+
+    /*
+    * @brief Erases a key
+    * @param key Key to erase
+    * @return true if the key existed
+    * @throws std::runtime_error on connection or server errors
+    */
+    bool del(const std::string& key);
+
+    /*
+    * @brief Looks several keys up in one round trip
+    * @param keys Keys to look up
+    * @param values Set to one value per key
+    * @param found Set to whether each key exists
+    * @throws std::runtime_error on connection or server errors
+    */
+    void mget(const std::vector<std::string>& keys, std::vector<std::string>& values,
+              std::vector<bool>& found);
+
+    /*
+    * @brief Stores several pairs in one round trip
+    * @param pairs Pairs to store
+    * @throws std::runtime_error on connection or server errors
+    */
+    void mset(const std::vector<std::pair<std::string, std::string>>& pairs);
+
+    /*
+    * @brief Runs one step of a scan over the server's keys (see HashMap::scan())
+    * @param cursor 0 to start, then the cursor returned by the previous step
+    * @param count Minimum number of keys to return (fewer at the end)
+    * @param keys Set to the keys of this step
+    * @return Cursor of the next step, 0 when the scan is complete
+    * @throws std::runtime_error on connection or server errors
+    */
+    std::size_t scan(std::size_t cursor, size_t count, std::vector<std::string>& keys);
+
+private:
+    int fd;
+    std::string output;
+    RespParser input;
+
+    /*
+    * @brief Wraps a connected socket
+    * @param fd Connected socket
+    */
+    explicit KvClient(int fd);
+
+    /*
+    * @brief Throws if a reply is an error
+    * @param reply Reply to check
+    * @return The reply
+    * @throws std::runtime_error with the server's message
+    */
+    static RespValue& check(RespValue& reply);
+
+    /*
+    * @brief Throws a std::runtime_error naming the failed call and errno
+    * @param what Name of the failed call
+    */
+    [[noreturn]] static void fail(const std::string& what);
+};
+
+// ==================== Implementation ====================
+
+inline KvClient KvClient::connect_unix(const std::string& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Unix socket path too long: " + path);
+    }
+    std::strcpy(address.sun_path, path.c_str());
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) fail("socket");
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        fail("connect to " + path);
+    }
+    return KvClient(fd);
+}
+
+
+inline KvClient KvClient::connect_tcp(const std::string& host, int port) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<std::uint16_t>(port));
+    if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) {
+        throw std::runtime_error("invalid IPv4 address: " + host);
+    }
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) fail("socket");
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        fail("connect to " + host + ":" + std::to_string(port));
+    }
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    return KvClient(fd);
+}
+
+
+inline KvClient::KvClient(int fd) : fd(fd) {}
+
+
+inline KvClient::KvClient(KvClient&& other) noexcept :
+    fd(other.fd), output(std::move(other.output)), input(std::move(other.input)) {
+    other.fd = -1;
+}
+
+
+inline KvClient& KvClient::operator=(KvClient&& other) noexcept {
+    if (this != &other) {
+        if (fd >= 0) close(fd);
+        fd = other.fd;
+        output = std::move(other.output);
+        input = std::move(other.input);
+        other.fd = -1;
+    }
+    return *this;
+}
+
+
+inline KvClient::~KvClient() {
+    if (fd >= 0) close(fd);
+}
+
+
+inline void KvClient::send(const std::vector<std::string>& args) {
+    RespWriter::command(output, args);
+}
+
+
+inline void KvClient::flush() {
+    size_t sent = 0;
+    while (sent < output.size()) {
+        ssize_t written = write(fd, output.data() + sent, output.size() - sent);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            fail("write");
+        }
+        sent += static_cast<size_t>(written);
+    }
+    output.clear();
+}
+
+
+inline RespValue KvClient::receive() {
+    RespValue reply;
+    char chunk[KV_CLIENT_READ_CHUNK];
+    while (!input.next(reply)) {
+        ssize_t received = read(fd, chunk, sizeof(chunk));
+        if (received == 0) throw std::runtime_error("connection closed by server");
+        if (received < 0) {
+            if (errno == EINTR) continue;
+            fail("read");
+        }
+        input.feed(chunk, static_cast<size_t>(received));
+    }
+    return reply;
+}
+
+
+inline RespValue KvClient::call(const std::vector<std::string>& args) {
+    send(args);
+    flush();
+    return receive();
+}
+
+
+inline bool KvClient::get(const std::string& key, std::string& value) {
+    RespValue reply = call({"GET", key});
+    if (check(reply).type == RespValue::Type::Null) return false;
+    value = std::move(reply.text);
+    return true;
+}
+
+
+inline void KvClient::set(const std::string& key, const std::string& value) {
+    RespValue reply = call({"SET", key, value});
+    check(reply);
+}
+
+
+inline bool KvClient::del(const std::string& key) {
+    RespValue reply = call({"DEL", key});
+    return check(reply).integer > 0;
+}
+
+
+inline void KvClient::mget(const std::vector<std::string>& keys, std::vector<std::string>& values,
+                           std::vector<bool>& found) {
+    values.assign(keys.size(), std::string());
+    found.assign(keys.size(), false);
+    if (keys.empty()) return;
+    std::vector<std::string> args;
+    args.reserve(keys.size() + 1);
+    args.push_back("MGET");
+    args.insert(args.end(), keys.begin(), keys.end());
+    RespValue reply = call(args);
+    if (check(reply).elements.size() != keys.size()) {
+        throw std::runtime_error("MGET reply has the wrong number of values");
+    }
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (reply.elements[i].type != RespValue::Type::Null) {
+            values[i] = std::move(reply.elements[i].text);
+            found[i] = true;
+        }
+    }
+}
+
+
+inline void KvClient::mset(const std::vector<std::pair<std::string, std::string>>& pairs) {
+    if (pairs.empty()) return;
+    std::vector<std::string> args;
+    args.reserve(2 * pairs.size() + 1);
+    args.push_back("MSET");
+    for (const auto& [key, value] : pairs) {
+        args.push_back(key);
+        args.push_back(value);
+    }
+    RespValue reply = call(args);
+    check(reply);
+}
+
+
+inline std::size_t KvClient::scan(std::size_t cursor, size_t count, std::vector<std::string>& keys) {
+    RespValue reply = call({"SCAN", std::to_string(cursor), "COUNT", std::to_string(count)});
+    if (check(reply).elements.size() != 2) throw std::runtime_error("unexpected SCAN reply");
+    keys.clear();
+    for (auto& key : reply.elements[1].elements) {
+        keys.push_back(std::move(key.text));
+    }
+    return std::strtoull(reply.elements[0].text.c_str(), nullptr, 10);
+}
+
+
+inline RespValue& KvClient::check(RespValue& reply) {
+    if (reply.type == RespValue::Type::Error) throw std::runtime_error(reply.text);
+    return reply;
+}
+
+
+inline void KvClient::fail(const std::string& what) {
+    throw std::runtime_error(what + " failed: " + std::strerror(errno));
+}
+
+#endif //KVCLIENT_HPP
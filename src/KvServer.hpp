@@ -0,0 +1,639 @@
+#ifndef KVSERVER_HPP
+#define KVSERVER_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "Dictionary.hpp"
+#include "Resp.hpp"
+#include "Snapshot.hpp"
+#include "BackgroundSaver.hpp"
+
+#define KV_MAX_EVENTS 64
+#define KV_READ_CHUNK 65536
+#define KV_LISTEN_BACKLOG 128
+#define KV_SCAN_COUNT 10
+#define KV_MAX_INPUT (64 * 1024 * 1024)
+#define KV_MAX_OUTPUT (256 * 1024 * 1024)
+
+/*
+* @class KvServer
+* @brief Serves a Dictionary to local processes over a Unix domain socket
+* and/or loopback TCP, speaking RESP (GET, SET, DEL, MGET, MSET, PING,
+* DBSIZE, SCAN, BGSAVE, LASTSAVE). One epoll thread owns the Dictionary, so
+* no locking is needed. Every read parses all the pipelined requests it
+* delivered and their replies go back in one batched write
+* @var dictionary The served Dictionary
+* @var epoll_fd The event loop's epoll instance
+* @var wake_fd eventfd that stop() writes to, to break out of run()
+* @var task_fd eventfd that post() writes to, to run the queued tasks
+* @var unix_fd Listening Unix socket, -1 if not used
+* @var tcp_fd Listening TCP socket, -1 if not used
+* @var connections Open client connections by file descriptor
+* @var snapshot_path Where BGSAVE writes, empty if snapshots are off
+* @var saver Runs BGSAVE in a forked child
+* @var max_input Most bytes a connection may have buffered for requests not
+* complete yet, so no single request can be larger (see Options)
+* @var max_output Most reply bytes a connection may have waiting to be sent
+* @note A client exceeding either limit is disconnected: one sending an
+* oversized request gets an error first, one not reading its replies is
+* dropped with them
+*/
+class KvServer {
+public:
+
+    /*
+    * @struct Options
+    * @brief Where to listen, at least one of the two must be set, and
+    * where to keep the snapshot
+    */
+    struct Options {
+        std::string unix_path;      // Unix socket path, empty for none
+        int tcp_port = -1;          // loopback TCP port, -1 for none (0 picks a free port)
+        std::string snapshot_path;  // loaded at startup if present and written by BGSAVE, empty for none
+        size_t max_input = KV_MAX_INPUT;    // per-connection limit on buffered request bytes
+        size_t max_output = KV_MAX_OUTPUT;  // per-connection limit on unsent reply bytes
+    };
+
+    /*
+    * @brief Creates the listening sockets and loads the snapshot
+    * @param options Where to listen and where the snapshot is
+    * @throws std::runtime_error if no endpoint is given, a limit is 0, a
+    * socket call fails or the snapshot is corrupt
+    */
+    explicit KvServer(const Options& options);
+
+    /*
+    * @brief Closes every socket and removes the Unix socket file (destructor)
+    */
+    virtual ~KvServer();
+
+    KvServer(const KvServer&) = delete;
+    KvServer& operator=(const KvServer&) = delete;
+
+    /*
+    * @brief Runs the event loop until stop() is called
+    */
+    void run();
+
+    /*
+    * @brief Makes run() return, safe from other threads and signal handlers
+    */
+    void stop();
+
+    /*
+    * @brief Queues a function to run on the event loop thread, the only
+    * thread that may touch the Dictionary while run() is running
+    * @param task Function to run, safe to call from any thread
+    */
+    void post(std::function<void()> task);
+
+    /*
+    * @brief Returns the TCP port actually bound (useful with port 0)
+    * @return The port, -1 if not listening on TCP
+    */
+    int tcp_port() const;
+
+    /*
+    * @brief Returns the served Dictionary, only safe to use while run() is not running
+    * @return The Dictionary
+    */
+    Dictionary& dictionary();
+
+protected:
+
+    /*
+    * @brief Executes one request and appends its reply
+    * @param args Command name followed by its arguments
+    * @param out Reply buffer of the connection
+    */
+    virtual void execute(const std::vector<std::string>& args, std::string& out);
+
+    /*
+    * @brief Stores a pair on behalf of SET and MSET
+    * @param key Key to store
+    * @param value Value to store
+    */
+    virtual void apply_set(const std::string& key, const std::string& value);
+
+    /*
+    * @brief Erases a key on behalf of DEL
+    * @param key Key to erase
+    * @return true if the key existed
+    */
+    virtual bool apply_erase(const std::string& key);
+
+    /*
+    * @brief Called after executing the requests that arrived in one read,
+    * before their replies are sent
+    * @throws std::exception to fail the batch: each of its replies is
+    * replaced with an error carrying what(), the connection stays open
+    */
+    virtual void on_requests_executed() {}
+
+    /*
+    * @brief Compares a command name case-insensitively
+    * @param name Command name received
+    * @param command Upper-case command name
+    * @return true if they match
+    */
+    static bool is_command(const std::string& name, const char* command);
+
+    Dictionary store;
+
+private:
+
+    /*
+    * @struct Connection
+    * @brief A client socket with its unparsed input and unsent output
+    */
+    struct Connection {
+        int fd;
+        RespParser input;
+        std::string output;
+        size_t sent = 0;
+        bool want_write = false;
+    };
+
+    int epoll_fd = -1;
+    int wake_fd = -1;
+    int task_fd = -1;
+    int unix_fd = -1;
+    int tcp_fd = -1;
+    int bound_port = -1;
+    std::string unix_path;
+    HashMap<int, std::shared_ptr<Connection>> connections;
+    std::string snapshot_path;
+    BackgroundSaver saver;
+    size_t max_input;
+    size_t max_output;
+    std::mutex tasks_lock;
+    std::vector<std::function<void()>> tasks;
+
+    /*
+    * @brief Registers a descriptor with epoll
+    * @param fd Descriptor to watch
+    * @param events epoll event mask
+    */
+    void watch(int fd, std::uint32_t events);
+
+    /*
+    * @brief Accepts every pending client of a listening socket
+    * @param listen_fd Listening socket
+    */
+    void accept_clients(int listen_fd);
+
+    /*
+    * @brief Reads what a client sent, executes every complete request and
+    * sends the replies
+    * @param connection The client
+    * @return false if the connection must be closed (including when it
+    * exceeds max_input or max_output)
+    */
+    bool handle_input(Connection& connection);
+
+    /*
+    * @brief Runs on_requests_executed() for a batch of requests, replacing
+    * the batch's replies with errors if it throws
+    * @param connection The client
+    * @param batch_start Size of the output before the batch's replies
+    * @param replies Number of replies the batch appended
+    */
+    void finish_batch(Connection& connection, size_t batch_start, size_t replies);
+
+    /*
+    * @brief Writes as much pending output as the socket takes, and watches
+    * for writability while some is left
+    * @param connection The client
+    * @return false if the connection must be closed
+    */
+    bool flush(Connection& connection);
+
+    /*
+    * @brief Unregisters and closes a client
+    * @param fd The client's descriptor
+    */
+    void close_connection(int fd);
+
+    /*
+    * @brief Makes a descriptor non-blocking
+    * @param fd Descriptor
+    */
+    static void set_nonblocking(int fd);
+
+    /*
+    * @brief Throws a std::runtime_error naming the failed call and errno
+    * @param what Name of the failed call
+    */
+    [[noreturn]] static void fail(const std::string& what);
+};
+
+// ==================== Implementation ====================
+
+inline KvServer::KvServer(const Options& options) :
+    snapshot_path(options.snapshot_path), max_input(options.max_input), max_output(options.max_output) {
+    if (options.unix_path.empty() && options.tcp_port < 0) {
+        throw std::runtime_error("KvServer needs a Unix socket path or a TCP port");
+    }
+    if (max_input == 0 || max_output == 0) {
+        throw std::runtime_error("KvServer buffer limits must be positive");
+    }
+    if (!snapshot_path.empty() && access(snapshot_path.c_str(), F_OK) == 0) {
+        IncrementalSnapshot<std::string, std::string>::load({snapshot_path}, store);
+    }
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) fail("epoll_create1");
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd < 0) fail("eventfd");
+    watch(wake_fd, EPOLLIN);
+    task_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (task_fd < 0) fail("eventfd");
+    watch(task_fd, EPOLLIN);
+    if (!options.unix_path.empty()) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (options.unix_path.size() >= sizeof(address.sun_path)) {
+            throw std::runtime_error("Unix socket path too long: " + options.unix_path);
+        }
+        std::strcpy(address.sun_path, options.unix_path.c_str());
+        unix_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (unix_fd < 0) fail("socket");
+        unlink(options.unix_path.c_str());
+        if (bind(unix_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) fail("bind");
+        if (listen(unix_fd, KV_LISTEN_BACKLOG) < 0) fail("listen");
+        unix_path = options.unix_path;
+        set_nonblocking(unix_fd);
+        watch(unix_fd, EPOLLIN);
+    }
+    if (options.tcp_port >= 0) {
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(static_cast<std::uint16_t>(options.tcp_port));
+        tcp_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (tcp_fd < 0) fail("socket");
+        int on = 1;
+        setsockopt(tcp_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (bind(tcp_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) fail("bind");
+        if (listen(tcp_fd, KV_LISTEN_BACKLOG) < 0) fail("listen");
+        socklen_t length = sizeof(address);
+        getsockname(tcp_fd, reinterpret_cast<sockaddr*>(&address), &length);
+        bound_port = ntohs(address.sin_port);
+        set_nonblocking(tcp_fd);
+        watch(tcp_fd, EPOLLIN);
+    }
+}
+
+
+inline KvServer::~KvServer() {
+    for (auto& [fd, connection] : connections) {
+        close(fd);
+    }
+    for (int fd : {unix_fd, tcp_fd, task_fd, wake_fd, epoll_fd}) {
+        if (fd >= 0) close(fd);
+    }
+    if (!unix_path.empty()) unlink(unix_path.c_str());
+}
+
+
+inline void KvServer::run() {
+    epoll_event events[KV_MAX_EVENTS];
+    for (;;) {
+        int ready = epoll_wait(epoll_fd, events, KV_MAX_EVENTS, -1);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            fail("epoll_wait");
+        }
+        for (int i = 0; i < ready; i++) {
+            int fd = events[i].data.fd;
+            if (fd == wake_fd) {
+                std::uint64_t count;
+                while (read(wake_fd, &count, sizeof(count)) > 0) {
+                }
+                return;
+            }
+            if (fd == task_fd) {
+                std::uint64_t count;
+                while (read(task_fd, &count, sizeof(count)) > 0) {
+                }
+                std::vector<std::function<void()>> ready_tasks;
+                {
+                    std::lock_guard<std::mutex> guard(tasks_lock);
+                    ready_tasks.swap(tasks);
+                }
+                for (auto& task : ready_tasks) task();
+                continue;
+            }
+            if (fd == unix_fd || fd == tcp_fd) {
+                accept_clients(fd);
+                continue;
+            }
+            auto* found = connections.find_hashed(fd, std::hash<int>()(fd));
+            if (found == nullptr) continue;
+            std::shared_ptr<Connection> connection = *found;
+            bool open = true;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                open = handle_input(*connection);
+            }
+            if (open && (events[i].events & EPOLLOUT)) {
+                open = flush(*connection);
+            }
+            if (!open) close_connection(fd);
+        }
+    }
+}
+
+
+inline void KvServer::stop() {
+    std::uint64_t one = 1;
+    // write() is async-signal-safe, nothing else is touched here
+    ssize_t written = write(wake_fd, &one, sizeof(one));
+    (void)written;
+}
+
+
+inline void KvServer::post(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> guard(tasks_lock);
+        tasks.push_back(std::move(task));
+    }
+    std::uint64_t one = 1;
+    ssize_t written = write(task_fd, &one, sizeof(one));
+    (void)written;
+}
+
+
+inline int KvServer::tcp_port() const {
+    return bound_port;
+}
+
+
+inline Dictionary& KvServer::dictionary() {
+    return store;
+}
+
+
+inline void KvServer::execute(const std::vector<std::string>& args, std::string& out) {
+    const std::string& name = args[0];
+    if (is_command(name, "GET") && args.size() == 2) {
+        const std::string* value = store.find_hashed(args[1], std::hash<std::string>()(args[1]));
+        if (value == nullptr) {
+            RespWriter::null(out);
+        } else {
+            RespWriter::bulk(out, *value);
+        }
+    } else if (is_command(name, "SET") && args.size() == 3) {
+        apply_set(args[1], args[2]);
+        RespWriter::simple(out, "OK");
+    } else if (is_command(name, "DEL") && args.size() >= 2) {
+        long long erased = 0;
+        for (size_t i = 1; i < args.size(); i++) {
+            erased += apply_erase(args[i]) ? 1 : 0;
+        }
+        RespWriter::integer(out, erased);
+    } else if (is_command(name, "MGET") && args.size() >= 2) {
+        RespWriter::array(out, args.size() - 1);
+        for (size_t i = 1; i < args.size(); i++) {
+            const std::string* value = store.find_hashed(args[i], std::hash<std::string>()(args[i]));
+            if (value == nullptr) {
+                RespWriter::null(out);
+            } else {
+                RespWriter::bulk(out, *value);
+            }
+        }
+    } else if (is_command(name, "MSET") && args.size() >= 3 && args.size() % 2 == 1) {
+        for (size_t i = 1; i < args.size(); i += 2) {
+            apply_set(args[i], args[i + 1]);
+        }
+        RespWriter::simple(out, "OK");
+    } else if (is_command(name, "PING") && args.size() <= 2) {
+        if (args.size() == 2) {
+            RespWriter::bulk(out, args[1]);
+        } else {
+            RespWriter::simple(out, "PONG");
+        }
+    } else if (is_command(name, "SCAN") && (args.size() == 2 || (args.size() == 4 && is_command(args[2], "COUNT")))) {
+        // SCAN cursor [COUNT n]: the next cursor and at least n keys (fewer at the end)
+        std::size_t cursor = std::strtoull(args[1].c_str(), nullptr, 10);
+        size_t count = args.size() == 4 ? std::strtoull(args[3].c_str(), nullptr, 10) : KV_SCAN_COUNT;
+        std::vector<const std::string*> keys;
+        do {
+            cursor = store.scan(cursor, [&keys](const std::string& key, const std::string&) {
+                keys.push_back(&key);
+            });
+        } while (cursor != 0 && keys.size() < count);
+        RespWriter::array(out, 2);
+        RespWriter::bulk(out, std::to_string(cursor));
+        RespWriter::array(out, keys.size());
+        for (const std::string* key : keys) {
+            RespWriter::bulk(out, *key);
+        }
+    } else if (is_command(name, "DBSIZE") && args.size() == 1) {
+        RespWriter::integer(out, store.size());
+    } else if (is_command(name, "BGSAVE") && args.size() == 1) {
+        if (snapshot_path.empty()) {
+            RespWriter::error(out, "ERR no snapshot path configured");
+        } else if (!saver.snapshot_async(store, snapshot_path)) {
+            RespWriter::error(out, "ERR Background save already in progress");
+        } else {
+            RespWriter::simple(out, "Background saving started");
+        }
+    } else if (is_command(name, "LASTSAVE") && args.size() == 1) {
+        // Unix time of the last successful save, 0 if none
+        auto last = saver.status().last_success;
+        RespWriter::integer(out, std::chrono::duration_cast<std::chrono::seconds>(last.time_since_epoch()).count());
+    } else {
+        RespWriter::error(out, "ERR unknown command or wrong number of arguments for '" + name + "'");
+    }
+}
+
+
+inline void KvServer::apply_set(const std::string& key, const std::string& value) {
+    store.insert_or_assign(key, value);
+}
+
+
+inline bool KvServer::apply_erase(const std::string& key) {
+    return store.erase_hashed(key, std::hash<std::string>()(key));
+}
+
+
+inline bool KvServer::is_command(const std::string& name, const char* command) {
+    return strcasecmp(name.c_str(), command) == 0;
+}
+
+
+inline void KvServer::watch(int fd, std::uint32_t events) {
+    epoll_event event{};
+    event.events = events;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) fail("epoll_ctl");
+}
+
+
+inline void KvServer::accept_clients(int listen_fd) {
+    for (;;) {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            // EAGAIN: no more pending clients, anything else: drop this attempt
+            return;
+        }
+        if (listen_fd == tcp_fd) {
+            int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        }
+        auto connection = std::make_shared<Connection>();
+        connection->fd = fd;
+        connections.insert_or_assign(fd, connection);
+        watch(fd, EPOLLIN);
+    }
+}
+
+
+inline bool KvServer::handle_input(Connection& connection) {
+    char chunk[KV_READ_CHUNK];
+    bool closed = false;
+    for (;;) {
+        ssize_t received = read(connection.fd, chunk, sizeof(chunk));
+        if (received > 0) {
+            connection.input.feed(chunk, static_cast<size_t>(received));
+            // stop at the limit, the rest stays in the socket until this is executed
+            if (connection.input.buffered() >= max_input) break;
+            if (static_cast<size_t>(received) < sizeof(chunk)) break;
+        } else if (received == 0) {
+            closed = true;
+            break;
+        } else {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return false;
+        }
+    }
+    // execute everything that arrived, replies are batched into one buffer
+    RespValue request;
+    std::vector<std::string> args;
+    bool overflow = false;
+    size_t batch_start = connection.output.size();
+    size_t replies = 0;
+    try {
+        while (connection.input.next(request)) {
+            if (request.type != RespValue::Type::Array || request.elements.empty()) {
+                if (request.type != RespValue::Type::Array) {
+                    RespWriter::error(connection.output, "ERR requests must be arrays of bulk strings");
+                    replies++;
+                }
+                continue;
+            }
+            args.clear();
+            for (auto& element : request.elements) {
+                args.push_back(std::move(element.text));
+            }
+            execute(args, connection.output);
+            replies++;
+            if (connection.output.size() - connection.sent > max_output) {
+                overflow = true;
+                break;
+            }
+        }
+    } catch (const std::runtime_error& e) {
+        RespWriter::error(connection.output, std::string("ERR protocol error: ") + e.what());
+        finish_batch(connection, batch_start, replies + 1);
+        flush(connection);
+        return false;
+    }
+    finish_batch(connection, batch_start, replies);
+    // a client not reading its replies is dropped with them
+    if (overflow) return false;
+    // what is left is part of a request, which can't fit under the limit any more
+    if (connection.input.buffered() >= max_input) {
+        RespWriter::error(connection.output, "ERR request exceeds the input buffer limit");
+        flush(connection);
+        return false;
+    }
+    if (!flush(connection)) return false;
+    return !closed;
+}
+
+
+inline void KvServer::finish_batch(Connection& connection, size_t batch_start, size_t replies) {
+    try {
+        on_requests_executed();
+    } catch (const std::exception& e) {
+        // nothing past batch_start was sent, the replies go out after this
+        connection.output.resize(batch_start);
+        for (size_t i = 0; i < replies; i++) {
+            RespWriter::error(connection.output, std::string("ERR ") + e.what());
+        }
+    }
+}
+
+
+inline bool KvServer::flush(Connection& connection) {
+    while (connection.sent < connection.output.size()) {
+        ssize_t written = write(connection.fd, connection.output.data() + connection.sent,
+                                connection.output.size() - connection.sent);
+        if (written > 0) {
+            connection.sent += static_cast<size_t>(written);
+        } else if (written < 0 && errno == EINTR) {
+            continue;
+        } else if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            return false;
+        }
+    }
+    bool pending = connection.sent < connection.output.size();
+    if (!pending) {
+        connection.output.clear();
+        connection.sent = 0;
+    }
+    // only watch for writability while output is stuck
+    if (pending != connection.want_write) {
+        epoll_event event{};
+        event.events = pending ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+        event.data.fd = connection.fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection.fd, &event);
+        connection.want_write = pending;
+    }
+    return true;
+}
+
+
+inline void KvServer::close_connection(int fd) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    connections.erase(fd);
+}
+
+
+inline void KvServer::set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+
+inline void KvServer::fail(const std::string& what) {
+    throw std::runtime_error(what + " failed: " + std::strerror(errno));
+}
+
+#endif //KVSERVER_HPP
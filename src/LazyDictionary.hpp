@@ -0,0 +1,301 @@
+#ifndef LAZYDICTIONARY_HPP
+#define LAZYDICTIONARY_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <stdexcept>
+#include <utility>
+#include <cstdint>
+
+#include "Dictionary.hpp"
+#include "Snapshot.hpp"
+
+/*
+* @class LazyDictionary
+* @brief A Dictionary served straight from a snapshot chain (see
+* IncrementalSnapshot) without loading it first. Opening maps the files and
+* reads their block index only, so the first lookup is answered within
+* milliseconds whatever the snapshot's size. Each operation first loads the
+* segment its key hashes to, if no one has yet, and a background thread
+* loads the others in order meanwhile. Once every segment is in, the
+* LazyDictionary is an ordinary Dictionary behind a lock
+* @var chain The mapped snapshot files
+* @var mask Segment count - 1, a key's segment is its hash & mask
+* @var lock Protects store and unloaded_pairs, held while a decoded segment
+* is inserted but not while it is read and decoded
+* @var store Pairs of the loaded segments, with every write made since opening
+* @var loaded Whether each segment is in store
+* @var unloaded_pairs Pairs the chain holds for segments not in store yet
+* @var warmer Thread loading every segment
+* @var warm Set once every segment is loaded, or the warmer failed (written under lock)
+* @var warmed_signal Signaled when warm is set
+* @var warm_error Why the warmer stopped, if it failed
+* @var stopping Tells the warmer to stop
+* @note Safe to use from several threads. Segments are decoded outside the
+* lock, so a lookup of a cold key only waits for its own segment
+*/
+class LazyDictionary {
+public:
+
+    /*
+    * @brief Opens a snapshot chain and starts warming it
+    * @param paths Full snapshot first, then its deltas in the order they were saved
+    * @throws std::invalid_argument if paths is empty
+    * @throws std::runtime_error if a file can't be read, is corrupt or is
+    * not the child of the previous one
+    */
+    explicit LazyDictionary(const std::vector<std::string>& paths);
+
+    /*
+    * @brief Stops the warmer and unmaps the files (destructor)
+    */
+    ~LazyDictionary();
+
+    LazyDictionary(const LazyDictionary&) = delete;
+    LazyDictionary& operator=(const LazyDictionary&) = delete;
+
+    /*
+    * @brief Looks a key up
+    * @param key Key to look up
+    * @param value Set to the key's value when found
+    * @return true if the key exists, false otherwise
+    * @throws std::runtime_error if the key's segment is corrupt
+    */
+    bool get(const std::string& key, std::string& value);
+
+    /*
+    * @brief Returns whether a key exists
+    * @param key Key to look for
+    * @return true if the key exists, false otherwise
+    * @throws std::runtime_error if the key's segment is corrupt
+    */
+    bool contains_key(const std::string& key);
+
+    /*
+    * @brief Inserts a pair or assigns to an existing one
+    * @param key Key to insert or update
+    * @param value Value to store
+    * @return true if a new pair was inserted, false if a value was assigned
+    * @throws std::runtime_error if the key's segment is corrupt
+    */
+    bool insert_or_assign(const std::string& key, const std::string& value);
+
+    /*
+    * @brief Erases a key
+    * @param key Key to erase
+    * @return true if the key existed
+    * @throws std::runtime_error if the key's segment is corrupt
+    */
+    bool erase(const std::string& key);
+
+    /*
+    * @brief Returns the number of pairs, loaded or not
+    * @return Pairs in the store plus pairs of segments not loaded yet
+    */
+    size_t size();
+
+    /*
+    * @brief Returns the header of the last file of the chain
+    * @return Header, its id is the one the next delta must name as parent
+    */
+    const SnapshotHeader& head() const;
+
+    /*
+    * @brief Returns the number of segments loaded so far
+    * @return Loaded segments, head().segment_count once warm
+    */
+    size_t loaded_segments() const;
+
+    /*
+    * @brief Returns whether every segment is loaded
+    * @return true once warm (or once the warmer failed)
+    */
+    bool warmed() const;
+
+    /*
+    * @brief Waits until every segment is loaded
+    * @throws std::runtime_error if the warmer found a corrupt segment
+    */
+    void wait_until_warm();
+
+    /*
+    * @brief Waits until every segment is loaded and moves the Dictionary out
+    * @return Every pair, with the writes made since opening
+    * @throws std::runtime_error if the warmer found a corrupt segment
+    * @note The LazyDictionary is empty afterwards
+    */
+    Dictionary take();
+
+private:
+    SnapshotChain chain;
+    std::size_t mask;
+    std::mutex lock;
+    Dictionary store;
+    std::unique_ptr<std::atomic<bool>[]> loaded;
+    std::atomic<size_t> loaded_count{0};
+    std::uint64_t unloaded_pairs;
+    std::thread warmer;
+    std::atomic<bool> warm{false};
+    std::condition_variable warmed_signal;
+    std::exception_ptr warm_error;
+    std::atomic<bool> stopping{false};
+
+    /*
+    * @brief Loads a segment into store unless it is there already
+    * @param segment Segment index
+    * @throws std::runtime_error if the segment is corrupt
+    */
+    void ensure_loaded(std::size_t segment);
+
+    /*
+    * @brief Warmer thread body: loads every segment in order
+    */
+    void warm_up();
+};
+
+// ==================== Implementation ====================
+
+inline LazyDictionary::LazyDictionary(const std::vector<std::string>& paths)
+    : chain(paths), mask(chain.head().segment_count - 1),
+      loaded(new std::atomic<bool>[chain.head().segment_count]), unloaded_pairs(chain.pairs()) {
+    for (size_t segment = 0; segment <= mask; segment++) loaded[segment].store(false);
+    warmer = std::thread(&LazyDictionary::warm_up, this);
+}
+
+
+inline LazyDictionary::~LazyDictionary() {
+    stopping.store(true);
+    if (warmer.joinable()) warmer.join();
+}
+
+
+inline bool LazyDictionary::get(const std::string& key, std::string& value) {
+    std::size_t hash = std::hash<std::string>()(key);
+    ensure_loaded(hash & mask);
+    std::lock_guard<std::mutex> guard(lock);
+    const std::string* found = store.find_hashed(key, hash);
+    if (found == nullptr) return false;
+    value = *found;
+    return true;
+}
+
+
+inline bool LazyDictionary::contains_key(const std::string& key) {
+    std::size_t hash = std::hash<std::string>()(key);
+    ensure_loaded(hash & mask);
+    std::lock_guard<std::mutex> guard(lock);
+    return store.find_hashed(key, hash) != nullptr;
+}
+
+
+inline bool LazyDictionary::insert_or_assign(const std::string& key, const std::string& value) {
+    std::size_t hash = std::hash<std::string>()(key);
+    // the segment goes in first, or loading it later would undo the write
+    ensure_loaded(hash & mask);
+    std::lock_guard<std::mutex> guard(lock);
+    return store.insert_or_assign_hashed(key, hash, value);
+}
+
+
+inline bool LazyDictionary::erase(const std::string& key) {
+    std::size_t hash = std::hash<std::string>()(key);
+    ensure_loaded(hash & mask);
+    std::lock_guard<std::mutex> guard(lock);
+    return store.erase_hashed(key, hash);
+}
+
+
+inline size_t LazyDictionary::size() {
+    std::lock_guard<std::mutex> guard(lock);
+    return static_cast<size_t>(store.size()) + static_cast<size_t>(unloaded_pairs);
+}
+
+
+inline const SnapshotHeader& LazyDictionary::head() const {
+    return chain.head();
+}
+
+
+inline size_t LazyDictionary::loaded_segments() const {
+    return loaded_count.load();
+}
+
+
+inline bool LazyDictionary::warmed() const {
+    return warm.load();
+}
+
+
+inline void LazyDictionary::wait_until_warm() {
+    std::unique_lock<std::mutex> guard(lock);
+    warmed_signal.wait(guard, [this]() { return warm.load(); });
+    if (warm_error) std::rethrow_exception(warm_error);
+}
+
+
+inline Dictionary LazyDictionary::take() {
+    wait_until_warm();
+    std::lock_guard<std::mutex> guard(lock);
+    return std::move(store);
+}
+
+
+inline void LazyDictionary::ensure_loaded(std::size_t segment) {
+    if (loaded[segment].load(std::memory_order_acquire)) return;
+    // decode outside the lock, a racing load of the same segment is dropped below
+    std::string payload;
+    std::uint64_t pairs = chain.read_segment(static_cast<std::uint32_t>(segment), payload);
+    std::vector<std::pair<std::string, std::string>> decoded(pairs);
+    const char* cursor = payload.data();
+    const char* end = cursor + payload.size();
+    for (auto& pair : decoded) {
+        if (!Serializer<std::string>::read(cursor, end, pair.first)
+            || !Serializer<std::string>::read(cursor, end, pair.second)) {
+            throw std::runtime_error("malformed pair in snapshot segment " + std::to_string(segment));
+        }
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    if (loaded[segment].load(std::memory_order_relaxed)) return;
+    for (auto& pair : decoded) {
+        std::size_t hash = std::hash<std::string>()(pair.first);
+        store.insert_or_assign_hashed(std::move(pair.first), hash, std::move(pair.second));
+    }
+    unloaded_pairs -= pairs;
+    loaded[segment].store(true, std::memory_order_release);
+    loaded_count.fetch_add(1);
+}
+
+
+inline void LazyDictionary::warm_up() {
+    std::exception_ptr error;
+    try {
+        {
+            // sized here rather than when opening, which only maps the files, and
+            // outside the lock: only the pairs readers loaded meanwhile move in under it
+            Dictionary sized;
+            sized.reserve(static_cast<int>(chain.pairs()));
+            std::lock_guard<std::mutex> guard(lock);
+            sized.update(std::move(store));
+            store.swap(sized);
+        }
+        for (size_t segment = 0; segment <= mask && !stopping.load(); segment++) {
+            ensure_loaded(segment);
+        }
+    } catch (...) {
+        error = std::current_exception();
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        warm_error = error;
+        warm.store(true);
+    }
+    warmed_signal.notify_all();
+}
+
+#endif //LAZYDICTIONARY_HPP
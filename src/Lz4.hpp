@@ -0,0 +1,229 @@
+#ifndef LZ4_HPP
+#define LZ4_HPP
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+#define LZ4_MIN_MATCH 4
+#define LZ4_MAX_OFFSET 65535
+#define LZ4_HASH_BITS 12
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MATCH_FIND_LIMIT 12
+#define LZ4_SKIP_TRIGGER 6
+
+/*
+* @class Lz4
+* @brief In-tree LZ4 block codec: greedy single-probe match finding for
+* speed over ratio, output in the standard LZ4 block format (sequences of
+* literals plus a 16-bit back reference). Blocks are independent, so
+* snapshot segments can be compressed and decompressed on separate threads
+*/
+class Lz4 {
+public:
+
+    /*
+    * @brief Returns the largest compressed size of an input, for incompressible data
+    * @param length Input length
+    * @return Worst-case compressed length
+    */
+    static size_t bound(size_t length);
+
+    /*
+    * @brief Compresses a byte range as one block
+    * @param data Bytes to compress
+    * @param length Number of bytes
+    * @param out Compressed block appended to it
+    * @return Number of bytes appended
+    */
+    static size_t compress(const char* data, size_t length, std::string& out);
+
+    /*
+    * @brief Decompresses a block whose decompressed length is known
+    * @param data Compressed block
+    * @param length Length of the compressed block
+    * @param out Destination, out_length bytes
+    * @param out_length Decompressed length
+    * @return true if the block decoded to exactly out_length bytes, false if
+    * it is malformed (never reads or writes out of bounds)
+    */
+    static bool decompress(const char* data, size_t length, char* out, size_t out_length);
+
+private:
+
+    /*
+    * @brief Reads 4 bytes
+    * @param data Where to read
+    * @return The bytes as an integer (host order, only compared)
+    */
+    static std::uint32_t read32(const unsigned char* data);
+
+    /*
+    * @brief Hashes the 4 bytes at a position into the match table
+    * @param sequence The bytes
+    * @return Table slot
+    */
+    static std::uint32_t slot(std::uint32_t sequence);
+
+    /*
+    * @brief Appends the extension bytes of a length that overflowed its 4-bit field
+    * @param out Destination
+    * @param length Length minus 15
+    */
+    static void write_length(std::string& out, size_t length);
+
+    /*
+    * @brief Reads the extension bytes of a length
+    * @param data Compressed block
+    * @param length Length of the compressed block
+    * @param pos Position of the first extension byte, advanced past them
+    * @param value Incremented by the extension
+    * @return false if the block ends in the middle
+    */
+    static bool read_length(const unsigned char* data, size_t length, size_t& pos, size_t& value);
+
+    /*
+    * @brief Appends one sequence: literals, then a match unless it is the last one
+    * @param out Destination
+    * @param literals Literal bytes
+    * @param literal_count Number of literal bytes
+    * @param offset Distance back to the match, 0 for the last sequence
+    * @param match_length Length of the match (at least LZ4_MIN_MATCH)
+    */
+    static void sequence(std::string& out, const unsigned char* literals, size_t literal_count,
+                         size_t offset, size_t match_length);
+};
+
+// ==================== Implementation ====================
+
+inline size_t Lz4::bound(size_t length) {
+    return length + length / 255 + 16;
+}
+
+
+inline size_t Lz4::compress(const char* data, size_t length, std::string& out) {
+    size_t start = out.size();
+    out.reserve(start + bound(length));
+    const unsigned char* src = reinterpret_cast<const unsigned char*>(data);
+    size_t anchor = 0;
+    if (length > LZ4_MATCH_FIND_LIMIT) {
+        // the format wants the last match to start 12 bytes before the end
+        // and the last 5 bytes to be literals
+        size_t match_limit = length - LZ4_MATCH_FIND_LIMIT;
+        size_t end_limit = length - LZ4_LAST_LITERALS;
+        std::uint32_t table[1u << LZ4_HASH_BITS] = {};
+        size_t pos = 1;
+        table[slot(read32(src))] = 0;
+        while (pos < match_limit) {
+            std::uint32_t sequence_bytes = read32(src + pos);
+            std::uint32_t& entry = table[slot(sequence_bytes)];
+            size_t candidate = entry;
+            entry = static_cast<std::uint32_t>(pos);
+            if (candidate >= pos || pos - candidate > LZ4_MAX_OFFSET || read32(src + candidate) != sequence_bytes) {
+                // skip faster through data that doesn't match
+                pos += 1 + ((pos - anchor) >> LZ4_SKIP_TRIGGER);
+                continue;
+            }
+            while (pos > anchor && candidate > 0 && src[pos - 1] == src[candidate - 1]) {
+                pos--;
+                candidate--;
+            }
+            size_t match_length = LZ4_MIN_MATCH;
+            while (pos + match_length < end_limit && src[candidate + match_length] == src[pos + match_length]) {
+                match_length++;
+            }
+            sequence(out, src + anchor, pos - anchor, pos - candidate, match_length);
+            pos += match_length;
+            anchor = pos;
+            if (pos - 2 < match_limit) table[slot(read32(src + pos - 2))] = static_cast<std::uint32_t>(pos - 2);
+        }
+    }
+    sequence(out, src + anchor, length - anchor, 0, 0);
+    return out.size() - start;
+}
+
+
+inline bool Lz4::decompress(const char* data, size_t length, char* out, size_t out_length) {
+    const unsigned char* src = reinterpret_cast<const unsigned char*>(data);
+    size_t pos = 0;
+    size_t written = 0;
+    while (pos < length) {
+        unsigned token = src[pos++];
+        size_t literal_count = token >> 4;
+        if (literal_count == 15 && !read_length(src, length, pos, literal_count)) return false;
+        if (literal_count > length - pos || literal_count > out_length - written) return false;
+        std::memcpy(out + written, src + pos, literal_count);
+        pos += literal_count;
+        written += literal_count;
+        // the last sequence has no match
+        if (pos == length) break;
+        if (length - pos < 2) return false;
+        size_t offset = src[pos] | (static_cast<size_t>(src[pos + 1]) << 8);
+        pos += 2;
+        if (offset == 0 || offset > written) return false;
+        size_t match_length = token & 15;
+        if (match_length == 15 && !read_length(src, length, pos, match_length)) return false;
+        match_length += LZ4_MIN_MATCH;
+        if (match_length > out_length - written) return false;
+        char* destination = out + written;
+        const char* source = destination - offset;
+        if (offset >= match_length) {
+            std::memcpy(destination, source, match_length);
+        } else {
+            // overlapping copy repeats the last offset bytes
+            for (size_t i = 0; i < match_length; i++) destination[i] = source[i];
+        }
+        written += match_length;
+    }
+    return written == out_length;
+}
+
+
+inline std::uint32_t Lz4::read32(const unsigned char* data) {
+    std::uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+
+inline std::uint32_t Lz4::slot(std::uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+
+inline void Lz4::write_length(std::string& out, size_t length) {
+    while (length >= 255) {
+        out.push_back(static_cast<char>(255));
+        length -= 255;
+    }
+    out.push_back(static_cast<char>(length));
+}
+
+
+inline bool Lz4::read_length(const unsigned char* data, size_t length, size_t& pos, size_t& value) {
+    unsigned byte;
+    do {
+        if (pos >= length) return false;
+        byte = data[pos++];
+        value += byte;
+    } while (byte == 255);
+    return true;
+}
+
+
+inline void Lz4::sequence(std::string& out, const unsigned char* literals, size_t literal_count,
+                          size_t offset, size_t match_length) {
+    size_t match_code = offset == 0 ? 0 : match_length - LZ4_MIN_MATCH;
+    unsigned token = (literal_count >= 15 ? 15u : static_cast<unsigned>(literal_count)) << 4;
+    token |= match_code >= 15 ? 15u : static_cast<unsigned>(match_code);
+    out.push_back(static_cast<char>(token));
+    if (literal_count >= 15) write_length(out, literal_count - 15);
+    out.append(reinterpret_cast<const char*>(literals), literal_count);
+    if (offset == 0) return;
+    out.push_back(static_cast<char>(offset & 0xFF));
+    out.push_back(static_cast<char>(offset >> 8));
+    if (match_code >= 15) write_length(out, match_code - 15);
+}
+
+#endif //LZ4_HPP
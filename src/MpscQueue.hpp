@@ -0,0 +1,163 @@
+#ifndef MPSCQUEUE_HPP
+#define MPSCQUEUE_HPP
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <utility>
+#include <stdexcept>
+
+/*
+* @brief Template parameters:
+* - T : type of the queued elements (default-constructible and movable)
+*/
+template <class T>
+
+/*
+* @class MpscQueue
+* @brief A bounded lock-free multi-producer single-consumer queue (a ring of
+* cells stamped with sequence numbers, after Vyukov's bounded queue)
+* @var cells Ring of cells, capacity is a power of 2
+* @var mask capacity - 1
+* @var tail Next position producers claim (shared by producers)
+* @var head Next position the consumer reads (consumer only)
+*/
+class MpscQueue {
+public:
+
+    /*
+    * @brief Constructs an empty queue
+    * @param capacity Maximum number of queued elements (rounded up to a power of 2)
+    * @throws std::invalid_argument if capacity is not positive
+    */
+    explicit MpscQueue(size_t capacity);
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    /*
+    * @brief Appends an element, safe to call from any number of threads
+    * @param item Element to append (moved from only on success)
+    * @return true if appended, false if the queue is full
+    */
+    bool try_push(T& item);
+
+    /*
+    * @brief Appends an element (rvalue convenience overload)
+    */
+    bool try_push(T&& item);
+
+    /*
+    * @brief Removes the oldest element, must only be called by the consumer thread
+    * @param item Set to the removed element
+    * @return true if an element was removed, false if the queue is empty
+    */
+    bool try_pop(T& item);
+
+    /*
+    * @brief Returns an estimate of the number of queued elements
+    * @return Number of elements, exact when no push or pop is in progress
+    */
+    size_t size_approx() const;
+
+    /*
+    * @brief Capacity getter
+    * @return Maximum number of queued elements
+    */
+    size_t capacity() const;
+
+private:
+
+    /*
+    * @struct Cell
+    * @brief One slot of the ring: the element and its sequence stamp
+    */
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> tail;
+    alignas(64) std::atomic<size_t> head;
+};
+
+// ==================== Implementation ====================
+
+template <class T>
+MpscQueue<T>::MpscQueue(size_t capacity) : tail(0), head(0) {
+    if (capacity == 0) {
+        throw std::invalid_argument("queue capacity must be positive");
+    }
+    size_t rounded = 1;
+    while (rounded < capacity) {
+        rounded *= 2;
+    }
+    cells.reset(new Cell[rounded]);
+    for (size_t i = 0; i < rounded; i++) {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    mask = rounded - 1;
+}
+
+
+template <class T>
+bool MpscQueue<T>::try_push(T& item) {
+    size_t pos = tail.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell& cell = cells[pos & mask];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        // the cell is free for position pos exactly when its stamp equals pos
+        auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+        if (diff == 0) {
+            if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                cell.data = std::move(item);
+                cell.sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+
+template <class T>
+bool MpscQueue<T>::try_push(T&& item) {
+    return try_push(item);
+}
+
+
+template <class T>
+bool MpscQueue<T>::try_pop(T& item) {
+    size_t pos = head.load(std::memory_order_relaxed);
+    Cell& cell = cells[pos & mask];
+    size_t sequence = cell.sequence.load(std::memory_order_acquire);
+    if (sequence != pos + 1) {
+        return false;
+    }
+    item = std::move(cell.data);
+    // stamp the cell free for the producer one lap ahead
+    cell.sequence.store(pos + mask + 1, std::memory_order_release);
+    head.store(pos + 1, std::memory_order_relaxed);
+    return true;
+}
+
+
+template <class T>
+size_t MpscQueue<T>::size_approx() const {
+    size_t back = tail.load(std::memory_order_relaxed);
+    size_t front = head.load(std::memory_order_relaxed);
+    return (back > front) ? back - front : 0;
+}
+
+
+template <class T>
+size_t MpscQueue<T>::capacity() const {
+    return mask + 1;
+}
+
+#endif //MPSCQUEUE_HPP
@@ -0,0 +1,483 @@
+#ifndef NUMAHASHMAP_HPP
+#define NUMAHASHMAP_HPP
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <future>
+#include <exception>
+#include <functional>
+#include <cstdint>
+#include <stdexcept>
+
+#include "HashMap.hpp"
+#include "NumaTopology.hpp"
+
+
+/*
+* @brief Template parameters:
+* - KeyT   : type of keys
+* - ValueT : type of values
+*/
+template <class KeyT, class ValueT>
+
+/*
+* @class NumaHashMap
+* @brief A thread-safe HashMap split into shards placed on NUMA nodes.
+* In partitioned mode every key lives in exactly one shard, chosen by hash,
+* and shards are spread round-robin over the nodes. In replicated mode every
+* node holds a full copy: reads go to the caller's node, writes go to all copies
+* @var topology NUMA layout used for placement and routing
+* @var shards Shards (partitioned mode) or per-node replicas (replicated mode)
+* @var writers One writer thread per node, bound to it
+* @var replicated Whether every node holds a full copy
+* @var replica_writes Serializes writers in replicated mode
+* @note Every node has a writer thread bound to its CPUs with a preferred
+* memory policy. It creates the node's shards, so their bucket arrays
+* (reserved for expected_size) are allocated on the node. In partitioned
+* mode that is all it does: writes run on the caller's thread under the
+* owning shard's lock, without a hand-off, so what they allocate later
+* (rehashed arrays, pair vectors, copies of keys and values) lands on the
+* caller's node. In replicated mode the writers stay and apply every write
+* to their node's replica in parallel, the caller waiting for the results,
+* so each replica's allocations stay on its node. Reads run on the
+* caller's thread. Placement is a preference: when a node is out of
+* memory the kernel allocates elsewhere, and with a simulated topology the
+* writers are not bound at all
+*/
+class NumaHashMap {
+public:
+
+    /*
+    * @brief Constructs an empty NumaHashMap
+    * @param topology NUMA layout to place shards on (detected or simulated)
+    * @param replicate true for one full replica per node (read-mostly maps)
+    * @param shards_per_node Number of shards per node in partitioned mode
+    * @param expected_size Number of pairs to reserve room for up front
+    * @throws std::invalid_argument if shards_per_node is not positive
+    */
+    explicit NumaHashMap(const NumaTopology& topology, bool replicate = false,
+                         int shards_per_node = 1, int expected_size = 0);
+
+    /*
+    * @brief Stops the writer threads (destructor)
+    */
+    ~NumaHashMap();
+
+    NumaHashMap(const NumaHashMap&) = delete;
+    NumaHashMap& operator=(const NumaHashMap&) = delete;
+
+    /*
+    * @brief Inserts a (key, value) pair
+    * @param key Key to insert
+    * @param value Value to insert
+    * @return true if insertion was successful, false if the key already exists
+    */
+    bool insert(const KeyT& key, const ValueT& value);
+
+    /*
+    * @brief Inserts a pair or assigns the value of an existing key
+    * @param key Key to insert or update
+    * @param value Value to insert or assign
+    * @return true if a new pair was inserted, false if a value was assigned
+    */
+    bool insert_or_assign(const KeyT& key, const ValueT& value);
+
+    /*
+    * @brief Returns whether a given key is stored in the map
+    * @param key Key to look for
+    * @return true if key exists, false otherwise
+    */
+    bool contains_key(const KeyT& key) const;
+
+    /*
+    * @brief Copies out the value of a given key
+    * @param key Key to look up
+    * @param value Set to the key's value when found
+    * @return true if the key exists, false otherwise
+    */
+    bool get(const KeyT& key, ValueT& value) const;
+
+    /*
+    * @brief Copies out the value of a given key
+    * @param key Key to look up
+    * @return Copy of the value mapped to the key
+    * @throws std::runtime_error if key does not exist
+    */
+    ValueT at(const KeyT& key) const;
+
+    /*
+    * @brief Erases a pair with a given key
+    * @param key Key in the pair that should be erased
+    * @return true if erasure was successful, false otherwise
+    */
+    bool erase(const KeyT& key);
+
+    /*
+    * @brief Returns the number of pairs
+    * @return Number of distinct keys stored
+    */
+    int size() const;
+
+    /*
+    * @brief Shard count getter
+    * @return Number of shards (replicas in replicated mode)
+    */
+    int shard_count() const;
+
+    /*
+    * @brief Returns the node a shard is placed on
+    * @param shard Shard index
+    * @return Node of the shard
+    */
+    int shard_node(int shard) const;
+
+    /*
+    * @brief Returns the shard a lookup of a key from the calling thread goes to
+    * @param key Key to look up
+    * @return Index of the shard serving the lookup
+    */
+    int shard_for(const KeyT& key) const;
+
+    /*
+    * @brief Replication getter
+    * @return true if every node holds a full copy
+    */
+    bool is_replicated() const;
+
+private:
+
+    /*
+    * @struct Shard
+    * @brief One HashMap with its own reader/writer lock, placed on a node
+    */
+    struct Shard {
+        mutable std::shared_mutex lock;
+        HashMap<KeyT, ValueT> map;
+        int node;
+    };
+
+    /*
+    * @struct Job
+    * @brief A replicated write handed to a node's writer, the caller waits on result
+    */
+    struct Job {
+        Shard* shard;
+        bool (*run)(void* write, HashMap<KeyT, ValueT>& map);
+        void* write;
+        std::promise<bool> result;
+    };
+
+    /*
+    * @struct Writer
+    * @brief The thread applying writes on one node, and its job queue
+    */
+    struct Writer {
+        std::mutex lock;
+        std::condition_variable wake;
+        std::deque<Job*> jobs;
+        bool stopping = false;
+        std::thread thread;
+    };
+
+    NumaTopology topology;
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::vector<std::unique_ptr<Writer>> writers;
+    bool replicated;
+    std::mutex replica_writes;
+
+    /*
+    * @brief Picks the shard owning a hash in partitioned mode
+    * @param hash std::hash<KeyT> of the key
+    * @return Index of the owning shard
+    */
+    size_t owner_of(std::size_t hash) const;
+
+    /*
+    * @brief Picks the shard serving a read from the calling thread
+    * @param hash std::hash<KeyT> of the key
+    * @return Index of the shard to read from
+    */
+    size_t reader_of(std::size_t hash) const;
+
+    /*
+    * @brief Applies a write to the owning shard on the calling thread, or to
+    * every replica through the writers
+    * @param hash std::hash<KeyT> of the key
+    * @param write Callable taking HashMap<KeyT, ValueT>& and returning bool
+    * @return Result of the write (on the owning shard or the first replica)
+    */
+    template <class Write>
+    bool apply_write(std::size_t hash, Write write);
+
+    /*
+    * @brief Queues a job on the writer of its shard's node
+    * @param job Job to run, owned by the caller until its result is set
+    */
+    void submit(Job& job);
+
+    /*
+    * @brief Writer thread body: binds to the node, creates the node's shards,
+    * then (replicated mode only) applies jobs until stopped
+    * @param node Node of the writer
+    * @param reserve Pairs to reserve room for in each shard
+    * @param ready Set once the shards exist, or to why they couldn't be created
+    */
+    void run_writer(int node, int reserve, std::promise<void> ready);
+
+    /*
+    * @brief Stops and joins the writer threads
+    */
+    void stop_writers();
+};
+
+// ==================== Implementation ====================
+
+template <class KeyT, class ValueT>
+NumaHashMap<KeyT, ValueT>::NumaHashMap(const NumaTopology& topology, bool replicate,
+                                       int shards_per_node, int expected_size) :
+    topology(topology), replicated(replicate) {
+    if (shards_per_node <= 0) {
+        throw std::invalid_argument("shards_per_node must be positive");
+    }
+    int per_node = replicate ? 1 : shards_per_node;
+    int count = topology.nodes() * per_node;
+    int reserve = replicate ? expected_size : expected_size / count;
+    shards.resize(count);
+    // each node's writer creates its shards (first-touch placement)
+    for (int node = 0; node < topology.nodes(); node++) writers.push_back(std::make_unique<Writer>());
+    std::vector<std::future<void>> ready;
+    try {
+        for (int node = 0; node < topology.nodes(); node++) {
+            std::promise<void> created;
+            ready.push_back(created.get_future());
+            writers[node]->thread = std::thread(&NumaHashMap::run_writer, this, node, reserve, std::move(created));
+        }
+        for (auto& node_ready : ready) node_ready.get();
+    } catch (...) {
+        stop_writers();
+        throw;
+    }
+}
+
+
+template <class KeyT, class ValueT>
+NumaHashMap<KeyT, ValueT>::~NumaHashMap() {
+    stop_writers();
+}
+
+
+template <class KeyT, class ValueT>
+bool NumaHashMap<KeyT, ValueT>::insert(const KeyT& key, const ValueT& value) {
+    std::size_t hash = std::hash<KeyT>()(key);
+    return apply_write(hash, [&](HashMap<KeyT, ValueT>& map) {
+        return map.insert_hashed(key, hash, value);
+    });
+}
+
+
+template <class KeyT, class ValueT>
+bool NumaHashMap<KeyT, ValueT>::insert_or_assign(const KeyT& key, const ValueT& value) {
+    std::size_t hash = std::hash<KeyT>()(key);
+    return apply_write(hash, [&](HashMap<KeyT, ValueT>& map) {
+        return map.insert_or_assign_hashed(key, hash, value);
+    });
+}
+
+
+template <class KeyT, class ValueT>
+bool NumaHashMap<KeyT, ValueT>::contains_key(const KeyT& key) const {
+    std::size_t hash = std::hash<KeyT>()(key);
+    const Shard& shard = *shards[reader_of(hash)];
+    std::shared_lock<std::shared_mutex> guard(shard.lock);
+    return shard.map.find_hashed(key, hash) != nullptr;
+}
+
+
+template <class KeyT, class ValueT>
+bool NumaHashMap<KeyT, ValueT>::get(const KeyT& key, ValueT& value) const {
+    std::size_t hash = std::hash<KeyT>()(key);
+    const Shard& shard = *shards[reader_of(hash)];
+    std::shared_lock<std::shared_mutex> guard(shard.lock);
+    const ValueT* found = shard.map.find_hashed(key, hash);
+    if (found == nullptr) return false;
+    value = *found;
+    return true;
+}
+
+
+template <class KeyT, class ValueT>
+ValueT NumaHashMap<KeyT, ValueT>::at(const KeyT& key) const {
+    ValueT value;
+    if (!get(key, value)) throw std::runtime_error("no such key exists!");
+    return value;
+}
+
+
+template <class KeyT, class ValueT>
+bool NumaHashMap<KeyT, ValueT>::erase(const KeyT& key) {
+    std::size_t hash = std::hash<KeyT>()(key);
+    return apply_write(hash, [&](HashMap<KeyT, ValueT>& map) {
+        return map.erase_hashed(key, hash);
+    });
+}
+
+
+template <class KeyT, class ValueT>
+int NumaHashMap<KeyT, ValueT>::size() const {
+    if (replicated) {
+        std::shared_lock<std::shared_mutex> guard(shards[0]->lock);
+        return shards[0]->map.size();
+    }
+    int total = 0;
+    for (const auto& shard : shards) {
+        std::shared_lock<std::shared_mutex> guard(shard->lock);
+        total += shard->map.size();
+    }
+    return total;
+}
+
+
+template <class KeyT, class ValueT>
+int NumaHashMap<KeyT, ValueT>::shard_count() const {
+    return static_cast<int>(shards.size());
+}
+
+
+template <class KeyT, class ValueT>
+int NumaHashMap<KeyT, ValueT>::shard_node(int shard) const {
+    return shards.at(shard)->node;
+}
+
+
+template <class KeyT, class ValueT>
+int NumaHashMap<KeyT, ValueT>::shard_for(const KeyT& key) const {
+    return static_cast<int>(reader_of(std::hash<KeyT>()(key)));
+}
+
+
+template <class KeyT, class ValueT>
+bool NumaHashMap<KeyT, ValueT>::is_replicated() const {
+    return replicated;
+}
+
+
+template <class KeyT, class ValueT>
+size_t NumaHashMap<KeyT, ValueT>::owner_of(std::size_t hash) const {
+    // high bits of the scrambled hash, independent of the buckets' low bits
+    std::uint64_t mixed = mix_hash(hash);
+    return static_cast<size_t>((mixed >> 32) % shards.size());
+}
+
+
+template <class KeyT, class ValueT>
+size_t NumaHashMap<KeyT, ValueT>::reader_of(std::size_t hash) const {
+    if (replicated) {
+        // replica i lives on node i
+        return static_cast<size_t>(topology.current_node()) % shards.size();
+    }
+    return owner_of(hash);
+}
+
+
+template <class KeyT, class ValueT>
+template <class Write>
+bool NumaHashMap<KeyT, ValueT>::apply_write(std::size_t hash, Write write) {
+    if (!replicated) {
+        Shard& shard = *shards[owner_of(hash)];
+        std::unique_lock<std::shared_mutex> guard(shard.lock);
+        return write(shard.map);
+    }
+    auto run = [](void* fn, HashMap<KeyT, ValueT>& map) -> bool {
+        return (*static_cast<Write*>(fn))(map);
+    };
+    // one writer at a time hands a write to every replica, so they all see
+    // writes in the same order; readers only ever wait on their own replica's lock
+    std::lock_guard<std::mutex> writer(replica_writes);
+    std::vector<Job> jobs(shards.size());
+    std::vector<std::future<bool>> results;
+    for (size_t i = 0; i < shards.size(); i++) {
+        jobs[i].shard = shards[i].get();
+        jobs[i].run = run;
+        jobs[i].write = &write;
+        results.push_back(jobs[i].result.get_future());
+        submit(jobs[i]);
+    }
+    // wait for every replica before reporting a failure, the jobs live on this stack
+    for (auto& result : results) result.wait();
+    bool applied = results[0].get();
+    for (size_t i = 1; i < results.size(); i++) results[i].get();
+    return applied;
+}
+
+
+template <class KeyT, class ValueT>
+void NumaHashMap<KeyT, ValueT>::submit(Job& job) {
+    Writer& writer = *writers[job.shard->node];
+    {
+        std::lock_guard<std::mutex> guard(writer.lock);
+        writer.jobs.push_back(&job);
+    }
+    writer.wake.notify_one();
+}
+
+
+template <class KeyT, class ValueT>
+void NumaHashMap<KeyT, ValueT>::run_writer(int node, int reserve, std::promise<void> ready) {
+    topology.bind_thread(node);
+    topology.prefer_memory(node);
+    try {
+        for (size_t i = node; i < shards.size(); i += topology.nodes()) {
+            auto shard = std::make_unique<Shard>();
+            shard->node = node;
+            shard->map.reserve(reserve);
+            shards[i] = std::move(shard);
+        }
+        ready.set_value();
+    } catch (...) {
+        ready.set_exception(std::current_exception());
+        return;
+    }
+    // partitioned writes run on the callers' threads
+    if (!replicated) return;
+    Writer& writer = *writers[node];
+    for (;;) {
+        Job* job;
+        {
+            std::unique_lock<std::mutex> guard(writer.lock);
+            writer.wake.wait(guard, [&writer]() { return writer.stopping || !writer.jobs.empty(); });
+            if (writer.jobs.empty()) return;
+            job = writer.jobs.front();
+            writer.jobs.pop_front();
+        }
+        try {
+            std::unique_lock<std::shared_mutex> guard(job->shard->lock);
+            bool applied = job->run(job->write, job->shard->map);
+            guard.unlock();
+            job->result.set_value(applied);
+        } catch (...) {
+            job->result.set_exception(std::current_exception());
+        }
+    }
+}
+
+
+template <class KeyT, class ValueT>
+void NumaHashMap<KeyT, ValueT>::stop_writers() {
+    for (auto& writer : writers) {
+        {
+            std::lock_guard<std::mutex> guard(writer->lock);
+            writer->stopping = true;
+        }
+        writer->wake.notify_one();
+    }
+    for (auto& writer : writers) {
+        if (writer->thread.joinable()) writer->thread.join();
+    }
+}
+
+#endif //NUMAHASHMAP_HPP
@@ -0,0 +1,294 @@
+#ifndef NUMATOPOLOGY_HPP
+#define NUMATOPOLOGY_HPP
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+#define NUMA_SYSFS_NODES "/sys/devices/system/node/node"
+#define NUMA_SYSFS_ONLINE "/sys/devices/system/node/online"
+#define NUMA_MAX_NODES 64
+#define NUMA_MPOL_DEFAULT 0
+#define NUMA_MPOL_PREFERRED 1
+
+/*
+* @class NumaTopology
+* @brief Describes which CPUs belong to which NUMA node, and places the
+* calling thread (CPU affinity and memory policy) on a node.
+* Detected from sysfs on Linux, or simulated for testing on single-node boxes
+* @var node_ids Kernel ID of every node. Nodes are numbered 0..nodes() - 1
+* here, the kernel's IDs may have gaps (e.g. nodes 0 and 2)
+* @var node_cpus CPUs of every node
+* @var cpu_node Node of every CPU
+* @var simulated true if the layout was made up rather than detected - placement
+* calls are then no-ops
+*/
+class NumaTopology {
+public:
+
+    /*
+    * @brief Detects the NUMA layout of the machine. Falls back to a single
+    * node holding every CPU when sysfs is unavailable
+    * @return Detected topology
+    */
+    static NumaTopology detect();
+
+    /*
+    * @brief Makes up a NUMA layout, CPU c belongs to node (c / cpus_per_node) % nodes
+    * @param nodes Number of simulated nodes
+    * @param cpus_per_node Number of CPUs per simulated node
+    * @return Simulated topology
+    * @throws std::invalid_argument if nodes or cpus_per_node is not positive
+    */
+    static NumaTopology simulated(int nodes, int cpus_per_node);
+
+    /*
+    * @brief Node count getter
+    * @return Number of NUMA nodes
+    */
+    int nodes() const;
+
+    /*
+    * @brief CPU list getter
+    * @param node Node to list the CPUs of
+    * @return CPUs belonging to the node
+    */
+    const std::vector<int>& cpus(int node) const;
+
+    /*
+    * @brief Returns the kernel's ID of a node
+    * @param node Node index, 0..nodes() - 1
+    * @return ID of the node in sysfs and in memory policies
+    */
+    int node_id(int node) const;
+
+    /*
+    * @brief Returns the node a CPU belongs to
+    * @param cpu CPU number
+    * @return Node of the CPU (CPUs beyond the known ones wrap around)
+    */
+    int node_of_cpu(int cpu) const;
+
+    /*
+    * @brief Returns the node the calling thread runs on - the node set by
+    * set_thread_node() if any, otherwise the node of the current CPU
+    * @return Node of the calling thread
+    */
+    int current_node() const;
+
+    /*
+    * @brief Overrides the node current_node() reports for the calling thread,
+    * used to route threads explicitly and to test simulated layouts
+    * @param node Node to report, -1 to go back to the CPU's node
+    */
+    static void set_thread_node(int node);
+
+    /*
+    * @brief Pins the calling thread to the CPUs of a node
+    * @param node Node to run on
+    * @return true if the affinity was set, false if simulated or unsupported
+    */
+    bool bind_thread(int node) const;
+
+    /*
+    * @brief Makes the calling thread's future allocations prefer a node's
+    * memory (set_mempolicy(MPOL_PREFERRED))
+    * @param node Node to allocate on, -1 to restore the default policy
+    * @return true if the policy was set, false if simulated or unsupported
+    */
+    bool prefer_memory(int node) const;
+
+    /*
+    * @brief Simulation getter
+    * @return true if the topology is simulated
+    */
+    bool is_simulated() const;
+
+private:
+    std::vector<int> node_ids;
+    std::vector<std::vector<int>> node_cpus;
+    std::vector<int> cpu_node;
+    bool simulated_layout = false;
+
+    /*
+    * @brief Parses a sysfs CPU or node list such as "0-3,8-11"
+    * @param list List text
+    * @return Numbers in the list
+    */
+    static std::vector<int> parse_cpu_list(const std::string& list);
+
+    /*
+    * @brief Thread-local node override used by current_node()
+    * @return Reference to the calling thread's override (-1 if unset)
+    */
+    static int& thread_node();
+};
+
+// ==================== Implementation ====================
+
+inline NumaTopology NumaTopology::detect() {
+    NumaTopology topology;
+    // node IDs can have gaps, so take them from the online list rather than counting up
+    std::vector<int> ids;
+    std::ifstream online(NUMA_SYSFS_ONLINE);
+    std::string list;
+    if (online && std::getline(online, list)) {
+        ids = parse_cpu_list(list);
+    } else {
+        for (int id = 0; id < NUMA_MAX_NODES; id++) ids.push_back(id);
+    }
+    for (int id : ids) {
+        if (id < 0 || id >= NUMA_MAX_NODES) continue;
+        std::ifstream file(NUMA_SYSFS_NODES + std::to_string(id) + "/cpulist");
+        if (!file) continue;
+        list.clear();
+        std::getline(file, list);
+        topology.node_ids.push_back(id);
+        topology.node_cpus.push_back(parse_cpu_list(list));
+    }
+    if (topology.node_cpus.empty()) {
+        // no sysfs - one node with every CPU
+        int count = 1;
+#ifdef __linux__
+        count = static_cast<int>(sysconf(_SC_NPROCESSORS_CONF));
+#endif
+        topology.node_ids.push_back(0);
+        topology.node_cpus.emplace_back();
+        for (int cpu = 0; cpu < count; cpu++) {
+            topology.node_cpus[0].push_back(cpu);
+        }
+    }
+    for (int node = 0; node < static_cast<int>(topology.node_cpus.size()); node++) {
+        for (int cpu : topology.node_cpus[node]) {
+            if (cpu >= static_cast<int>(topology.cpu_node.size())) {
+                topology.cpu_node.resize(cpu + 1, 0);
+            }
+            topology.cpu_node[cpu] = node;
+        }
+    }
+    if (topology.cpu_node.empty()) topology.cpu_node.push_back(0);
+    return topology;
+}
+
+
+inline NumaTopology NumaTopology::simulated(int nodes, int cpus_per_node) {
+    if (nodes <= 0 || cpus_per_node <= 0) {
+        throw std::invalid_argument("simulated topology needs positive node and CPU counts");
+    }
+    NumaTopology topology;
+    topology.simulated_layout = true;
+    topology.node_cpus.resize(nodes);
+    for (int node = 0; node < nodes; node++) topology.node_ids.push_back(node);
+    for (int cpu = 0; cpu < nodes * cpus_per_node; cpu++) {
+        topology.node_cpus[cpu / cpus_per_node].push_back(cpu);
+        topology.cpu_node.push_back(cpu / cpus_per_node);
+    }
+    return topology;
+}
+
+
+inline int NumaTopology::nodes() const {
+    return static_cast<int>(node_cpus.size());
+}
+
+
+inline const std::vector<int>& NumaTopology::cpus(int node) const {
+    return node_cpus.at(node);
+}
+
+
+inline int NumaTopology::node_id(int node) const {
+    return node_ids.at(node);
+}
+
+
+inline int NumaTopology::node_of_cpu(int cpu) const {
+    if (cpu < 0) return 0;
+    return cpu_node[cpu % cpu_node.size()];
+}
+
+
+inline int NumaTopology::current_node() const {
+    int node = thread_node();
+    if (node >= 0) return node % nodes();
+#ifdef __linux__
+    return node_of_cpu(sched_getcpu());
+#else
+    return 0;
+#endif
+}
+
+
+inline void NumaTopology::set_thread_node(int node) {
+    thread_node() = node;
+}
+
+
+inline bool NumaTopology::bind_thread(int node) const {
+#ifdef __linux__
+    if (simulated_layout) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus(node)) {
+        CPU_SET(cpu, &set);
+    }
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void)node;
+    return false;
+#endif
+}
+
+
+inline bool NumaTopology::prefer_memory(int node) const {
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+    if (simulated_layout) return false;
+    if (node < 0) {
+        return syscall(SYS_set_mempolicy, NUMA_MPOL_DEFAULT, nullptr, 0) == 0;
+    }
+    unsigned long mask = 1UL << node_id(node);
+    return syscall(SYS_set_mempolicy, NUMA_MPOL_PREFERRED, &mask,
+                   sizeof(mask) * 8) == 0;
+#else
+    (void)node;
+    return false;
+#endif
+}
+
+
+inline bool NumaTopology::is_simulated() const {
+    return simulated_layout;
+}
+
+
+inline std::vector<int> NumaTopology::parse_cpu_list(const std::string& list) {
+    std::vector<int> cpus;
+    std::stringstream ranges(list);
+    std::string range;
+    while (std::getline(ranges, range, ',')) {
+        if (range.empty()) continue;
+        size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+
+inline int& NumaTopology::thread_node() {
+    thread_local int node = -1;
+    return node;
+}
+
+#endif //NUMATOPOLOGY_HPP
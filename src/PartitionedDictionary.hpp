@@ -0,0 +1,647 @@
+#ifndef PARTITIONEDDICTIONARY_HPP
+#define PARTITIONEDDICTIONARY_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <utility>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <cstdint>
+
+#include "HashMap.hpp"
+#include "KvClient.hpp"
+
+#define PARTITION_MIGRATION_BATCH 512
+#define PARTITION_FNV_OFFSET 0xCBF29CE484222325ULL
+#define PARTITION_FNV_PRIME 0x100000001B3ULL
+
+/*
+* @class PartitionedDictionary
+* @brief Client-side sharding of a Dictionary over several KvServer
+* processes. Keys are placed by rendezvous (highest random weight) hashing:
+* each key goes to the backend with the highest hash of (key, backend), so
+* adding a backend only moves the keys it wins and removing one only moves
+* its own keys. mget() and mset() send one request per backend and talk to
+* all backends in the same round trip. Adding or removing a backend starts
+* a background migration; lookups and writes keep working meanwhile
+* @var pool Every backend connected to, including ones being added or removed
+* @var source Backends the keys live on (placement before the migration)
+* @var target Backends the keys are moving to, same as source when not migrating
+* @var migrator Thread moving keys from source placement to target placement
+* @var migration_lock Makes moving a batch and writing a moving key mutually exclusive
+* @var migration_failed Set when a migration stopped on an error, until it
+* is retried or rolled back
+* @var touched Moving keys written by this client during the migration, the
+* migrator leaves them alone
+* @note Not thread-safe, like KvClient: use one PartitionedDictionary per
+* thread. During a migration, only the PartitionedDictionary running it
+* may write moving keys, other clients' writes can be overwritten by it
+*/
+class PartitionedDictionary {
+public:
+
+    /*
+    * @struct Endpoint
+    * @brief Address of a backend, one of the two must be set
+    */
+    struct Endpoint {
+        std::string unix_path;
+        int tcp_port = -1;
+
+        /*
+        * @brief Returns a name identifying the backend, which its placement hashes
+        * @return "unix:<path>" or "tcp:<port>"
+        */
+        std::string name() const {
+            return tcp_port >= 0 ? "tcp:" + std::to_string(tcp_port) : "unix:" + unix_path;
+        }
+    };
+
+    /*
+    * @brief Connects to every backend
+    * @param backends Backends to spread the keys over
+    * @throws std::invalid_argument if there is no backend or one is listed twice
+    * @throws std::runtime_error if a connection fails
+    */
+    explicit PartitionedDictionary(const std::vector<Endpoint>& backends);
+
+    /*
+    * @brief Stops a running migration (moved keys stay where they are) and
+    * closes every connection (destructor)
+    */
+    ~PartitionedDictionary();
+
+    PartitionedDictionary(const PartitionedDictionary&) = delete;
+    PartitionedDictionary& operator=(const PartitionedDictionary&) = delete;
+
+    /*
+    * @brief Stores a pair on its backend
+    * @param key Key to store
+    * @param value Value to store
+    */
+    void set(const std::string& key, const std::string& value);
+
+    /*
+    * @brief Looks a key up on its backend
+    * @param key Key to look up
+    * @param value Set to the key's value when found
+    * @return true if the key exists, false otherwise
+    */
+    bool get(const std::string& key, std::string& value);
+
+    /*
+    * @brief Erases a key from its backend
+    * @param key Key to erase
+    * @return true if the key existed
+    */
+    bool del(const std::string& key);
+
+    /*
+    * @brief Looks several keys up, one MGET per backend, all in one round trip
+    * @param keys Keys to look up
+    * @param values Set to one value per key
+    * @param found Set to whether each key exists
+    */
+    void mget(const std::vector<std::string>& keys, std::vector<std::string>& values,
+              std::vector<bool>& found);
+
+    /*
+    * @brief Stores several pairs, one MSET per backend, all in one round trip
+    * @param pairs Pairs to store
+    */
+    void mset(const std::vector<std::pair<std::string, std::string>>& pairs);
+
+    /*
+    * @brief Returns the number of keys stored on all backends
+    * @return Sum of the backends' DBSIZE (a key being moved may count twice)
+    */
+    long long size();
+
+    /*
+    * @brief Adds a backend and starts moving the keys it wins to it
+    * @param endpoint Backend to add
+    * @throws std::logic_error if a migration is running or failed
+    * @throws std::invalid_argument if the backend is already used
+    * @throws std::runtime_error if the connection fails
+    */
+    void add_backend(const Endpoint& endpoint);
+
+    /*
+    * @brief Starts moving the keys of a backend to the others, the backend
+    * is dropped once it is empty
+    * @param endpoint Backend to remove
+    * @throws std::logic_error if a migration is running or failed
+    * @throws std::invalid_argument if the backend is not used or is the last one
+    */
+    void remove_backend(const Endpoint& endpoint);
+
+    /*
+    * @brief Returns whether a migration is still running
+    * @return true until the last key has moved, and while a failed one
+    * waits for retry_migration() or rollback_migration()
+    */
+    bool migrating();
+
+    /*
+    * @brief Waits for the running migration, if any, to finish
+    * @throws whatever stopped the migration, which then stays unfinished
+    * until retry_migration() or rollback_migration()
+    */
+    void wait_for_migration();
+
+    /*
+    * @brief Restarts a failed migration, the keys it moved stay moved
+    * @throws std::logic_error if no migration failed
+    */
+    void retry_migration();
+
+    /*
+    * @brief Moves the keys of a failed migration back, restoring the
+    * backends from before it (runs as a migration of its own)
+    * @throws std::logic_error if no migration failed
+    */
+    void rollback_migration();
+
+    /*
+    * @brief Returns the number of keys the last migration moved so far
+    * @return Moved keys
+    */
+    std::uint64_t migrated_keys() const;
+
+    /*
+    * @brief Returns the number of backends keys are placed on
+    * @return Backends in the target placement
+    */
+    size_t backend_count() const;
+
+private:
+
+    /*
+    * @struct Backend
+    * @brief A backend, its connection and the seed its placement scores are hashed with
+    */
+    struct Backend {
+        Endpoint endpoint;
+        std::uint64_t seed;
+        KvClient client;
+    };
+
+    std::vector<std::unique_ptr<Backend>> pool;
+    std::vector<Backend*> source;
+    std::vector<Backend*> target;
+    std::thread migrator;
+    std::atomic<bool> migration_done{true};
+    bool migration_failed = false;
+    std::atomic<bool> stopping{false};
+    std::atomic<std::uint64_t> moved{0};
+    std::exception_ptr migration_error;
+    std::mutex migration_lock;
+    HashMap<std::string, bool> touched;
+
+    /*
+    * @brief Returns the backend a key is placed on
+    * @param key Key to place
+    * @param backends Placement to use
+    * @return The backend with the highest score for the key
+    */
+    static Backend* owner(const std::string& key, const std::vector<Backend*>& backends);
+
+    /*
+    * @brief Stable 64-bit hash (FNV-1a, then a splitmix64 finalizer), the
+    * same in every process
+    * @param text Bytes to hash
+    * @param seed Mixed into the result
+    * @return The hash
+    */
+    static std::uint64_t stable_hash(const std::string& text, std::uint64_t seed = 0);
+
+    /*
+    * @brief Opens a connection to a backend
+    * @param endpoint Backend to connect to
+    * @return The connection
+    */
+    static KvClient connect(const Endpoint& endpoint);
+
+    /*
+    * @brief Joins a finished migration and makes its target placement the
+    * only one, called before every operation
+    */
+    void settle();
+
+    /*
+    * @brief Right after joining the migrator: makes the target placement
+    * the only one, or records the failure
+    */
+    void finish_migration();
+
+    /*
+    * @brief Starts the migrator once target differs from source
+    */
+    void start_migration();
+
+    /*
+    * @brief Migrator thread body: scans the backends that lose keys and
+    * moves the keys placed elsewhere, a batch at a time
+    * @param from Source placement
+    * @param to Target placement
+    */
+    void migrate(std::vector<Backend*> from, std::vector<Backend*> to);
+
+    /*
+    * @brief Writes a moving key: marks it as touched, applies the write at
+    * its target and removes it from its source. Caller holds migration_lock
+    * @param key Key written
+    * @param value Value to store, nullptr to erase
+    * @return Whether the key existed (on either backend)
+    */
+    bool write_moving(const std::string& key, const std::string* value);
+
+    /*
+    * @brief Throws if a reply is an error
+    * @param reply Reply to check
+    * @return The reply
+    */
+    static RespValue& check(RespValue& reply);
+};
+
+// ==================== Implementation ====================
+
+inline PartitionedDictionary::PartitionedDictionary(const std::vector<Endpoint>& backends) {
+    if (backends.empty()) {
+        throw std::invalid_argument("PartitionedDictionary needs at least one backend");
+    }
+    for (const auto& endpoint : backends) {
+        for (const auto& backend : pool) {
+            if (backend->endpoint.name() == endpoint.name()) {
+                throw std::invalid_argument("backend listed twice: " + endpoint.name());
+            }
+        }
+        pool.push_back(std::unique_ptr<Backend>(
+            new Backend{endpoint, stable_hash(endpoint.name()), connect(endpoint)}));
+        source.push_back(pool.back().get());
+    }
+    target = source;
+}
+
+
+inline PartitionedDictionary::~PartitionedDictionary() {
+    stopping.store(true);
+    if (migrator.joinable()) migrator.join();
+}
+
+
+inline void PartitionedDictionary::set(const std::string& key, const std::string& value) {
+    settle();
+    Backend* to = owner(key, target);
+    if (!migration_done.load() && owner(key, source) != to) {
+        std::lock_guard<std::mutex> guard(migration_lock);
+        write_moving(key, &value);
+        return;
+    }
+    to->client.set(key, value);
+}
+
+
+inline bool PartitionedDictionary::get(const std::string& key, std::string& value) {
+    settle();
+    Backend* to = owner(key, target);
+    Backend* from = owner(key, source);
+    // a moving key is looked for where it was first: the migrator copies before it deletes
+    if (!migration_done.load() && from != to && from->client.get(key, value)) return true;
+    return to->client.get(key, value);
+}
+
+
+inline bool PartitionedDictionary::del(const std::string& key) {
+    settle();
+    Backend* to = owner(key, target);
+    if (!migration_done.load() && owner(key, source) != to) {
+        std::lock_guard<std::mutex> guard(migration_lock);
+        return write_moving(key, nullptr);
+    }
+    return to->client.del(key);
+}
+
+
+inline void PartitionedDictionary::mget(const std::vector<std::string>& keys, std::vector<std::string>& values,
+                                        std::vector<bool>& found) {
+    settle();
+    values.assign(keys.size(), std::string());
+    found.assign(keys.size(), false);
+    bool moving = !migration_done.load();
+    // round 1: every key where it is (moving keys where they were), round 2:
+    // moving keys not found there, at their target
+    std::vector<size_t> pending(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) pending[i] = i;
+    for (int round = 0; round < (moving ? 2 : 1) && !pending.empty(); round++) {
+        std::vector<Backend*> placed(keys.size(), nullptr);
+        HashMap<Backend*, std::vector<size_t>> groups;
+        std::vector<Backend*> order;
+        for (size_t i : pending) {
+            Backend* backend = (moving && round == 0) ? owner(keys[i], source) : owner(keys[i], target);
+            std::vector<size_t>& group = groups[backend];
+            if (group.empty()) order.push_back(backend);
+            group.push_back(i);
+        }
+        for (Backend* backend : order) {
+            std::vector<std::string> args{"MGET"};
+            for (size_t i : groups.at(backend)) args.push_back(keys[i]);
+            backend->client.send(args);
+            backend->client.flush();
+        }
+        std::vector<size_t> missed;
+        for (Backend* backend : order) {
+            RespValue reply = backend->client.receive();
+            const std::vector<size_t>& group = groups.at(backend);
+            if (check(reply).elements.size() != group.size()) {
+                throw std::runtime_error("MGET reply has the wrong number of values");
+            }
+            for (size_t j = 0; j < group.size(); j++) {
+                size_t i = group[j];
+                if (reply.elements[j].type != RespValue::Type::Null) {
+                    values[i] = std::move(reply.elements[j].text);
+                    found[i] = true;
+                } else if (round == 0 && owner(keys[i], source) != owner(keys[i], target)) {
+                    missed.push_back(i);
+                }
+            }
+        }
+        pending.swap(missed);
+    }
+}
+
+
+inline void PartitionedDictionary::mset(const std::vector<std::pair<std::string, std::string>>& pairs) {
+    settle();
+    bool moving = !migration_done.load();
+    std::unique_lock<std::mutex> guard(migration_lock, std::defer_lock);
+    if (moving) guard.lock();
+    HashMap<Backend*, std::vector<std::string>> requests;
+    std::vector<Backend*> order;
+    for (const auto& [key, value] : pairs) {
+        Backend* to = owner(key, target);
+        if (moving && owner(key, source) != to) {
+            write_moving(key, &value);
+            continue;
+        }
+        std::vector<std::string>& args = requests[to];
+        if (args.empty()) {
+            args.push_back("MSET");
+            order.push_back(to);
+        }
+        args.push_back(key);
+        args.push_back(value);
+    }
+    for (Backend* backend : order) {
+        backend->client.send(requests.at(backend));
+        backend->client.flush();
+    }
+    for (Backend* backend : order) {
+        RespValue reply = backend->client.receive();
+        check(reply);
+    }
+}
+
+
+inline long long PartitionedDictionary::size() {
+    settle();
+    std::vector<Backend*> counted = source;
+    for (Backend* backend : target) {
+        if (std::find(counted.begin(), counted.end(), backend) == counted.end()) counted.push_back(backend);
+    }
+    long long total = 0;
+    for (Backend* backend : counted) {
+        RespValue reply = backend->client.call({"DBSIZE"});
+        total += check(reply).integer;
+    }
+    return total;
+}
+
+
+inline void PartitionedDictionary::add_backend(const Endpoint& endpoint) {
+    settle();
+    if (migration_failed) throw std::logic_error("the last migration failed, retry or roll it back first");
+    if (!migration_done.load()) throw std::logic_error("a migration is already running");
+    for (Backend* backend : target) {
+        if (backend->endpoint.name() == endpoint.name()) {
+            throw std::invalid_argument("backend already used: " + endpoint.name());
+        }
+    }
+    pool.push_back(std::unique_ptr<Backend>(
+        new Backend{endpoint, stable_hash(endpoint.name()), connect(endpoint)}));
+    target.push_back(pool.back().get());
+    start_migration();
+}
+
+
+inline void PartitionedDictionary::remove_backend(const Endpoint& endpoint) {
+    settle();
+    if (migration_failed) throw std::logic_error("the last migration failed, retry or roll it back first");
+    if (!migration_done.load()) throw std::logic_error("a migration is already running");
+    auto it = std::find_if(target.begin(), target.end(), [&endpoint](Backend* backend) {
+        return backend->endpoint.name() == endpoint.name();
+    });
+    if (it == target.end()) throw std::invalid_argument("backend not used: " + endpoint.name());
+    if (target.size() == 1) throw std::invalid_argument("can't remove the last backend");
+    target.erase(it);
+    start_migration();
+}
+
+
+inline bool PartitionedDictionary::migrating() {
+    settle();
+    return !migration_done.load();
+}
+
+
+inline void PartitionedDictionary::wait_for_migration() {
+    if (migrator.joinable()) {
+        migrator.join();
+        finish_migration();
+    }
+    if (migration_error) std::rethrow_exception(migration_error);
+}
+
+
+inline void PartitionedDictionary::retry_migration() {
+    settle();
+    if (!migration_failed) throw std::logic_error("no failed migration to retry");
+    start_migration();
+}
+
+
+inline void PartitionedDictionary::rollback_migration() {
+    settle();
+    if (!migration_failed) throw std::logic_error("no failed migration to roll back");
+    // the keys now move from the target placement back to the source one,
+    // written ones included
+    std::swap(source, target);
+    touched.clear();
+    start_migration();
+}
+
+
+inline std::uint64_t PartitionedDictionary::migrated_keys() const {
+    return moved.load();
+}
+
+
+inline size_t PartitionedDictionary::backend_count() const {
+    return target.size();
+}
+
+
+inline PartitionedDictionary::Backend*
+PartitionedDictionary::owner(const std::string& key, const std::vector<Backend*>& backends) {
+    std::uint64_t hash = stable_hash(key);
+    Backend* best = backends[0];
+    std::uint64_t best_score = 0;
+    for (Backend* backend : backends) {
+        std::uint64_t score = stable_hash(std::string(), hash ^ backend->seed);
+        if (score >= best_score) {
+            best_score = score;
+            best = backend;
+        }
+    }
+    return best;
+}
+
+
+inline std::uint64_t PartitionedDictionary::stable_hash(const std::string& text, std::uint64_t seed) {
+    std::uint64_t hash = PARTITION_FNV_OFFSET ^ seed;
+    for (unsigned char c : text) {
+        hash = (hash ^ c) * PARTITION_FNV_PRIME;
+    }
+    hash ^= hash >> 30;
+    hash *= 0xBF58476D1CE4E5B9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94D049BB133111EBULL;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+
+inline KvClient PartitionedDictionary::connect(const Endpoint& endpoint) {
+    if (endpoint.tcp_port >= 0) return KvClient::connect_tcp("127.0.0.1", endpoint.tcp_port);
+    return KvClient::connect_unix(endpoint.unix_path);
+}
+
+
+inline void PartitionedDictionary::settle() {
+    if (!migration_done.load() || !migrator.joinable()) return;
+    migrator.join();
+    finish_migration();
+}
+
+
+inline void PartitionedDictionary::finish_migration() {
+    if (migration_error) {
+        // unfinished: keep both placements so every key stays reachable
+        migration_failed = true;
+        migration_done.store(false);
+        return;
+    }
+    source = target;
+    touched.clear();
+    // drop the connections of removed backends
+    pool.erase(std::remove_if(pool.begin(), pool.end(), [this](const std::unique_ptr<Backend>& backend) {
+        return std::find(target.begin(), target.end(), backend.get()) == target.end();
+    }), pool.end());
+}
+
+
+inline void PartitionedDictionary::start_migration() {
+    moved.store(0);
+    migration_failed = false;
+    migration_error = nullptr;
+    migration_done.store(false);
+    migrator = std::thread([this, from = source, to = target]() {
+        try {
+            migrate(from, to);
+        } catch (...) {
+            migration_error = std::current_exception();
+        }
+        migration_done.store(true);
+    });
+}
+
+
+inline void PartitionedDictionary::migrate(std::vector<Backend*> from, std::vector<Backend*> to) {
+    bool added = std::any_of(to.begin(), to.end(), [&from](Backend* backend) {
+        return std::find(from.begin(), from.end(), backend) == from.end();
+    });
+    // the migrator has its own connections, the foreground ones stay usable
+    HashMap<Backend*, std::shared_ptr<KvClient>> clients;
+    auto client_of = [&clients](Backend* backend) -> KvClient& {
+        std::shared_ptr<KvClient>& client = clients[backend];
+        if (!client) client = std::make_shared<KvClient>(connect(backend->endpoint));
+        return *client;
+    };
+    for (Backend* backend : from) {
+        bool kept = std::find(to.begin(), to.end(), backend) != to.end();
+        // with rendezvous hashing a kept backend only loses keys to added ones
+        if (kept && !added) continue;
+        KvClient& scanner = client_of(backend);
+        std::vector<std::string> keys;
+        std::size_t cursor = 0;
+        do {
+            if (stopping.load()) return;
+            cursor = scanner.scan(cursor, PARTITION_MIGRATION_BATCH, keys);
+            std::vector<std::string> leaving;
+            for (auto& key : keys) {
+                if (owner(key, to) != backend) leaving.push_back(std::move(key));
+            }
+            if (leaving.empty()) continue;
+            std::vector<std::string> values;
+            std::vector<bool> found;
+            scanner.mget(leaving, values, found);
+            std::lock_guard<std::mutex> guard(migration_lock);
+            HashMap<Backend*, std::vector<std::pair<std::string, std::string>>> batches;
+            std::vector<std::string> erased{"DEL"};
+            for (size_t i = 0; i < leaving.size(); i++) {
+                // keys written meanwhile were already moved by the writer
+                if (!found[i] || touched.contains_key(leaving[i])) continue;
+                batches[owner(leaving[i], to)].emplace_back(leaving[i], std::move(values[i]));
+                erased.push_back(leaving[i]);
+            }
+            // copy first, then delete: a reader checks the source first
+            for (auto& [destination, pairs] : batches) {
+                client_of(destination).mset(pairs);
+            }
+            if (erased.size() > 1) {
+                RespValue reply = scanner.call(erased);
+                check(reply);
+                moved.fetch_add(erased.size() - 1);
+            }
+        } while (cursor != 0);
+    }
+}
+
+
+inline bool PartitionedDictionary::write_moving(const std::string& key, const std::string* value) {
+    touched.insert_or_assign(key, true);
+    Backend* to = owner(key, target);
+    Backend* from = owner(key, source);
+    bool existed;
+    if (value != nullptr) {
+        to->client.set(key, *value);
+        existed = true;
+    } else {
+        existed = to->client.del(key);
+    }
+    existed = from->client.del(key) || existed;
+    return existed;
+}
+
+
+inline RespValue& PartitionedDictionary::check(RespValue& reply) {
+    if (reply.type == RespValue::Type::Error) throw std::runtime_error(reply.text);
+    return reply;
+}
+
+#endif //PARTITIONEDDICTIONARY_HPP
@@ -0,0 +1,472 @@
+#ifndef REPLICATION_HPP
+#define REPLICATION_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <optional>
+#include <chrono>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdint>
+
+#include "KvServer.hpp"
+#include "KvClient.hpp"
+#include "ChangeLog.hpp"
+
+#define REPLICATION_BATCH_BYTES (1024 * 1024)
+#define REPLICATION_POLL_MS 5
+#define REPLICATION_RETRY_MS 200
+
+/*
+* @class LeaderServer
+* @brief A KvServer that appends every mutation to a ChangeLog and ships
+* the log to followers. The log is written once per batch of requests,
+* before their replies are sent, and replayed on startup. Besides the
+* KvServer commands it answers REPLICATE after [max_bytes] with
+* [last sequence, encoded records after the given one], and ROLE
+* @var changes The log of every mutation
+* @var log_error Why writing the log last failed, empty while it works
+* @var failed_sequence Last record of a batch already failed for it
+* @note If writing the log fails, the requests of the batch that appended
+* get errors instead of their replies, and writes are refused until a
+* retry succeeds. The failed writes stay applied, and are logged and
+* shipped by that retry. Reads go on, and followers keep the records
+* written so far. Writes too large for one log record (see
+* ChangeLog::fits()) are refused
+*/
+class LeaderServer : public KvServer {
+public:
+
+    /*
+    * @brief Opens the log, rebuilds the Dictionary from it and starts listening
+    * @param options Where to listen
+    * @param log_path Path of the change log
+    * @throws std::runtime_error if a socket or the log can't be opened
+    */
+    LeaderServer(const Options& options, const std::string& log_path);
+
+    /*
+    * @brief Returns the change log, only safe to use while run() is not running
+    * @return The log
+    */
+    ChangeLog& log();
+
+protected:
+    void execute(const std::vector<std::string>& args, std::string& out) override;
+    void apply_set(const std::string& key, const std::string& value) override;
+    bool apply_erase(const std::string& key) override;
+    void on_requests_executed() override;
+
+private:
+    ChangeLog changes;
+    std::string log_error;
+    std::uint64_t failed_sequence = 0;
+
+    /*
+    * @brief Writes the pending records, remembering why if that fails
+    * @return true if everything appended so far is in the file
+    */
+    bool flush_log();
+};
+
+/*
+* @class FollowerServer
+* @brief A read-only KvServer kept up to date from a leader: a background
+* thread tails the leader's log, over the leader's socket (REPLICATE) or by
+* reading its log file, and hands each batch to the event loop to apply.
+* Writes are refused; ROLE and status() report how far behind it is
+* @var source Where the log is read from
+* @var fetcher Thread tailing the log
+* @var stopping Set to make the fetcher return
+* @var in_flight Whether a fetched batch is waiting for the event loop
+* @var applied_sequence Last sequence number applied
+* @var applied_timestamp Leader time of the last applied record (ms), or
+* the follower's start time before the first one
+* @var leader_sequence Last sequence number the leader reported
+* @var last_contact Follower time of the last successful fetch (ms)
+* @var connected Whether the last fetch succeeded
+* @note Only one batch is in flight at a time, so a slow event loop slows
+* the fetcher instead of piling batches up in memory
+*/
+class FollowerServer : public KvServer {
+public:
+
+    /*
+    * @struct Source
+    * @brief The leader to follow, set exactly one of the three
+    */
+    struct Source {
+        std::string unix_path;      // leader's Unix socket
+        int tcp_port = -1;          // leader's loopback TCP port
+        std::string log_path;       // leader's log file, read directly
+    };
+
+    /*
+    * @struct Status
+    * @brief Replication progress. lag_ms is the age of the last applied
+    * write while records are still pending, 0 once caught up
+    */
+    struct Status {
+        std::uint64_t applied_sequence;
+        std::uint64_t leader_sequence;
+        std::uint64_t lag_records;
+        std::uint64_t lag_ms;
+        std::uint64_t since_contact_ms;
+        bool connected;
+    };
+
+    /*
+    * @brief Starts listening and starts tailing the leader's log
+    * @param options Where to listen for readers
+    * @param source The leader to follow
+    * @throws std::runtime_error if a socket can't be opened or source is empty
+    */
+    FollowerServer(const Options& options, const Source& source);
+
+    /*
+    * @brief Stops the fetcher thread (destructor)
+    */
+    ~FollowerServer() override;
+
+    /*
+    * @brief Returns the replication progress, safe from any thread
+    * @return Current status
+    */
+    Status status() const;
+
+protected:
+    void execute(const std::vector<std::string>& args, std::string& out) override;
+
+private:
+    Source source;
+    std::thread fetcher;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping = false;
+    bool in_flight = false;
+    std::atomic<std::uint64_t> applied_sequence{0};
+    std::atomic<std::uint64_t> applied_timestamp{0};
+    std::atomic<std::uint64_t> leader_sequence{0};
+    std::atomic<std::uint64_t> last_contact{0};
+    std::atomic<bool> connected{false};
+
+    /*
+    * @brief Fetcher thread body: fetch, wait for the previous batch, post, repeat
+    */
+    void fetch_loop();
+
+    /*
+    * @brief Fetches the records after a sequence number from the leader's socket
+    * @param client Connection to the leader, opened when empty
+    * @param after Last sequence number fetched
+    * @param batch Filled with the records
+    * @return The leader's last sequence number
+    */
+    std::uint64_t fetch_socket(std::optional<KvClient>& client, std::uint64_t after,
+                               std::vector<ChangeRecord>& batch);
+
+    /*
+    * @brief Reads the records after a sequence number from the leader's log file
+    * @param fd The log file, opened when negative
+    * @param decoder Decoder holding the file's undecoded tail
+    * @param offset Bytes of the file read so far
+    * @param after Last sequence number fetched
+    * @param batch Filled with the records
+    * @return Last sequence number found in the file so far
+    */
+    std::uint64_t fetch_file(int& fd, ChangeLogDecoder& decoder, std::uint64_t& offset,
+                             std::uint64_t after, std::vector<ChangeRecord>& batch);
+
+    /*
+    * @brief Waits for a while, returning early when stopping
+    * @param milliseconds How long to wait
+    * @return false if stopping
+    */
+    bool pause(int milliseconds);
+
+    /*
+    * @brief Returns the wall clock in milliseconds, the unit of record timestamps
+    * @return Milliseconds since the epoch
+    */
+    static std::uint64_t now_ms();
+};
+
+// ==================== Implementation ====================
+
+inline LeaderServer::LeaderServer(const Options& options, const std::string& log_path) :
+    KvServer(options), changes(log_path) {
+    changes.scan(0, [this](const ChangeRecord& record) {
+        ChangeLog::apply(store, record);
+        return true;
+    });
+}
+
+
+inline ChangeLog& LeaderServer::log() {
+    return changes;
+}
+
+
+inline void LeaderServer::execute(const std::vector<std::string>& args, std::string& out) {
+    const std::string& name = args[0];
+    if (is_command(name, "REPLICATE") && (args.size() == 2 || args.size() == 3)) {
+        char* end = nullptr;
+        std::uint64_t after = std::strtoull(args[1].c_str(), &end, 10);
+        size_t max_bytes = REPLICATION_BATCH_BYTES;
+        if (args.size() == 3) max_bytes = std::strtoull(args[2].c_str(), nullptr, 10);
+        if (end == args[1].c_str() || max_bytes == 0) {
+            RespWriter::error(out, "ERR REPLICATE expects a sequence number and a positive byte limit");
+            return;
+        }
+        // records executed earlier in this batch must be readable from the file,
+        // if that fails the follower gets what was written before
+        flush_log();
+        std::string records;
+        changes.read_from(after, max_bytes, records);
+        RespWriter::array(out, 2);
+        RespWriter::integer(out, static_cast<long long>(changes.last_sequence()));
+        RespWriter::bulk(out, records);
+    } else if (is_command(name, "ROLE") && args.size() == 1) {
+        RespWriter::array(out, 2);
+        RespWriter::bulk(out, "leader");
+        RespWriter::integer(out, static_cast<long long>(changes.last_sequence()));
+    } else if (is_command(name, "SET") || is_command(name, "MSET") || is_command(name, "DEL")) {
+        if (!log_error.empty() && !flush_log()) {
+            RespWriter::error(out, "ERR change log write failed, writes are refused: " + log_error);
+            return;
+        }
+        // check every pair first, MSET must not apply part of its pairs
+        for (size_t i = 1; !is_command(name, "DEL") && i + 1 < args.size(); i += 2) {
+            if (!ChangeLog::fits(args[i], args[i + 1])) {
+                RespWriter::error(out, "ERR pair too large for the change log");
+                return;
+            }
+        }
+        KvServer::execute(args, out);
+    } else {
+        KvServer::execute(args, out);
+    }
+}
+
+
+inline void LeaderServer::apply_set(const std::string& key, const std::string& value) {
+    // logged first, a record the log refuses must not change the Dictionary
+    changes.append(ChangeOp::Set, key, value);
+    KvServer::apply_set(key, value);
+}
+
+
+inline bool LeaderServer::apply_erase(const std::string& key) {
+    if (!KvServer::apply_erase(key)) return false;
+    changes.append(ChangeOp::Erase, key);
+    return true;
+}
+
+
+inline void LeaderServer::on_requests_executed() {
+    if (flush_log()) return;
+    // a batch that appended nothing (writes are refused meanwhile) goes through
+    if (changes.last_sequence() == failed_sequence) return;
+    failed_sequence = changes.last_sequence();
+    throw std::runtime_error("change log write failed: " + log_error);
+}
+
+
+inline bool LeaderServer::flush_log() {
+    try {
+        changes.flush();
+    } catch (const std::exception& e) {
+        log_error = e.what();
+        return false;
+    }
+    log_error.clear();
+    return true;
+}
+
+
+inline FollowerServer::FollowerServer(const Options& options, const Source& source) :
+    KvServer(options), source(source) {
+    int given = (!source.unix_path.empty()) + (source.tcp_port >= 0) + (!source.log_path.empty());
+    if (given != 1) {
+        throw std::runtime_error("FollowerServer needs exactly one of a leader socket, port or log file");
+    }
+    applied_timestamp.store(now_ms());
+    fetcher = std::thread([this]() { fetch_loop(); });
+}
+
+
+inline FollowerServer::~FollowerServer() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    fetcher.join();
+}
+
+
+inline FollowerServer::Status FollowerServer::status() const {
+    Status result;
+    std::uint64_t now = now_ms();
+    result.applied_sequence = applied_sequence.load();
+    result.leader_sequence = std::max(leader_sequence.load(), result.applied_sequence);
+    result.lag_records = result.leader_sequence - result.applied_sequence;
+    std::uint64_t timestamp = applied_timestamp.load();
+    result.lag_ms = (result.lag_records > 0 && now > timestamp) ? now - timestamp : 0;
+    std::uint64_t contact = last_contact.load();
+    result.since_contact_ms = (contact > 0 && now > contact) ? now - contact : 0;
+    result.connected = connected.load();
+    return result;
+}
+
+
+inline void FollowerServer::execute(const std::vector<std::string>& args, std::string& out) {
+    const std::string& name = args[0];
+    if (is_command(name, "SET") || is_command(name, "MSET") || is_command(name, "DEL")) {
+        RespWriter::error(out, "READONLY this is a follower, send writes to the leader");
+    } else if (is_command(name, "ROLE") && args.size() == 1) {
+        Status current = status();
+        RespWriter::array(out, 5);
+        RespWriter::bulk(out, "follower");
+        RespWriter::integer(out, static_cast<long long>(current.applied_sequence));
+        RespWriter::integer(out, static_cast<long long>(current.leader_sequence));
+        RespWriter::integer(out, static_cast<long long>(current.lag_ms));
+        RespWriter::bulk(out, current.connected ? "connected" : "disconnected");
+    } else {
+        KvServer::execute(args, out);
+    }
+}
+
+
+inline void FollowerServer::fetch_loop() {
+    std::optional<KvClient> client;
+    int fd = -1;
+    ChangeLogDecoder decoder;
+    std::uint64_t offset = 0;
+    std::uint64_t fetched = 0;
+    for (;;) {
+        std::vector<ChangeRecord> batch;
+        std::uint64_t head;
+        try {
+            if (source.log_path.empty()) {
+                head = fetch_socket(client, fetched, batch);
+            } else {
+                head = fetch_file(fd, decoder, offset, fetched, batch);
+            }
+            if (!batch.empty() && batch.front().sequence != fetched + 1) {
+                throw std::runtime_error("replication: leader log does not continue ours");
+            }
+        } catch (const std::exception&) {
+            // start over on a fresh connection (or from the top of the file)
+            connected.store(false);
+            client.reset();
+            if (fd >= 0) close(fd);
+            fd = -1;
+            decoder = ChangeLogDecoder();
+            offset = 0;
+            if (!pause(REPLICATION_RETRY_MS)) break;
+            continue;
+        }
+        connected.store(true);
+        last_contact.store(now_ms());
+        leader_sequence.store(head);
+        if (batch.empty()) {
+            if (!pause(REPLICATION_POLL_MS)) break;
+            continue;
+        }
+        fetched = batch.back().sequence;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [this]() { return stopping || !in_flight; });
+            if (stopping) break;
+            in_flight = true;
+        }
+        auto records = std::make_shared<std::vector<ChangeRecord>>(std::move(batch));
+        post([this, records]() {
+            for (const auto& record : *records) {
+                ChangeLog::apply(store, record);
+            }
+            applied_timestamp.store(records->back().timestamp_ms);
+            applied_sequence.store(records->back().sequence);
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                in_flight = false;
+            }
+            wake.notify_all();
+        });
+    }
+    if (fd >= 0) close(fd);
+}
+
+
+inline std::uint64_t FollowerServer::fetch_socket(std::optional<KvClient>& client, std::uint64_t after,
+                                                  std::vector<ChangeRecord>& batch) {
+    if (!client) {
+        if (source.tcp_port >= 0) {
+            client.emplace(KvClient::connect_tcp("127.0.0.1", source.tcp_port));
+        } else {
+            client.emplace(KvClient::connect_unix(source.unix_path));
+        }
+    }
+    RespValue reply = client->call({"REPLICATE", std::to_string(after), std::to_string(REPLICATION_BATCH_BYTES)});
+    if (reply.type != RespValue::Type::Array || reply.elements.size() != 2 ||
+        reply.elements[0].type != RespValue::Type::Integer || reply.elements[1].type != RespValue::Type::Bulk) {
+        throw std::runtime_error("replication: unexpected REPLICATE reply");
+    }
+    ChangeLogDecoder decoder;
+    decoder.feed(reply.elements[1].text.data(), reply.elements[1].text.size());
+    ChangeRecord record;
+    while (decoder.next(record)) {
+        batch.push_back(std::move(record));
+    }
+    return static_cast<std::uint64_t>(reply.elements[0].integer);
+}
+
+
+inline std::uint64_t FollowerServer::fetch_file(int& fd, ChangeLogDecoder& decoder, std::uint64_t& offset,
+                                                std::uint64_t after, std::vector<ChangeRecord>& batch) {
+    if (fd < 0) {
+        fd = open(source.log_path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) throw std::runtime_error("replication: can't open " + source.log_path);
+    }
+    std::uint64_t head = after;
+    size_t bytes = 0;
+    std::vector<char> chunk(CHANGE_LOG_READ_CHUNK);
+    ChangeRecord record;
+    while (bytes < REPLICATION_BATCH_BYTES) {
+        ssize_t received = pread(fd, chunk.data(), chunk.size(), static_cast<off_t>(offset));
+        if (received < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("replication: can't read " + source.log_path);
+        }
+        if (received == 0) break;
+        offset += static_cast<std::uint64_t>(received);
+        bytes += static_cast<size_t>(received);
+        decoder.feed(chunk.data(), static_cast<size_t>(received));
+        while (decoder.next(record)) {
+            head = record.sequence;
+            // after a restart from the top of the file, skip what was applied
+            if (record.sequence > after) batch.push_back(std::move(record));
+        }
+    }
+    return head;
+}
+
+
+inline bool FollowerServer::pause(int milliseconds) {
+    std::unique_lock<std::mutex> guard(lock);
+    return !wake.wait_for(guard, std::chrono::milliseconds(milliseconds), [this]() { return stopping; });
+}
+
+
+inline std::uint64_t FollowerServer::now_ms() {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+#endif //REPLICATION_HPP
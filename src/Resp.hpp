@@ -0,0 +1,352 @@
+#ifndef RESP_HPP
+#define RESP_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstddef>
+#include <algorithm>
+
+#define RESP_MAX_BULK (512 * 1024 * 1024)
+#define RESP_MAX_DEPTH 8
+#define RESP_COMPACT_BYTES 4096
+
+/*
+* @struct RespValue
+* @brief One RESP (REdis Serialization Protocol) value: a request is an
+* Array of Bulk strings, a reply can be any type
+*/
+struct RespValue {
+    enum class Type { Simple, Error, Integer, Bulk, Null, Array };
+
+    Type type = Type::Null;
+    std::string text;                   // Simple, Error and Bulk payload
+    long long integer = 0;              // Integer payload
+    std::vector<RespValue> elements;    // Array elements
+};
+
+/*
+* @class RespParser
+* @brief Incremental RESP parser: bytes are fed as they arrive and complete
+* values are taken out one by one, so pipelined requests are parsed from a
+* single read. Lines not starting with a RESP type byte are parsed as inline
+* commands (space-separated words), which is what telnet sends. A value that
+* arrives over many reads is parsed as its parts arrive and the parse resumes
+* where it stopped (like Redis' multibulklen/bulklen), so a large request
+* costs time linear in its size however it is split
+* @var buffer Bytes received and not consumed yet (from pos on)
+* @var pos Start of the first unparsed byte in buffer
+* @var open Arrays being parsed, outermost first, with their elements so far
+* @var bulk_length Length of a bulk string whose header is consumed and whose
+* payload has not fully arrived, -1 if none
+* @var partial Bytes consumed by the value being parsed
+* @var scanned Offset in buffer up to which the current line has no CRLF
+*/
+class RespParser {
+public:
+
+    /*
+    * @brief Appends received bytes
+    * @param data Received bytes
+    * @param length Number of bytes
+    */
+    void feed(const char* data, size_t length);
+
+    /*
+    * @brief Takes out the next complete value
+    * @param value Set to the parsed value
+    * @return true if a value was parsed, false if more bytes are needed
+    * @throws std::runtime_error on malformed input
+    */
+    bool next(RespValue& value);
+
+    /*
+    * @brief Returns the number of bytes received and not taken out as
+    * complete values yet
+    * @return Unparsed bytes plus the bytes of the value being parsed
+    */
+    size_t buffered() const;
+
+private:
+
+    /*
+    * @struct Frame
+    * @brief An array being parsed and how many elements it still needs
+    */
+    struct Frame {
+        RespValue array;
+        long long remaining;
+    };
+
+    std::string buffer;
+    size_t pos = 0;
+    std::vector<Frame> open;
+    long long bulk_length = -1;
+    size_t partial = 0;
+    size_t scanned = 0;
+
+    /*
+    * @brief Parses from pos until a value that is not a non-empty array is
+    * complete, consuming array headers (pushed on open) on the way
+    * @param value Set to the completed value
+    * @return true if a value was completed, false if more bytes are needed
+    * @throws std::runtime_error on malformed input
+    */
+    bool parse_step(RespValue& value);
+
+    /*
+    * @brief Marks bytes from pos on as parsed
+    * @param bytes Number of bytes
+    */
+    void consume(size_t bytes);
+
+    /*
+    * @brief Reads a CRLF-terminated line
+    * @param at Offset of the line, advanced past the CRLF on success
+    * @param line Set to the line without CRLF
+    * @return true if the whole line is buffered, false otherwise
+    */
+    bool read_line(size_t& at, std::string_view& line);
+
+    /*
+    * @brief Parses a signed decimal header (lengths and integers)
+    * @param text Digits to parse
+    * @return The number
+    * @throws std::runtime_error if text is not a number
+    */
+    static long long to_integer(std::string_view text);
+};
+
+/*
+* @class RespWriter
+* @brief Appends RESP-encoded values to an output buffer, so a batch of
+* replies (or pipelined requests) goes out in one write
+*/
+class RespWriter {
+public:
+    static void simple(std::string& out, std::string_view text);
+    static void error(std::string& out, std::string_view message);
+    static void integer(std::string& out, long long value);
+    static void bulk(std::string& out, std::string_view text);
+    static void null(std::string& out);
+    static void array(std::string& out, size_t count);
+
+    /*
+    * @brief Appends a request: an array of bulk strings
+    * @param out Output buffer
+    * @param args Command name followed by its arguments
+    */
+    static void command(std::string& out, const std::vector<std::string>& args);
+};
+
+// ==================== Implementation ====================
+
+inline void RespParser::feed(const char* data, size_t length) {
+    // drop consumed bytes once they dominate the buffer
+    if (pos > RESP_COMPACT_BYTES && pos * 2 > buffer.size()) {
+        buffer.erase(0, pos);
+        scanned = scanned > pos ? scanned - pos : 0;
+        pos = 0;
+    }
+    buffer.append(data, length);
+}
+
+
+inline bool RespParser::next(RespValue& value) {
+    RespValue element;
+    while (parse_step(element)) {
+        // hand the value to the innermost open array, closing every array it completes
+        while (!open.empty()) {
+            Frame& frame = open.back();
+            frame.array.elements.push_back(std::move(element));
+            if (--frame.remaining > 0) break;
+            element = std::move(frame.array);
+            open.pop_back();
+        }
+        if (open.empty()) {
+            value = std::move(element);
+            partial = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+inline size_t RespParser::buffered() const {
+    return buffer.size() - pos + partial;
+}
+
+
+inline bool RespParser::parse_step(RespValue& value) {
+    for (;;) {
+        if (bulk_length >= 0) {
+            // the header was consumed by an earlier call, wait for the whole payload
+            size_t length = static_cast<size_t>(bulk_length);
+            if (buffer.size() - pos < length + 2) return false;
+            if (buffer[pos + length] != '\r' || buffer[pos + length + 1] != '\n') {
+                throw std::runtime_error("RESP: bulk string not terminated by CRLF");
+            }
+            value = RespValue();
+            value.type = RespValue::Type::Bulk;
+            value.text = buffer.substr(pos, length);
+            consume(length + 2);
+            bulk_length = -1;
+            return true;
+        }
+        if (pos >= buffer.size()) return false;
+        if (open.size() > RESP_MAX_DEPTH) throw std::runtime_error("RESP: arrays nested too deep");
+        char type = buffer[pos];
+        size_t cursor = pos;
+        std::string_view line;
+        if (type != '+' && type != '-' && type != ':' && type != '$' && type != '*') {
+            // inline command
+            if (!read_line(cursor, line)) return false;
+            value = RespValue();
+            value.type = RespValue::Type::Array;
+            size_t start = 0;
+            while (start < line.size()) {
+                size_t end = line.find(' ', start);
+                if (end == std::string_view::npos) end = line.size();
+                if (end > start) {
+                    RespValue word;
+                    word.type = RespValue::Type::Bulk;
+                    word.text = std::string(line.substr(start, end - start));
+                    value.elements.push_back(std::move(word));
+                }
+                start = end + 1;
+            }
+            consume(cursor - pos);
+            return true;
+        }
+        cursor++;
+        if (!read_line(cursor, line)) return false;
+        value = RespValue();
+        switch (type) {
+            case '+':
+                value.type = RespValue::Type::Simple;
+                value.text = std::string(line);
+                break;
+            case '-':
+                value.type = RespValue::Type::Error;
+                value.text = std::string(line);
+                break;
+            case ':':
+                value.type = RespValue::Type::Integer;
+                value.integer = to_integer(line);
+                break;
+            case '$': {
+                long long length = to_integer(line);
+                if (length == -1) {
+                    value.type = RespValue::Type::Null;
+                    break;
+                }
+                if (length < 0 || length > RESP_MAX_BULK) {
+                    throw std::runtime_error("RESP: invalid bulk length");
+                }
+                consume(cursor - pos);
+                bulk_length = length;
+                continue;
+            }
+            case '*': {
+                long long count = to_integer(line);
+                if (count == -1) {
+                    value.type = RespValue::Type::Null;
+                    break;
+                }
+                if (count < 0) throw std::runtime_error("RESP: invalid array length");
+                value.type = RespValue::Type::Array;
+                if (count == 0) break;
+                consume(cursor - pos);
+                open.push_back(Frame{std::move(value), count});
+                continue;
+            }
+        }
+        consume(cursor - pos);
+        return true;
+    }
+}
+
+
+inline void RespParser::consume(size_t bytes) {
+    pos += bytes;
+    partial += bytes;
+}
+
+
+inline bool RespParser::read_line(size_t& at, std::string_view& line) {
+    // bytes before scanned were searched by an earlier call for this same line
+    size_t end = buffer.find("\r\n", std::max(at, scanned));
+    if (end == std::string::npos) {
+        // a CR at the very end may still be followed by its LF
+        scanned = std::max(at, buffer.empty() ? 0 : buffer.size() - 1);
+        return false;
+    }
+    line = std::string_view(buffer).substr(at, end - at);
+    at = end + 2;
+    return true;
+}
+
+
+inline long long RespParser::to_integer(std::string_view text) {
+    if (text.empty()) throw std::runtime_error("RESP: empty number");
+    std::string digits(text);
+    char* end = nullptr;
+    long long number = std::strtoll(digits.c_str(), &end, 10);
+    if (end != digits.c_str() + digits.size()) throw std::runtime_error("RESP: invalid number");
+    return number;
+}
+
+
+inline void RespWriter::simple(std::string& out, std::string_view text) {
+    out += '+';
+    out += text;
+    out += "\r\n";
+}
+
+
+inline void RespWriter::error(std::string& out, std::string_view message) {
+    out += '-';
+    out += message;
+    out += "\r\n";
+}
+
+
+inline void RespWriter::integer(std::string& out, long long value) {
+    out += ':';
+    out += std::to_string(value);
+    out += "\r\n";
+}
+
+
+inline void RespWriter::bulk(std::string& out, std::string_view text) {
+    out += '$';
+    out += std::to_string(text.size());
+    out += "\r\n";
+    out += text;
+    out += "\r\n";
+}
+
+
+inline void RespWriter::null(std::string& out) {
+    out += "$-1\r\n";
+}
+
+
+inline void RespWriter::array(std::string& out, size_t count) {
+    out += '*';
+    out += std::to_string(count);
+    out += "\r\n";
+}
+
+
+inline void RespWriter::command(std::string& out, const std::vector<std::string>& args) {
+    array(out, args.size());
+    for (const auto& arg : args) {
+        bulk(out, arg);
+    }
+}
+
+#endif //RESP_HPP
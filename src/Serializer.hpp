@@ -0,0 +1,58 @@
+#ifndef SERIALIZER_HPP
+#define SERIALIZER_HPP
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+
+/*
+* @brief Template parameters:
+* - T : type to (de)serialize
+*/
+template <class T, class Enable = void>
+
+/*
+* @struct Serializer
+* @brief Trait that turns a key or value into bytes for snapshots and back.
+* Provided for arithmetic types (host byte order) and std::string; other
+* types get it by specializing Serializer<T> with the same two functions:
+*   static void write(std::string& out, const T& value);
+*   static bool read(const char*& cursor, const char* end, T& value);
+* read() advances cursor past the value, or returns false if the bytes up
+* to end are truncated or malformed
+*/
+struct Serializer;
+
+template <class T>
+struct Serializer<T, std::enable_if_t<std::is_arithmetic_v<T>>> {
+    static void write(std::string& out, const T& value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    static bool read(const char*& cursor, const char* end, T& value) {
+        if (static_cast<size_t>(end - cursor) < sizeof(T)) return false;
+        std::memcpy(&value, cursor, sizeof(T));
+        cursor += sizeof(T);
+        return true;
+    }
+};
+
+template <>
+struct Serializer<std::string> {
+    static void write(std::string& out, const std::string& value) {
+        Serializer<std::uint32_t>::write(out, static_cast<std::uint32_t>(value.size()));
+        out.append(value);
+    }
+
+    static bool read(const char*& cursor, const char* end, std::string& value) {
+        std::uint32_t length;
+        if (!Serializer<std::uint32_t>::read(cursor, end, length)) return false;
+        if (static_cast<size_t>(end - cursor) < length) return false;
+        value.assign(cursor, length);
+        cursor += length;
+        return true;
+    }
+};
+
+#endif //SERIALIZER_HPP
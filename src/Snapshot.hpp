@@ -0,0 +1,1068 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <algorithm>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "HashMap.hpp"
+#include "Serializer.hpp"
+#include "Crc32.hpp"
+#include "Lz4.hpp"
+
+#define SNAPSHOT_MAGIC "HMSNAP02"
+#define SNAPSHOT_MAGIC_V1 "HMSNAP01"
+#define SNAPSHOT_MAGIC_BYTES 8
+#define SNAPSHOT_HEADER_BYTES 32
+#define SNAPSHOT_BLOCK_HEADER_BYTES 32
+#define SNAPSHOT_BLOCK_HEADER_BYTES_V1 24
+#define SNAPSHOT_END_MARKER 0xFFFFFFFFu
+#define SNAPSHOT_INDEX_MAGIC "HMSNAPIX"
+#define SNAPSHOT_INDEX_ENTRY_BYTES 40
+#define SNAPSHOT_FOOTER_BYTES 24
+#define SNAPSHOT_SEGMENTS 65536
+#define SNAPSHOT_WRITE_BUFFER (1 << 20)
+#define SNAPSHOT_WINDOW_SEGMENTS 1024
+
+/*
+* @enum SnapshotKind
+* @brief A full snapshot holds every segment, a delta only the segments
+* changed since its parent
+*/
+enum class SnapshotKind : std::uint32_t { Full = 1, Delta = 2 };
+
+/*
+* @struct SnapshotHeader
+* @brief Header of a snapshot file. Ids are random; a delta names the
+* snapshot it applies to as its parent, a full snapshot has parent 0
+*/
+struct SnapshotHeader {
+    SnapshotKind kind = SnapshotKind::Full;
+    std::uint32_t segment_count = 0;
+    std::uint64_t id = 0;
+    std::uint64_t parent = 0;
+};
+
+/*
+* @struct SnapshotStats
+* @brief What a save or a compaction wrote
+*/
+struct SnapshotStats {
+    size_t segments = 0;
+    size_t pairs = 0;
+    std::uint64_t bytes = 0;            // file size
+    std::uint64_t raw_bytes = 0;        // serialized pairs before compression
+};
+
+namespace snapshot_detail {
+
+/*
+* @brief Throws a std::runtime_error naming the failed call and errno
+* @param what Name of the failed call
+*/
+[[noreturn]] inline void fail(const std::string& what) {
+    throw std::runtime_error(what + " failed: " + std::strerror(errno));
+}
+
+/*
+* @brief Draws a random non-zero snapshot id
+* @return The id
+*/
+inline std::uint64_t new_snapshot_id() {
+    std::random_device device;
+    std::uint64_t id = (static_cast<std::uint64_t>(device()) << 32) ^ device()
+        ^ static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+    return id == 0 ? 1 : id;
+}
+
+/*
+* @brief Resolves a thread count argument
+* @param threads Requested threads, 0 for one per hardware thread
+* @return Number of threads to use, at least 1
+*/
+inline size_t resolve_threads(size_t threads) {
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    return threads == 0 ? 1 : threads;
+}
+
+/*
+* @brief Runs fn(0) ... fn(count - 1) on up to threads threads (the caller
+* being one of them), each thread taking the next index until none is left
+* @param count Number of indices
+* @param threads Maximum number of threads
+* @param fn Called with each index, must be safe to call concurrently
+* @throws The first exception fn threw, once every thread has stopped
+*/
+template <class Fn>
+void parallel_for(size_t count, size_t threads, Fn&& fn) {
+    threads = std::min(threads, count);
+    if (threads <= 1) {
+        for (size_t i = 0; i < count; i++) fn(i);
+        return;
+    }
+    std::atomic<size_t> next(0);
+    std::mutex error_lock;
+    std::exception_ptr error;
+    auto work = [&]() {
+        try {
+            for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) fn(i);
+        } catch (...) {
+            std::lock_guard<std::mutex> guard(error_lock);
+            if (!error) error = std::current_exception();
+            next.store(count);
+        }
+    };
+    std::vector<std::thread> helpers;
+    for (size_t t = 1; t < threads; t++) helpers.emplace_back(work);
+    work();
+    for (auto& helper : helpers) helper.join();
+    if (error) std::rethrow_exception(error);
+}
+
+/*
+* @struct EncodedBlock
+* @brief A segment block as stored: the serialized pairs LZ4-compressed,
+* or raw when that doesn't make them smaller (stored size == raw size),
+* with a CRC-32 of the stored bytes
+*/
+struct EncodedBlock {
+    std::uint32_t segment = 0;
+    std::uint64_t pairs = 0;
+    std::uint32_t crc = 0;
+    std::uint64_t raw_bytes = 0;
+    std::string stored;
+    bool skip = false;                  // empty segment left out of a full snapshot
+};
+
+/*
+* @brief Compresses and checksums a segment's serialized pairs
+* @param payload Serialized pairs
+* @param block Filled with the stored bytes, sizes and checksum (segment and pairs untouched)
+*/
+inline void encode_block(const std::string& payload, EncodedBlock& block) {
+    block.raw_bytes = payload.size();
+    block.stored.clear();
+    Lz4::compress(payload.data(), payload.size(), block.stored);
+    if (block.stored.size() >= payload.size()) block.stored = payload;
+    block.crc = Crc32::of(block.stored.data(), block.stored.size());
+}
+
+/*
+* @brief Restores a segment's serialized pairs from its stored bytes
+* @param stored Stored bytes, checksum already verified
+* @param stored_bytes Number of stored bytes
+* @param raw_bytes Size of the serialized pairs
+* @param payload Set to the serialized pairs
+* @return false if the compressed bytes are malformed
+*/
+inline bool decode_block(const char* stored, size_t stored_bytes, std::uint64_t raw_bytes, std::string& payload) {
+    if (stored_bytes == raw_bytes) {
+        payload.assign(stored, stored_bytes);
+        return true;
+    }
+    payload.resize(raw_bytes);
+    return Lz4::decompress(stored, stored_bytes, &payload[0], payload.size());
+}
+
+/*
+* @class SnapshotWriter
+* @brief Writes a snapshot file: the header, one block per segment, an
+* end marker, then an index of the blocks and a footer locating it, so a
+* reader can open the file without walking every block. The file is
+* written under a temporary name and renamed over path by commit(), so a
+* crash never leaves a partial snapshot behind
+* @var path Final path
+* @var temp_path Path written until commit()
+* @var fd The temporary file
+* @var buffer Bytes not written yet
+* @var index Index entries of the blocks written so far
+* @var stats Segments, pairs and bytes written so far
+*/
+class SnapshotWriter {
+public:
+
+    /*
+    * @brief Creates the temporary file and writes the header
+    * @param path Final path of the snapshot
+    * @param header Header to write
+    * @throws std::runtime_error if the file can't be created
+    */
+    SnapshotWriter(const std::string& path, const SnapshotHeader& header);
+
+    /*
+    * @brief Removes the temporary file unless committed (destructor)
+    */
+    ~SnapshotWriter();
+
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    /*
+    * @brief Appends a segment block, encoded by encode_block() or copied
+    * from another snapshot
+    * @param block Block to append
+    * @throws std::runtime_error if the write fails
+    */
+    void block(const EncodedBlock& block);
+
+    /*
+    * @brief Writes the end marker, syncs the file and renames it to its final path
+    * @return What was written
+    * @throws std::runtime_error if a write, the sync or the rename fails
+    */
+    SnapshotStats commit();
+
+private:
+    std::string path;
+    std::string temp_path;
+    int fd;
+    std::string buffer;
+    std::string index;
+    SnapshotStats stats;
+
+    /*
+    * @brief Writes the buffer to the file
+    * @throws std::runtime_error if the write fails
+    */
+    void drain();
+};
+
+/*
+* @brief Writes the segments of a map as a snapshot file
+* @param map Map to write
+* @param path Path of the snapshot
+* @param header Header of the file, its segment count splits the map
+* @param dirty Bitmap of the segments to write (empty ones included), or
+* nullptr to write every non-empty segment
+* @param threads Threads serializing and compressing segments, windows of
+* SNAPSHOT_WINDOW_SEGMENTS at a time written in segment order
+* @return What was written
+* @throws std::runtime_error if the write fails
+*/
+template <class KeyT, class ValueT>
+SnapshotStats write_map(const HashMap<KeyT, ValueT>& map, const std::string& path, const SnapshotHeader& header,
+                        const std::vector<std::uint64_t>* dirty, size_t threads = 1);
+
+} // namespace snapshot_detail
+
+/*
+* @class SnapshotChain
+* @brief A full snapshot followed by the deltas saved after it, in order.
+* Opening the chain checks that each file's parent is the previous file and
+* indexes where the newest version of every segment is, so loading reads
+* each segment once and compaction copies blocks without decoding pairs.
+* Files are memory-mapped and only their block index is read when opening,
+* so a segment's pages are faulted in when it is first read. Reading
+* segments is safe from several threads at once
+* @var paths Paths of the files
+* @var files Read-only mappings of the files, one per path
+* @var last Header of the last file
+* @var locations Newest block of each segment, file -1 if no file has one
+*/
+class SnapshotChain {
+public:
+
+    /*
+    * @brief Opens and indexes a chain
+    * @param paths Full snapshot first, then its deltas in the order they were saved
+    * @throws std::invalid_argument if paths is empty
+    * @throws std::runtime_error if a file can't be read, is corrupt or is
+    * not the child of the previous one
+    */
+    explicit SnapshotChain(const std::vector<std::string>& paths);
+
+    /*
+    * @brief Unmaps the files (destructor)
+    */
+    ~SnapshotChain();
+
+    SnapshotChain(const SnapshotChain&) = delete;
+    SnapshotChain& operator=(const SnapshotChain&) = delete;
+
+    /*
+    * @brief Returns the header of the last file of the chain
+    * @return Header, its id is the one the next delta must name as parent
+    */
+    const SnapshotHeader& head() const;
+
+    /*
+    * @brief Returns the number of pairs in the newest version of every segment
+    * @return Pairs the chain loads into a map
+    */
+    std::uint64_t pairs() const;
+
+    /*
+    * @brief Reads and decompresses the newest version of a segment
+    * @param segment Segment index
+    * @param payload Set to the serialized pairs, empty if no file holds the segment
+    * @return Number of pairs in payload
+    * @throws std::runtime_error if the checksum doesn't match or the block
+    * doesn't decompress
+    */
+    std::uint64_t read_segment(std::uint32_t segment, std::string& payload) const;
+
+    /*
+    * @brief Writes the newest version of every segment as one full snapshot,
+    * copying blocks as stored. The result keeps the id of the chain's last
+    * file, so deltas saved after that file can follow it
+    * @param path Path of the compacted snapshot, may be one of the chain's files
+    * @return What was written
+    * @throws std::runtime_error if a read or a write fails
+    */
+    SnapshotStats compact(const std::string& path) const;
+
+private:
+
+    /*
+    * @struct Location
+    * @brief Where a segment block is
+    */
+    struct Location {
+        int file = -1;
+        std::uint64_t offset = 0;
+        std::uint64_t pairs = 0;
+        std::uint64_t bytes = 0;
+        std::uint64_t raw_bytes = 0;
+        std::uint32_t crc = 0;
+    };
+
+    /*
+    * @struct Mapping
+    * @brief A memory-mapped file
+    */
+    struct Mapping {
+        const char* data = nullptr;
+        size_t size = 0;
+    };
+
+    std::vector<std::string> paths;
+    std::vector<Mapping> files;
+    SnapshotHeader last;
+    std::vector<Location> locations;
+
+    /*
+    * @brief Reads a file's header and its block index (or, in files without
+    * one, every block header) into locations
+    * @param file Index of the file in paths
+    * @return The file's header
+    */
+    SnapshotHeader index_file(size_t file);
+
+    /*
+    * @brief Finds the stored bytes of a block and checks its checksum
+    * @param location Block to read
+    * @return The stored bytes, in the file's mapping
+    */
+    const char* read_block(const Location& location) const;
+
+    /*
+    * @brief Throws a std::runtime_error about a corrupt file
+    * @param file Index of the file in paths
+    * @param what What is wrong
+    */
+    [[noreturn]] void corrupt(size_t file, const std::string& what) const;
+};
+
+/*
+* @brief Template parameters:
+* - KeyT   : type of keys, with a Serializer<KeyT>
+* - ValueT : type of values, with a Serializer<ValueT>
+*/
+template <class KeyT, class ValueT>
+
+/*
+* @class IncrementalSnapshot
+* @brief Saves a HashMap or Dictionary to snapshot files whose size follows
+* the volume of changes rather than the size of the table. Pairs are split
+* into segments by the low bits of their hash; attached as the map's
+* mutation observer, it marks the segment of every written or erased key
+* dirty. save() writes every segment as a full snapshot, save_incremental()
+* only the dirty ones as a delta naming the previous file as its parent, and
+* a delta replaces those segments wholesale when the chain is loaded.
+* Segments are LZ4-compressed and checksummed independently, by several
+* threads on save and on load
+* @var map The saved map
+* @var segment_count Number of segments, a power of 2
+* @var dirty Bitmap of the segments changed since the last save
+* @var dirty_count Number of bits set in dirty
+* @var last_snapshot_id Id of the last file saved (or loaded), 0 if none
+* @var threads Threads serializing and compressing on save
+* @note It takes the map's mutation observer slot. Like the HashMap it is
+* not thread-safe: save from the thread that mutates the map. Values
+* changed in place through a reference aren't observed, touch() their keys
+*/
+class IncrementalSnapshot : public MutationObserver<KeyT, ValueT> {
+public:
+
+    /*
+    * @brief Attaches to a map, every segment starts dirty
+    * @param map Map to save, must outlive the IncrementalSnapshot
+    * @param segment_count Number of segments, a power of 2. Must match the
+    * chain given by base_id
+    * @param base_id Id of the snapshot the map was just loaded from (the
+    * head() of its chain), so the next save_incremental() extends that
+    * chain; 0 to start with save()
+    * @throws std::invalid_argument if segment_count is not a power of 2
+    */
+    explicit IncrementalSnapshot(HashMap<KeyT, ValueT>& map, size_t segment_count = SNAPSHOT_SEGMENTS,
+                                 std::uint64_t base_id = 0);
+
+    /*
+    * @brief Detaches from the map (destructor)
+    */
+    ~IncrementalSnapshot() override;
+
+    IncrementalSnapshot(const IncrementalSnapshot&) = delete;
+    IncrementalSnapshot& operator=(const IncrementalSnapshot&) = delete;
+
+    /*
+    * @brief Writes a full snapshot, the base of a new chain
+    * @param path Path of the snapshot
+    * @return What was written
+    * @throws std::runtime_error if the write fails (segments stay dirty)
+    */
+    SnapshotStats save(const std::string& path);
+
+    /*
+    * @brief Writes the segments changed since the last save as a delta
+    * @param path Path of the delta
+    * @return What was written
+    * @throws std::logic_error if nothing was saved or loaded yet
+    * @throws std::runtime_error if the write fails (segments stay dirty)
+    */
+    SnapshotStats save_incremental(const std::string& path);
+
+    /*
+    * @brief Sets the number of threads that serialize and compress segments
+    * on save (they only read the map, which must not change meanwhile)
+    * @param threads Number of threads, 0 for one per hardware thread (the default)
+    */
+    void set_threads(size_t threads);
+
+    /*
+    * @brief Marks a key's segment dirty, for values changed in place
+    * @param key Key changed
+    */
+    void touch(const KeyT& key);
+
+    /*
+    * @brief Returns the number of segments the next delta would write
+    * @return Dirty segments
+    */
+    size_t dirty_segments() const;
+
+    /*
+    * @brief Returns the id of the last file saved
+    * @return Id, 0 before the first save
+    */
+    std::uint64_t last_id() const;
+
+    /*
+    * @brief Replaces a map's contents with a chain of snapshots. Worker
+    * threads read, verify, decompress and deserialize a window of segments
+    * (hashing the keys too) while the calling thread inserts the previous one
+    * @param paths Full snapshot first, then its deltas in order
+    * @param map Map to fill
+    * @param threads Number of worker threads, 0 for one per hardware thread
+    * @return Header of the chain's last file (give its id and segment count
+    * to an IncrementalSnapshot to keep extending the chain)
+    * @throws std::runtime_error if a file is missing, corrupt or out of order
+    */
+    static SnapshotHeader load(const std::vector<std::string>& paths, HashMap<KeyT, ValueT>& map,
+                               size_t threads = 0);
+
+    /*
+    * @brief Merges a chain into a single full snapshot (see SnapshotChain::compact())
+    * @param paths Full snapshot first, then its deltas in order
+    * @param path Path of the compacted snapshot
+    * @return What was written
+    * @throws std::runtime_error if a read or a write fails
+    */
+    static SnapshotStats compact(const std::vector<std::string>& paths, const std::string& path);
+
+    void on_write(const KeyT& key, const ValueT& value, bool inserted) override;
+    void on_erase(const KeyT& key) override;
+    void on_clear() override;
+
+private:
+    HashMap<KeyT, ValueT>& map;
+    size_t segment_count;
+    std::vector<std::uint64_t> dirty;
+    size_t dirty_count;
+    std::uint64_t last_snapshot_id;
+    size_t threads;
+
+    /*
+    * @brief Writes a snapshot of the map
+    * @param path Path of the snapshot
+    * @param kind Full (non-empty segments) or Delta (dirty segments, empty ones included)
+    * @return What was written
+    */
+    SnapshotStats write(const std::string& path, SnapshotKind kind);
+
+    /*
+    * @brief Marks every segment dirty
+    */
+    void mark_all();
+};
+
+// ==================== Implementation ====================
+
+namespace snapshot_detail {
+
+inline SnapshotWriter::SnapshotWriter(const std::string& path, const SnapshotHeader& header) :
+    path(path), temp_path(path + ".tmp") {
+    fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) fail("open " + temp_path);
+    buffer.append(SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_BYTES);
+    Serializer<std::uint32_t>::write(buffer, static_cast<std::uint32_t>(header.kind));
+    Serializer<std::uint32_t>::write(buffer, header.segment_count);
+    Serializer<std::uint64_t>::write(buffer, header.id);
+    Serializer<std::uint64_t>::write(buffer, header.parent);
+    stats.bytes = SNAPSHOT_HEADER_BYTES;
+}
+
+
+inline SnapshotWriter::~SnapshotWriter() {
+    if (fd >= 0) {
+        close(fd);
+        unlink(temp_path.c_str());
+    }
+}
+
+
+inline void SnapshotWriter::block(const EncodedBlock& block) {
+    // an index entry is the block header followed by the payload offset
+    Serializer<std::uint32_t>::write(index, block.segment);
+    Serializer<std::uint32_t>::write(index, block.crc);
+    Serializer<std::uint64_t>::write(index, block.pairs);
+    Serializer<std::uint64_t>::write(index, block.stored.size());
+    Serializer<std::uint64_t>::write(index, block.raw_bytes);
+    Serializer<std::uint64_t>::write(index, stats.bytes + SNAPSHOT_BLOCK_HEADER_BYTES);
+    Serializer<std::uint32_t>::write(buffer, block.segment);
+    Serializer<std::uint32_t>::write(buffer, block.crc);
+    Serializer<std::uint64_t>::write(buffer, block.pairs);
+    Serializer<std::uint64_t>::write(buffer, block.stored.size());
+    Serializer<std::uint64_t>::write(buffer, block.raw_bytes);
+    buffer.append(block.stored);
+    stats.segments++;
+    stats.pairs += block.pairs;
+    stats.bytes += SNAPSHOT_BLOCK_HEADER_BYTES + block.stored.size();
+    stats.raw_bytes += block.raw_bytes;
+    if (buffer.size() >= SNAPSHOT_WRITE_BUFFER) drain();
+}
+
+
+inline SnapshotStats SnapshotWriter::commit() {
+    // the end marker records the totals, so a reader can tell a complete file
+    Serializer<std::uint32_t>::write(buffer, SNAPSHOT_END_MARKER);
+    Serializer<std::uint32_t>::write(buffer, 0);
+    Serializer<std::uint64_t>::write(buffer, stats.pairs);
+    Serializer<std::uint64_t>::write(buffer, stats.segments);
+    Serializer<std::uint64_t>::write(buffer, stats.raw_bytes);
+    stats.bytes += SNAPSHOT_BLOCK_HEADER_BYTES;
+    // readers that predate the index stop at the end marker
+    std::uint64_t index_offset = stats.bytes;
+    buffer.append(index);
+    Serializer<std::uint64_t>::write(buffer, index_offset);
+    Serializer<std::uint64_t>::write(buffer, stats.segments);
+    buffer.append(SNAPSHOT_INDEX_MAGIC, SNAPSHOT_MAGIC_BYTES);
+    stats.bytes += index.size() + SNAPSHOT_FOOTER_BYTES;
+    drain();
+    if (fsync(fd) < 0) fail("fsync " + temp_path);
+    if (close(fd) < 0) {
+        fd = -1;
+        unlink(temp_path.c_str());
+        fail("close " + temp_path);
+    }
+    fd = -1;
+    if (std::rename(temp_path.c_str(), path.c_str()) < 0) {
+        unlink(temp_path.c_str());
+        fail("rename " + temp_path);
+    }
+    return stats;
+}
+
+
+inline void SnapshotWriter::drain() {
+    size_t sent = 0;
+    while (sent < buffer.size()) {
+        ssize_t written = ::write(fd, buffer.data() + sent, buffer.size() - sent);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            fail("write " + temp_path);
+        }
+        sent += static_cast<size_t>(written);
+    }
+    buffer.clear();
+}
+
+
+template <class KeyT, class ValueT>
+SnapshotStats write_map(const HashMap<KeyT, ValueT>& map, const std::string& path, const SnapshotHeader& header,
+                        const std::vector<std::uint64_t>* dirty, size_t threads) {
+    size_t segment_count = header.segment_count;
+    std::vector<std::uint32_t> segments;
+    for (size_t word = 0; word * 64 < segment_count; word++) {
+        std::uint64_t bits = dirty == nullptr ? ~std::uint64_t(0) : (*dirty)[word];
+        while (bits != 0) {
+            size_t segment = word * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            if (segment >= segment_count) break;
+            segments.push_back(static_cast<std::uint32_t>(segment));
+        }
+    }
+    // in deterministic mode a segment's pairs are spread over the whole
+    // table, so they are sorted into segments in one pass up front
+    std::vector<std::vector<std::pair<const KeyT*, const ValueT*>>> grouped;
+    if (map.is_deterministic()) {
+        std::vector<std::int64_t> slot(segment_count, -1);
+        for (size_t i = 0; i < segments.size(); i++) slot[segments[i]] = static_cast<std::int64_t>(i);
+        grouped.resize(segments.size());
+        map.for_each_with_stripe(segment_count, [&slot, &grouped](std::size_t segment, const KeyT& key, const ValueT& value) {
+            if (slot[segment] >= 0) grouped[static_cast<size_t>(slot[segment])].emplace_back(&key, &value);
+        });
+    }
+    SnapshotWriter writer(path, header);
+    std::vector<EncodedBlock> window(std::min<size_t>(segments.size(), SNAPSHOT_WINDOW_SEGMENTS));
+    for (size_t first = 0; first < segments.size(); first += window.size()) {
+        size_t count = std::min(window.size(), segments.size() - first);
+        // the map is only read, so segments serialize and compress concurrently
+        parallel_for(count, threads, [&](size_t i) {
+            EncodedBlock& block = window[i];
+            std::string payload;
+            block.segment = segments[first + i];
+            block.pairs = 0;
+            auto add = [&payload, &block](const KeyT& key, const ValueT& value) {
+                Serializer<KeyT>::write(payload, key);
+                Serializer<ValueT>::write(payload, value);
+                block.pairs++;
+            };
+            if (grouped.empty()) {
+                map.for_each_in_stripe(block.segment, segment_count, add);
+            } else {
+                for (const auto& pair : grouped[first + i]) add(*pair.first, *pair.second);
+            }
+            // in a delta an empty block erases the segment
+            block.skip = block.pairs == 0 && dirty == nullptr;
+            if (!block.skip) encode_block(payload, block);
+        });
+        for (size_t i = 0; i < count; i++) {
+            if (!window[i].skip) writer.block(window[i]);
+        }
+    }
+    return writer.commit();
+}
+
+} // namespace snapshot_detail
+
+
+inline SnapshotChain::SnapshotChain(const std::vector<std::string>& paths) : paths(paths) {
+    if (paths.empty()) throw std::invalid_argument("snapshot chain is empty");
+    try {
+        for (size_t i = 0; i < paths.size(); i++) {
+            int fd = open(paths[i].c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) snapshot_detail::fail("open " + paths[i]);
+            struct stat info;
+            if (fstat(fd, &info) < 0) {
+                int error = errno;
+                close(fd);
+                errno = error;
+                snapshot_detail::fail("stat " + paths[i]);
+            }
+            Mapping mapping;
+            mapping.size = static_cast<size_t>(info.st_size);
+            if (mapping.size < SNAPSHOT_HEADER_BYTES + SNAPSHOT_BLOCK_HEADER_BYTES_V1) {
+                close(fd);
+                throw std::runtime_error("snapshot truncated: " + paths[i]);
+            }
+            void* data = mmap(nullptr, mapping.size, PROT_READ, MAP_PRIVATE, fd, 0);
+            // the mapping keeps the file referenced
+            close(fd);
+            if (data == MAP_FAILED) snapshot_detail::fail("mmap " + paths[i]);
+            mapping.data = static_cast<const char*>(data);
+            files.push_back(mapping);
+            SnapshotHeader header = index_file(i);
+            if (i == 0 && header.kind != SnapshotKind::Full) {
+                throw std::runtime_error("snapshot chain must start with a full snapshot: " + paths[i]);
+            }
+            if (i > 0 && (header.kind != SnapshotKind::Delta || header.parent != last.id)) {
+                throw std::runtime_error("snapshot is not a delta of the previous file: " + paths[i]);
+            }
+            last = header;
+        }
+    } catch (...) {
+        for (const Mapping& mapping : files) munmap(const_cast<char*>(mapping.data), mapping.size);
+        throw;
+    }
+}
+
+
+inline SnapshotChain::~SnapshotChain() {
+    for (const Mapping& mapping : files) munmap(const_cast<char*>(mapping.data), mapping.size);
+}
+
+
+inline const SnapshotHeader& SnapshotChain::head() const {
+    return last;
+}
+
+
+inline std::uint64_t SnapshotChain::pairs() const {
+    std::uint64_t total = 0;
+    for (const Location& location : locations) {
+        if (location.file >= 0) total += location.pairs;
+    }
+    return total;
+}
+
+
+inline std::uint64_t SnapshotChain::read_segment(std::uint32_t segment, std::string& payload) const {
+    payload.clear();
+    const Location& location = locations[segment];
+    if (location.file < 0) return 0;
+    const char* stored = read_block(location);
+    if (!snapshot_detail::decode_block(stored, location.bytes, location.raw_bytes, payload)) {
+        corrupt(location.file, "block doesn't decompress");
+    }
+    return location.pairs;
+}
+
+
+inline SnapshotStats SnapshotChain::compact(const std::string& path) const {
+    SnapshotHeader header;
+    header.kind = SnapshotKind::Full;
+    header.segment_count = last.segment_count;
+    header.id = last.id;
+    snapshot_detail::SnapshotWriter writer(path, header);
+    snapshot_detail::EncodedBlock block;
+    for (std::uint32_t segment = 0; segment < last.segment_count; segment++) {
+        const Location& location = locations[segment];
+        // a full snapshot leaves empty segments out
+        if (location.file < 0 || location.pairs == 0) continue;
+        block.stored.assign(read_block(location), location.bytes);
+        block.segment = segment;
+        block.pairs = location.pairs;
+        block.crc = location.crc;
+        block.raw_bytes = location.raw_bytes;
+        writer.block(block);
+    }
+    return writer.commit();
+}
+
+
+inline SnapshotHeader SnapshotChain::index_file(size_t file) {
+    const Mapping& mapping = files[file];
+    // version 1 files have uncompressed blocks without a raw size
+    bool version1 = std::memcmp(mapping.data, SNAPSHOT_MAGIC_V1, SNAPSHOT_MAGIC_BYTES) == 0;
+    if (!version1 && std::memcmp(mapping.data, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_BYTES) != 0) {
+        throw std::runtime_error("not a snapshot file: " + paths[file]);
+    }
+    size_t block_header_bytes = version1 ? SNAPSHOT_BLOCK_HEADER_BYTES_V1 : SNAPSHOT_BLOCK_HEADER_BYTES;
+    const char* cursor = mapping.data + SNAPSHOT_MAGIC_BYTES;
+    const char* end = mapping.data + SNAPSHOT_HEADER_BYTES;
+    std::uint32_t kind;
+    SnapshotHeader header;
+    Serializer<std::uint32_t>::read(cursor, end, kind);
+    Serializer<std::uint32_t>::read(cursor, end, header.segment_count);
+    Serializer<std::uint64_t>::read(cursor, end, header.id);
+    Serializer<std::uint64_t>::read(cursor, end, header.parent);
+    header.kind = static_cast<SnapshotKind>(kind);
+    if ((kind != static_cast<std::uint32_t>(SnapshotKind::Full) && kind != static_cast<std::uint32_t>(SnapshotKind::Delta))
+        || header.segment_count == 0 || (header.segment_count & (header.segment_count - 1)) != 0
+        || (file > 0 && header.segment_count != last.segment_count)) {
+        corrupt(file, "bad header");
+    }
+    if (file == 0) locations.assign(header.segment_count, Location());
+
+    // the index, when the file has one, stops right before the footer
+    std::uint64_t index_offset = 0;
+    std::uint64_t index_entries = 0;
+    const char* footer = mapping.data + mapping.size - SNAPSHOT_FOOTER_BYTES;
+    bool indexed = !version1 && mapping.size >= SNAPSHOT_HEADER_BYTES + SNAPSHOT_BLOCK_HEADER_BYTES + SNAPSHOT_FOOTER_BYTES
+        && std::memcmp(footer + 16, SNAPSHOT_INDEX_MAGIC, SNAPSHOT_MAGIC_BYTES) == 0;
+    if (indexed) {
+        cursor = footer;
+        end = footer + 16;
+        Serializer<std::uint64_t>::read(cursor, end, index_offset);
+        Serializer<std::uint64_t>::read(cursor, end, index_entries);
+        std::uint64_t index_end = mapping.size - SNAPSHOT_FOOTER_BYTES;
+        if (index_offset < SNAPSHOT_HEADER_BYTES + SNAPSHOT_BLOCK_HEADER_BYTES || index_offset > index_end
+            || (index_end - index_offset) / SNAPSHOT_INDEX_ENTRY_BYTES != index_entries
+            || (index_end - index_offset) % SNAPSHOT_INDEX_ENTRY_BYTES != 0) {
+            corrupt(file, "bad block index");
+        }
+    }
+    // blocks end at the end marker: just before the index, or wherever walking them stops
+    std::uint64_t blocks_end = indexed ? index_offset - SNAPSHOT_BLOCK_HEADER_BYTES : mapping.size;
+
+    std::uint64_t offset = SNAPSHOT_HEADER_BYTES;
+    std::uint64_t blocks = 0;
+    std::uint64_t pairs = 0;
+    for (;;) {
+        if (indexed && blocks == index_entries) {
+            offset = blocks_end;
+        }
+        if (block_header_bytes > mapping.size - offset) corrupt(file, "truncated");
+        cursor = mapping.data + offset;
+        end = cursor + block_header_bytes;
+        Location location;
+        std::uint32_t segment;
+        Serializer<std::uint32_t>::read(cursor, end, segment);
+        Serializer<std::uint32_t>::read(cursor, end, location.crc);
+        Serializer<std::uint64_t>::read(cursor, end, location.pairs);
+        Serializer<std::uint64_t>::read(cursor, end, location.bytes);
+        location.raw_bytes = location.bytes;
+        if (!version1) Serializer<std::uint64_t>::read(cursor, end, location.raw_bytes);
+        if (segment == SNAPSHOT_END_MARKER) {
+            if (location.pairs != pairs || location.bytes != blocks) corrupt(file, "end marker doesn't match its blocks");
+            return header;
+        }
+        offset += block_header_bytes;
+        if (indexed) {
+            // take the block from the index instead of walking to it
+            const char* entry = mapping.data + index_offset + blocks * SNAPSHOT_INDEX_ENTRY_BYTES;
+            cursor = entry;
+            end = entry + SNAPSHOT_INDEX_ENTRY_BYTES;
+            Serializer<std::uint32_t>::read(cursor, end, segment);
+            Serializer<std::uint32_t>::read(cursor, end, location.crc);
+            Serializer<std::uint64_t>::read(cursor, end, location.pairs);
+            Serializer<std::uint64_t>::read(cursor, end, location.bytes);
+            Serializer<std::uint64_t>::read(cursor, end, location.raw_bytes);
+            Serializer<std::uint64_t>::read(cursor, end, offset);
+        }
+        // LZ4 never expands a block more than 255 times
+        if (segment >= header.segment_count || offset > blocks_end || location.bytes > blocks_end - offset
+            || location.raw_bytes < location.bytes || location.raw_bytes > 255 * location.bytes + 16) {
+            corrupt(file, "bad block");
+        }
+        location.file = static_cast<int>(file);
+        location.offset = offset;
+        locations[segment] = location;
+        offset += location.bytes;
+        blocks++;
+        pairs += location.pairs;
+    }
+}
+
+
+inline const char* SnapshotChain::read_block(const Location& location) const {
+    const char* stored = files[location.file].data + location.offset;
+    if (Crc32::of(stored, location.bytes) != location.crc) corrupt(location.file, "block checksum mismatch");
+    return stored;
+}
+
+
+inline void SnapshotChain::corrupt(size_t file, const std::string& what) const {
+    throw std::runtime_error("corrupt snapshot " + paths[file] + ": " + what);
+}
+
+
+template <class KeyT, class ValueT>
+IncrementalSnapshot<KeyT, ValueT>::IncrementalSnapshot(HashMap<KeyT, ValueT>& map, size_t segment_count,
+                                                       std::uint64_t base_id) :
+    map(map), segment_count(segment_count), dirty_count(0), last_snapshot_id(base_id),
+    threads(snapshot_detail::resolve_threads(0)) {
+    if (segment_count == 0 || (segment_count & (segment_count - 1)) != 0
+        || segment_count >= SNAPSHOT_END_MARKER) {
+        throw std::invalid_argument("segment count must be a power of 2");
+    }
+    dirty.assign((segment_count + 63) / 64, 0);
+    // a loaded map matches its chain, anything else has to be written in full
+    if (base_id == 0) mark_all();
+    map.set_mutation_observer(this);
+}
+
+
+template <class KeyT, class ValueT>
+IncrementalSnapshot<KeyT, ValueT>::~IncrementalSnapshot() {
+    map.set_mutation_observer(nullptr);
+}
+
+
+template <class KeyT, class ValueT>
+SnapshotStats IncrementalSnapshot<KeyT, ValueT>::save(const std::string& path) {
+    return write(path, SnapshotKind::Full);
+}
+
+
+template <class KeyT, class ValueT>
+SnapshotStats IncrementalSnapshot<KeyT, ValueT>::save_incremental(const std::string& path) {
+    if (last_snapshot_id == 0) {
+        throw std::logic_error("no base snapshot to save a delta against");
+    }
+    return write(path, SnapshotKind::Delta);
+}
+
+
+template <class KeyT, class ValueT>
+void IncrementalSnapshot<KeyT, ValueT>::set_threads(size_t threads) {
+    this->threads = snapshot_detail::resolve_threads(threads);
+}
+
+
+template <class KeyT, class ValueT>
+void IncrementalSnapshot<KeyT, ValueT>::touch(const KeyT& key) {
+    std::size_t segment = std::hash<KeyT>()(key) & (segment_count - 1);
+    std::uint64_t bit = std::uint64_t(1) << (segment % 64);
+    if ((dirty[segment / 64] & bit) == 0) {
+        dirty[segment / 64] |= bit;
+        dirty_count++;
+    }
+}
+
+
+template <class KeyT, class ValueT>
+size_t IncrementalSnapshot<KeyT, ValueT>::dirty_segments() const {
+    return dirty_count;
+}
+
+
+template <class KeyT, class ValueT>
+std::uint64_t IncrementalSnapshot<KeyT, ValueT>::last_id() const {
+    return last_snapshot_id;
+}
+
+
+template <class KeyT, class ValueT>
+SnapshotHeader IncrementalSnapshot<KeyT, ValueT>::load(const std::vector<std::string>& paths,
+                                                       HashMap<KeyT, ValueT>& map, size_t threads) {
+    struct Decoded {
+        KeyT key;
+        std::size_t hash;
+        ValueT value;
+    };
+    using Window = std::vector<std::vector<Decoded>>;
+
+    SnapshotChain chain(paths);
+    threads = snapshot_detail::resolve_threads(threads);
+    size_t segments = chain.head().segment_count;
+    size_t window_size = std::min<size_t>(segments, SNAPSHOT_WINDOW_SEGMENTS);
+    auto decode = [&chain, segments, threads](size_t first, Window& window) {
+        size_t count = std::min(window.size(), segments - first);
+        snapshot_detail::parallel_for(count, threads, [&chain, &window, first](size_t i) {
+            std::string payload;
+            std::uint32_t segment = static_cast<std::uint32_t>(first + i);
+            std::uint64_t pairs = chain.read_segment(segment, payload);
+            const char* cursor = payload.data();
+            const char* end = cursor + payload.size();
+            window[i].clear();
+            window[i].reserve(pairs);
+            for (std::uint64_t p = 0; p < pairs; p++) {
+                Decoded decoded;
+                if (!Serializer<KeyT>::read(cursor, end, decoded.key)
+                    || !Serializer<ValueT>::read(cursor, end, decoded.value)) {
+                    throw std::runtime_error("malformed pair in snapshot segment " + std::to_string(segment));
+                }
+                decoded.hash = std::hash<KeyT>()(decoded.key);
+                window[i].push_back(std::move(decoded));
+            }
+        });
+    };
+
+    map.clear();
+    map.reserve(static_cast<int>(chain.pairs()));
+    Window current(window_size);
+    Window next(window_size);
+    decode(0, current);
+    for (size_t first = 0; first < segments; first += window_size) {
+        // decode the next window while this one is inserted (the HashMap takes one writer)
+        std::thread prefetch;
+        std::exception_ptr error;
+        bool more = first + window_size < segments;
+        if (more && threads > 1) {
+            prefetch = std::thread([&decode, &next, &error, first, window_size]() {
+                try {
+                    decode(first + window_size, next);
+                } catch (...) {
+                    error = std::current_exception();
+                }
+            });
+        }
+        try {
+            for (size_t i = 0; i < std::min(window_size, segments - first); i++) {
+                for (Decoded& decoded : current[i]) {
+                    map.insert_or_assign_hashed(std::move(decoded.key), decoded.hash, std::move(decoded.value));
+                }
+            }
+        } catch (...) {
+            if (prefetch.joinable()) prefetch.join();
+            throw;
+        }
+        if (prefetch.joinable()) {
+            prefetch.join();
+            if (error) std::rethrow_exception(error);
+        } else if (more) {
+            decode(first + window_size, next);
+        }
+        std::swap(current, next);
+    }
+    return chain.head();
+}
+
+
+template <class KeyT, class ValueT>
+SnapshotStats IncrementalSnapshot<KeyT, ValueT>::compact(const std::vector<std::string>& paths,
+                                                         const std::string& path) {
+    return SnapshotChain(paths).compact(path);
+}
+
+
+template <class KeyT, class ValueT>
+void IncrementalSnapshot<KeyT, ValueT>::on_write(const KeyT& key, const ValueT&, bool) {
+    touch(key);
+}
+
+
+template <class KeyT, class ValueT>
+void IncrementalSnapshot<KeyT, ValueT>::on_erase(const KeyT& key) {
+    touch(key);
+}
+
+
+template <class KeyT, class ValueT>
+void IncrementalSnapshot<KeyT, ValueT>::on_clear() {
+    mark_all();
+}
+
+
+template <class KeyT, class ValueT>
+SnapshotStats IncrementalSnapshot<KeyT, ValueT>::write(const std::string& path, SnapshotKind kind) {
+    SnapshotHeader header;
+    header.kind = kind;
+    header.segment_count = static_cast<std::uint32_t>(segment_count);
+    header.id = snapshot_detail::new_snapshot_id();
+    header.parent = kind == SnapshotKind::Delta ? last_snapshot_id : 0;
+    SnapshotStats stats = snapshot_detail::write_map(map, path, header,
+                                                     kind == SnapshotKind::Delta ? &dirty : nullptr, threads);
+    std::fill(dirty.begin(), dirty.end(), 0);
+    dirty_count = 0;
+    last_snapshot_id = header.id;
+    return stats;
+}
+
+
+template <class KeyT, class ValueT>
+void IncrementalSnapshot<KeyT, ValueT>::mark_all() {
+    std::fill(dirty.begin(), dirty.end(), ~std::uint64_t(0));
+    if (segment_count % 64 != 0) dirty.back() = (std::uint64_t(1) << (segment_count % 64)) - 1;
+    dirty_count = segment_count;
+}
+
+#endif //SNAPSHOT_HPP
@@ -0,0 +1,616 @@
+#ifndef SPILLINGHASHMAP_HPP
+#define SPILLINGHASHMAP_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "HashMap.hpp"
+#include "Serializer.hpp"
+
+#define SPILL_COMPACT_MIN_BYTES (1u << 20)
+
+namespace spill_detail {
+
+/*
+* @brief Returns the memory a resident value is charged against the budget
+* @param value The value
+* @return sizeof the value, plus its heap buffer for strings
+*/
+template <class ValueT>
+size_t footprint(const ValueT&) {
+    return sizeof(ValueT);
+}
+
+inline size_t footprint(const std::string& value) {
+    return sizeof(std::string) + value.capacity();
+}
+
+} // namespace spill_detail
+
+/*
+* @struct SpillStats
+* @brief Where the values of a SpillingHashMap are and how often they moved
+*/
+struct SpillStats {
+    size_t resident = 0;            // values in memory
+    size_t spilled = 0;             // values in the spill file
+    size_t resident_bytes = 0;      // memory charged for resident values
+    std::uint64_t file_bytes = 0;   // size of the spill file
+    std::uint64_t dead_bytes = 0;   // spill file bytes no value refers to
+    std::uint64_t spills = 0;       // values written out
+    std::uint64_t reloads = 0;      // values read back by at()
+};
+
+/*
+* @brief Template parameters:
+* - KeyT   : type of keys
+* - ValueT : type of values, needs a Serializer<ValueT>
+*/
+template <class KeyT, class ValueT>
+
+/*
+* @class SpillingHashMap
+* @brief A HashMap that keeps its values within a memory budget. Past the
+* budget, cold values are chosen by CLOCK (second chance: a value used since
+* the hand last passed it is skipped once) and written to a spill file;
+* the map keeps their file offset instead and at() reads them back. Keys and
+* per-value metadata always stay in memory, so contains_key(), misses and
+* erase() never touch the file. Rewritten or reloaded values leave dead
+* bytes behind, and the file is compacted once they make up half of it
+* @var index Every key and the slot holding its value
+* @var slots Value slots, the resident ones linked in a ring in CLOCK order
+* @var free_slots Slots of erased keys, reused first
+* @var hand Next resident slot CLOCK looks at, NO_SLOT when none is resident
+* @var budget Most memory resident values may take, in bytes
+* @var path Path of the spill file
+* @var fd The spill file, written at explicit offsets so a failed write
+* leaves nothing past file_bytes that a later write won't overwrite
+* @var pending Spilled values not written to the file yet, flushed in one write
+* @var stats Counters, resident_bytes and file_bytes included
+* @note Not thread-safe, like HashMap. A reference returned by at() is
+* valid until the next call that can spill (insert(), insert_or_assign(),
+* at()). The spill file is scratch space: it is truncated when the map is
+* created and removed when it is destroyed
+*/
+class SpillingHashMap {
+public:
+
+    /*
+    * @brief Constructs an empty map
+    * @param budget_bytes Most memory resident values may take (keys and
+    * metadata are not counted)
+    * @param spill_path Path of the spill file, created or truncated
+    * @throws std::runtime_error if the file can't be created
+    */
+    SpillingHashMap(size_t budget_bytes, const std::string& spill_path);
+
+    /*
+    * @brief Closes and removes the spill file (destructor)
+    */
+    ~SpillingHashMap();
+
+    SpillingHashMap(const SpillingHashMap&) = delete;
+    SpillingHashMap& operator=(const SpillingHashMap&) = delete;
+
+    /*
+    * @brief Inserts a (key, value) pair, spilling colder values if the budget is exceeded
+    * @param key Key to insert
+    * @param value Value to insert
+    * @return true if insertion was successful, false if the key already exists
+    * @throws std::runtime_error if spilling fails
+    */
+    bool insert(const KeyT& key, const ValueT& value);
+
+    /*
+    * @brief Inserts a pair or assigns the value of an existing key, resident
+    * or spilled
+    * @param key Key to insert or update
+    * @param value Value to insert or assign
+    * @return true if a new pair was inserted, false if a value was assigned
+    * @throws std::runtime_error if spilling fails
+    */
+    bool insert_or_assign(const KeyT& key, const ValueT& value);
+
+    /*
+    * @brief Returns the value of a key, reading it back from the spill file
+    * if it was spilled
+    * @param key Key to look up
+    * @return Reference to the value
+    * @throws std::runtime_error if the key does not exist or the value can't be read
+    */
+    ValueT& at(const KeyT& key);
+
+    /*
+    * @brief Returns whether a given key is stored in the map, without I/O
+    * @param key Key to look for
+    * @return true if the key exists, false otherwise
+    */
+    bool contains_key(const KeyT& key) const;
+
+    /*
+    * @brief Erases a pair, without I/O
+    * @param key Key in the pair that should be erased
+    * @return true if erasure was successful, false if the key does not exist
+    */
+    bool erase(const KeyT& key);
+
+    /*
+    * @brief Returns the number of pairs
+    * @return Resident and spilled pairs
+    */
+    int size() const;
+
+    /*
+    * @brief Returns the memory budget
+    * @return Bytes resident values may take
+    */
+    size_t budget_bytes() const;
+
+    /*
+    * @brief Changes the memory budget, spilling values now if it shrank
+    * @param bytes Bytes resident values may take
+    * @throws std::runtime_error if spilling fails
+    */
+    void set_budget(size_t bytes);
+
+    /*
+    * @brief Returns where the values are and how often they moved
+    * @return A copy of the counters
+    */
+    SpillStats spill_stats() const;
+
+private:
+
+    /*
+    * @struct Slot
+    * @brief A value, in memory or at an offset of the spill file
+    */
+    struct Slot {
+        std::unique_ptr<ValueT> value;      // nullptr when spilled
+        std::uint64_t offset = 0;           // where the spilled value is
+        std::uint32_t length = 0;           // its serialized length
+        bool referenced = false;            // used since the hand last passed
+        bool used = false;                  // false for free slots
+        bool spilling = false;              // in pending, not written yet
+        std::uint32_t prev = 0;             // neighbours in the resident ring
+        std::uint32_t next = 0;
+    };
+
+    static constexpr std::uint32_t NO_SLOT = UINT32_MAX;
+
+    HashMap<KeyT, std::uint32_t> index;
+    std::vector<Slot> slots;
+    std::vector<std::uint32_t> free_slots;
+    std::uint32_t hand = NO_SLOT;
+    size_t budget;
+    std::string path;
+    int fd = -1;
+    std::string pending;
+    SpillStats stats;
+
+    /*
+    * @brief Puts a value in a free slot
+    * @param value Value to store
+    * @return The slot
+    */
+    std::uint32_t allocate(const ValueT& value);
+
+    /*
+    * @brief Forgets the value of a slot, resident or spilled
+    * @param slot Slot to clear
+    */
+    void release_value(std::uint32_t slot);
+
+    /*
+    * @brief Adds a slot whose value just became resident to the ring, just
+    * behind the hand so it is looked at last
+    * @param slot Slot to link
+    */
+    void ring_insert(std::uint32_t slot);
+
+    /*
+    * @brief Removes a slot whose value leaves memory from the ring
+    * @param slot Slot to unlink
+    */
+    void ring_remove(std::uint32_t slot);
+
+    /*
+    * @brief Spills values in CLOCK order until resident values fit the budget,
+    * looking only at resident slots
+    * @param keep Slot that stays resident (the one just used), or NO_SLOT
+    * @throws std::runtime_error if writing the spill file fails
+    */
+    void enforce_budget(std::uint32_t keep);
+
+    /*
+    * @brief Serializes a resident value into pending and records where it
+    * will be in the file. The value stays in memory until pending is written
+    * @param slot Slot to spill
+    */
+    void spill(Slot& slot);
+
+    /*
+    * @brief Reads a spilled value back into memory
+    * @param slot Slot to reload
+    * @throws std::runtime_error if the read fails or the bytes don't deserialize
+    */
+    void reload(Slot& slot);
+
+    /*
+    * @brief Writes pending at the end of the spill file
+    * @throws std::runtime_error if the write fails
+    */
+    void flush();
+
+    /*
+    * @brief Rewrites the spill file with only the values still spilled, once
+    * dead bytes are half of it
+    * @throws std::runtime_error if the new file can't be written
+    */
+    void maybe_compact();
+
+    /*
+    * @brief Reads bytes of the spill file
+    * @param file File to read
+    * @param offset Where to read
+    * @param length How many bytes
+    * @param out Set to the bytes
+    * @throws std::runtime_error if the read fails or comes up short
+    */
+    static void read_at(int file, std::uint64_t offset, size_t length, std::string& out);
+
+    /*
+    * @brief Writes all bytes at an offset of a file
+    * @param file File to write
+    * @param offset Where to write
+    * @param data Bytes to write
+    * @throws std::runtime_error if the write fails
+    */
+    static void write_at(int file, std::uint64_t offset, const std::string& data);
+
+    /*
+    * @brief Throws a std::runtime_error naming the failed call and errno
+    * @param what Name of the failed call
+    */
+    [[noreturn]] static void fail(const std::string& what);
+};
+
+// ==================== Implementation ====================
+
+template <class KeyT, class ValueT>
+SpillingHashMap<KeyT, ValueT>::SpillingHashMap(size_t budget_bytes, const std::string& spill_path)
+    : budget(budget_bytes), path(spill_path) {
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) fail("open " + path);
+}
+
+
+template <class KeyT, class ValueT>
+SpillingHashMap<KeyT, ValueT>::~SpillingHashMap() {
+    close(fd);
+    unlink(path.c_str());
+}
+
+
+template <class KeyT, class ValueT>
+bool SpillingHashMap<KeyT, ValueT>::insert(const KeyT& key, const ValueT& value) {
+    std::size_t hash = std::hash<KeyT>()(key);
+    if (index.find_hashed(key, hash) != nullptr) return false;
+    std::uint32_t slot = allocate(value);
+    index.insert_hashed(key, hash, slot);
+    enforce_budget(slot);
+    return true;
+}
+
+
+template <class KeyT, class ValueT>
+bool SpillingHashMap<KeyT, ValueT>::insert_or_assign(const KeyT& key, const ValueT& value) {
+    std::size_t hash = std::hash<KeyT>()(key);
+    std::uint32_t* existing = index.find_hashed(key, hash);
+    if (existing == nullptr) {
+        std::uint32_t slot = allocate(value);
+        index.insert_hashed(key, hash, slot);
+        enforce_budget(slot);
+        return true;
+    }
+    release_value(*existing);
+    Slot& slot = slots[*existing];
+    slot.value.reset(new ValueT(value));
+    slot.referenced = true;
+    stats.resident++;
+    stats.resident_bytes += spill_detail::footprint(*slot.value);
+    ring_insert(*existing);
+    enforce_budget(*existing);
+    return false;
+}
+
+
+template <class KeyT, class ValueT>
+ValueT& SpillingHashMap<KeyT, ValueT>::at(const KeyT& key) {
+    const std::uint32_t* found = index.find_hashed(key, std::hash<KeyT>()(key));
+    if (found == nullptr) throw std::runtime_error("no such key exists!");
+    Slot& slot = slots[*found];
+    slot.referenced = true;
+    if (slot.value == nullptr) {
+        reload(slot);
+        ring_insert(*found);
+        enforce_budget(*found);
+    }
+    return *slot.value;
+}
+
+
+template <class KeyT, class ValueT>
+bool SpillingHashMap<KeyT, ValueT>::contains_key(const KeyT& key) const {
+    return index.contains_key(key);
+}
+
+
+template <class KeyT, class ValueT>
+bool SpillingHashMap<KeyT, ValueT>::erase(const KeyT& key) {
+    std::size_t hash = std::hash<KeyT>()(key);
+    const std::uint32_t* found = index.find_hashed(key, hash);
+    if (found == nullptr) return false;
+    std::uint32_t slot = *found;
+    release_value(slot);
+    slots[slot].used = false;
+    free_slots.push_back(slot);
+    index.erase_hashed(key, hash);
+    return true;
+}
+
+
+template <class KeyT, class ValueT>
+int SpillingHashMap<KeyT, ValueT>::size() const {
+    return index.size();
+}
+
+
+template <class KeyT, class ValueT>
+size_t SpillingHashMap<KeyT, ValueT>::budget_bytes() const {
+    return budget;
+}
+
+
+template <class KeyT, class ValueT>
+void SpillingHashMap<KeyT, ValueT>::set_budget(size_t bytes) {
+    budget = bytes;
+    enforce_budget(NO_SLOT);
+}
+
+
+template <class KeyT, class ValueT>
+SpillStats SpillingHashMap<KeyT, ValueT>::spill_stats() const {
+    return stats;
+}
+
+
+template <class KeyT, class ValueT>
+std::uint32_t SpillingHashMap<KeyT, ValueT>::allocate(const ValueT& value) {
+    std::uint32_t slot;
+    if (!free_slots.empty()) {
+        slot = free_slots.back();
+        free_slots.pop_back();
+    } else {
+        slot = static_cast<std::uint32_t>(slots.size());
+        slots.emplace_back();
+    }
+    Slot& entry = slots[slot];
+    entry.value.reset(new ValueT(value));
+    entry.referenced = true;
+    entry.used = true;
+    stats.resident++;
+    stats.resident_bytes += spill_detail::footprint(*entry.value);
+    ring_insert(slot);
+    return slot;
+}
+
+
+template <class KeyT, class ValueT>
+void SpillingHashMap<KeyT, ValueT>::release_value(std::uint32_t slot) {
+    Slot& entry = slots[slot];
+    if (entry.value != nullptr) {
+        stats.resident--;
+        stats.resident_bytes -= spill_detail::footprint(*entry.value);
+        entry.value.reset();
+        ring_remove(slot);
+    } else {
+        stats.spilled--;
+        stats.dead_bytes += entry.length;
+    }
+}
+
+
+template <class KeyT, class ValueT>
+void SpillingHashMap<KeyT, ValueT>::ring_insert(std::uint32_t slot) {
+    Slot& entry = slots[slot];
+    if (hand == NO_SLOT) {
+        entry.prev = entry.next = slot;
+        hand = slot;
+        return;
+    }
+    entry.next = hand;
+    entry.prev = slots[hand].prev;
+    slots[entry.prev].next = slot;
+    slots[hand].prev = slot;
+}
+
+
+template <class KeyT, class ValueT>
+void SpillingHashMap<KeyT, ValueT>::ring_remove(std::uint32_t slot) {
+    Slot& entry = slots[slot];
+    if (entry.next == slot) {
+        hand = NO_SLOT;
+        return;
+    }
+    if (hand == slot) hand = entry.next;
+    slots[entry.prev].next = entry.next;
+    slots[entry.next].prev = entry.prev;
+}
+
+
+template <class KeyT, class ValueT>
+void SpillingHashMap<KeyT, ValueT>::enforce_budget(std::uint32_t keep) {
+    std::vector<std::uint32_t> victims;
+    size_t freed = 0;
+    // two sweeps clear every referenced bit, so the second one always finds a victim
+    size_t steps = 2 * stats.resident;
+    while (stats.resident_bytes - freed > budget && steps-- > 0) {
+        std::uint32_t current = hand;
+        hand = slots[current].next;
+        Slot& slot = slots[current];
+        if (slot.spilling || current == keep) continue;
+        if (slot.referenced) {
+            slot.referenced = false;
+            continue;
+        }
+        spill(slot);
+        victims.push_back(current);
+        freed += spill_detail::footprint(*slot.value);
+    }
+    if (victims.empty()) return;
+    try {
+        flush();
+    } catch (...) {
+        // the victims keep their values, nothing was lost, and the next flush
+        // overwrites whatever part of pending reached the file
+        pending.clear();
+        for (std::uint32_t victim : victims) slots[victim].spilling = false;
+        throw;
+    }
+    for (std::uint32_t victim : victims) {
+        Slot& slot = slots[victim];
+        stats.resident--;
+        stats.resident_bytes -= spill_detail::footprint(*slot.value);
+        stats.spilled++;
+        stats.spills++;
+        slot.value.reset();
+        slot.spilling = false;
+        ring_remove(victim);
+    }
+    maybe_compact();
+}
+
+
+template <class KeyT, class ValueT>
+void SpillingHashMap<KeyT, ValueT>::spill(Slot& slot) {
+    size_t start = pending.size();
+    Serializer<ValueT>::write(pending, *slot.value);
+    slot.offset = stats.file_bytes + start;
+    slot.length = static_cast<std::uint32_t>(pending.size() - start);
+    slot.spilling = true;
+}
+
+
+template <class KeyT, class ValueT>
+void SpillingHashMap<KeyT, ValueT>::reload(Slot& slot) {
+    std::string bytes;
+    read_at(fd, slot.offset, slot.length, bytes);
+    std::unique_ptr<ValueT> value(new ValueT());
+    const char* cursor = bytes.data();
+    if (!Serializer<ValueT>::read(cursor, bytes.data() + bytes.size(), *value)) {
+        throw std::runtime_error("corrupt spill file " + path);
+    }
+    // the value may change once in memory, so its spilled copy is dropped
+    stats.spilled--;
+    stats.dead_bytes += slot.length;
+    stats.resident++;
+    stats.resident_bytes += spill_detail::footprint(*value);
+    stats.reloads++;
+    slot.value = std::move(value);
+}
+
+
+template <class KeyT, class ValueT>
+void SpillingHashMap<KeyT, ValueT>::flush() {
+    write_at(fd, stats.file_bytes, pending);
+    stats.file_bytes += pending.size();
+    pending.clear();
+}
+
+
+template <class KeyT, class ValueT>
+void SpillingHashMap<KeyT, ValueT>::maybe_compact() {
+    if (stats.file_bytes < SPILL_COMPACT_MIN_BYTES || stats.dead_bytes * 2 < stats.file_bytes) return;
+    std::string compact_path = path + ".compact";
+    int compact_fd = open(compact_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (compact_fd < 0) fail("open " + compact_path);
+    std::vector<std::uint64_t> offsets(slots.size());
+    std::uint64_t written = 0;
+    std::string bytes;
+    try {
+        for (size_t i = 0; i < slots.size(); i++) {
+            const Slot& slot = slots[i];
+            if (!slot.used || slot.value != nullptr) continue;
+            read_at(fd, slot.offset, slot.length, bytes);
+            offsets[i] = written + pending.size();
+            pending.append(bytes);
+            if (pending.size() >= SPILL_COMPACT_MIN_BYTES) {
+                write_at(compact_fd, written, pending);
+                written += pending.size();
+                pending.clear();
+            }
+        }
+        write_at(compact_fd, written, pending);
+        written += pending.size();
+        pending.clear();
+        if (rename(compact_path.c_str(), path.c_str()) < 0) fail("rename " + compact_path);
+    } catch (...) {
+        pending.clear();
+        close(compact_fd);
+        unlink(compact_path.c_str());
+        throw;
+    }
+    close(fd);
+    fd = compact_fd;
+    for (size_t i = 0; i < slots.size(); i++) {
+        if (slots[i].used && slots[i].value == nullptr) slots[i].offset = offsets[i];
+    }
+    stats.file_bytes = written;
+    stats.dead_bytes = 0;
+}
+
+
+template <class KeyT, class ValueT>
+void SpillingHashMap<KeyT, ValueT>::read_at(int file, std::uint64_t offset, size_t length, std::string& out) {
+    out.resize(length);
+    size_t got = 0;
+    while (got < length) {
+        ssize_t received = pread(file, &out[got], length - got, static_cast<off_t>(offset + got));
+        if (received < 0 && errno == EINTR) continue;
+        if (received < 0) fail("pread");
+        if (received == 0) throw std::runtime_error("spill file truncated");
+        got += static_cast<size_t>(received);
+    }
+}
+
+
+template <class KeyT, class ValueT>
+void SpillingHashMap<KeyT, ValueT>::write_at(int file, std::uint64_t offset, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t written = pwrite(file, data.data() + sent, data.size() - sent,
+                                 static_cast<off_t>(offset + sent));
+        if (written < 0 && errno == EINTR) continue;
+        if (written < 0) fail("pwrite");
+        sent += static_cast<size_t>(written);
+    }
+}
+
+
+template <class KeyT, class ValueT>
+void SpillingHashMap<KeyT, ValueT>::fail(const std::string& what) {
+    throw std::runtime_error(what + " failed: " + std::strerror(errno));
+}
+
+#endif //SPILLINGHASHMAP_HPP
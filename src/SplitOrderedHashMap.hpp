@@ -0,0 +1,685 @@
+#ifndef SPLITORDEREDHASHMAP_HPP
+#define SPLITORDEREDHASHMAP_HPP
+
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <iterator>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <cstdint>
+
+#include "HashMap.hpp"
+#include "EpochReclamation.hpp"
+
+#define SPLIT_ORDER_INIT_BUCKETS 16
+#define SPLIT_ORDER_MAX_LOAD 2
+#define SPLIT_ORDER_SEGMENTS 32
+
+/*
+* @brief Template parameters:
+* - KeyT   : type of keys (hashable with std::hash, comparable with ==)
+* - ValueT : type of values (copy-constructible)
+*/
+template <class KeyT, class ValueT>
+
+/*
+* @class SplitOrderedHashMap
+* @brief A lock-free resizable hash map built on split-ordered lists
+* (Shalev & Shavit): every pair lives in one lock-free sorted linked list
+* ordered by the bit-reversed hash, and each bucket is just a pointer to a
+* sentinel node inside that list. Doubling the bucket count only adds
+* sentinels lazily, so a resize never moves a single pair
+* @var segments Bucket directory, segment s holds buckets [2^(s-1), 2^s)
+* (segment 0 holds bucket 0), allocated on first use and never moved
+* @var bucket_count Number of buckets in use, a power of 2
+* @var table_size Number of pairs
+* @var domain Epoch domain reclaiming unlinked nodes and replaced values
+* @note Values are replaced by swapping a pointer, readers get copies.
+* Iteration is weakly consistent: it sees every pair present for the whole
+* traversal, and may or may not see concurrent changes
+*/
+class SplitOrderedHashMap {
+private:
+    struct Link;
+    struct Node;
+
+public:
+
+    /*
+    * @brief Constructs an empty SplitOrderedHashMap (default constructor)
+    */
+    SplitOrderedHashMap();
+
+    /*
+    * @brief Frees every node, no other thread may use the map (destructor)
+    */
+    ~SplitOrderedHashMap();
+
+    SplitOrderedHashMap(const SplitOrderedHashMap&) = delete;
+    SplitOrderedHashMap& operator=(const SplitOrderedHashMap&) = delete;
+
+    /*
+    * @brief Returns the number of pairs
+    * @return Number of keys stored
+    */
+    int size() const;
+
+    /*
+    * @brief Returns the number of buckets
+    * @return Current bucket count
+    */
+    int capacity() const;
+
+    /*
+    * @brief Checks whether the map is empty
+    * @return true if no pairs are stored, false otherwise
+    */
+    bool empty() const;
+
+    /*
+    * @brief Inserts a (key, value) pair
+    * @param key Key to insert
+    * @param value Value to insert
+    * @return true if insertion was successful, false if the key already exists
+    */
+    bool insert(const KeyT& key, const ValueT& value);
+
+    /*
+    * @brief Inserts a pair or assigns the value of an existing key
+    * @param key Key to insert or update
+    * @param value Value to insert or assign
+    * @return true if a new pair was inserted, false if a value was assigned
+    */
+    bool insert_or_assign(const KeyT& key, const ValueT& value);
+
+    /*
+    * @brief Returns whether a given key is stored in the map
+    * @param key Key to look for
+    * @return true if key exists, false otherwise
+    */
+    bool contains_key(const KeyT& key) const;
+
+    /*
+    * @brief Copies out the value of a given key
+    * @param key Key to look up
+    * @param value Set to the key's value when found
+    * @return true if the key exists, false otherwise
+    */
+    bool get(const KeyT& key, ValueT& value) const;
+
+    /*
+    * @brief Copies out the value of a given key
+    * @param key Key to look up
+    * @return Copy of the value mapped to the key
+    * @throws std::runtime_error if key does not exist
+    */
+    ValueT at(const KeyT& key) const;
+
+    /*
+    * @brief Erases a pair with a given key
+    * @param key Key in the pair that should be erased
+    * @return true if erasure was successful, false otherwise
+    */
+    bool erase(const KeyT& key);
+
+    /*
+    * @class ConstIterator
+    * @brief A forward-only const iterator over copies of the (key, value)
+    * pairs, in split order. The thread stays pinned while any copy of the
+    * iterator is alive, so it must not outlive the thread that created it
+    * @var _map Map to iterate over
+    * @var _guard Pin shared by the copies of the iterator
+    * @var _link Current node, nullptr at end()
+    * @var _pair Copy of the current pair
+    */
+    class ConstIterator {
+        friend class SplitOrderedHashMap<KeyT, ValueT>;
+
+    public:
+
+        // typedefs
+        typedef std::pair<KeyT, ValueT> value_type;
+        typedef const value_type &reference;
+        typedef const value_type *pointer;
+        typedef int difference_type;
+        typedef std::forward_iterator_tag iterator_category;
+
+        /*
+        * @brief Pre-increment: advances to the next live pair,
+        * if already at end(), doesn't advance
+        * @return ConstIterator that holds the next pair
+        */
+        ConstIterator &operator++ () {
+            if (_link != nullptr) settle(ptr(_link->next.load(std::memory_order_acquire)));
+            return *this;
+        }
+
+        /*
+        * @brief Post-increment: advances to the next live pair,
+        * if already at end(), doesn't advance
+        * @return ConstIterator that holds the current pair (before advancing)
+        */
+        ConstIterator operator++ (int) {
+            ConstIterator it (*this);
+            this->operator++();
+            return it;
+        }
+
+        /*
+        * @brief Checks if a given ConstIterator is equal to this ConstIterator -
+        * same map and same node
+        * @param rhs ConstIterator to check equality with
+        * @return true if the iterators are equal, false otherwise
+        */
+        bool operator== (const ConstIterator& rhs) const {
+            return (_map == rhs._map) && (_link == rhs._link);
+        }
+
+        /*
+        * @brief Checks if a given ConstIterator is not equal to this ConstIterator
+        * @param rhs ConstIterator to check inequality with
+        * @return true if the iterators are unequal, false otherwise
+        */
+        bool operator != (const ConstIterator &rhs) const {
+            return !operator== (rhs);
+        }
+
+        /*
+        * @brief Dereference operator
+        * @return Const reference to a copy of the current pair
+        * throws std::out_of_range when trying to dereference end()
+        */
+        reference operator* () const {
+            if (_link == nullptr) {
+                throw std::out_of_range("SplitOrderedHashMap iterator: dereference of end()");
+            }
+            return *_pair;
+        }
+
+        /*
+        * @brief Pointer operator
+        * @return Pointer to a copy of the current (key, value) pair
+        */
+        pointer operator-> () const {
+            return &(**this);
+        }
+
+    private:
+        const SplitOrderedHashMap<KeyT, ValueT>* _map;
+        std::shared_ptr<EpochDomain::Guard> _guard;
+        const Link* _link;
+        std::optional<value_type> _pair;
+
+        /*
+        * @brief Constructs a ConstIterator at the first live pair from a given node
+        * @param map Map to iterate over
+        * @param guard Pin kept while iterating, nullptr for end()
+        * @param link Node to start from
+        */
+        ConstIterator(const SplitOrderedHashMap<KeyT, ValueT>* map,
+            std::shared_ptr<EpochDomain::Guard> guard, const Link* link) :
+            _map(map), _guard(std::move(guard)), _link(nullptr) {
+            settle(link);
+        }
+
+        /*
+        * @brief Moves to the first live pair at or after a node, skipping
+        * sentinels and erased pairs, and copies it
+        * @param link Node to start from
+        */
+        void settle(const Link* link) {
+            while (link != nullptr) {
+                std::uintptr_t next = link->next.load(std::memory_order_acquire);
+                if (!is_sentinel(link) && !marked(next)) {
+                    const Node* node = static_cast<const Node*>(link);
+                    _pair.emplace(node->key, *node->value.load(std::memory_order_acquire));
+                    break;
+                }
+                link = ptr(next);
+            }
+            _link = link;
+            if (_link == nullptr) {
+                _pair.reset();
+                _guard.reset();
+            }
+        }
+    };
+
+    using const_iterator = ConstIterator;
+
+    /*
+    * @brief const begin(), pins the calling thread until the iterator is gone
+    */
+    ConstIterator cbegin() const;
+
+    /*
+    * @brief const end()
+    */
+    ConstIterator cend() const;
+
+    /*
+    * @brief begin()
+    * @return ConstIterator at the first pair
+    */
+    ConstIterator begin() const {
+        return cbegin();
+    }
+
+    /*
+    * @brief end()
+    * @return ConstIterator at end position
+    */
+    ConstIterator end() const {
+        return cend();
+    }
+
+private:
+
+    /*
+    * @struct Link
+    * @brief A list node: sentinels have an even split-order key and pairs an
+    * odd one. The low bit of next marks the node itself as erased
+    */
+    struct Link {
+        std::uint64_t order;
+        std::atomic<std::uintptr_t> next{0};
+        explicit Link(std::uint64_t order) : order(order) {}
+    };
+
+    /*
+    * @struct Node
+    * @brief A list node holding a pair, the value is swapped as a whole
+    */
+    struct Node : Link {
+        KeyT key;
+        std::atomic<ValueT*> value;
+        Node(std::uint64_t order, const KeyT& key, ValueT* value) :
+            Link(order), key(key), value(value) {}
+        ~Node() { delete value.load(std::memory_order_relaxed); }
+    };
+
+    /*
+    * @struct Position
+    * @brief Where a search ended: the link pointing at curr, and curr itself
+    */
+    struct Position {
+        std::atomic<std::uintptr_t>* prev;
+        Link* curr;
+    };
+
+    std::atomic<std::atomic<Link*>*> segments[SPLIT_ORDER_SEGMENTS];
+    std::atomic<std::size_t> bucket_count;
+    std::atomic<int> table_size;
+    mutable EpochDomain domain;
+
+    /*
+    * @brief Scrambles a key's hash, the bucket comes from its high bits
+    * @param key Key to hash
+    * @return Scrambled hash
+    */
+    static std::uint64_t hash_of(const KeyT& key);
+
+    /*
+    * @brief Reverses the bits of a 64-bit word
+    */
+    static std::uint64_t reverse(std::uint64_t word);
+
+    /*
+    * @brief Marked-pointer helpers
+    */
+    static Link* ptr(std::uintptr_t word) {
+        return reinterpret_cast<Link*>(word & ~static_cast<std::uintptr_t>(1));
+    }
+    static bool marked(std::uintptr_t word) {
+        return (word & 1) != 0;
+    }
+    static bool is_sentinel(const Link* link) {
+        return (link->order & 1) == 0;
+    }
+
+    /*
+    * @brief Returns the directory slot of a bucket, allocating its segment if needed
+    * @param bucket Bucket index
+    * @return Slot holding the bucket's sentinel (nullptr until initialized)
+    */
+    std::atomic<Link*>& slot_of(std::size_t bucket) const;
+
+    /*
+    * @brief Returns a bucket's sentinel, splicing it into the list on first use
+    * (after its parent bucket's sentinel, recursively)
+    * @param bucket Bucket index
+    * @return The bucket's sentinel
+    */
+    Link* sentinel_of(std::size_t bucket) const;
+
+    /*
+    * @brief Returns the sentinel of the bucket a hash falls into
+    * @param hash Scrambled hash
+    * @return The bucket's sentinel
+    */
+    Link* head_of(std::uint64_t hash) const;
+
+    /*
+    * @brief Searches the list from a sentinel for a pair (or a sentinel),
+    * unlinking erased nodes on the way. The caller must be pinned
+    * @param head Sentinel to start from
+    * @param order Split-order key to look for
+    * @param key Key to look for, nullptr when looking for a sentinel
+    * @param pos Set to the matching node, or where it would be inserted
+    * @return true if found, false otherwise
+    */
+    bool search(Link* head, std::uint64_t order, const KeyT* key, Position& pos) const;
+
+    /*
+    * @brief Finds the node of a key. The caller must be pinned
+    * @param key Key to look for
+    * @return The node, nullptr if the key is not stored
+    */
+    Node* find_node(const KeyT& key) const;
+
+    /*
+    * @brief Doubles the bucket count when the load is above SPLIT_ORDER_MAX_LOAD
+    * @param size Pair count after an insertion
+    */
+    void maybe_grow(int size);
+};
+
+// ==================== Implementation ====================
+
+template <class KeyT, class ValueT>
+SplitOrderedHashMap<KeyT, ValueT>::SplitOrderedHashMap() :
+    bucket_count(SPLIT_ORDER_INIT_BUCKETS), table_size(0) {
+    for (auto& segment : segments) {
+        segment.store(nullptr, std::memory_order_relaxed);
+    }
+    // bucket 0's sentinel (split-order key 0) is the head of the whole list
+    slot_of(0).store(new Link(0), std::memory_order_release);
+}
+
+
+template <class KeyT, class ValueT>
+SplitOrderedHashMap<KeyT, ValueT>::~SplitOrderedHashMap() {
+    // erased-but-unlinked nodes are still on the list, unlinked ones belong to domain
+    Link* link = slot_of(0).load();
+    while (link != nullptr) {
+        Link* next = ptr(link->next.load());
+        if (is_sentinel(link)) {
+            delete link;
+        } else {
+            delete static_cast<Node*>(link);
+        }
+        link = next;
+    }
+    for (auto& segment : segments) {
+        delete[] segment.load();
+    }
+}
+
+
+template <class KeyT, class ValueT>
+int SplitOrderedHashMap<KeyT, ValueT>::size() const {
+    return table_size.load(std::memory_order_relaxed);
+}
+
+
+template <class KeyT, class ValueT>
+int SplitOrderedHashMap<KeyT, ValueT>::capacity() const {
+    return static_cast<int>(bucket_count.load(std::memory_order_relaxed));
+}
+
+
+template <class KeyT, class ValueT>
+bool SplitOrderedHashMap<KeyT, ValueT>::empty() const {
+    return size() == 0;
+}
+
+
+template <class KeyT, class ValueT>
+bool SplitOrderedHashMap<KeyT, ValueT>::insert(const KeyT& key, const ValueT& value) {
+    std::uint64_t hash = hash_of(key);
+    std::uint64_t order = hash | 1;
+    auto guard = domain.pin();
+    Link* head = head_of(hash);
+    Node* node = nullptr;
+    Position pos;
+    while (!search(head, order, &key, pos)) {
+        if (node == nullptr) node = new Node(order, key, new ValueT(value));
+        node->next.store(reinterpret_cast<std::uintptr_t>(pos.curr), std::memory_order_relaxed);
+        auto expected = reinterpret_cast<std::uintptr_t>(pos.curr);
+        if (pos.prev->compare_exchange_strong(expected, reinterpret_cast<std::uintptr_t>(node),
+                                              std::memory_order_acq_rel)) {
+            maybe_grow(table_size.fetch_add(1, std::memory_order_relaxed) + 1);
+            return true;
+        }
+    }
+    delete node;
+    return false;
+}
+
+
+template <class KeyT, class ValueT>
+bool SplitOrderedHashMap<KeyT, ValueT>::insert_or_assign(const KeyT& key, const ValueT& value) {
+    auto guard = domain.pin();
+    for (;;) {
+        Node* node = find_node(key);
+        if (node == nullptr) {
+            if (insert(key, value)) return true;
+            continue;
+        }
+        ValueT* old = node->value.exchange(new ValueT(value), std::memory_order_acq_rel);
+        domain.retire(old);
+        // the node may have been erased under us, then the value went with it
+        if (!marked(node->next.load(std::memory_order_acquire))) return false;
+    }
+}
+
+
+template <class KeyT, class ValueT>
+bool SplitOrderedHashMap<KeyT, ValueT>::contains_key(const KeyT& key) const {
+    auto guard = domain.pin();
+    return find_node(key) != nullptr;
+}
+
+
+template <class KeyT, class ValueT>
+bool SplitOrderedHashMap<KeyT, ValueT>::get(const KeyT& key, ValueT& value) const {
+    auto guard = domain.pin();
+    const Node* node = find_node(key);
+    if (node == nullptr) return false;
+    value = *node->value.load(std::memory_order_acquire);
+    return true;
+}
+
+
+template <class KeyT, class ValueT>
+ValueT SplitOrderedHashMap<KeyT, ValueT>::at(const KeyT& key) const {
+    auto guard = domain.pin();
+    const Node* node = find_node(key);
+    if (node == nullptr) throw std::runtime_error("no such key exists!");
+    return *node->value.load(std::memory_order_acquire);
+}
+
+
+template <class KeyT, class ValueT>
+bool SplitOrderedHashMap<KeyT, ValueT>::erase(const KeyT& key) {
+    std::uint64_t hash = hash_of(key);
+    std::uint64_t order = hash | 1;
+    auto guard = domain.pin();
+    Link* head = head_of(hash);
+    Position pos;
+    for (;;) {
+        if (!search(head, order, &key, pos)) return false;
+        std::uintptr_t next = pos.curr->next.load(std::memory_order_acquire);
+        if (marked(next)) continue;
+        // marking the node's own next pointer is the logical erase
+        if (!pos.curr->next.compare_exchange_strong(next, next | 1, std::memory_order_acq_rel)) {
+            continue;
+        }
+        table_size.fetch_sub(1, std::memory_order_relaxed);
+        auto expected = reinterpret_cast<std::uintptr_t>(pos.curr);
+        if (pos.prev->compare_exchange_strong(expected, next, std::memory_order_acq_rel)) {
+            domain.retire(static_cast<Node*>(pos.curr));
+        } else {
+            // someone else changed prev, let a search do the unlinking
+            search(head, order, &key, pos);
+        }
+        return true;
+    }
+}
+
+
+template <class KeyT, class ValueT>
+typename SplitOrderedHashMap<KeyT, ValueT>::ConstIterator
+SplitOrderedHashMap<KeyT, ValueT>::cbegin() const {
+    auto guard = std::make_shared<EpochDomain::Guard>(domain.pin());
+    return ConstIterator(this, std::move(guard), slot_of(0).load(std::memory_order_acquire));
+}
+
+
+template <class KeyT, class ValueT>
+typename SplitOrderedHashMap<KeyT, ValueT>::ConstIterator
+SplitOrderedHashMap<KeyT, ValueT>::cend() const {
+    return ConstIterator(this, nullptr, nullptr);
+}
+
+
+template <class KeyT, class ValueT>
+std::uint64_t SplitOrderedHashMap<KeyT, ValueT>::hash_of(const KeyT& key) {
+    return mix_hash(std::hash<KeyT>()(key));
+}
+
+
+template <class KeyT, class ValueT>
+std::uint64_t SplitOrderedHashMap<KeyT, ValueT>::reverse(std::uint64_t word) {
+    word = ((word >> 1) & 0x5555555555555555ULL) | ((word & 0x5555555555555555ULL) << 1);
+    word = ((word >> 2) & 0x3333333333333333ULL) | ((word & 0x3333333333333333ULL) << 2);
+    word = ((word >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((word & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    word = ((word >> 8) & 0x00FF00FF00FF00FFULL) | ((word & 0x00FF00FF00FF00FFULL) << 8);
+    word = ((word >> 16) & 0x0000FFFF0000FFFFULL) | ((word & 0x0000FFFF0000FFFFULL) << 16);
+    return (word >> 32) | (word << 32);
+}
+
+
+template <class KeyT, class ValueT>
+std::atomic<typename SplitOrderedHashMap<KeyT, ValueT>::Link*>&
+SplitOrderedHashMap<KeyT, ValueT>::slot_of(std::size_t bucket) const {
+    int segment = 0;
+    while ((static_cast<std::size_t>(1) << segment) <= bucket) {
+        segment++;
+    }
+    std::size_t first = (segment == 0) ? 0 : static_cast<std::size_t>(1) << (segment - 1);
+    auto& entry = const_cast<std::atomic<std::atomic<Link*>*>&>(segments[segment]);
+    std::atomic<Link*>* slots = entry.load(std::memory_order_acquire);
+    if (slots == nullptr) {
+        std::size_t length = (segment == 0) ? 1 : first;
+        auto* fresh = new std::atomic<Link*>[length]();
+        if (entry.compare_exchange_strong(slots, fresh, std::memory_order_acq_rel)) {
+            slots = fresh;
+        } else {
+            delete[] fresh;
+        }
+    }
+    return slots[bucket - first];
+}
+
+
+template <class KeyT, class ValueT>
+typename SplitOrderedHashMap<KeyT, ValueT>::Link*
+SplitOrderedHashMap<KeyT, ValueT>::sentinel_of(std::size_t bucket) const {
+    std::atomic<Link*>& slot = slot_of(bucket);
+    Link* sentinel = slot.load(std::memory_order_acquire);
+    if (sentinel != nullptr) return sentinel;
+    // a bucket splits off its parent: the same index without its top bit
+    std::size_t parent = bucket;
+    for (std::size_t bit = 1; bit <= bucket; bit <<= 1) {
+        if (bucket & bit) parent = bucket & ~bit;
+    }
+    Link* head = sentinel_of(parent);
+    Link* fresh = new Link(reverse(bucket));
+    Position pos;
+    for (;;) {
+        if (search(head, fresh->order, nullptr, pos)) {
+            // another thread spliced the same sentinel first
+            delete fresh;
+            sentinel = pos.curr;
+            break;
+        }
+        fresh->next.store(reinterpret_cast<std::uintptr_t>(pos.curr), std::memory_order_relaxed);
+        auto expected = reinterpret_cast<std::uintptr_t>(pos.curr);
+        if (pos.prev->compare_exchange_strong(expected, reinterpret_cast<std::uintptr_t>(fresh),
+                                              std::memory_order_acq_rel)) {
+            sentinel = fresh;
+            break;
+        }
+    }
+    slot.store(sentinel, std::memory_order_release);
+    return sentinel;
+}
+
+
+template <class KeyT, class ValueT>
+typename SplitOrderedHashMap<KeyT, ValueT>::Link*
+SplitOrderedHashMap<KeyT, ValueT>::head_of(std::uint64_t hash) const {
+    std::size_t buckets = bucket_count.load(std::memory_order_acquire);
+    // reversing makes the hash's high bits the bucket index
+    return sentinel_of(static_cast<std::size_t>(reverse(hash) & (buckets - 1)));
+}
+
+
+template <class KeyT, class ValueT>
+bool SplitOrderedHashMap<KeyT, ValueT>::search(Link* head, std::uint64_t order,
+                                               const KeyT* key, Position& pos) const {
+retry:
+    pos.prev = &head->next;
+    pos.curr = ptr(pos.prev->load(std::memory_order_acquire));
+    for (;;) {
+        if (pos.curr == nullptr) return false;
+        std::uintptr_t next = pos.curr->next.load(std::memory_order_acquire);
+        if (marked(next)) {
+            // help unlink an erased node, whoever unlinks it retires it
+            auto expected = reinterpret_cast<std::uintptr_t>(pos.curr);
+            if (!pos.prev->compare_exchange_strong(expected, next & ~static_cast<std::uintptr_t>(1),
+                                                   std::memory_order_acq_rel)) {
+                goto retry;
+            }
+            domain.retire(static_cast<Node*>(pos.curr));
+            pos.curr = ptr(next);
+            continue;
+        }
+        if (pos.prev->load(std::memory_order_acquire) != reinterpret_cast<std::uintptr_t>(pos.curr)) {
+            goto retry;
+        }
+        if (pos.curr->order > order) return false;
+        if (pos.curr->order == order) {
+            if (key == nullptr) return true;
+            if (static_cast<Node*>(pos.curr)->key == *key) return true;
+        }
+        pos.prev = &pos.curr->next;
+        pos.curr = ptr(next);
+    }
+}
+
+
+template <class KeyT, class ValueT>
+typename SplitOrderedHashMap<KeyT, ValueT>::Node*
+SplitOrderedHashMap<KeyT, ValueT>::find_node(const KeyT& key) const {
+    std::uint64_t hash = hash_of(key);
+    Position pos;
+    if (!search(head_of(hash), hash | 1, &key, pos)) return nullptr;
+    return static_cast<Node*>(pos.curr);
+}
+
+
+template <class KeyT, class ValueT>
+void SplitOrderedHashMap<KeyT, ValueT>::maybe_grow(int size) {
+    std::size_t buckets = bucket_count.load(std::memory_order_relaxed);
+    std::size_t max_buckets = static_cast<std::size_t>(1) << (SPLIT_ORDER_SEGMENTS - 1);
+    if (static_cast<std::size_t>(size) > buckets * SPLIT_ORDER_MAX_LOAD && buckets < max_buckets) {
+        // new buckets get their sentinels lazily, nothing moves
+        bucket_count.compare_exchange_strong(buckets, buckets * 2, std::memory_order_acq_rel);
+    }
+}
+
+#endif //SPLITORDEREDHASHMAP_HPP
@@ -0,0 +1,354 @@
+#ifndef STRIPEDHASHMAP_HPP
+#define STRIPEDHASHMAP_HPP
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+#include <stdexcept>
+
+#include "HashMap.hpp"
+
+#define STRIPED_DEFAULT_STRIPES 16
+
+/*
+* @brief Template parameters:
+* - KeyT   : type of keys
+* - ValueT : type of values
+*/
+template <class KeyT, class ValueT>
+
+/*
+* @class StripedHashMap
+* @brief A thread-safe HashMap split into independently locked stripes,
+* every key lives in the stripe chosen by the high bits of its scrambled hash
+* @var stripes The stripes, each a HashMap guarded by its own mutex
+* @note With a single stripe this is a plain mutex-guarded HashMap
+*/
+class StripedHashMap {
+public:
+
+    /*
+    * @brief Constructs an empty StripedHashMap
+    * @param stripe_count Number of stripes (rounded up to a power of 2)
+    * @throws std::invalid_argument if stripe_count is not positive
+    */
+    explicit StripedHashMap(int stripe_count = STRIPED_DEFAULT_STRIPES);
+
+    /*
+    * @brief Inserts a (key, value) pair
+    * @param key Key to insert
+    * @param value Value to insert
+    * @return true if insertion was successful, false if the key already exists
+    */
+    bool insert(const KeyT& key, const ValueT& value);
+
+    /*
+    * @brief Inserts a pair or assigns the value of an existing key
+    * @param key Key to insert or update
+    * @param value Value to insert or assign
+    * @return true if a new pair was inserted, false if a value was assigned
+    */
+    bool insert_or_assign(const KeyT& key, const ValueT& value);
+
+    /*
+    * @brief Returns whether a given key is stored in the map
+    * @param key Key to look for
+    * @return true if key exists, false otherwise
+    */
+    bool contains_key(const KeyT& key) const;
+
+    /*
+    * @brief Copies out the value of a given key
+    * @param key Key to look up
+    * @param value Set to the key's value when found
+    * @return true if the key exists, false otherwise
+    */
+    bool get(const KeyT& key, ValueT& value) const;
+
+    /*
+    * @brief Copies out the value of a given key
+    * @param key Key to look up
+    * @return Copy of the value mapped to the key
+    * @throws std::runtime_error if key does not exist
+    */
+    ValueT at(const KeyT& key) const;
+
+    /*
+    * @brief Erases a pair with a given key
+    * @param key Key in the pair that should be erased
+    * @return true if erasure was successful, false otherwise
+    */
+    bool erase(const KeyT& key);
+
+    /*
+    * @brief Atomically recomputes the value of a key under its stripe lock
+    * with a single probe
+    * @param key Key to update
+    * @param fn Called as fn(const ValueT* current), nullptr when the key is
+    * missing, returns the new value or an empty optional to erase the key
+    * @return The value now mapped to the key, empty if the key is not stored
+    */
+    template <class Fn>
+    std::optional<ValueT> compute(const KeyT& key, Fn fn);
+
+    /*
+    * @brief Returns the value of a key, atomically inserting fn() first if
+    * the key is missing (fn runs at most once, under the stripe lock)
+    * @param key Key to look up
+    * @param fn Called as fn() to make the missing value
+    * @return Copy of the value mapped to the key
+    */
+    template <class Fn>
+    ValueT compute_if_absent(const KeyT& key, Fn fn);
+
+    /*
+    * @brief Atomically inserts a value, or combines it with the existing one
+    * @param key Key to update
+    * @param value Value to insert, or to combine with the current value
+    * @param fn Called as fn(current, value) to make the new value
+    * @return Copy of the value now mapped to the key
+    */
+    template <class Fn>
+    ValueT merge(const KeyT& key, const ValueT& value, Fn fn);
+
+    /*
+    * @brief Atomically adds to the value of a key (arithmetic ValueT only),
+    * a missing key counts as ValueT()
+    * @param key Key to update
+    * @param delta Amount to add
+    * @return The value before the addition
+    */
+    ValueT fetch_add(const KeyT& key, const ValueT& delta);
+
+    /*
+    * @brief Atomically replaces the value of a key if it equals an expected value
+    * @param key Key to update
+    * @param expected Value the key must currently map to
+    * @param desired Value to store
+    * @return true if the value was replaced, false if the key is missing or
+    * maps to another value
+    */
+    bool compare_and_set(const KeyT& key, const ValueT& expected, const ValueT& desired);
+
+    /*
+    * @brief Returns the number of pairs
+    * @return Number of keys stored across all stripes
+    */
+    int size() const;
+
+    /*
+    * @brief Stripe count getter
+    * @return Number of stripes
+    */
+    int stripe_count() const;
+
+private:
+
+    /*
+    * @struct Stripe
+    * @brief One HashMap with its own lock, padded to its own cache lines
+    */
+    struct alignas(64) Stripe {
+        mutable std::mutex lock;
+        HashMap<KeyT, ValueT> map;
+    };
+
+    std::vector<std::unique_ptr<Stripe>> stripes;
+    int stripe_bits;
+
+    /*
+    * @brief Picks the stripe owning a hash
+    * @param hash std::hash<KeyT> of the key
+    * @return Reference to the owning stripe
+    */
+    Stripe& stripe_of(std::size_t hash) const;
+
+    /*
+    * @brief Runs a read-modify-write on a key's value under its stripe lock
+    * @param key Key to update
+    * @param fn Called as fn(std::optional<ValueT>&), see HashMap::compute_hashed()
+    * @return true if the key is stored afterwards, false otherwise
+    */
+    template <class Fn>
+    bool locked_compute(const KeyT& key, Fn&& fn);
+};
+
+// ==================== Implementation ====================
+
+template <class KeyT, class ValueT>
+StripedHashMap<KeyT, ValueT>::StripedHashMap(int stripe_count) : stripe_bits(0) {
+    if (stripe_count <= 0) {
+        throw std::invalid_argument("stripe_count must be positive");
+    }
+    while ((1 << stripe_bits) < stripe_count) {
+        stripe_bits++;
+    }
+    for (int i = 0; i < (1 << stripe_bits); i++) {
+        stripes.push_back(std::make_unique<Stripe>());
+    }
+}
+
+
+template <class KeyT, class ValueT>
+bool StripedHashMap<KeyT, ValueT>::insert(const KeyT& key, const ValueT& value) {
+    std::size_t hash = std::hash<KeyT>()(key);
+    Stripe& stripe = stripe_of(hash);
+    std::lock_guard<std::mutex> guard(stripe.lock);
+    return stripe.map.insert_hashed(key, hash, value);
+}
+
+
+template <class KeyT, class ValueT>
+bool StripedHashMap<KeyT, ValueT>::insert_or_assign(const KeyT& key, const ValueT& value) {
+    std::size_t hash = std::hash<KeyT>()(key);
+    Stripe& stripe = stripe_of(hash);
+    std::lock_guard<std::mutex> guard(stripe.lock);
+    return stripe.map.insert_or_assign_hashed(key, hash, value);
+}
+
+
+template <class KeyT, class ValueT>
+bool StripedHashMap<KeyT, ValueT>::contains_key(const KeyT& key) const {
+    std::size_t hash = std::hash<KeyT>()(key);
+    Stripe& stripe = stripe_of(hash);
+    std::lock_guard<std::mutex> guard(stripe.lock);
+    return stripe.map.find_hashed(key, hash) != nullptr;
+}
+
+
+template <class KeyT, class ValueT>
+bool StripedHashMap<KeyT, ValueT>::get(const KeyT& key, ValueT& value) const {
+    std::size_t hash = std::hash<KeyT>()(key);
+    Stripe& stripe = stripe_of(hash);
+    std::lock_guard<std::mutex> guard(stripe.lock);
+    const ValueT* found = stripe.map.find_hashed(key, hash);
+    if (found == nullptr) return false;
+    value = *found;
+    return true;
+}
+
+
+template <class KeyT, class ValueT>
+ValueT StripedHashMap<KeyT, ValueT>::at(const KeyT& key) const {
+    ValueT value;
+    if (!get(key, value)) throw std::runtime_error("no such key exists!");
+    return value;
+}
+
+
+template <class KeyT, class ValueT>
+bool StripedHashMap<KeyT, ValueT>::erase(const KeyT& key) {
+    std::size_t hash = std::hash<KeyT>()(key);
+    Stripe& stripe = stripe_of(hash);
+    std::lock_guard<std::mutex> guard(stripe.lock);
+    return stripe.map.erase_hashed(key, hash);
+}
+
+
+template <class KeyT, class ValueT>
+template <class Fn>
+std::optional<ValueT> StripedHashMap<KeyT, ValueT>::compute(const KeyT& key, Fn fn) {
+    std::optional<ValueT> result;
+    locked_compute(key, [&](std::optional<ValueT>& value) {
+        value = fn(value ? &*value : nullptr);
+        result = value;
+    });
+    return result;
+}
+
+
+template <class KeyT, class ValueT>
+template <class Fn>
+ValueT StripedHashMap<KeyT, ValueT>::compute_if_absent(const KeyT& key, Fn fn) {
+    std::optional<ValueT> result;
+    locked_compute(key, [&](std::optional<ValueT>& value) {
+        if (!value) value.emplace(fn());
+        result = value;
+    });
+    return *result;
+}
+
+
+template <class KeyT, class ValueT>
+template <class Fn>
+ValueT StripedHashMap<KeyT, ValueT>::merge(const KeyT& key, const ValueT& value, Fn fn) {
+    std::optional<ValueT> result;
+    locked_compute(key, [&](std::optional<ValueT>& current) {
+        if (current) {
+            current = fn(*current, value);
+        } else {
+            current = value;
+        }
+        result = current;
+    });
+    return *result;
+}
+
+
+template <class KeyT, class ValueT>
+ValueT StripedHashMap<KeyT, ValueT>::fetch_add(const KeyT& key, const ValueT& delta) {
+    static_assert(std::is_arithmetic<ValueT>::value, "fetch_add() needs an arithmetic ValueT");
+    ValueT previous = ValueT();
+    locked_compute(key, [&](std::optional<ValueT>& value) {
+        if (value) previous = *value;
+        value = previous + delta;
+    });
+    return previous;
+}
+
+
+template <class KeyT, class ValueT>
+bool StripedHashMap<KeyT, ValueT>::compare_and_set(const KeyT& key, const ValueT& expected,
+                                                   const ValueT& desired) {
+    bool replaced = false;
+    locked_compute(key, [&](std::optional<ValueT>& value) {
+        if (value && *value == expected) {
+            value = desired;
+            replaced = true;
+        }
+    });
+    return replaced;
+}
+
+
+template <class KeyT, class ValueT>
+int StripedHashMap<KeyT, ValueT>::size() const {
+    int total = 0;
+    for (const auto& stripe : stripes) {
+        std::lock_guard<std::mutex> guard(stripe->lock);
+        total += stripe->map.size();
+    }
+    return total;
+}
+
+
+template <class KeyT, class ValueT>
+int StripedHashMap<KeyT, ValueT>::stripe_count() const {
+    return static_cast<int>(stripes.size());
+}
+
+
+template <class KeyT, class ValueT>
+typename StripedHashMap<KeyT, ValueT>::Stripe&
+StripedHashMap<KeyT, ValueT>::stripe_of(std::size_t hash) const {
+    if (stripe_bits == 0) return *stripes[0];
+    // high bits of the scrambled hash, independent of the buckets' low bits
+    std::uint64_t mixed = mix_hash(hash);
+    return *stripes[static_cast<size_t>(mixed >> (64 - stripe_bits))];
+}
+
+
+template <class KeyT, class ValueT>
+template <class Fn>
+bool StripedHashMap<KeyT, ValueT>::locked_compute(const KeyT& key, Fn&& fn) {
+    std::size_t hash = std::hash<KeyT>()(key);
+    Stripe& stripe = stripe_of(hash);
+    std::lock_guard<std::mutex> guard(stripe.lock);
+    return stripe.map.compute_hashed(key, hash, std::forward<Fn>(fn));
+}
+
+#endif //STRIPEDHASHMAP_HPP
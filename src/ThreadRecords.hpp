@@ -0,0 +1,181 @@
+#ifndef THREADRECORDS_HPP
+#define THREADRECORDS_HPP
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+// ThreadSanitizer does not model standalone fences, so under it the domains
+// replace each seq_cst fence with a seq_cst read-modify-write it does model
+#if defined(__SANITIZE_THREAD__)
+#define RECLAMATION_UNDER_TSAN 1
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define RECLAMATION_UNDER_TSAN 1
+#endif
+#endif
+
+/*
+* @brief Template parameters:
+* - Record : per-thread state, with a std::atomic<bool> in_use and a Record* next
+* - Owner  : the shared state deriving from ThreadRecordRegistry<Record, Owner>,
+*            with a void release(Record&) that takes back what an exiting
+*            thread leaves in its record (e.g. garbage not freed yet)
+*/
+template <class Record, class Owner>
+
+/*
+* @class ThreadRecordRegistry
+* @brief The per-thread records of a memory reclamation domain (EpochDomain,
+* HazardDomain). Records form a lock-free list that is only ever prepended
+* to, so scans can walk it while threads join. A thread acquires a record
+* on first use, reusing one given back by an exited thread, and gives it
+* back when it exits, through a thread-local list of the records it holds
+* in every live domain
+* @var id Identifies the domain in the threads' record lists
+* @var records Every record, in use or not
+* @var record_count Number of records
+* @note The domain holds the Owner through a std::shared_ptr and threads
+* hold a std::weak_ptr, so a thread outliving the domain skips the release
+*/
+class ThreadRecordRegistry {
+public:
+
+    /*
+    * @brief Constructs an empty registry with a new id
+    */
+    ThreadRecordRegistry();
+
+    /*
+    * @brief Deletes every record (destructor)
+    */
+    ~ThreadRecordRegistry();
+
+    ThreadRecordRegistry(const ThreadRecordRegistry&) = delete;
+    ThreadRecordRegistry& operator=(const ThreadRecordRegistry&) = delete;
+
+    /*
+    * @brief Returns the calling thread's record, acquiring one on first use
+    * @param owner The registry, as the domain holds it
+    * @return The thread's record
+    */
+    static Record* local(const std::shared_ptr<Owner>& owner);
+
+    /*
+    * @brief Returns the first record, the others follow through next
+    * @return Newest record, nullptr if there is none
+    */
+    Record* head() const;
+
+    /*
+    * @brief Returns the number of records
+    * @return Records ever created (in use or not)
+    */
+    int size() const;
+
+private:
+
+    /*
+    * @struct ThreadRecords
+    * @brief The records a thread holds in every domain it used, released
+    * when the thread exits
+    */
+    struct ThreadRecords {
+        struct Entry {
+            std::uint64_t id;
+            std::weak_ptr<Owner> owner;
+            Record* record;
+        };
+        std::vector<Entry> entries;
+        ~ThreadRecords();
+    };
+
+    std::uint64_t id;
+    std::atomic<Record*> records{nullptr};
+    std::atomic<int> record_count{0};
+};
+
+// ==================== Implementation ====================
+
+template <class Record, class Owner>
+ThreadRecordRegistry<Record, Owner>::ThreadRecordRegistry() {
+    static std::atomic<std::uint64_t> next_id{1};
+    id = next_id.fetch_add(1);
+}
+
+
+template <class Record, class Owner>
+ThreadRecordRegistry<Record, Owner>::~ThreadRecordRegistry() {
+    Record* record = records.load();
+    while (record != nullptr) {
+        Record* next = record->next;
+        delete record;
+        record = next;
+    }
+}
+
+
+template <class Record, class Owner>
+Record* ThreadRecordRegistry<Record, Owner>::local(const std::shared_ptr<Owner>& owner) {
+    thread_local ThreadRecords held;
+    for (auto& entry : held.entries) {
+        if (entry.id == owner->id) return entry.record;
+    }
+    // reuse a record given back by an exited thread, or add a new one
+    Record* record = nullptr;
+    for (Record* r = owner->records.load(std::memory_order_acquire); r != nullptr; r = r->next) {
+        bool expected = false;
+        if (!r->in_use.load(std::memory_order_relaxed) &&
+            r->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            record = r;
+            break;
+        }
+    }
+    if (record == nullptr) {
+        record = new Record();
+        record->in_use.store(true, std::memory_order_relaxed);
+        Record* first = owner->records.load(std::memory_order_relaxed);
+        do {
+            record->next = first;
+        } while (!owner->records.compare_exchange_weak(first, record, std::memory_order_release));
+        owner->record_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    // drop entries of domains that no longer exist
+    auto& entries = held.entries;
+    for (size_t i = 0; i < entries.size();) {
+        if (entries[i].owner.expired()) {
+            entries[i] = entries.back();
+            entries.pop_back();
+        } else {
+            i++;
+        }
+    }
+    entries.push_back(typename ThreadRecords::Entry{owner->id, owner, record});
+    return record;
+}
+
+
+template <class Record, class Owner>
+Record* ThreadRecordRegistry<Record, Owner>::head() const {
+    return records.load(std::memory_order_acquire);
+}
+
+
+template <class Record, class Owner>
+int ThreadRecordRegistry<Record, Owner>::size() const {
+    return record_count.load(std::memory_order_relaxed);
+}
+
+
+template <class Record, class Owner>
+ThreadRecordRegistry<Record, Owner>::ThreadRecords::~ThreadRecords() {
+    for (auto& entry : entries) {
+        auto owner = entry.owner.lock();
+        if (!owner) continue;
+        owner->release(*entry.record);
+        entry.record->in_use.store(false, std::memory_order_release);
+    }
+}
+
+#endif //THREADRECORDS_HPP